@@ -177,6 +177,11 @@ static void bfq_group_chain_link(struct bfq_data *bfqd, struct cgroup *cgroup,
 
 		spin_lock_irqsave(&bgrp->lock, flags);
 
+		leaf->foreground = bgrp->foreground;
+		leaf->background = bgrp->background;
+		leaf->launch_start = bgrp->launch_start;
+		leaf->launching = bgrp->launching;
+
 		rcu_assign_pointer(leaf->bfqd, bfqd);
 		hlist_add_head_rcu(&leaf->group_node, &bgrp->group_data);
 		hlist_add_head(&leaf->bfqd_node, &bfqd->group_list);
@@ -233,6 +238,54 @@ static struct bfq_group *bfq_find_alloc_group(struct bfq_data *bfqd,
 	return bfqg;
 }
 
+static inline struct bfq_group *bfqq_group(struct bfq_queue *bfqq)
+{
+	return container_of(bfqq->entity.sched_data, struct bfq_group,
+			    sched_data);
+}
+
+/*
+ * A sync queue of a foreground group is in its launch window if a task
+ * has been moved into the group less than bfq_raising_launch_time ago.
+ * Must be called under the queue lock.
+ */
+static int bfq_bfqq_in_launch(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	struct bfq_group *bfqg = bfqq_group(bfqq);
+
+	if (!bfq_bfqq_sync(bfqq) || !bfqg->foreground || !bfqg->launching ||
+	    bfqd->bfq_raising_launch_time == 0)
+		return 0;
+	smp_rmb();
+
+	return time_before(jiffies, bfqg->launch_start +
+			   bfqd->bfq_raising_launch_time);
+}
+
+static inline int bfq_bfqq_background(struct bfq_queue *bfqq)
+{
+	return bfqq_group(bfqq)->background;
+}
+
+/*
+ * Account the time @rq spent in the scheduler to the group of @bfqq;
+ * @lat_us is the insertion to dispatch latency.  Queue lock held.
+ */
+static void bfq_account_dispatch(struct bfq_queue *bfqq, struct request *rq,
+				 unsigned long lat_us)
+{
+	struct bfq_group *bfqg = bfqq_group(bfqq);
+	int sync = rq_is_sync(rq), i = 0;
+
+	while (i < BFQ_LAT_BUCKETS - 1 && lat_us >= (USEC_PER_MSEC << i))
+		i++;
+	bfqg->lat_hist[sync][i]++;
+	bfqg->lat_dispatched[sync]++;
+	bfqg->lat_total_us[sync] += lat_us;
+	if (lat_us > bfqg->lat_max_us[sync])
+		bfqg->lat_max_us[sync] = lat_us;
+}
+
 /**
  * bfq_bfqq_move - migrate @bfqq to @bfqg.
  * @bfqd: queue descriptor.
@@ -616,6 +669,8 @@ static u64 bfqio_cgroup_##__VAR##_read(struct cgroup *cgroup,		\
 SHOW_FUNCTION(weight);
 SHOW_FUNCTION(ioprio);
 SHOW_FUNCTION(ioprio_class);
+SHOW_FUNCTION(foreground);
+SHOW_FUNCTION(background);
 #undef SHOW_FUNCTION
 
 #define STORE_FUNCTION(__VAR, __MIN, __MAX)				\
@@ -654,6 +709,138 @@ STORE_FUNCTION(ioprio, 0, IOPRIO_BE_NR - 1);
 STORE_FUNCTION(ioprio_class, IOPRIO_CLASS_RT, IOPRIO_CLASS_IDLE);
 #undef STORE_FUNCTION
 
+#define FLAG_STORE_FUNCTION(__VAR)					\
+static int bfqio_cgroup_##__VAR##_write(struct cgroup *cgroup,		\
+					struct cftype *cftype,		\
+					u64 val)			\
+{									\
+	struct bfqio_cgroup *bgrp;					\
+	struct bfq_group *bfqg;						\
+	struct hlist_node *n;						\
+									\
+	if (val > 1)							\
+		return -EINVAL;						\
+									\
+	if (!cgroup_lock_live_group(cgroup))				\
+		return -ENODEV;						\
+									\
+	bgrp = cgroup_to_bfqio(cgroup);					\
+									\
+	spin_lock_irq(&bgrp->lock);					\
+	bgrp->__VAR = (unsigned short)val;				\
+	hlist_for_each_entry(bfqg, n, &bgrp->group_data, group_node)	\
+		bfqg->__VAR = (int)val;					\
+	spin_unlock_irq(&bgrp->lock);					\
+									\
+	cgroup_unlock();						\
+									\
+	return 0;							\
+}
+
+FLAG_STORE_FUNCTION(foreground);
+FLAG_STORE_FUNCTION(background);
+#undef FLAG_STORE_FUNCTION
+
+/*
+ * Insertion to dispatch latency of the requests of the cgroup, summed
+ * over all the devices it has issued I/O to.  The counters are updated
+ * under the queue lock of each device and read without it, so a line
+ * may be slightly inconsistent while I/O is in progress.
+ */
+static int bfqio_cgroup_dispatch_latency_read(struct cgroup *cgroup,
+					      struct cftype *cftype,
+					      struct seq_file *m)
+{
+	static const char * const dir_name[2] = { "async", "sync" };
+	unsigned long dispatched[2] = { 0, 0 }, max_us[2] = { 0, 0 };
+	unsigned long hist[2][BFQ_LAT_BUCKETS];
+	u64 total_us[2] = { 0, 0 };
+	struct bfqio_cgroup *bgrp;
+	struct bfq_group *bfqg;
+	struct hlist_node *n;
+	int i, j;
+
+	if (!cgroup_lock_live_group(cgroup))
+		return -ENODEV;
+
+	bgrp = cgroup_to_bfqio(cgroup);
+	memset(hist, 0, sizeof(hist));
+
+	rcu_read_lock();
+	hlist_for_each_entry_rcu(bfqg, n, &bgrp->group_data, group_node) {
+		for (i = 0; i < 2; i++) {
+			dispatched[i] += bfqg->lat_dispatched[i];
+			total_us[i] += bfqg->lat_total_us[i];
+			max_us[i] = max(max_us[i], bfqg->lat_max_us[i]);
+			for (j = 0; j < BFQ_LAT_BUCKETS; j++)
+				hist[i][j] += bfqg->lat_hist[i][j];
+		}
+	}
+	rcu_read_unlock();
+
+	cgroup_unlock();
+
+	for (i = 1; i >= 0; i--) {
+		u64 avg_us = total_us[i];
+
+		if (dispatched[i])
+			do_div(avg_us, dispatched[i]);
+		seq_printf(m, "%s dispatched %lu avg_us %llu max_us %lu\n",
+			   dir_name[i], dispatched[i],
+			   (unsigned long long)avg_us, max_us[i]);
+	}
+
+	seq_printf(m, "%-6s %8s", "", "<1ms");
+	for (j = 1; j < BFQ_LAT_BUCKETS - 1; j++)
+		seq_printf(m, " %6s%-2lu", "<", 1UL << j);
+	seq_printf(m, " %8s\n", ">=256");
+	for (i = 1; i >= 0; i--) {
+		seq_printf(m, "%-6s", dir_name[i]);
+		for (j = 0; j < BFQ_LAT_BUCKETS; j++)
+			seq_printf(m, " %8lu", hist[i][j]);
+		seq_printf(m, "\n");
+	}
+
+	return 0;
+}
+
+/* Writing 0 clears the dispatch latency counters of the cgroup. */
+static int bfqio_cgroup_dispatch_latency_write(struct cgroup *cgroup,
+					       struct cftype *cftype,
+					       u64 val)
+{
+	struct bfqio_cgroup *bgrp;
+	struct bfq_group *bfqg;
+	struct bfq_data *bfqd;
+	struct hlist_node *n;
+	unsigned long flags;
+
+	if (val != 0)
+		return -EINVAL;
+
+	if (!cgroup_lock_live_group(cgroup))
+		return -ENODEV;
+
+	bgrp = cgroup_to_bfqio(cgroup);
+
+	rcu_read_lock();
+	hlist_for_each_entry_rcu(bfqg, n, &bgrp->group_data, group_node) {
+		bfqd = bfq_get_bfqd_locked(&bfqg->bfqd, &flags);
+		if (bfqd == NULL)
+			continue;
+		memset(bfqg->lat_dispatched, 0, sizeof(bfqg->lat_dispatched));
+		memset(bfqg->lat_total_us, 0, sizeof(bfqg->lat_total_us));
+		memset(bfqg->lat_max_us, 0, sizeof(bfqg->lat_max_us));
+		memset(bfqg->lat_hist, 0, sizeof(bfqg->lat_hist));
+		bfq_put_bfqd_unlock(bfqd, &flags);
+	}
+	rcu_read_unlock();
+
+	cgroup_unlock();
+
+	return 0;
+}
+
 static struct cftype bfqio_files[] = {
 	{
 		.name = "weight",
@@ -670,6 +857,21 @@ static struct cftype bfqio_files[] = {
 		.read_u64 = bfqio_cgroup_ioprio_class_read,
 		.write_u64 = bfqio_cgroup_ioprio_class_write,
 	},
+	{
+		.name = "foreground",
+		.read_u64 = bfqio_cgroup_foreground_read,
+		.write_u64 = bfqio_cgroup_foreground_write,
+	},
+	{
+		.name = "background",
+		.read_u64 = bfqio_cgroup_background_read,
+		.write_u64 = bfqio_cgroup_background_write,
+	},
+	{
+		.name = "dispatch_latency",
+		.read_seq_string = bfqio_cgroup_dispatch_latency_read,
+		.write_u64 = bfqio_cgroup_dispatch_latency_write,
+	},
 };
 
 static int bfqio_populate(struct cgroup_subsys *subsys, struct cgroup *cgroup)
@@ -731,10 +933,28 @@ static int bfqio_can_attach(struct cgroup_subsys *subsys, struct cgroup *cgroup,
 static void bfqio_attach(struct cgroup_subsys *subsys, struct cgroup *cgroup,
 			 struct cgroup *prev, struct task_struct *tsk)
 {
+	struct bfqio_cgroup *bgrp = cgroup_to_bfqio(cgroup);
 	struct io_context *ioc;
 	struct cfq_io_context *cic;
+	struct bfq_group *bfqg;
 	struct hlist_node *n;
 
+	/*
+	 * The application being launched is moved into the foreground
+	 * group: (re)open the launch window of the group on every device.
+	 */
+	spin_lock_irq(&bgrp->lock);
+	if (bgrp->foreground) {
+		bgrp->launch_start = jiffies;
+		bgrp->launching = 1;
+		hlist_for_each_entry(bfqg, n, &bgrp->group_data, group_node) {
+			bfqg->launch_start = bgrp->launch_start;
+			smp_wmb();
+			bfqg->launching = 1;
+		}
+	}
+	spin_unlock_irq(&bgrp->lock);
+
 	task_lock(tsk);
 	ioc = tsk->io_context;
 	if (ioc != NULL) {
@@ -795,6 +1015,23 @@ static inline void bfq_init_entity(struct bfq_entity *entity,
 	entity->sched_data = &bfqg->sched_data;
 }
 
+static inline int bfq_bfqq_in_launch(struct bfq_data *bfqd,
+				     struct bfq_queue *bfqq)
+{
+	return 0;
+}
+
+static inline int bfq_bfqq_background(struct bfq_queue *bfqq)
+{
+	return 0;
+}
+
+static inline void bfq_account_dispatch(struct bfq_queue *bfqq,
+					struct request *rq,
+					unsigned long lat_us)
+{
+}
+
 static inline struct bfq_group *
 bfq_cic_update_cgroup(struct cfq_io_context *cic)
 {
@@ -62,6 +62,7 @@
 #include <linux/jiffies.h>
 #include <linux/rbtree.h>
 #include <linux/ioprio.h>
+#include <linux/seq_file.h>
 #include "bfq.h"
 
 /* Max number of dispatches in one round of service. */
@@ -90,6 +91,13 @@ static const int bfq_max_budget_async_rq = 4;
  */
 static const int bfq_async_charge_factor = 10;
 
+/*
+ * While weight-raised queues are busy, async requests of background
+ * groups are charged this many times their normal cost, and their queues
+ * dispatch one request per service slot.
+ */
+static const int bfq_bg_charge_factor = 4;
+
 /* Default timeout values, in jiffies, approximating CFQ defaults. */
 static const int bfq_timeout_sync = HZ / 8;
 static int bfq_timeout_async = HZ / 25;
@@ -143,6 +151,9 @@ static DEFINE_IDA(cic_index_ida);
 #define RQ_CIC(rq)		\
 	((struct cfq_io_context *) (rq)->elevator_private[0])
 #define RQ_BFQQ(rq)		((rq)->elevator_private[1])
+/* insertion time in usecs, wraps but differences are fine */
+#define RQ_ADD_US(rq)		((unsigned long) (rq)->elevator_private[2])
+#define RQ_SET_ADD_US(rq, us)	((rq)->elevator_private[2] = (void *) (us))
 
 static inline void bfq_schedule_dispatch(struct bfq_data *bfqd);
 
@@ -391,13 +402,35 @@ static void bfq_del_rq_rb(struct request *rq)
 	}
 }
 
+static inline unsigned long bfq_now_us(void)
+{
+	return (unsigned long)ktime_to_us(ktime_get());
+}
+
+/*
+ * Async queues of background groups are throttled as long as some
+ * weight-raised queue (e.g., one of an application being launched)
+ * is busy.
+ */
+static inline int bfq_bfqq_throttled(struct bfq_data *bfqd,
+				     struct bfq_queue *bfqq)
+{
+	return bfqd->raised_busy_queues > 0 && bfqd->bfq_bg_charge_factor > 0 &&
+		!bfq_bfqq_sync(bfqq) && bfq_bfqq_background(bfqq);
+}
+
 /* see the definition of bfq_async_charge_factor for details */
 static inline unsigned long bfq_serv_to_charge(struct request *rq,
 					       struct bfq_queue *bfqq)
 {
-	return blk_rq_sectors(rq) *
+	unsigned long charge = blk_rq_sectors(rq) *
 		(1 + ((!bfq_bfqq_sync(bfqq)) * (bfqq->raising_coeff == 1) *
 		bfq_async_charge_factor));
+
+	if (bfq_bfqq_throttled(bfqq->bfqd, bfqq))
+		charge *= bfqq->bfqd->bfq_bg_charge_factor;
+
+	return charge;
 }
 
 /**
@@ -461,6 +494,7 @@ static void bfq_add_rq_rb(struct request *rq)
 	unsigned long old_raising_coeff = bfqq->raising_coeff;
 	int idle_for_long_time = bfqq->budget_timeout +
 		bfqd->bfq_raising_min_idle_time < jiffies;
+	int launch = bfqd->low_latency && bfq_bfqq_in_launch(bfqd, bfqq);
 
 	bfq_log_bfqq(bfqd, bfqq, "add_rq_rb %d", rq_is_sync(rq));
 	bfqq->queued[rq_is_sync(rq)]++;
@@ -495,9 +529,14 @@ static void bfq_add_rq_rb(struct request *rq)
 		 * If the queue is not being boosted and has been idle
 		 * for enough time, start a weight-raising period
 		 */
-		if(old_raising_coeff == 1 && (idle_for_long_time || soft_rt)) {
+		if(old_raising_coeff == 1 &&
+		   (idle_for_long_time || soft_rt || launch)) {
 			bfqq->raising_coeff = bfqd->bfq_raising_coeff;
-			if (idle_for_long_time)
+			if (launch)
+				bfqq->raising_cur_max_time = max(
+					bfq_wrais_duration(bfqd),
+					bfqd->bfq_raising_launch_time);
+			else if (idle_for_long_time)
 				bfqq->raising_cur_max_time =
 					bfq_wrais_duration(bfqd);
 			else
@@ -515,7 +554,7 @@ static void bfq_add_rq_rb(struct request *rq)
 					bfq_wrais_duration(bfqd);
 			else if (bfqq->raising_cur_max_time ==
 				 bfqd->bfq_raising_rt_max_time &&
-				 !soft_rt) {
+				 !soft_rt && !launch) {
 				bfqq->raising_coeff = 1;
 				bfq_log_bfqq(bfqd, bfqq,
 					     "wrais ending at %llu msec,"
@@ -536,6 +575,8 @@ add_bfqq_busy:
                         bfqd->bfq_raising_min_inter_arr_async < jiffies) {
                         bfqq->raising_coeff = bfqd->bfq_raising_coeff;
 			bfqq->raising_cur_max_time = bfq_wrais_duration(bfqd);
+			if (bfqq->raising_coeff > 1)
+				bfqd->raised_busy_queues++;
 
 			entity->ioprio_changed = 1;
 			bfq_log_bfqq(bfqd, bfqq,
@@ -544,6 +585,25 @@ add_bfqq_busy:
 				     bfqq->last_rais_start_finish,
 				     jiffies_to_msecs(bfqq->
 					raising_cur_max_time));
+		} else if (launch && old_raising_coeff == 1) {
+			/*
+			 * A queue of the application being launched may
+			 * be continuously backlogged, raise it anyway.
+			 */
+			bfqq->raising_coeff = bfqd->bfq_raising_coeff;
+			bfqq->raising_cur_max_time =
+				max(bfq_wrais_duration(bfqd),
+				    bfqd->bfq_raising_launch_time);
+			if (bfqq->raising_coeff > 1)
+				bfqd->raised_busy_queues++;
+
+			entity->ioprio_changed = 1;
+			bfq_log_bfqq(bfqd, bfqq,
+				     "launch wrais starting at %llu msec,"
+				     "rais_max_time %u",
+				     bfqq->last_rais_start_finish,
+				     jiffies_to_msecs(bfqq->
+					raising_cur_max_time));
                 }
                 bfq_updated_next_req(bfqd, bfqq);
 	}
@@ -960,6 +1020,8 @@ static void bfq_dispatch_insert(struct request_queue *q, struct request *rq)
 	struct bfq_data *bfqd = q->elevator->elevator_data;
 	struct bfq_queue *bfqq = RQ_BFQQ(rq);
 
+	bfq_account_dispatch(bfqq, rq, bfq_now_us() - RQ_ADD_US(rq));
+
 	bfq_remove_request(rq);
 	bfqq->dispatched++;
 	elv_dispatch_sort(q, rq);
@@ -1589,6 +1651,8 @@ static void update_raising_data(struct bfq_data *bfqd, struct bfq_queue *bfqq)
 					bfqd->bfq_raising_rt_max_time;
 			else {
 				bfqq->raising_coeff = 1;
+				if (bfq_bfqq_busy(bfqq))
+					bfqd->raised_busy_queues--;
 				entity->ioprio_changed = 1;
 				__bfq_entity_update_weight_prio(
 					bfq_entity_service_tree(entity),
@@ -1666,7 +1730,7 @@ static int bfq_dispatch_request(struct bfq_data *bfqd,
 
 	if (bfqd->busy_queues > 1 && ((!bfq_bfqq_sync(bfqq) &&
 	    dispatched >= bfqd->bfq_max_budget_async_rq) ||
-	    bfq_class_idle(bfqq)))
+	    bfq_class_idle(bfqq) || bfq_bfqq_throttled(bfqd, bfqq)))
 		goto expire;
 
 	return dispatched;
@@ -1743,7 +1807,8 @@ static int bfq_dispatch_requests(struct request_queue *q, int force)
 		max_dispatch = 1;
 
 	if (!bfq_bfqq_sync(bfqq))
-		max_dispatch = bfqd->bfq_max_budget_async_rq;
+		max_dispatch = bfq_bfqq_throttled(bfqd, bfqq) ? 1 :
+			bfqd->bfq_max_budget_async_rq;
 
 	if (bfqq->dispatched >= max_dispatch) {
 		if (bfqd->busy_queues > 1)
@@ -2212,6 +2277,7 @@ static void bfq_insert_request(struct request_queue *q, struct request *rq)
 	assert_spin_locked(bfqd->queue->queue_lock);
 	bfq_init_prio_data(bfqq, RQ_CIC(rq)->ioc);
 
+	RQ_SET_ADD_US(rq, bfq_now_us());
 	bfq_add_rq_rb(rq);
 
 	rq_set_fifo_time(rq, jiffies + bfqd->bfq_fifo_expire[rq_is_sync(rq)]);
@@ -2723,6 +2789,8 @@ static void *bfq_init_queue(struct request_queue *q)
 	bfqd->bfq_raising_min_idle_time = msecs_to_jiffies(2000);
 	bfqd->bfq_raising_min_inter_arr_async = msecs_to_jiffies(500);
 	bfqd->bfq_raising_max_softrt_rate = 7000;
+	bfqd->bfq_raising_launch_time = msecs_to_jiffies(3000);
+	bfqd->bfq_bg_charge_factor = bfq_bg_charge_factor;
 
 	/* Initially estimate the device's peak rate as the reference rate */
 	if (blk_queue_nonrot(bfqd->queue)) {
@@ -2850,6 +2918,8 @@ SHOW_FUNCTION(bfq_raising_min_inter_arr_async_show,
 	      1);
 SHOW_FUNCTION(bfq_raising_max_softrt_rate_show,
 	bfqd->bfq_raising_max_softrt_rate, 0);
+SHOW_FUNCTION(bfq_raising_launch_time_show, bfqd->bfq_raising_launch_time, 1);
+SHOW_FUNCTION(bfq_bg_charge_factor_show, bfqd->bfq_bg_charge_factor, 0);
 #undef SHOW_FUNCTION
 
 #define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
@@ -2894,6 +2964,10 @@ STORE_FUNCTION(bfq_raising_min_inter_arr_async_store,
 	       &bfqd->bfq_raising_min_inter_arr_async, 0, INT_MAX, 1);
 STORE_FUNCTION(bfq_raising_max_softrt_rate_store,
 	       &bfqd->bfq_raising_max_softrt_rate, 0, INT_MAX, 0);
+STORE_FUNCTION(bfq_raising_launch_time_store,
+	       &bfqd->bfq_raising_launch_time, 0, INT_MAX, 1);
+STORE_FUNCTION(bfq_bg_charge_factor_store, &bfqd->bfq_bg_charge_factor, 0,
+		INT_MAX, 0);
 #undef STORE_FUNCTION
 
 /* do nothing for the moment */
@@ -2987,6 +3061,8 @@ static struct elv_fs_entry bfq_attrs[] = {
 	BFQ_ATTR(raising_min_idle_time),
 	BFQ_ATTR(raising_min_inter_arr_async),
 	BFQ_ATTR(raising_max_softrt_rate),
+	BFQ_ATTR(raising_launch_time),
+	BFQ_ATTR(bg_charge_factor),
 	BFQ_ATTR(weights),
 	__ATTR_NULL
 };
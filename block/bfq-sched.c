@@ -1047,6 +1047,8 @@ static void bfq_del_bfqq_busy(struct bfq_data *bfqd, struct bfq_queue *bfqq,
 
 	BUG_ON(bfqd->busy_queues == 0);
 	bfqd->busy_queues--;
+	if (bfqq->raising_coeff > 1)
+		bfqd->raised_busy_queues--;
 
 	bfq_deactivate_bfqq(bfqd, bfqq, requeue);
 }
@@ -1065,4 +1067,6 @@ static void bfq_add_bfqq_busy(struct bfq_data *bfqd, struct bfq_queue *bfqq)
 
 	bfq_mark_bfqq_busy(bfqq);
 	bfqd->busy_queues++;
+	if (bfqq->raising_coeff > 1)
+		bfqd->raised_busy_queues++;
 }
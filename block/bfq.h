@@ -28,6 +28,9 @@
 #define BFQ_DEFAULT_GRP_IOPRIO	0
 #define BFQ_DEFAULT_GRP_CLASS	IOPRIO_CLASS_BE
 
+/* Dispatch latency histogram: <1ms, <2ms, ..., <256ms, >=256ms. */
+#define BFQ_LAT_BUCKETS		10
+
 struct bfq_entity;
 
 /**
@@ -301,6 +304,14 @@ struct bfq_queue {
  *                                   (in jiffies)
  * @bfq_raising_max_softrt_rate: max service-rate for a soft real-time queue,
  *			         sectors per seconds
+ * @bfq_raising_launch_time: duration of the launch window opened when a
+ *                           task is moved into a foreground group; sync
+ *                           queues of the group are weight-raised while
+ *                           it lasts (in jiffies, 0 disables)
+ * @bfq_bg_charge_factor: extra service charged to async queues of
+ *                        background groups while @raised_busy_queues
+ *                        is not zero (0 disables the throttling)
+ * @raised_busy_queues: number of busy weight-raised queues
  * @RT_prod: cached value of the product R*T used for computing the maximum
  * 	     duration of the weight raising automatically
  * @oom_bfqq: fallback dummy bfqq for extreme OOM conditions
@@ -365,6 +376,9 @@ struct bfq_data {
 	unsigned int bfq_raising_min_idle_time;
 	unsigned int bfq_raising_min_inter_arr_async;
 	unsigned int bfq_raising_max_softrt_rate;
+	unsigned int bfq_raising_launch_time;
+	unsigned int bfq_bg_charge_factor;
+	int raised_busy_queues;
 	u64 RT_prod;
 
 	struct bfq_queue oom_bfqq;
@@ -443,6 +457,14 @@ enum bfqq_expiration {
  * @async_idle_bfqq: async queue for the idle class (ioprio is ignored).
  * @my_entity: pointer to @entity, %NULL for the toplevel group; used
  *             to avoid too many special cases during group creation/migration.
+ * @foreground: copy of the bfqio_cgroup flag, see there.
+ * @background: copy of the bfqio_cgroup flag, see there.
+ * @launching: a task has been moved into the group at least once.
+ * @launch_start: last time a task was moved into the group (jiffies).
+ * @lat_dispatched: requests dispatched, per sync/async.
+ * @lat_total_us: sum of the insertion to dispatch latencies, per sync/async.
+ * @lat_max_us: maximum insertion to dispatch latency, per sync/async.
+ * @lat_hist: insertion to dispatch latency histogram, per sync/async.
  *
  * Each (device, cgroup) pair has its own bfq_group, i.e., for each cgroup
  * there is a set of bfq_groups, each one collecting the lower-level
@@ -468,6 +490,15 @@ struct bfq_group {
 	struct bfq_queue *async_idle_bfqq;
 
 	struct bfq_entity *my_entity;
+
+	int foreground, background;
+	int launching;
+	unsigned long launch_start;
+
+	unsigned long lat_dispatched[2];
+	u64 lat_total_us[2];
+	unsigned long lat_max_us[2];
+	unsigned long lat_hist[2][BFQ_LAT_BUCKETS];
 };
 
 /**
@@ -476,16 +507,26 @@ struct bfq_group {
  * @weight: cgroup weight.
  * @ioprio: cgroup ioprio.
  * @ioprio_class: cgroup ioprio_class.
+ * @foreground: the group holds the foreground application; moving a
+ *              task into it opens a launch window, during which its
+ *              sync queues are weight-raised.
+ * @background: the group holds background applications; its async
+ *              queues are throttled while weight-raised queues are busy.
+ * @launching: a task has been moved into the group at least once.
+ * @launch_start: last time a task was moved into the group (jiffies).
  * @lock: spinlock that protects @ioprio, @ioprio_class and @group_data.
  * @group_data: list containing the bfq_group belonging to this cgroup.
  *
  * @group_data is accessed using RCU, with @lock protecting the updates,
- * @ioprio and @ioprio_class are protected by @lock.
+ * @ioprio, @ioprio_class and the launch fields are protected by @lock.
  */
 struct bfqio_cgroup {
 	struct cgroup_subsys_state css;
 
 	unsigned short weight, ioprio, ioprio_class;
+	unsigned short foreground, background;
+	int launching;
+	unsigned long launch_start;
 
 	spinlock_t lock;
 	struct hlist_head group_data;
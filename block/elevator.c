@@ -783,6 +783,23 @@ int elv_may_queue(struct request_queue *q, int rw)
 	return ELV_MQUEUE_MAY;
 }
 
+/*
+ * Lets the driver know that the scheduler holds a request that should not
+ * wait behind whatever the driver is gathering, e.g. a read arriving
+ * while a batch of writes is being built.  Called with the queue lock
+ * held.
+ */
+bool elv_is_urgent(struct request_queue *q)
+{
+	struct elevator_queue *e = q->elevator;
+
+	if (e && e->ops->elevator_is_urgent_fn)
+		return e->ops->elevator_is_urgent_fn(q);
+
+	return false;
+}
+EXPORT_SYMBOL(elv_is_urgent);
+
 void elv_abort_queue(struct request_queue *q)
 {
 	struct request *rq;
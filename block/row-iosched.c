@@ -69,19 +69,40 @@ static const int queue_quantum[] = {
 	1	/* ROWQ_PRIO_LOW_SWRITE */
 };
 
+/* Names of the queues in the latency histogram */
+static const char * const queue_name[] = {
+	"hp_read",	/* ROWQ_PRIO_HIGH_READ */
+	"rp_read",	/* ROWQ_PRIO_REG_READ */
+	"hp_swrite",	/* ROWQ_PRIO_HIGH_SWRITE */
+	"rp_swrite",	/* ROWQ_PRIO_REG_SWRITE */
+	"rp_write",	/* ROWQ_PRIO_REG_WRITE */
+	"lp_read",	/* ROWQ_PRIO_LOW_READ */
+	"lp_swrite",	/* ROWQ_PRIO_LOW_SWRITE */
+};
+
 /* Default values for idling on read queues */
 #define ROW_IDLE_TIME_MSEC 5	/* msec */
-#define ROW_READ_FREQ_MSEC 20	/* msec */
+#define ROW_IDLE_HIST_LEN 8	/* arrivals that decide about idling */
+
+/*
+ * Completion latency buckets: < 1ms, then powers of two up to 256ms, and
+ * everything slower in the last one.
+ */
+#define ROW_LAT_BUCKETS 10
 
 /**
  * struct rowq_idling_data -  parameters for idling on the queue
- * @last_insert_time:	time the last request was inserted
- *			to the queue
+ * @empty_since:	time the queue last ran out of requests, that is
+ *			when idling on it would have started
+ * @hist:		one bit per request that arrived on the empty
+ *			queue, newest in bit 0, set if it came within
+ *			the idling time
  * @begin_idling:	flag indicating wether we should idle
  *
  */
 struct rowq_idling_data {
-	ktime_t			last_insert_time;
+	ktime_t			empty_since;
+	u32			hist;
 	bool			begin_idling;
 };
 
@@ -94,6 +115,8 @@ struct rowq_idling_data {
  *			the current dispatch cycle
  * @slice:		number of requests to dispatch in a cycle
  * @idle_data:		data for idling on queues
+ * @lat_hist:		completion latency histogram, from insertion
+ *			to completion
  *
  */
 struct row_queue {
@@ -106,19 +129,21 @@ struct row_queue {
 
 	/* used only for READ queues */
 	struct rowq_idling_data	idle_data;
+
+	unsigned long		lat_hist[ROW_LAT_BUCKETS];
 };
 
 /**
  * struct idling_data - data for idling on empty rqueue
  * @idle_time:		idling duration (jiffies)
- * @freq:		min time between two requests that
- *			triger idling (msec)
+ * @hist_len:		idling stops once this many requests in a row
+ *			arrived too late to benefit from it
  * @idle_work:		pointer to struct delayed_work
  *
  */
 struct idling_data {
 	unsigned long			idle_time;
-	u32				freq;
+	u32				hist_len;
 
 	struct workqueue_struct	*idle_workqueue;
 	struct delayed_work		idle_work;
@@ -136,6 +161,9 @@ struct idling_data {
  *			scheduler, nr_reqs[1] holds the number of all WRITE
  *			requests in scheduler
  * @cycle_flags:	used for marking unserved queueus
+ * @pending_urgent:	a read arrived while a write queue was being
+ *			served and should be dispatched next
+ * @nr_urgent:		number of times a write queue was preempted that way
  *
  */
 struct row_data {
@@ -152,9 +180,15 @@ struct row_data {
 	unsigned int			nr_reqs[2];
 
 	unsigned int			cycle_flags;
+
+	bool				pending_urgent;
+	unsigned long			nr_urgent;
 };
 
 #define RQ_ROWQ(rq) ((struct row_queue *) ((rq)->elevator_private[0]))
+/* insertion time in usecs, wraps but differences are fine */
+#define RQ_ADD_US(rq) ((unsigned long) ((rq)->elevator_private[1]))
+#define RQ_SET_ADD_US(rq, us) ((rq)->elevator_private[1] = (void *) (us))
 
 #define row_log(q, fmt, args...)   \
 	blk_add_trace_msg(q, "%s():" fmt , __func__, ##args)
@@ -237,6 +271,53 @@ static inline void row_get_next_queue(struct row_data *rd)
 		row_restart_disp_cycle(rd);
 }
 
+static inline unsigned long row_now_us(void)
+{
+	return (unsigned long)ktime_to_us(ktime_get());
+}
+
+/*
+ * row_update_idling() - Decide about idling on a queue
+ * @rd:		pointer to struct row_data
+ * @rqueue:	queue a request was just added to while it was empty
+ *
+ * Idling on an empty queue only pays off if the next request arrives
+ * within the idling time.  Record whether this one did, and stop idling
+ * once the last hist_len requests all came too late.  A request that
+ * would have been caught turns idling back on.
+ */
+static void row_update_idling(struct row_data *rd, struct row_queue *rqueue)
+{
+	struct rowq_idling_data *idle = &rqueue->idle_data;
+	u32 mask = rd->read_idle.hist_len >= 32 ? ~0U :
+		(1U << rd->read_idle.hist_len) - 1;
+	s64 think_us;
+
+	if (!idle->empty_since.tv64)
+		return;
+
+	think_us = ktime_to_us(ktime_sub(ktime_get(), idle->empty_since));
+	idle->hist <<= 1;
+	if (think_us <= jiffies_to_usecs(rd->read_idle.idle_time))
+		idle->hist |= 1;
+
+	if (idle->hist & mask) {
+		if (!idle->begin_idling)
+			row_log_rowq(rd, rqueue->prio, "Enable idling");
+		idle->begin_idling = true;
+	} else {
+		if (idle->begin_idling)
+			row_log_rowq(rd, rqueue->prio, "Disable idling");
+		idle->begin_idling = false;
+	}
+}
+
+static inline bool row_queue_is_read(enum row_queue_prio prio)
+{
+	return prio == ROWQ_PRIO_HIGH_READ || prio == ROWQ_PRIO_REG_READ ||
+		prio == ROWQ_PRIO_LOW_READ;
+}
+
 /******************* Elevator callback functions *********************/
 
 /*
@@ -254,22 +335,29 @@ static void row_add_request(struct request_queue *q,
 	list_add_tail(&rq->queuelist, &rqueue->fifo);
 	rd->nr_reqs[rq_data_dir(rq)]++;
 	rq_set_fifo_time(rq, jiffies); /* for statistics*/
+	RQ_SET_ADD_US(rq, row_now_us());
 
 	if (queue_idling_enabled[rqueue->prio]) {
 		if (delayed_work_pending(&rd->read_idle.idle_work))
 			(void)cancel_delayed_work(
 				&rd->read_idle.idle_work);
-		if (ktime_to_ms(ktime_sub(ktime_get(),
-				rqueue->idle_data.last_insert_time)) <
-				rd->read_idle.freq) {
-			rqueue->idle_data.begin_idling = true;
-			row_log_rowq(rd, rqueue->prio, "Enable idling");
-		} else {
-			rqueue->idle_data.begin_idling = false;
-			row_log_rowq(rd, rqueue->prio, "Disable idling");
-		}
+		if (list_is_singular(&rqueue->fifo))
+			row_update_idling(rd, rqueue);
+	}
 
-		rqueue->idle_data.last_insert_time = ktime_get();
+	/*
+	 * A regular or high priority read arriving while a write queue is
+	 * served would wait for the rest of that queue's quantum, and for
+	 * whatever write batch the driver is building from it.  Have it
+	 * dispatched next and let the driver know through elv_is_urgent().
+	 */
+	if (rqueue->prio <= ROWQ_PRIO_REG_READ &&
+	    !row_queue_is_read(rd->curr_queue) &&
+	    rd->row_queues[rd->curr_queue].rqueue.nr_dispatched &&
+	    !rd->pending_urgent) {
+		rd->pending_urgent = true;
+		row_log_rowq(rd, rqueue->prio, "Urgent read, rowq%d preempted",
+			     rd->curr_queue);
 	}
 	row_log_rowq(rd, rqueue->prio, "added request");
 }
@@ -300,11 +388,14 @@ static void row_remove_request(struct request_queue *q,
 static void row_dispatch_insert(struct row_data *rd)
 {
 	struct request *rq;
+	struct row_queue *rqueue = &rd->row_queues[rd->curr_queue].rqueue;
 
-	rq = rq_entry_fifo(rd->row_queues[rd->curr_queue].rqueue.fifo.next);
+	rq = rq_entry_fifo(rqueue->fifo.next);
 	row_remove_request(rd->dispatch_queue, rq);
 	elv_dispatch_add_tail(rd->dispatch_queue, rq);
-	rd->row_queues[rd->curr_queue].rqueue.nr_dispatched++;
+	if (list_empty(&rqueue->fifo))
+		rqueue->idle_data.empty_since = ktime_get();
+	rqueue->nr_dispatched++;
 	row_clear_rowq_unserved(rd, rd->curr_queue);
 	row_log_rowq(rd, rd->curr_queue, " Dispatched request nr_disp = %d",
 		     rd->row_queues[rd->curr_queue].rqueue.nr_dispatched);
@@ -359,6 +450,26 @@ static int row_dispatch_requests(struct request_queue *q, int force)
 
 	currq = rd->curr_queue;
 
+	/*
+	 * An urgent read preempts the write queue being served.  That
+	 * queue keeps what it dispatched so far and resumes in its place
+	 * in the cycle.
+	 */
+	if (rd->pending_urgent) {
+		rd->pending_urgent = false;
+		for (i = ROWQ_PRIO_HIGH_READ; i <= ROWQ_PRIO_REG_READ; i++) {
+			if (list_empty(&rd->row_queues[i].rqueue.fifo))
+				continue;
+			row_log_rowq(rd, currq, " Preempting for urgent rowq%d",
+				     i);
+			rd->curr_queue = i;
+			rd->nr_urgent++;
+			row_dispatch_insert(rd);
+			ret = 1;
+			goto done;
+		}
+	}
+
 	/*
 	 * Find the first unserved queue (with higher priority then currq)
 	 * that is not empty
@@ -453,8 +564,10 @@ static void *row_init_queue(struct request_queue *q)
 		rdata->row_queues[i].disp_quantum = queue_quantum[i];
 		rdata->row_queues[i].rqueue.rdata = rdata;
 		rdata->row_queues[i].rqueue.prio = i;
-		rdata->row_queues[i].rqueue.idle_data.begin_idling = false;
-		rdata->row_queues[i].rqueue.idle_data.last_insert_time =
+		rdata->row_queues[i].rqueue.idle_data.begin_idling =
+			queue_idling_enabled[i];
+		rdata->row_queues[i].rqueue.idle_data.hist = ~0U;
+		rdata->row_queues[i].rqueue.idle_data.empty_since =
 			ktime_set(0, 0);
 	}
 
@@ -467,7 +580,7 @@ static void *row_init_queue(struct request_queue *q)
 	/* Maybe 0 on some platforms */
 	if (!rdata->read_idle.idle_time)
 		rdata->read_idle.idle_time = 1;
-	rdata->read_idle.freq = ROW_READ_FREQ_MSEC;
+	rdata->read_idle.hist_len = ROW_IDLE_HIST_LEN;
 	rdata->read_idle.idle_workqueue = alloc_workqueue("row_idle_work",
 					    WQ_MEM_RECLAIM | WQ_HIGHPRI, 0);
 	if (!rdata->read_idle.idle_workqueue)
@@ -516,6 +629,35 @@ static void row_merged_requests(struct request_queue *q, struct request *rq,
 	rqueue->rdata->nr_reqs[rq_data_dir(rq)]--;
 }
 
+/*
+ * row_completed_request() - Account the latency of a completed request
+ * @q:		requests queue
+ * @rq:		completed request
+ *
+ * Called with the queue lock held.
+ */
+static void row_completed_request(struct request_queue *q, struct request *rq)
+{
+	struct row_queue *rqueue = RQ_ROWQ(rq);
+	unsigned long ms = (row_now_us() - RQ_ADD_US(rq)) / USEC_PER_MSEC;
+	int i = 0;
+
+	while (i < ROW_LAT_BUCKETS - 1 && ms >= (1UL << i))
+		i++;
+	rqueue->lat_hist[i]++;
+}
+
+/*
+ * row_is_urgent() - Tell the driver about a pending urgent read
+ * @q:		requests queue
+ */
+static bool row_is_urgent(struct request_queue *q)
+{
+	struct row_data *rd = (struct row_data *)q->elevator->elevator_data;
+
+	return rd->pending_urgent;
+}
+
 /*
  * get_queue_type() - Get queue type for a given request
  *
@@ -598,7 +740,7 @@ SHOW_FUNCTION(row_lp_read_quantum_show,
 SHOW_FUNCTION(row_lp_swrite_quantum_show,
 	rowd->row_queues[ROWQ_PRIO_LOW_SWRITE].disp_quantum, 0);
 SHOW_FUNCTION(row_read_idle_show, rowd->read_idle.idle_time, 1);
-SHOW_FUNCTION(row_read_idle_freq_show, rowd->read_idle.freq, 0);
+SHOW_FUNCTION(row_read_idle_hist_show, rowd->read_idle.hist_len, 0);
 #undef SHOW_FUNCTION
 
 #define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
@@ -638,10 +780,58 @@ STORE_FUNCTION(row_lp_swrite_quantum_store,
 			&rowd->row_queues[ROWQ_PRIO_LOW_SWRITE].disp_quantum,
 			1, INT_MAX, 1);
 STORE_FUNCTION(row_read_idle_store, &rowd->read_idle.idle_time, 1, INT_MAX, 1);
-STORE_FUNCTION(row_read_idle_freq_store, &rowd->read_idle.freq, 1, INT_MAX, 0);
+STORE_FUNCTION(row_read_idle_hist_store, &rowd->read_idle.hist_len, 1, 32, 0);
 
 #undef STORE_FUNCTION
 
+/*
+ * Completion latency histogram of every queue, and how often a write
+ * queue was preempted by an urgent read.  Writing 0 clears it.
+ */
+static ssize_t row_latency_hist_show(struct elevator_queue *e, char *page)
+{
+	struct row_data *rowd = e->elevator_data;
+	int i, j, len;
+
+	len = snprintf(page, PAGE_SIZE, "%-10s %8s", "queue", "<1ms");
+	for (j = 1; j < ROW_LAT_BUCKETS - 1; j++)
+		len += snprintf(page + len, PAGE_SIZE - len, " %6s%-2lu",
+				"<", 1UL << j);
+	len += snprintf(page + len, PAGE_SIZE - len, " %8s\n", ">=256");
+
+	for (i = 0; i < ROWQ_MAX_PRIO; i++) {
+		len += snprintf(page + len, PAGE_SIZE - len, "%-10s",
+				queue_name[i]);
+		for (j = 0; j < ROW_LAT_BUCKETS; j++)
+			len += snprintf(page + len, PAGE_SIZE - len, " %8lu",
+				rowd->row_queues[i].rqueue.lat_hist[j]);
+		len += snprintf(page + len, PAGE_SIZE - len, "\n");
+	}
+	len += snprintf(page + len, PAGE_SIZE - len, "urgent %lu\n",
+			rowd->nr_urgent);
+	return len;
+}
+
+static ssize_t row_latency_hist_store(struct elevator_queue *e,
+				      const char *page, size_t count)
+{
+	struct row_data *rowd = e->elevator_data;
+	struct request_queue *q = rowd->dispatch_queue;
+	unsigned long val;
+	int i;
+
+	if (kstrtoul(page, 10, &val) || val)
+		return -EINVAL;
+
+	spin_lock_irq(q->queue_lock);
+	for (i = 0; i < ROWQ_MAX_PRIO; i++)
+		memset(rowd->row_queues[i].rqueue.lat_hist, 0,
+		       sizeof(rowd->row_queues[i].rqueue.lat_hist));
+	rowd->nr_urgent = 0;
+	spin_unlock_irq(q->queue_lock);
+	return count;
+}
+
 #define ROW_ATTR(name) \
 	__ATTR(name, S_IRUGO|S_IWUSR, row_##name##_show, \
 				      row_##name##_store)
@@ -655,7 +845,8 @@ static struct elv_fs_entry row_attrs[] = {
 	ROW_ATTR(lp_read_quantum),
 	ROW_ATTR(lp_swrite_quantum),
 	ROW_ATTR(read_idle),
-	ROW_ATTR(read_idle_freq),
+	ROW_ATTR(read_idle_hist),
+	ROW_ATTR(latency_hist),
 	__ATTR_NULL
 };
 
@@ -667,6 +858,8 @@ static struct elevator_type iosched_row = {
 		.elevator_former_req_fn		= elv_rb_former_request,
 		.elevator_latter_req_fn		= elv_rb_latter_request,
 		.elevator_set_req_fn		= row_set_request,
+		.elevator_completed_req_fn	= row_completed_request,
+		.elevator_is_urgent_fn		= row_is_urgent,
 		.elevator_init_fn		= row_init_queue,
 		.elevator_exit_fn		= row_exit_queue,
 	},
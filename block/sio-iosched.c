@@ -25,11 +25,13 @@ enum {
 	SYNC,
 };
 
-/* Tunables */
+/* Tunables, defaults for the per queue sysfs attributes */
 static const int sync_expire = HZ / 2;	/* max time before a sync is submitted. */
 static const int async_expire = 5 * HZ;	/* ditto for async, these limits are SOFT! */
-static const int fifo_batch = 1;	/* # of sequential requests treated as one
+static const int fifo_batch = 16;	/* # of sequential requests treated as one
 					   by the above parameters. For throughput. */
+static const int fifo_batch_bytes = 512 * 1024;	/* ditto in bytes, so a batch of
+					   large requests stays short. 0 = off */
 
 /* Elevator data */
 struct sio_data {
@@ -38,10 +40,17 @@ struct sio_data {
 
 	/* Attributes */
 	unsigned int batched;
+	unsigned int batched_bytes;
 
 	/* Settings */
 	int fifo_expire[2];
 	int fifo_batch;
+	int fifo_batch_bytes;
+
+	/* Starvation accounting, per data direction */
+	unsigned long dispatched[2];
+	unsigned long starved[2];	/* dispatched past their deadline */
+	unsigned long max_overdue[2];	/* jiffies */
 };
 
 static void
@@ -143,6 +152,21 @@ sio_choose_request(struct sio_data *sd)
 static inline void
 sio_dispatch_request(struct sio_data *sd, struct request *rq)
 {
+	const int data_dir = rq_data_dir(rq);
+
+	/*
+	 * Account requests that waited past their deadline before
+	 * the fifo time is gone.
+	 */
+	sd->dispatched[data_dir]++;
+	if (time_after(jiffies, rq_fifo_time(rq))) {
+		unsigned long overdue = jiffies - rq_fifo_time(rq);
+
+		sd->starved[data_dir]++;
+		if (overdue > sd->max_overdue[data_dir])
+			sd->max_overdue[data_dir] = overdue;
+	}
+
 	/*
 	 * Remove the request from the fifo list
 	 * and dispatch it.
@@ -151,6 +175,7 @@ sio_dispatch_request(struct sio_data *sd, struct request *rq)
 	elv_dispatch_add_tail(rq->q, rq);
 
 	sd->batched++;
+	sd->batched_bytes += blk_rq_bytes(rq);
 }
 
 static int
@@ -161,10 +186,13 @@ sio_dispatch_requests(struct request_queue *q, int force)
 
 	/*
 	 * Retrieve any expired request after a batch of
-	 * sequential requests.
+	 * sequential requests, or of bytes.
 	 */
-	if (sd->batched > sd->fifo_batch) {
+	if (sd->batched > sd->fifo_batch ||
+	    (sd->fifo_batch_bytes &&
+	     sd->batched_bytes >= sd->fifo_batch_bytes)) {
 		sd->batched = 0;
+		sd->batched_bytes = 0;
 		rq = sio_choose_expired_request(sd);
 	}
 
@@ -213,7 +241,7 @@ sio_init_queue(struct request_queue *q)
 	struct sio_data *sd;
 
 	/* Allocate structure */
-	sd = kmalloc_node(sizeof(*sd), GFP_KERNEL, q->node);
+	sd = kmalloc_node(sizeof(*sd), GFP_KERNEL | __GFP_ZERO, q->node);
 	if (!sd)
 		return NULL;
 
@@ -226,6 +254,7 @@ sio_init_queue(struct request_queue *q)
 	sd->fifo_expire[SYNC] = sync_expire;
 	sd->fifo_expire[ASYNC] = async_expire;
 	sd->fifo_batch = fifo_batch;
+	sd->fifo_batch_bytes = fifo_batch_bytes;
 
 	return sd;
 }
@@ -273,6 +302,7 @@ static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
 SHOW_FUNCTION(sio_sync_expire_show, sd->fifo_expire[SYNC], 1);
 SHOW_FUNCTION(sio_async_expire_show, sd->fifo_expire[ASYNC], 1);
 SHOW_FUNCTION(sio_fifo_batch_show, sd->fifo_batch, 0);
+SHOW_FUNCTION(sio_fifo_batch_bytes_show, sd->fifo_batch_bytes, 0);
 #undef SHOW_FUNCTION
 
 #define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
@@ -294,8 +324,42 @@ static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)
 STORE_FUNCTION(sio_sync_expire_store, &sd->fifo_expire[SYNC], 0, INT_MAX, 1);
 STORE_FUNCTION(sio_async_expire_store, &sd->fifo_expire[ASYNC], 0, INT_MAX, 1);
 STORE_FUNCTION(sio_fifo_batch_store, &sd->fifo_batch, 0, INT_MAX, 0);
+STORE_FUNCTION(sio_fifo_batch_bytes_store, &sd->fifo_batch_bytes, 0, INT_MAX, 0);
 #undef STORE_FUNCTION
 
+/*
+ * Per direction: requests dispatched, how many of them only after their
+ * deadline had passed and the longest such overrun.  Writing 0 clears it.
+ */
+static ssize_t
+sio_starved_show(struct elevator_queue *e, char *page)
+{
+	struct sio_data *sd = e->elevator_data;
+
+	return sprintf(page, "read dispatched %lu starved %lu max_overdue_ms %u\n"
+		       "write dispatched %lu starved %lu max_overdue_ms %u\n",
+		       sd->dispatched[READ], sd->starved[READ],
+		       jiffies_to_msecs(sd->max_overdue[READ]),
+		       sd->dispatched[WRITE], sd->starved[WRITE],
+		       jiffies_to_msecs(sd->max_overdue[WRITE]));
+}
+
+static ssize_t
+sio_starved_store(struct elevator_queue *e, const char *page, size_t count)
+{
+	struct sio_data *sd = e->elevator_data;
+	int val;
+
+	sio_var_store(&val, page, count);
+	if (val)
+		return -EINVAL;
+
+	memset(sd->dispatched, 0, sizeof(sd->dispatched));
+	memset(sd->starved, 0, sizeof(sd->starved));
+	memset(sd->max_overdue, 0, sizeof(sd->max_overdue));
+	return count;
+}
+
 #define DD_ATTR(name) \
 	__ATTR(name, S_IRUGO|S_IWUSR, sio_##name##_show, \
 				      sio_##name##_store)
@@ -304,6 +368,8 @@ static struct elv_fs_entry sio_attrs[] = {
 	DD_ATTR(sync_expire),
 	DD_ATTR(async_expire),
 	DD_ATTR(fifo_batch),
+	DD_ATTR(fifo_batch_bytes),
+	DD_ATTR(starved),
 	__ATTR_NULL
 };
 
@@ -0,0 +1,518 @@
+/*
+ * drivers/cpufreq/cpufreq_governor.c
+ *
+ * Common part of the demand based switching (dbs) governors: load
+ * measurement from the idle time statistics, the deferrable sampling work
+ * of each policy, governor start/stop/limits and the sysfs tunables all of
+ * them have.  The governors themselves only decide the next speed.
+ *
+ * Copyright (C)  2001 Russell King
+ *            (C)  2003 Venkatesh Pallipadi <venkatesh.pallipadi@intel.com>.
+ *                      Jun Nakajima <jun.nakajima@intel.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/cpufreq.h>
+#include <linux/cpu.h>
+#include <linux/jiffies.h>
+#include <linux/kernel_stat.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/tick.h>
+
+#include "cpufreq_governor.h"
+
+struct dbs_cpu {
+	cputime64_t prev_cpu_idle;
+	cputime64_t prev_cpu_iowait;
+	cputime64_t prev_cpu_wall;
+	cputime64_t prev_cpu_nice;
+	struct dbs_policy *dp;		/* NULL if no dbs governor runs it */
+};
+static DEFINE_PER_CPU(struct dbs_cpu, dbs_cpu);
+
+static inline cputime64_t get_cpu_idle_time_jiffy(unsigned int cpu,
+							cputime64_t *wall)
+{
+	cputime64_t idle_time;
+	cputime64_t cur_wall_time;
+	cputime64_t busy_time;
+
+	cur_wall_time = jiffies64_to_cputime64(get_jiffies_64());
+	busy_time = cputime64_add(kstat_cpu(cpu).cpustat.user,
+			kstat_cpu(cpu).cpustat.system);
+
+	busy_time = cputime64_add(busy_time, kstat_cpu(cpu).cpustat.irq);
+	busy_time = cputime64_add(busy_time, kstat_cpu(cpu).cpustat.softirq);
+	busy_time = cputime64_add(busy_time, kstat_cpu(cpu).cpustat.steal);
+	busy_time = cputime64_add(busy_time, kstat_cpu(cpu).cpustat.nice);
+
+	idle_time = cputime64_sub(cur_wall_time, busy_time);
+	if (wall)
+		*wall = (cputime64_t)jiffies_to_usecs(cur_wall_time);
+
+	return (cputime64_t)jiffies_to_usecs(idle_time);
+}
+
+static inline cputime64_t get_cpu_idle_time(unsigned int cpu, cputime64_t *wall)
+{
+	u64 idle_time = get_cpu_idle_time_us(cpu, wall);
+
+	if (idle_time == -1ULL)
+		return get_cpu_idle_time_jiffy(cpu, wall);
+
+	return idle_time;
+}
+
+static inline cputime64_t get_cpu_iowait_time(unsigned int cpu, cputime64_t *wall)
+{
+	u64 iowait_time = get_cpu_iowait_time_us(cpu, wall);
+
+	if (iowait_time == -1ULL)
+		return 0;
+
+	return iowait_time;
+}
+
+/* Start a new measurement period on cpu. */
+static void dbs_reset_cpu(struct dbs_cpu *dc, unsigned int cpu)
+{
+	dc->prev_cpu_idle = get_cpu_idle_time(cpu, &dc->prev_cpu_wall);
+	dc->prev_cpu_iowait = get_cpu_iowait_time(cpu, &dc->prev_cpu_wall);
+	dc->prev_cpu_nice = kstat_cpu(cpu).cpustat.nice;
+}
+
+/**
+ * dbs_update_load - measure the load of a policy's CPUs
+ * @dp: the policy
+ *
+ * Computes the load of every CPU of the policy since the previous call,
+ * the percentage of wall time it was not idle, and leaves the highest,
+ * the sum and the highest in terms of frequency in @dp.
+ */
+void dbs_update_load(struct dbs_policy *dp)
+{
+	struct dbs_tuners *tuners = &dp->gov->tuners;
+	struct cpufreq_policy *policy = dp->policy;
+	unsigned int j;
+
+	dp->max_load = 0;
+	dp->total_load = 0;
+	dp->max_load_freq = 0;
+
+	for_each_cpu(j, policy->cpus) {
+		struct dbs_cpu *dc = &per_cpu(dbs_cpu, j);
+		cputime64_t cur_wall_time, cur_idle_time, cur_iowait_time;
+		unsigned int idle_time, wall_time, iowait_time;
+		unsigned int load, load_freq;
+		int freq_avg;
+
+		cur_idle_time = get_cpu_idle_time(j, &cur_wall_time);
+		cur_iowait_time = get_cpu_iowait_time(j, &cur_wall_time);
+
+		wall_time = (unsigned int) cputime64_sub(cur_wall_time,
+				dc->prev_cpu_wall);
+		dc->prev_cpu_wall = cur_wall_time;
+
+		idle_time = (unsigned int) cputime64_sub(cur_idle_time,
+				dc->prev_cpu_idle);
+		dc->prev_cpu_idle = cur_idle_time;
+
+		iowait_time = (unsigned int) cputime64_sub(cur_iowait_time,
+				dc->prev_cpu_iowait);
+		dc->prev_cpu_iowait = cur_iowait_time;
+
+		if (tuners->ignore_nice) {
+			cputime64_t cur_nice;
+			unsigned long cur_nice_jiffies;
+
+			cur_nice = cputime64_sub(kstat_cpu(j).cpustat.nice,
+					 dc->prev_cpu_nice);
+			/*
+			 * Assumption: nice time between sampling periods will
+			 * be less than 2^32 jiffies for 32 bit sys
+			 */
+			cur_nice_jiffies = (unsigned long)
+					cputime64_to_jiffies64(cur_nice);
+
+			dc->prev_cpu_nice = kstat_cpu(j).cpustat.nice;
+			idle_time += jiffies_to_usecs(cur_nice_jiffies);
+		}
+
+		/*
+		 * Waiting for disk IO is an indication that you're
+		 * performance critical, and not that the system is actually
+		 * idle. So subtract the iowait time from the cpu idle time.
+		 */
+		if (tuners->io_is_busy && idle_time >= iowait_time)
+			idle_time -= iowait_time;
+
+		if (unlikely(!wall_time || wall_time < idle_time))
+			continue;
+
+		load = 100 * (wall_time - idle_time) / wall_time;
+
+		dp->total_load += load;
+		if (load > dp->max_load)
+			dp->max_load = load;
+
+		freq_avg = __cpufreq_driver_getavg(policy, j);
+		if (freq_avg <= 0)
+			freq_avg = policy->cur;
+
+		load_freq = load * freq_avg;
+		if (load_freq > dp->max_load_freq)
+			dp->max_load_freq = load_freq;
+	}
+}
+EXPORT_SYMBOL_GPL(dbs_update_load);
+
+/**
+ * dbs_sample_delay - jiffies until the next sample
+ * @usecs: sampling period
+ *
+ * Rounds the next sample down to a multiple of the period, so that the
+ * works of all policies come due on the same jiffy and wake the system
+ * once.
+ */
+unsigned long dbs_sample_delay(unsigned int usecs)
+{
+	unsigned long delay = max(usecs_to_jiffies(usecs), 1UL);
+
+	if (num_online_cpus() > 1)
+		delay -= jiffies % delay;
+	return delay;
+}
+EXPORT_SYMBOL_GPL(dbs_sample_delay);
+
+/**
+ * dbs_get_policy - the dbs_policy of a CPU
+ * @dg: governor
+ * @cpu: any CPU of the policy
+ *
+ * Returns NULL unless @dg is running the policy of @cpu.  The caller
+ * keeps the governor from being stopped, by holding @dg->mutex or the
+ * policy's rwsem.
+ */
+struct dbs_policy *dbs_get_policy(struct dbs_governor *dg, unsigned int cpu)
+{
+	struct dbs_policy *dp = per_cpu(dbs_cpu, cpu).dp;
+
+	return dp && dp->gov == dg ? dp : NULL;
+}
+EXPORT_SYMBOL_GPL(dbs_get_policy);
+
+/**
+ * dbs_idle_micro_accounting - whether idle time is known in microseconds
+ *
+ * True with NO_HZ, where the idle statistics are exact and the sampling
+ * rate need not cover many ticks.
+ */
+bool dbs_idle_micro_accounting(void)
+{
+	cputime64_t wall;
+	u64 idle_time;
+	int cpu = get_cpu();
+
+	idle_time = get_cpu_idle_time_us(cpu, &wall);
+	put_cpu();
+	return idle_time != -1ULL;
+}
+EXPORT_SYMBOL_GPL(dbs_idle_micro_accounting);
+
+/**
+ * dbs_init_sampling_rate - default sampling rate for a policy
+ * @dg: governor
+ * @policy: first policy using it
+ *
+ * Sets the sampling rate from the transition latency of the CPU,
+ * LATENCY_MULTIPLIER times it but no less than min_sampling_rate, and
+ * raises min_sampling_rate to MIN_LATENCY_MULTIPLIER times it.
+ */
+void dbs_init_sampling_rate(struct dbs_governor *dg,
+			    struct cpufreq_policy *policy)
+{
+	unsigned int latency;
+
+	/* policy latency is in nS. Convert it to uS first */
+	latency = policy->cpuinfo.transition_latency / 1000;
+	if (latency == 0)
+		latency = 1;
+	/* Bring kernel and HW constraints together */
+	dg->min_sampling_rate = max(dg->min_sampling_rate,
+				    MIN_LATENCY_MULTIPLIER * latency);
+	dg->tuners.sampling_rate = max(dg->min_sampling_rate,
+				       latency * LATENCY_MULTIPLIER);
+}
+EXPORT_SYMBOL_GPL(dbs_init_sampling_rate);
+
+/*
+ * Not all CPUs want IO time to be accounted as busy; this depends on how
+ * efficient idling at a higher frequency/voltage is.
+ * Pavel Machek says this is not so for various generations of AMD and old
+ * Intel systems.
+ * Mike Chan (androidlcom) calis this is also not true for ARM.
+ * Because of this, whitelist specific known (series) of CPUs by default, and
+ * leave all others up to the user.
+ */
+int dbs_should_io_be_busy(void)
+{
+#if defined(CONFIG_X86)
+	/*
+	 * For Intel, Core 2 (model 15) andl later have an efficient idle.
+	 */
+	if (boot_cpu_data.x86_vendor == X86_VENDOR_INTEL &&
+	    boot_cpu_data.x86 == 6 &&
+	    boot_cpu_data.x86_model >= 15)
+		return 1;
+#endif
+	return 0;
+}
+EXPORT_SYMBOL_GPL(dbs_should_io_be_busy);
+
+/************************** sysfs interface ************************/
+
+ssize_t dbs_show_sampling_rate_min(struct dbs_governor *dg, char *buf)
+{
+	return sprintf(buf, "%u\n", dg->min_sampling_rate);
+}
+EXPORT_SYMBOL_GPL(dbs_show_sampling_rate_min);
+
+ssize_t dbs_show_sampling_rate(struct dbs_governor *dg, char *buf)
+{
+	return sprintf(buf, "%u\n", dg->tuners.sampling_rate);
+}
+EXPORT_SYMBOL_GPL(dbs_show_sampling_rate);
+
+ssize_t dbs_store_sampling_rate(struct dbs_governor *dg,
+				const char *buf, size_t count)
+{
+	unsigned int input;
+	int ret;
+
+	ret = sscanf(buf, "%u", &input);
+	if (ret != 1)
+		return -EINVAL;
+	dg->tuners.sampling_rate = max(input, dg->min_sampling_rate);
+	return count;
+}
+EXPORT_SYMBOL_GPL(dbs_store_sampling_rate);
+
+ssize_t dbs_show_ignore_nice_load(struct dbs_governor *dg, char *buf)
+{
+	return sprintf(buf, "%u\n", dg->tuners.ignore_nice);
+}
+EXPORT_SYMBOL_GPL(dbs_show_ignore_nice_load);
+
+ssize_t dbs_store_ignore_nice_load(struct dbs_governor *dg,
+				   const char *buf, size_t count)
+{
+	unsigned int input;
+	int ret;
+	unsigned int j;
+
+	ret = sscanf(buf, "%u", &input);
+	if (ret != 1)
+		return -EINVAL;
+
+	if (input > 1)
+		input = 1;
+
+	mutex_lock(&dg->mutex);
+	if (input == dg->tuners.ignore_nice) { /* nothing to do */
+		mutex_unlock(&dg->mutex);
+		return count;
+	}
+	dg->tuners.ignore_nice = input;
+
+	/* we need to re-evaluate prev_cpu_idle */
+	for_each_online_cpu(j) {
+		if (dbs_get_policy(dg, j))
+			dbs_reset_cpu(&per_cpu(dbs_cpu, j), j);
+	}
+	mutex_unlock(&dg->mutex);
+
+	return count;
+}
+EXPORT_SYMBOL_GPL(dbs_store_ignore_nice_load);
+
+ssize_t dbs_show_io_is_busy(struct dbs_governor *dg, char *buf)
+{
+	return sprintf(buf, "%u\n", dg->tuners.io_is_busy);
+}
+EXPORT_SYMBOL_GPL(dbs_show_io_is_busy);
+
+ssize_t dbs_store_io_is_busy(struct dbs_governor *dg,
+			     const char *buf, size_t count)
+{
+	unsigned int input;
+	int ret;
+
+	ret = sscanf(buf, "%u", &input);
+	if (ret != 1)
+		return -EINVAL;
+	dg->tuners.io_is_busy = !!input;
+	return count;
+}
+EXPORT_SYMBOL_GPL(dbs_store_io_is_busy);
+
+/************************** sysfs end ************************/
+
+static void dbs_queue_work(struct dbs_policy *dp, unsigned long delay)
+{
+	struct workqueue_struct *wq = dp->gov->wq ? dp->gov->wq : system_wq;
+
+	queue_delayed_work_on(dp->cpu, wq, &dp->work, delay);
+}
+
+static void dbs_timer(struct work_struct *work)
+{
+	struct dbs_policy *dp =
+		container_of(work, struct dbs_policy, work.work);
+	unsigned long delay;
+
+	mutex_lock(&dp->timer_mutex);
+	delay = dp->gov->check(dp);
+	dbs_queue_work(dp, delay);
+	mutex_unlock(&dp->timer_mutex);
+}
+
+static int dbs_start(struct dbs_governor *dg, struct cpufreq_policy *policy)
+{
+	unsigned int cpu = policy->cpu;
+	struct dbs_policy *dp;
+	unsigned int j;
+	int rc;
+
+	if ((!cpu_online(cpu)) || (!policy->cur))
+		return -EINVAL;
+
+	dp = kzalloc(max(dg->policy_size, sizeof(*dp)), GFP_KERNEL);
+	if (!dp)
+		return -ENOMEM;
+	dp->policy = policy;
+	dp->gov = dg;
+	dp->cpu = cpu;
+	dp->freq_table = cpufreq_frequency_get_table(cpu);
+	mutex_init(&dp->timer_mutex);
+	INIT_DELAYED_WORK_DEFERRABLE(&dp->work, dbs_timer);
+
+	mutex_lock(&dg->mutex);
+	/*
+	 * Set up the tunables and their sysfs group when this governor
+	 * is used for first time
+	 */
+	if (!dg->enable) {
+		rc = dg->init ? dg->init(dg, policy) : 0;
+		if (!rc) {
+			rc = sysfs_create_group(cpufreq_global_kobject,
+						dg->attr_group);
+			if (rc && dg->exit)
+				dg->exit(dg);
+		}
+		if (rc) {
+			mutex_unlock(&dg->mutex);
+			mutex_destroy(&dp->timer_mutex);
+			kfree(dp);
+			return rc;
+		}
+	}
+	dg->enable++;
+
+	for_each_cpu(j, policy->cpus) {
+		struct dbs_cpu *dc = &per_cpu(dbs_cpu, j);
+
+		dbs_reset_cpu(dc, j);
+		dc->dp = dp;
+	}
+	if (dg->start)
+		dg->start(dp);
+	mutex_unlock(&dg->mutex);
+
+	dbs_queue_work(dp, dbs_sample_delay(dg->tuners.sampling_rate));
+	return 0;
+}
+
+static void dbs_stop(struct dbs_governor *dg, struct cpufreq_policy *policy)
+{
+	struct dbs_policy *dp = dbs_get_policy(dg, policy->cpu);
+	unsigned int j;
+	bool last;
+
+	if (!dp)
+		return;
+
+	cancel_delayed_work_sync(&dp->work);
+
+	/* policy->cpus misses the CPUs that went offline since start */
+	mutex_lock(&dg->mutex);
+	for_each_possible_cpu(j)
+		if (per_cpu(dbs_cpu, j).dp == dp)
+			per_cpu(dbs_cpu, j).dp = NULL;
+	last = !--dg->enable;
+	if (last && dg->exit)
+		dg->exit(dg);
+	mutex_unlock(&dg->mutex);
+
+	/* outside the mutex, the store methods take it */
+	if (last)
+		sysfs_remove_group(cpufreq_global_kobject, dg->attr_group);
+
+	mutex_destroy(&dp->timer_mutex);
+	kfree(dp);
+}
+
+static void dbs_limits(struct dbs_governor *dg, struct cpufreq_policy *policy)
+{
+	struct dbs_policy *dp = dbs_get_policy(dg, policy->cpu);
+
+	if (!dp)
+		return;
+
+	mutex_lock(&dp->timer_mutex);
+	if (policy->max < dp->policy->cur)
+		__cpufreq_driver_target(dp->policy,
+			policy->max, CPUFREQ_RELATION_H);
+	else if (policy->min > dp->policy->cur)
+		__cpufreq_driver_target(dp->policy,
+			policy->min, CPUFREQ_RELATION_L);
+	mutex_unlock(&dp->timer_mutex);
+}
+
+/**
+ * cpufreq_governor_dbs - governor callback of the dbs governors
+ * @dg: the governor
+ * @policy: policy the event is for
+ * @event: CPUFREQ_GOV_START, CPUFREQ_GOV_STOP or CPUFREQ_GOV_LIMITS
+ *
+ * Each governor's cpufreq_governor.governor method passes its events on
+ * to this with its struct dbs_governor.
+ */
+int cpufreq_governor_dbs(struct dbs_governor *dg,
+			 struct cpufreq_policy *policy, unsigned int event)
+{
+	switch (event) {
+	case CPUFREQ_GOV_START:
+		return dbs_start(dg, policy);
+
+	case CPUFREQ_GOV_STOP:
+		dbs_stop(dg, policy);
+		break;
+
+	case CPUFREQ_GOV_LIMITS:
+		dbs_limits(dg, policy);
+		break;
+	}
+	return 0;
+}
+EXPORT_SYMBOL_GPL(cpufreq_governor_dbs);
+
+MODULE_DESCRIPTION("Common code of the demand based switching cpufreq "
+	"governors");
+MODULE_LICENSE("GPL");
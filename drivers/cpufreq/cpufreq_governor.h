@@ -0,0 +1,152 @@
+/*
+ * drivers/cpufreq/cpufreq_governor.h
+ *
+ * Common part of the demand based switching (dbs) governors: ondemand,
+ * conservative, lazy, wheatley and hotplug.
+ *
+ * Copyright (C)  2001 Russell King
+ *            (C)  2003 Venkatesh Pallipadi <venkatesh.pallipadi@intel.com>.
+ *                      Jun Nakajima <jun.nakajima@intel.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef _CPUFREQ_GOVERNOR_H
+#define _CPUFREQ_GOVERNOR_H
+
+#include <linux/cpufreq.h>
+#include <linux/kernel.h>
+#include <linux/mutex.h>
+#include <linux/sysfs.h>
+#include <linux/workqueue.h>
+
+/*
+ * The polling frequency of these governors depends on the capability of
+ * the processor. Default polling frequency is 1000 times the transition
+ * latency of the processor. The governors will work on any processor with
+ * transition latency <= 10mS, using appropriate sampling rate.
+ * For CPUs with transition latency > 10mS (mostly drivers with
+ * CPUFREQ_ETERNAL) they will not work.
+ * All times here are in uS.
+ */
+#define MIN_SAMPLING_RATE_RATIO			(2)
+#define LATENCY_MULTIPLIER			(1000)
+#define MIN_LATENCY_MULTIPLIER			(100)
+#define TRANSITION_LATENCY_LIMIT		(10 * 1000 * 1000)
+
+/* Tunables the core itself uses, shown in the governor's sysfs group */
+struct dbs_tuners {
+	unsigned int sampling_rate;
+	unsigned int ignore_nice;
+	unsigned int io_is_busy;
+};
+
+/*
+ * One per policy, i.e. per group of CPUs sharing a clock: a single
+ * deferrable work on policy->cpu samples all of them, so an idle cluster
+ * costs one wakeup per sampling period at most.  Governors that keep
+ * state per policy embed this at the start of their own structure and
+ * set dbs_governor.policy_size.
+ */
+struct dbs_policy {
+	struct cpufreq_policy *policy;
+	struct dbs_governor *gov;
+	struct cpufreq_frequency_table *freq_table;
+	unsigned int cpu;
+	struct delayed_work work;
+	/*
+	 * Serializes governor limit change with the sampling work. We do
+	 * not want the governor to sample when the user is changing the
+	 * governor or limits.
+	 */
+	struct mutex timer_mutex;
+
+	/* Filled by dbs_update_load(), loads in percent */
+	unsigned int max_load;		/* busiest CPU */
+	unsigned int total_load;	/* sum over the policy's CPUs */
+	unsigned int max_load_freq;	/* highest load * average kHz */
+};
+
+struct dbs_governor {
+	struct attribute_group *attr_group;
+	struct workqueue_struct *wq;	/* NULL for the system workqueue */
+	size_t policy_size;		/* 0 for sizeof(struct dbs_policy) */
+	struct dbs_tuners tuners;
+	unsigned int min_sampling_rate;
+
+	/*
+	 * Called with mutex held when the first policy starts using the
+	 * governor, before its sysfs group is created, and when the last
+	 * one stops.  Both optional.
+	 */
+	int (*init)(struct dbs_governor *dg, struct cpufreq_policy *policy);
+	void (*exit)(struct dbs_governor *dg);
+	/* Optional, sets up the governor's part of a new dbs_policy */
+	void (*start)(struct dbs_policy *dp);
+	/*
+	 * The decision: called from the sampling work with timer_mutex
+	 * held, measures with dbs_update_load() if it wants a sample, sets
+	 * the speed and returns the number of jiffies until the next call.
+	 */
+	unsigned long (*check)(struct dbs_policy *dp);
+
+	/* Protects enable, the per-cpu policy pointers and the tuners */
+	struct mutex mutex;
+	unsigned int enable;		/* number of policies using it */
+};
+
+#define DBS_GOVERNOR_INIT(_name)	.mutex = __MUTEX_INITIALIZER(_name.mutex)
+
+extern int cpufreq_governor_dbs(struct dbs_governor *dg,
+				struct cpufreq_policy *policy,
+				unsigned int event);
+extern struct dbs_policy *dbs_get_policy(struct dbs_governor *dg,
+					 unsigned int cpu);
+extern void dbs_update_load(struct dbs_policy *dp);
+extern unsigned long dbs_sample_delay(unsigned int usecs);
+extern void dbs_init_sampling_rate(struct dbs_governor *dg,
+				   struct cpufreq_policy *policy);
+extern bool dbs_idle_micro_accounting(void);
+extern int dbs_should_io_be_busy(void);
+
+extern ssize_t dbs_show_sampling_rate_min(struct dbs_governor *dg, char *buf);
+extern ssize_t dbs_show_sampling_rate(struct dbs_governor *dg, char *buf);
+extern ssize_t dbs_store_sampling_rate(struct dbs_governor *dg,
+				       const char *buf, size_t count);
+extern ssize_t dbs_show_ignore_nice_load(struct dbs_governor *dg, char *buf);
+extern ssize_t dbs_store_ignore_nice_load(struct dbs_governor *dg,
+					  const char *buf, size_t count);
+extern ssize_t dbs_show_io_is_busy(struct dbs_governor *dg, char *buf);
+extern ssize_t dbs_store_io_is_busy(struct dbs_governor *dg,
+				    const char *buf, size_t count);
+
+/*
+ * Global sysfs attributes for the common tunables of governor _dg:
+ * dbs_attr_rw(od_dbs, sampling_rate) defines sampling_rate.attr for the
+ * governor's attribute group.
+ */
+#define dbs_attr_ro(_dg, _name)						\
+static ssize_t show_##_name(struct kobject *kobj,			\
+			    struct attribute *attr, char *buf)		\
+{									\
+	return dbs_show_##_name(&_dg, buf);				\
+}									\
+define_one_global_ro(_name)
+
+#define dbs_attr_rw(_dg, _name)						\
+static ssize_t show_##_name(struct kobject *kobj,			\
+			    struct attribute *attr, char *buf)		\
+{									\
+	return dbs_show_##_name(&_dg, buf);				\
+}									\
+static ssize_t store_##_name(struct kobject *kobj,			\
+			     struct attribute *attr, const char *buf,	\
+			     size_t count)				\
+{									\
+	return dbs_store_##_name(&_dg, buf, count);			\
+}									\
+define_one_global_rw(_name)
+
+#endif /* _CPUFREQ_GOVERNOR_H */
@@ -17,17 +17,14 @@
 #include <linux/cpufreq.h>
 #include <linux/cpu.h>
 #include <linux/jiffies.h>
-#include <linux/kernel_stat.h>
 #include <linux/mutex.h>
-#include <linux/hrtimer.h>
-#include <linux/tick.h>
-#include <linux/ktime.h>
-#include <linux/sched.h>
 
 #ifdef CONFIG_HAS_EARLYSUSPEND
 #include <linux/earlysuspend.h>
 #endif
 
+#include "cpufreq_governor.h"
+
 /*
  * dbs is used in this file as a shortform for demandbased switching
  * It helps to keep variable names smaller, simpler
@@ -42,34 +39,15 @@
 #define MIN_FREQUENCY_UP_THRESHOLD		(11)
 #define MAX_FREQUENCY_UP_THRESHOLD		(100)
 
-/*
- * The polling frequency of this governor depends on the capability of
- * the processor. Default polling frequency is 1000 times the transition
- * latency of the processor. The governor will work on any processor with
- * transition latency <= 10mS, using appropriate sampling
- * rate.
- * For CPUs with transition latency > 10mS (mostly drivers with CPUFREQ_ETERNAL)
- * this governor will not work.
- * All times here are in uS.
- */
-#define MIN_SAMPLING_RATE_RATIO			(2)
-
-static unsigned int min_sampling_rate, current_sampling_rate;
-
-#define LATENCY_MULTIPLIER			(1000)
-#define MIN_LATENCY_MULTIPLIER			(100)
-#define TRANSITION_LATENCY_LIMIT		(10 * 1000 * 1000)
-
-static void do_dbs_timer(struct work_struct *work);
-static int cpufreq_governor_dbs(struct cpufreq_policy *policy,
-				unsigned int event);
+static int lz_cpufreq_governor_dbs(struct cpufreq_policy *policy,
+				   unsigned int event);
 
 #ifndef CONFIG_CPU_FREQ_DEFAULT_GOV_LAZY
 static
 #endif
 struct cpufreq_governor cpufreq_gov_lazy = {
     .name                   = "lazy",
-    .governor               = cpufreq_governor_dbs,
+    .governor               = lz_cpufreq_governor_dbs,
     .max_transition_latency = TRANSITION_LATENCY_LIMIT,
     .owner                  = THIS_MODULE,
 };
@@ -77,50 +55,34 @@ struct cpufreq_governor cpufreq_gov_lazy = {
 /* Sampling types */
 enum {DBS_NORMAL_SAMPLE, DBS_SUB_SAMPLE};
 
-struct cpu_dbs_info_s {
-    cputime64_t prev_cpu_idle;
-    cputime64_t prev_cpu_iowait;
-    cputime64_t prev_cpu_wall;
-    cputime64_t prev_cpu_nice;
-    struct cpufreq_policy *cur_policy;
-    struct delayed_work work;
-    struct cpufreq_frequency_table *freq_table;
+struct lz_policy {
+    struct dbs_policy dbs;
     unsigned int freq_lo;
     unsigned int freq_lo_jiffies;
     unsigned int freq_hi_jiffies;
-    int cpu;
+    /* sampling_rate, or min_timeinstate right after a speed change */
+    unsigned int current_sampling_rate;
     unsigned int sample_type:1;
-    /*
-     * percpu mutex that serializes governor limit change with
-     * do_dbs_timer invocation. We do not want do_dbs_timer to run
-     * when user is changing the governor or limits.
-     */
-    struct mutex timer_mutex;
 };
-static DEFINE_PER_CPU(struct cpu_dbs_info_s, od_cpu_dbs_info);
 
-static unsigned int dbs_enable;	/* number of CPUs using this policy */
+static inline struct lz_policy *to_lz_policy(struct dbs_policy *dp)
+{
+    return container_of(dp, struct lz_policy, dbs);
+}
 
-/*
- * dbs_mutex protects protects dbs_enable in governor start/stop.
- */
-static DEFINE_MUTEX(dbs_mutex);
+static struct dbs_governor lz_dbs;
 
-static struct dbs_tuners {
-    unsigned int sampling_rate;
+static struct lz_tuners {
     unsigned int up_threshold;
     unsigned int down_differential;
-    unsigned int ignore_nice;
     unsigned int powersave_bias;
-    unsigned int io_is_busy;
     unsigned int min_timeinstate;
 #ifdef CONFIG_HAS_EARLYSUSPEND
     bool screenoff_maxfreq;
 #endif
-} dbs_tuners_ins = {
+} lz_tuners = {
     .up_threshold = DEF_FREQUENCY_UP_THRESHOLD,
     .down_differential = DEF_FREQUENCY_DOWN_DIFFERENTIAL,
-    .ignore_nice = 0,
     .powersave_bias = 0,
 #ifdef CONFIG_HAS_EARLYSUSPEND
     .screenoff_maxfreq = false,
@@ -151,55 +113,12 @@ static struct early_suspend lazy_suspend = {
 };
 #endif
 
-static inline cputime64_t get_cpu_idle_time_jiffy(unsigned int cpu,
-						  cputime64_t *wall)
-{
-    cputime64_t idle_time;
-    cputime64_t cur_wall_time;
-    cputime64_t busy_time;
-
-    cur_wall_time = jiffies64_to_cputime64(get_jiffies_64());
-    busy_time = cputime64_add(kstat_cpu(cpu).cpustat.user,
-			      kstat_cpu(cpu).cpustat.system);
-
-    busy_time = cputime64_add(busy_time, kstat_cpu(cpu).cpustat.irq);
-    busy_time = cputime64_add(busy_time, kstat_cpu(cpu).cpustat.softirq);
-    busy_time = cputime64_add(busy_time, kstat_cpu(cpu).cpustat.steal);
-    busy_time = cputime64_add(busy_time, kstat_cpu(cpu).cpustat.nice);
-
-    idle_time = cputime64_sub(cur_wall_time, busy_time);
-    if (wall)
-	*wall = (cputime64_t)jiffies_to_usecs(cur_wall_time);
-
-    return (cputime64_t)jiffies_to_usecs(idle_time);
-}
-
-static inline cputime64_t get_cpu_idle_time(unsigned int cpu, cputime64_t *wall)
-{
-    u64 idle_time = get_cpu_idle_time_us(cpu, wall);
-
-    if (idle_time == -1ULL)
-	return get_cpu_idle_time_jiffy(cpu, wall);
-
-    return idle_time;
-}
-
-static inline cputime64_t get_cpu_iowait_time(unsigned int cpu, cputime64_t *wall)
-{
-    u64 iowait_time = get_cpu_iowait_time_us(cpu, wall);
-
-    if (iowait_time == -1ULL)
-	return 0;
-
-    return iowait_time;
-}
-
 /*
  * Find right freq to be set now with powersave_bias on.
  * Returns the freq_hi to be used right now and will set freq_hi_jiffies,
- * freq_lo, and freq_lo_jiffies in percpu area for averaging freqs.
+ * freq_lo, and freq_lo_jiffies in the policy for averaging freqs.
  */
-static unsigned int powersave_bias_target(struct cpufreq_policy *policy,
+static unsigned int powersave_bias_target(struct lz_policy *lp,
 					  unsigned int freq_next,
 					  unsigned int relation)
 {
@@ -207,114 +126,99 @@ static unsigned int powersave_bias_target(struct cpufreq_policy *policy,
     unsigned int freq_hi, freq_lo;
     unsigned int index = 0;
     unsigned int jiffies_total, jiffies_hi, jiffies_lo;
-    struct cpu_dbs_info_s *dbs_info = &per_cpu(od_cpu_dbs_info,
-					       policy->cpu);
+    struct cpufreq_policy *policy = lp->dbs.policy;
+    struct cpufreq_frequency_table *freq_table = lp->dbs.freq_table;
 
-    if (!dbs_info->freq_table) {
-	dbs_info->freq_lo = 0;
-	dbs_info->freq_lo_jiffies = 0;
+    if (!freq_table) {
+	lp->freq_lo = 0;
+	lp->freq_lo_jiffies = 0;
 	return freq_next;
     }
 
-    cpufreq_frequency_table_target(policy, dbs_info->freq_table, freq_next,
+    cpufreq_frequency_table_target(policy, freq_table, freq_next,
 				   relation, &index);
-    freq_req = dbs_info->freq_table[index].frequency;
-    freq_reduc = freq_req * dbs_tuners_ins.powersave_bias / 1000;
+    freq_req = freq_table[index].frequency;
+    freq_reduc = freq_req * lz_tuners.powersave_bias / 1000;
     freq_avg = freq_req - freq_reduc;
 
     /* Find freq bounds for freq_avg in freq_table */
     index = 0;
-    cpufreq_frequency_table_target(policy, dbs_info->freq_table, freq_avg,
+    cpufreq_frequency_table_target(policy, freq_table, freq_avg,
 				   CPUFREQ_RELATION_H, &index);
-    freq_lo = dbs_info->freq_table[index].frequency;
+    freq_lo = freq_table[index].frequency;
     index = 0;
-    cpufreq_frequency_table_target(policy, dbs_info->freq_table, freq_avg,
+    cpufreq_frequency_table_target(policy, freq_table, freq_avg,
 				   CPUFREQ_RELATION_L, &index);
-    freq_hi = dbs_info->freq_table[index].frequency;
+    freq_hi = freq_table[index].frequency;
 
     /* Find out how long we have to be in hi and lo freqs */
     if (freq_hi == freq_lo) {
-	dbs_info->freq_lo = 0;
-	dbs_info->freq_lo_jiffies = 0;
+	lp->freq_lo = 0;
+	lp->freq_lo_jiffies = 0;
 	return freq_lo;
     }
-    jiffies_total = usecs_to_jiffies(current_sampling_rate);
+    jiffies_total = usecs_to_jiffies(lp->current_sampling_rate);
     jiffies_hi = (freq_avg - freq_lo) * jiffies_total;
     jiffies_hi += ((freq_hi - freq_lo) / 2);
     jiffies_hi /= (freq_hi - freq_lo);
     jiffies_lo = jiffies_total - jiffies_hi;
-    dbs_info->freq_lo = freq_lo;
-    dbs_info->freq_lo_jiffies = jiffies_lo;
-    dbs_info->freq_hi_jiffies = jiffies_hi;
+    lp->freq_lo = freq_lo;
+    lp->freq_lo_jiffies = jiffies_lo;
+    lp->freq_hi_jiffies = jiffies_hi;
     return freq_hi;
 }
 
-static void lazy_powersave_bias_init_cpu(int cpu)
-{
-    struct cpu_dbs_info_s *dbs_info = &per_cpu(od_cpu_dbs_info, cpu);
-    dbs_info->freq_table = cpufreq_frequency_get_table(cpu);
-    dbs_info->freq_lo = 0;
-}
-
-static void lazy_powersave_bias_init(void)
+/* Drop any powersave_bias averaging in effect */
+static void lazy_reset_policies(void)
 {
+    struct dbs_policy *dp;
     int i;
+
+    mutex_lock(&lz_dbs.mutex);
     for_each_online_cpu(i) {
-	lazy_powersave_bias_init_cpu(i);
+	dp = dbs_get_policy(&lz_dbs, i);
+	if (dp)
+	    to_lz_policy(dp)->freq_lo = 0;
     }
+    mutex_unlock(&lz_dbs.mutex);
 }
 
 /************************** sysfs interface ************************/
 
-static ssize_t show_sampling_rate_min(struct kobject *kobj,
-				      struct attribute *attr, char *buf)
-{
-    return sprintf(buf, "%u\n", min_sampling_rate);
-}
-
-define_one_global_ro(sampling_rate_min);
+dbs_attr_ro(lz_dbs, sampling_rate_min);
+dbs_attr_rw(lz_dbs, io_is_busy);
+dbs_attr_rw(lz_dbs, ignore_nice_load);
 
 /* cpufreq_lazy Governor Tunables */
 #define show_one(file_name, object)				\
     static ssize_t show_##file_name				\
     (struct kobject *kobj, struct attribute *attr, char *buf)	\
     {								\
-	return sprintf(buf, "%u\n", dbs_tuners_ins.object);	\
+	return sprintf(buf, "%u\n", lz_tuners.object);		\
     }
-show_one(sampling_rate, sampling_rate);
-show_one(io_is_busy, io_is_busy);
 show_one(up_threshold, up_threshold);
-show_one(ignore_nice_load, ignore_nice);
 show_one(powersave_bias, powersave_bias);
 show_one(min_timeinstate, min_timeinstate);
 #ifdef CONFIG_HAS_EARLYSUSPEND
 show_one(screenoff_maxfreq, screenoff_maxfreq);
 #endif
 
-static ssize_t store_sampling_rate(struct kobject *a, struct attribute *b,
-				   const char *buf, size_t count)
+static ssize_t show_sampling_rate(struct kobject *kobj,
+				  struct attribute *attr, char *buf)
 {
-    unsigned int input;
-    int ret;
-    ret = sscanf(buf, "%u", &input);
-    if (ret != 1)
-	return -EINVAL;
-    dbs_tuners_ins.sampling_rate = max(input, min_sampling_rate);
-    dbs_tuners_ins.min_timeinstate = max(dbs_tuners_ins.min_timeinstate, dbs_tuners_ins.sampling_rate);
-    return count;
+    return dbs_show_sampling_rate(&lz_dbs, buf);
 }
 
-static ssize_t store_io_is_busy(struct kobject *a, struct attribute *b,
-				const char *buf, size_t count)
+static ssize_t store_sampling_rate(struct kobject *a, struct attribute *b,
+				   const char *buf, size_t count)
 {
-    unsigned int input;
-    int ret;
+    ssize_t ret = dbs_store_sampling_rate(&lz_dbs, buf, count);
 
-    ret = sscanf(buf, "%u", &input);
-    if (ret != 1)
-	return -EINVAL;
-    dbs_tuners_ins.io_is_busy = !!input;
-    return count;
+    if (ret < 0)
+	return ret;
+    lz_tuners.min_timeinstate = max(lz_tuners.min_timeinstate,
+				    lz_dbs.tuners.sampling_rate);
+    return ret;
 }
 
 static ssize_t store_up_threshold(struct kobject *a, struct attribute *b,
@@ -328,41 +232,7 @@ static ssize_t store_up_threshold(struct kobject *a, struct attribute *b,
 	input < MIN_FREQUENCY_UP_THRESHOLD) {
 	return -EINVAL;
     }
-    dbs_tuners_ins.up_threshold = input;
-    return count;
-}
-
-static ssize_t store_ignore_nice_load(struct kobject *a, struct attribute *b,
-				      const char *buf, size_t count)
-{
-    unsigned int input;
-    int ret;
-
-    unsigned int j;
-
-    ret = sscanf(buf, "%u", &input);
-    if (ret != 1)
-	return -EINVAL;
-
-    if (input > 1)
-	input = 1;
-
-    if (input == dbs_tuners_ins.ignore_nice) { /* nothing to do */
-	mutex_unlock(&dbs_mutex);
-	return count;
-    }
-    dbs_tuners_ins.ignore_nice = input;
-
-    /* we need to re-evaluate prev_cpu_idle */
-    for_each_online_cpu(j) {
-	struct cpu_dbs_info_s *dbs_info;
-	dbs_info = &per_cpu(od_cpu_dbs_info, j);
-	dbs_info->prev_cpu_idle = get_cpu_idle_time(j,
-						    &dbs_info->prev_cpu_wall);
-	if (dbs_tuners_ins.ignore_nice)
-	    dbs_info->prev_cpu_nice = kstat_cpu(j).cpustat.nice;
-
-    }
+    lz_tuners.up_threshold = input;
     return count;
 }
 
@@ -379,8 +249,8 @@ static ssize_t store_powersave_bias(struct kobject *a, struct attribute *b,
     if (input > 1000)
 	input = 1000;
 
-    dbs_tuners_ins.powersave_bias = input;
-    lazy_powersave_bias_init();
+    lz_tuners.powersave_bias = input;
+    lazy_reset_policies();
     return count;
 }
 
@@ -392,7 +262,7 @@ static ssize_t store_min_timeinstate(struct kobject *a, struct attribute *b,
     ret = sscanf(buf, "%u", &input);
     if (ret != 1)
 	return -EINVAL;
-    dbs_tuners_ins.min_timeinstate = max(input, dbs_tuners_ins.sampling_rate);
+    lz_tuners.min_timeinstate = max(input, lz_dbs.tuners.sampling_rate);
     return count;
 }
 
@@ -405,15 +275,13 @@ static ssize_t store_screenoff_maxfreq(struct kobject *a, struct attribute *b,
     ret = sscanf(buf, "%u", &input);
     if (ret != 1 || input > 1)
 	return -EINVAL;
-    dbs_tuners_ins.screenoff_maxfreq = input;
+    lz_tuners.screenoff_maxfreq = input;
     return count;
 }
 #endif
 
 define_one_global_rw(sampling_rate);
-define_one_global_rw(io_is_busy);
 define_one_global_rw(up_threshold);
-define_one_global_rw(ignore_nice_load);
 define_one_global_rw(powersave_bias);
 define_one_global_rw(min_timeinstate);
 #ifdef CONFIG_HAS_EARLYSUSPEND
@@ -441,34 +309,30 @@ static struct attribute_group dbs_attr_group = {
 
 /************************** sysfs end ************************/
 
-static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
+static void dbs_check_cpu(struct lz_policy *lp)
 {
+    struct cpufreq_policy *policy = lp->dbs.policy;
     unsigned int max_load_freq;
 
-    struct cpufreq_policy *policy;
-    unsigned int j;
-
-    this_dbs_info->freq_lo = 0;
-    policy = this_dbs_info->cur_policy;
-
-    current_sampling_rate = dbs_tuners_ins.sampling_rate;
+    lp->freq_lo = 0;
+    lp->current_sampling_rate = lz_dbs.tuners.sampling_rate;
 
 #ifdef CONFIG_HAS_EARLYSUSPEND
-    if (suspended && dbs_tuners_ins.screenoff_maxfreq) {
+    if (suspended && lz_tuners.screenoff_maxfreq) {
 	/* if we are already at full speed then break out early */
-	if (!dbs_tuners_ins.powersave_bias) {
+	if (!lz_tuners.powersave_bias) {
 	    if (policy->cur == policy->max)
 		return;
 
 	    __cpufreq_driver_target(policy, policy->max,
 				    CPUFREQ_RELATION_H);
 	} else {
-	    int freq = powersave_bias_target(policy, policy->max,
+	    int freq = powersave_bias_target(lp, policy->max,
 					     CPUFREQ_RELATION_H);
 	    __cpufreq_driver_target(policy, freq,
 				    CPUFREQ_RELATION_L);
 	}
-	current_sampling_rate = dbs_tuners_ins.min_timeinstate;
+	lp->current_sampling_rate = lz_tuners.min_timeinstate;
 	return;
     }
 #endif
@@ -486,89 +350,25 @@ static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
      */
 
     /* Get Absolute Load - in terms of freq */
-    max_load_freq = 0;
-
-    for_each_cpu(j, policy->cpus) {
-	struct cpu_dbs_info_s *j_dbs_info;
-	cputime64_t cur_wall_time, cur_idle_time, cur_iowait_time;
-	unsigned int idle_time, wall_time, iowait_time;
-	unsigned int load, load_freq;
-	int freq_avg;
-
-	j_dbs_info = &per_cpu(od_cpu_dbs_info, j);
-
-	cur_idle_time = get_cpu_idle_time(j, &cur_wall_time);
-	cur_iowait_time = get_cpu_iowait_time(j, &cur_wall_time);
-
-	wall_time = (unsigned int) cputime64_sub(cur_wall_time,
-						 j_dbs_info->prev_cpu_wall);
-	j_dbs_info->prev_cpu_wall = cur_wall_time;
-
-	idle_time = (unsigned int) cputime64_sub(cur_idle_time,
-						 j_dbs_info->prev_cpu_idle);
-	j_dbs_info->prev_cpu_idle = cur_idle_time;
-
-	iowait_time = (unsigned int) cputime64_sub(cur_iowait_time,
-						   j_dbs_info->prev_cpu_iowait);
-	j_dbs_info->prev_cpu_iowait = cur_iowait_time;
-
-	if (dbs_tuners_ins.ignore_nice) {
-	    cputime64_t cur_nice;
-	    unsigned long cur_nice_jiffies;
-
-	    cur_nice = cputime64_sub(kstat_cpu(j).cpustat.nice,
-				     j_dbs_info->prev_cpu_nice);
-	    /*
-	     * Assumption: nice time between sampling periods will
-	     * be less than 2^32 jiffies for 32 bit sys
-	     */
-	    cur_nice_jiffies = (unsigned long)
-		cputime64_to_jiffies64(cur_nice);
-
-	    j_dbs_info->prev_cpu_nice = kstat_cpu(j).cpustat.nice;
-	    idle_time += jiffies_to_usecs(cur_nice_jiffies);
-	}
-
-	/*
-	 * For the purpose of lazy, waiting for disk IO is an
-	 * indication that you're performance critical, and not that
-	 * the system is actually idle. So subtract the iowait time
-	 * from the cpu idle time.
-	 */
-
-	if (dbs_tuners_ins.io_is_busy && idle_time >= iowait_time)
-	    idle_time -= iowait_time;
-
-	if (unlikely(!wall_time || wall_time < idle_time))
-	    continue;
-
-	load = 100 * (wall_time - idle_time) / wall_time;
-
-	freq_avg = __cpufreq_driver_getavg(policy, j);
-	if (freq_avg <= 0)
-	    freq_avg = policy->cur;
-
-	load_freq = load * freq_avg;
-	if (load_freq > max_load_freq)
-	    max_load_freq = load_freq;
-    }
+    dbs_update_load(&lp->dbs);
+    max_load_freq = lp->dbs.max_load_freq;
 
     /* Check for frequency increase */
-    if (max_load_freq > dbs_tuners_ins.up_threshold * policy->cur) {
+    if (max_load_freq > lz_tuners.up_threshold * policy->cur) {
 	/* if we are already at full speed then break out early */
-	if (!dbs_tuners_ins.powersave_bias) {
+	if (!lz_tuners.powersave_bias) {
 	    if (policy->cur == policy->max)
 		return;
 
 	    __cpufreq_driver_target(policy, policy->max,
 				    CPUFREQ_RELATION_H);
 	} else {
-	    int freq = powersave_bias_target(policy, policy->max,
+	    int freq = powersave_bias_target(lp, policy->max,
 					     CPUFREQ_RELATION_H);
 	    __cpufreq_driver_target(policy, freq,
 				    CPUFREQ_RELATION_L);
 	}
-	current_sampling_rate = dbs_tuners_ins.min_timeinstate;
+	lp->current_sampling_rate = lz_tuners.min_timeinstate;
 	return;
     }
 
@@ -583,216 +383,101 @@ static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
      * policy. To be safe, we focus 10 points under the threshold.
      */
     if (max_load_freq <
-	(dbs_tuners_ins.up_threshold - dbs_tuners_ins.down_differential) *
+	(lz_tuners.up_threshold - lz_tuners.down_differential) *
 	policy->cur) {
 	unsigned int freq_next;
 	freq_next = max_load_freq /
-	    (dbs_tuners_ins.up_threshold -
-	     dbs_tuners_ins.down_differential);
+	    (lz_tuners.up_threshold -
+	     lz_tuners.down_differential);
 
 	if (freq_next < policy->min)
 	    freq_next = policy->min;
 
-	if (!dbs_tuners_ins.powersave_bias) {
+	if (!lz_tuners.powersave_bias) {
 	    __cpufreq_driver_target(policy, freq_next,
 				    CPUFREQ_RELATION_L);
 	} else {
-	    int freq = powersave_bias_target(policy, freq_next,
+	    int freq = powersave_bias_target(lp, freq_next,
 					     CPUFREQ_RELATION_L);
 	    __cpufreq_driver_target(policy, freq,
 				    CPUFREQ_RELATION_L);
 	}
-	current_sampling_rate = dbs_tuners_ins.min_timeinstate;
+	lp->current_sampling_rate = lz_tuners.min_timeinstate;
     }
 }
 
-static void do_dbs_timer(struct work_struct *work)
+static unsigned long lz_check(struct dbs_policy *dp)
 {
-    struct cpu_dbs_info_s *dbs_info =
-	container_of(work, struct cpu_dbs_info_s, work.work);
-    unsigned int cpu = dbs_info->cpu;
-    int delay;
-    int sample_type = dbs_info->sample_type;
-
-    mutex_lock(&dbs_info->timer_mutex);
+    struct lz_policy *lp = to_lz_policy(dp);
+    int sample_type = lp->sample_type;
 
     /* Common NORMAL_SAMPLE setup */
-    dbs_info->sample_type = DBS_NORMAL_SAMPLE;
-    if (!dbs_tuners_ins.powersave_bias ||
+    lp->sample_type = DBS_NORMAL_SAMPLE;
+    if (!lz_tuners.powersave_bias ||
 	sample_type == DBS_NORMAL_SAMPLE) {
-	dbs_check_cpu(dbs_info);
-	if (dbs_info->freq_lo) {
+	dbs_check_cpu(lp);
+	if (lp->freq_lo) {
 	    /* Setup timer for SUB_SAMPLE */
-	    dbs_info->sample_type = DBS_SUB_SAMPLE;
-	    delay = dbs_info->freq_hi_jiffies;
-	} else {
-	    delay = usecs_to_jiffies(current_sampling_rate);
-	    if (num_online_cpus() > 1)
-		delay -= jiffies % delay;
+	    lp->sample_type = DBS_SUB_SAMPLE;
+	    return lp->freq_hi_jiffies;
 	}
     } else {
-	__cpufreq_driver_target(dbs_info->cur_policy,
-				dbs_info->freq_lo, CPUFREQ_RELATION_H);
-	delay = usecs_to_jiffies(current_sampling_rate);
-	if (num_online_cpus() > 1)
-	    delay -= jiffies % delay;
+	__cpufreq_driver_target(dp->policy, lp->freq_lo,
+				CPUFREQ_RELATION_H);
     }
-    schedule_delayed_work_on(cpu, &dbs_info->work, delay);
-    mutex_unlock(&dbs_info->timer_mutex);
+    return dbs_sample_delay(lp->current_sampling_rate);
 }
 
-static inline void dbs_timer_init(struct cpu_dbs_info_s *dbs_info)
+static int lz_init(struct dbs_governor *dg, struct cpufreq_policy *policy)
 {
-    /* We want all CPUs to do sampling nearly on same jiffy */
-    int delay = usecs_to_jiffies(current_sampling_rate);
-    delay -= jiffies % delay;
-
-    dbs_info->sample_type = DBS_NORMAL_SAMPLE;
-    INIT_DELAYED_WORK_DEFERRABLE(&dbs_info->work, do_dbs_timer);
-    schedule_delayed_work_on(dbs_info->cpu, &dbs_info->work, delay);
+    /* latency based default, kept as the floor for min_timeinstate */
+    dbs_init_sampling_rate(dg, policy);
+    lz_tuners.min_timeinstate = dg->tuners.sampling_rate;
+
+    dg->tuners.sampling_rate = max(dg->min_sampling_rate,
+				   (unsigned int)DEF_SAMPLE_RATE);
+    lz_tuners.min_timeinstate = max(dg->tuners.sampling_rate,
+				    lz_tuners.min_timeinstate);
+    dg->tuners.io_is_busy = dbs_should_io_be_busy();
+    return 0;
 }
 
-static inline void dbs_timer_exit(struct cpu_dbs_info_s *dbs_info)
+static void lz_start(struct dbs_policy *dp)
 {
-    cancel_delayed_work_sync(&dbs_info->work);
+    to_lz_policy(dp)->current_sampling_rate = lz_dbs.tuners.sampling_rate;
 }
 
-/*
- * Not all CPUs want IO time to be accounted as busy; this dependson how
- * efficient idling at a higher frequency/voltage is.
- * Pavel Machek says this is not so for various generations of AMD and old
- * Intel systems.
- * Mike Chan (androidlcom) calis this is also not true for ARM.
- * Because of this, whitelist specific known (series) of CPUs by default, and
- * leave all others up to the user.
- */
-static int should_io_be_busy(void)
-{
-#if defined(CONFIG_X86)
-    /*
-     * For Intel, Core 2 (model 15) andl later have an efficient idle.
-     */
-    if (boot_cpu_data.x86_vendor == X86_VENDOR_INTEL &&
-	boot_cpu_data.x86 == 6 &&
-	boot_cpu_data.x86_model >= 15)
-	return 1;
-#endif
-    return 0;
-}
+static struct dbs_governor lz_dbs = {
+    DBS_GOVERNOR_INIT(lz_dbs),
+    .attr_group		= &dbs_attr_group,
+    .policy_size	= sizeof(struct lz_policy),
+    .init		= lz_init,
+    .start		= lz_start,
+    .check		= lz_check,
+};
 
-static int cpufreq_governor_dbs(struct cpufreq_policy *policy,
-				unsigned int event)
+static int lz_cpufreq_governor_dbs(struct cpufreq_policy *policy,
+				   unsigned int event)
 {
-    unsigned int cpu = policy->cpu;
-    struct cpu_dbs_info_s *this_dbs_info;
-    unsigned int j;
-    int rc;
-
-    this_dbs_info = &per_cpu(od_cpu_dbs_info, cpu);
-
-    switch (event) {
-    case CPUFREQ_GOV_START:
-	if ((!cpu_online(cpu)) || (!policy->cur))
-	    return -EINVAL;
-
-	mutex_lock(&dbs_mutex);
-
-	dbs_enable++;
-	for_each_cpu(j, policy->cpus) {
-	    struct cpu_dbs_info_s *j_dbs_info;
-	    j_dbs_info = &per_cpu(od_cpu_dbs_info, j);
-	    j_dbs_info->cur_policy = policy;
-
-	    j_dbs_info->prev_cpu_idle = get_cpu_idle_time(j,
-							  &j_dbs_info->prev_cpu_wall);
-	    if (dbs_tuners_ins.ignore_nice) {
-		j_dbs_info->prev_cpu_nice =
-		    kstat_cpu(j).cpustat.nice;
-	    }
-	}
-	this_dbs_info->cpu = cpu;
-	lazy_powersave_bias_init_cpu(cpu);
-	/*
-	 * Start the timerschedule work, when this governor
-	 * is used for first time
-	 */
-	if (dbs_enable == 1) {
-	    unsigned int latency;
-
-	    rc = sysfs_create_group(cpufreq_global_kobject,
-				    &dbs_attr_group);
-	    if (rc) {
-		mutex_unlock(&dbs_mutex);
-		return rc;
-	    }
-
-	    /* policy latency is in nS. Convert it to uS first */
-	    latency = policy->cpuinfo.transition_latency / 1000;
-	    if (latency == 0)
-		latency = 1;
-	    /* Bring kernel and HW constraints together */
-	    min_sampling_rate = max(min_sampling_rate, MIN_LATENCY_MULTIPLIER * latency);
-	    dbs_tuners_ins.sampling_rate = max(min_sampling_rate, DEF_SAMPLE_RATE);
-	    current_sampling_rate = dbs_tuners_ins.sampling_rate;
-	    dbs_tuners_ins.min_timeinstate = latency * LATENCY_MULTIPLIER;
-	    dbs_tuners_ins.min_timeinstate = max(dbs_tuners_ins.sampling_rate, dbs_tuners_ins.min_timeinstate);
-	    dbs_tuners_ins.io_is_busy = should_io_be_busy();
-	}
-	mutex_unlock(&dbs_mutex);
-
-	mutex_init(&this_dbs_info->timer_mutex);
-	dbs_timer_init(this_dbs_info);
-	break;
-
-    case CPUFREQ_GOV_STOP:
-	dbs_timer_exit(this_dbs_info);
-
-	mutex_lock(&dbs_mutex);
-	mutex_destroy(&this_dbs_info->timer_mutex);
-	dbs_enable--;
-	mutex_unlock(&dbs_mutex);
-	if (!dbs_enable)
-	    sysfs_remove_group(cpufreq_global_kobject,
-			       &dbs_attr_group);
-
-	break;
-
-    case CPUFREQ_GOV_LIMITS:
-	mutex_lock(&this_dbs_info->timer_mutex);
-	if (policy->max < this_dbs_info->cur_policy->cur)
-	    __cpufreq_driver_target(this_dbs_info->cur_policy,
-				    policy->max, CPUFREQ_RELATION_H);
-	else if (policy->min > this_dbs_info->cur_policy->cur)
-	    __cpufreq_driver_target(this_dbs_info->cur_policy,
-				    policy->min, CPUFREQ_RELATION_L);
-	mutex_unlock(&this_dbs_info->timer_mutex);
-	break;
-    }
-    return 0;
+    return cpufreq_governor_dbs(&lz_dbs, policy, event);
 }
 
 static int __init cpufreq_gov_dbs_init(void)
 {
-    cputime64_t wall;
-    u64 idle_time;
-    int cpu = get_cpu();
-
-    idle_time = get_cpu_idle_time_us(cpu, &wall);
-    put_cpu();
-    if (idle_time != -1ULL) {
+    if (dbs_idle_micro_accounting()) {
 	/* Idle micro accounting is supported. Use finer thresholds */
-	dbs_tuners_ins.up_threshold = MICRO_FREQUENCY_UP_THRESHOLD;
-	dbs_tuners_ins.down_differential =
+	lz_tuners.up_threshold = MICRO_FREQUENCY_UP_THRESHOLD;
+	lz_tuners.down_differential =
 	    MICRO_FREQUENCY_DOWN_DIFFERENTIAL;
 	/*
 	 * In no_hz/micro accounting case we set the minimum frequency
 	 * not depending on HZ, but fixed (very low). The deferred
 	 * timer might skip some samples if idle/sleeping as needed.
 	 */
-	min_sampling_rate = MICRO_FREQUENCY_MIN_SAMPLE_RATE;
+	lz_dbs.min_sampling_rate = MICRO_FREQUENCY_MIN_SAMPLE_RATE;
     } else {
 	/* For correct statistics, we need 10 ticks for each measure */
-	min_sampling_rate =
+	lz_dbs.min_sampling_rate =
 	    MIN_SAMPLING_RATE_RATIO * jiffies_to_usecs(10);
     }
 
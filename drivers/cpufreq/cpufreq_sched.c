@@ -0,0 +1,486 @@
+/*
+ * drivers/cpufreq/cpufreq_sched.c
+ *
+ * Scheduler-driven cpufreq governor.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Instead of sampling idle time from a timer, this governor gets the
+ * runnable utilization of each CPU from the scheduler whenever a task
+ * starts or stops being runnable and on every tick (see
+ * include/linux/cpufreq_sched.h) and decides right there whether the
+ * speed has to change.  The runqueue lock is held at that point, so the
+ * change itself is handed to an irq_work of the local CPU, which wakes a
+ * SCHED_FIFO thread that calls the cpufreq driver.  Without an irq_work
+ * IPI on ARM the irq_work runs from the next tick, which NOHZ idle keeps
+ * while one is pending, so a request takes effect within one tick
+ * instead of one or more 20ms timer periods.
+ *
+ * Speed goes up as soon as it is asked for and down only after the
+ * current speed has been held for down_delay usecs.  Tunables live in
+ * /sys/devices/system/cpu/cpufreq/sched/.
+ */
+
+#include <linux/cpu.h>
+#include <linux/cpumask.h>
+#include <linux/cpufreq.h>
+#include <linux/cpufreq_sched.h>
+#include <linux/irq_work.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/timer.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/init.h>
+
+static atomic_t active_count = ATOMIC_INIT(0);
+
+struct cpufreq_sched_cpuinfo {
+	struct sched_util_hook hook;
+	spinlock_t lock;		/* util, util_time, nr_running */
+	unsigned long util;
+	u64 util_time;
+	unsigned long nr_running;
+	struct cpufreq_policy *policy;
+	struct cpufreq_frequency_table *freq_table;
+	int governor_enabled;
+
+	/* Only used in the entry of policy->cpu */
+	unsigned int down_freq;		/* next lower table speed */
+	u64 freq_set_time;
+	int down_pending;
+	struct timer_list down_timer;
+
+	/* Raised on this CPU, for whichever policy it updated */
+	struct irq_work speed_work;
+};
+
+static DEFINE_PER_CPU(struct cpufreq_sched_cpuinfo, cpuinfo);
+
+static struct task_struct *speed_task;
+static cpumask_t speed_cpumask;
+static DEFINE_SPINLOCK(speed_cpumask_lock);
+static DEFINE_MUTEX(set_speed_lock);
+
+/* Aim for this busy percentage at the chosen speed. */
+#define DEFAULT_TARGET_LOAD 80
+
+/* Go to at least hispeed_freq at or above this utilization. */
+#define DEFAULT_GO_HISPEED_LOAD 90
+
+/* Minimum time at a speed before ramping down. */
+#define DEFAULT_DOWN_DELAY (20 * USEC_PER_MSEC)
+static unsigned long down_delay_val;
+
+static struct cpufreq_sched_tunables tunables;
+
+static int cpufreq_governor_sched(struct cpufreq_policy *policy,
+		unsigned int event);
+
+#ifndef CONFIG_CPU_FREQ_DEFAULT_GOV_SCHED
+static
+#endif
+struct cpufreq_governor cpufreq_gov_sched = {
+	.name = "sched",
+	.governor = cpufreq_governor_sched,
+	.max_transition_latency = 10000000,
+	.owner = THIS_MODULE,
+};
+
+static void cpufreq_sched_kick(unsigned int cpu)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&speed_cpumask_lock, flags);
+	cpumask_set_cpu(cpu, &speed_cpumask);
+	spin_unlock_irqrestore(&speed_cpumask_lock, flags);
+}
+
+/*
+ * Runqueue lock held, interrupts off.  Only decide whether the speed
+ * needs to be looked at, the thread redoes the sums for the whole policy.
+ */
+static void cpufreq_sched_util(struct sched_util_hook *hook, u64 time,
+			       unsigned long util, unsigned long nr_running)
+{
+	struct cpufreq_sched_cpuinfo *pcpu =
+		container_of(hook, struct cpufreq_sched_cpuinfo, hook);
+	struct cpufreq_sched_cpuinfo *ppol;
+	unsigned int cur, freq;
+
+	spin_lock(&pcpu->lock);
+	pcpu->util = util;
+	pcpu->util_time = time;
+	pcpu->nr_running = nr_running;
+	spin_unlock(&pcpu->lock);
+
+	smp_rmb();
+	if (!pcpu->governor_enabled)
+		return;
+
+	ppol = &per_cpu(cpuinfo, pcpu->policy->cpu);
+	cur = pcpu->policy->cur;
+	freq = cpufreq_sched_next_freq(&tunables, cur, util);
+	if ((freq > cur && cur < pcpu->policy->max) ||
+	    (freq <= ppol->down_freq && ppol->down_freq &&
+	     !ppol->down_pending)) {
+		cpufreq_sched_kick(pcpu->policy->cpu);
+		irq_work_queue(&__get_cpu_var(cpuinfo).speed_work);
+	}
+}
+
+static void cpufreq_sched_irq_work(struct irq_work *work)
+{
+	wake_up_process(speed_task);
+}
+
+static void cpufreq_sched_down_timer(unsigned long data)
+{
+	struct cpufreq_sched_cpuinfo *ppol = &per_cpu(cpuinfo, data);
+
+	ppol->down_pending = 0;
+	cpufreq_sched_kick(data);
+	wake_up_process(speed_task);
+}
+
+/* Highest table speed below the current one, 0 if there is none. */
+static void cpufreq_sched_update_down_freq(struct cpufreq_sched_cpuinfo *ppol)
+{
+	struct cpufreq_policy *policy = ppol->policy;
+	unsigned int i, f, down = 0;
+
+	for (i = 0; ppol->freq_table[i].frequency != CPUFREQ_TABLE_END; i++) {
+		f = ppol->freq_table[i].frequency;
+		if (f == CPUFREQ_ENTRY_INVALID || f < policy->min)
+			continue;
+		if (f < policy->cur && f > down)
+			down = f;
+	}
+	ppol->down_freq = down;
+}
+
+/* Utilization of a CPU now, from its last update. */
+static unsigned long cpufreq_sched_cpu_util(unsigned int cpu)
+{
+	struct cpufreq_sched_cpuinfo *pcpu = &per_cpu(cpuinfo, cpu);
+	u64 now = cpu_clock(cpu);
+	unsigned long util, flags;
+
+	spin_lock_irqsave(&pcpu->lock, flags);
+	util = sched_util_update(pcpu->util, pcpu->nr_running != 0,
+				 now > pcpu->util_time ?
+				 now - pcpu->util_time : 0);
+	spin_unlock_irqrestore(&pcpu->lock, flags);
+	return util;
+}
+
+static void cpufreq_sched_set_speed(struct cpufreq_sched_cpuinfo *ppol)
+{
+	struct cpufreq_policy *policy = ppol->policy;
+	unsigned int j, index, freq, max_freq = 0;
+	u64 now, held;
+
+	for_each_cpu(j, policy->cpus) {
+		freq = cpufreq_sched_next_freq(&tunables, policy->cur,
+					       cpufreq_sched_cpu_util(j));
+		if (freq > max_freq)
+			max_freq = freq;
+	}
+	max_freq = clamp(max_freq, policy->min, policy->max);
+
+	if (cpufreq_frequency_table_target(policy, ppol->freq_table, max_freq,
+					   CPUFREQ_RELATION_L, &index)) {
+		pr_warn_once("cpufreq_sched: table lookup failed\n");
+		return;
+	}
+	max_freq = ppol->freq_table[index].frequency;
+	if (max_freq == policy->cur)
+		return;
+
+	now = ktime_to_us(ktime_get());
+	held = now - ppol->freq_set_time;
+	if (max_freq < policy->cur && held < down_delay_val) {
+		ppol->down_pending = 1;
+		mod_timer(&ppol->down_timer,
+			  jiffies + usecs_to_jiffies(down_delay_val - held));
+		return;
+	}
+
+	__cpufreq_driver_target(policy, max_freq, CPUFREQ_RELATION_L);
+	ppol->freq_set_time = now;
+	cpufreq_sched_update_down_freq(ppol);
+}
+
+static int cpufreq_sched_speed_task(void *data)
+{
+	unsigned int cpu;
+	cpumask_t tmp_mask;
+	unsigned long flags;
+	struct cpufreq_sched_cpuinfo *ppol;
+
+	while (1) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		spin_lock_irqsave(&speed_cpumask_lock, flags);
+
+		if (cpumask_empty(&speed_cpumask)) {
+			spin_unlock_irqrestore(&speed_cpumask_lock, flags);
+			schedule();
+
+			if (kthread_should_stop())
+				break;
+
+			spin_lock_irqsave(&speed_cpumask_lock, flags);
+		}
+
+		set_current_state(TASK_RUNNING);
+		tmp_mask = speed_cpumask;
+		cpumask_clear(&speed_cpumask);
+		spin_unlock_irqrestore(&speed_cpumask_lock, flags);
+
+		for_each_cpu(cpu, &tmp_mask) {
+			ppol = &per_cpu(cpuinfo, cpu);
+
+			mutex_lock(&set_speed_lock);
+			smp_rmb();
+			if (ppol->governor_enabled)
+				cpufreq_sched_set_speed(ppol);
+			mutex_unlock(&set_speed_lock);
+		}
+	}
+
+	return 0;
+}
+
+static ssize_t show_target_load(struct kobject *kobj,
+				struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", tunables.target_load);
+}
+
+static ssize_t store_target_load(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	if (val < 1 || val > 100)
+		return -EINVAL;
+	tunables.target_load = val;
+	return count;
+}
+
+define_one_global_rw(target_load);
+
+static ssize_t show_go_hispeed_load(struct kobject *kobj,
+				    struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", tunables.go_hispeed_load);
+}
+
+static ssize_t store_go_hispeed_load(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	tunables.go_hispeed_load = val;
+	return count;
+}
+
+define_one_global_rw(go_hispeed_load);
+
+static ssize_t show_hispeed_freq(struct kobject *kobj,
+				 struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", tunables.hispeed_freq);
+}
+
+static ssize_t store_hispeed_freq(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	tunables.hispeed_freq = val;
+	return count;
+}
+
+define_one_global_rw(hispeed_freq);
+
+static ssize_t show_down_delay(struct kobject *kobj,
+			       struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", down_delay_val);
+}
+
+static ssize_t store_down_delay(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	down_delay_val = val;
+	return count;
+}
+
+define_one_global_rw(down_delay);
+
+static struct attribute *sched_attributes[] = {
+	&target_load.attr,
+	&go_hispeed_load.attr,
+	&hispeed_freq.attr,
+	&down_delay.attr,
+	NULL,
+};
+
+static struct attribute_group sched_attr_group = {
+	.attrs = sched_attributes,
+	.name = "sched",
+};
+
+static int cpufreq_governor_sched(struct cpufreq_policy *policy,
+		unsigned int event)
+{
+	int rc;
+	unsigned int j;
+	struct cpufreq_sched_cpuinfo *pcpu, *ppol;
+	struct cpufreq_frequency_table *freq_table;
+
+	ppol = &per_cpu(cpuinfo, policy->cpu);
+
+	switch (event) {
+	case CPUFREQ_GOV_START:
+		if (!cpu_online(policy->cpu))
+			return -EINVAL;
+
+		freq_table = cpufreq_frequency_get_table(policy->cpu);
+		if (!freq_table)
+			return -EINVAL;
+
+		if (!tunables.hispeed_freq)
+			tunables.hispeed_freq = policy->max;
+
+		if (atomic_inc_return(&active_count) == 1) {
+			rc = sysfs_create_group(cpufreq_global_kobject,
+						&sched_attr_group);
+			if (rc) {
+				atomic_dec(&active_count);
+				return rc;
+			}
+		}
+
+		ppol->freq_set_time = ktime_to_us(ktime_get());
+		ppol->down_pending = 0;
+		for_each_cpu(j, policy->cpus) {
+			pcpu = &per_cpu(cpuinfo, j);
+			pcpu->policy = policy;
+			pcpu->freq_table = freq_table;
+			pcpu->governor_enabled = 1;
+			smp_wmb();
+		}
+		cpufreq_sched_update_down_freq(ppol);
+
+		for_each_cpu(j, policy->cpus)
+			sched_set_util_hook(j, &per_cpu(cpuinfo, j).hook);
+		break;
+
+	case CPUFREQ_GOV_STOP:
+		for_each_cpu(j, policy->cpus) {
+			pcpu = &per_cpu(cpuinfo, j);
+			sched_set_util_hook(j, NULL);
+			pcpu->governor_enabled = 0;
+			smp_wmb();
+		}
+		synchronize_sched();
+		for_each_possible_cpu(j)
+			irq_work_sync(&per_cpu(cpuinfo, j).speed_work);
+
+		/* Let a running speed change finish before the policy goes */
+		mutex_lock(&set_speed_lock);
+		mutex_unlock(&set_speed_lock);
+		del_timer_sync(&ppol->down_timer);
+
+		if (atomic_dec_return(&active_count) == 0)
+			sysfs_remove_group(cpufreq_global_kobject,
+					   &sched_attr_group);
+		break;
+
+	case CPUFREQ_GOV_LIMITS:
+		mutex_lock(&set_speed_lock);
+		if (policy->max < policy->cur)
+			__cpufreq_driver_target(policy,
+					policy->max, CPUFREQ_RELATION_H);
+		else if (policy->min > policy->cur)
+			__cpufreq_driver_target(policy,
+					policy->min, CPUFREQ_RELATION_L);
+		if (ppol->governor_enabled)
+			cpufreq_sched_update_down_freq(ppol);
+		mutex_unlock(&set_speed_lock);
+		break;
+	}
+	return 0;
+}
+
+static int __init cpufreq_sched_init(void)
+{
+	unsigned int i;
+	struct cpufreq_sched_cpuinfo *pcpu;
+	struct sched_param param = { .sched_priority = MAX_RT_PRIO-1 };
+
+	tunables.target_load = DEFAULT_TARGET_LOAD;
+	tunables.go_hispeed_load = DEFAULT_GO_HISPEED_LOAD;
+	down_delay_val = DEFAULT_DOWN_DELAY;
+
+	for_each_possible_cpu(i) {
+		pcpu = &per_cpu(cpuinfo, i);
+		pcpu->hook.func = cpufreq_sched_util;
+		spin_lock_init(&pcpu->lock);
+		setup_timer(&pcpu->down_timer, cpufreq_sched_down_timer, i);
+		init_irq_work(&pcpu->speed_work, cpufreq_sched_irq_work);
+	}
+
+	speed_task = kthread_create(cpufreq_sched_speed_task, NULL,
+				    "kschedfreq");
+	if (IS_ERR(speed_task))
+		return PTR_ERR(speed_task);
+
+	sched_setscheduler_nocheck(speed_task, SCHED_FIFO, &param);
+	get_task_struct(speed_task);
+
+	return cpufreq_register_governor(&cpufreq_gov_sched);
+}
+
+#ifdef CONFIG_CPU_FREQ_DEFAULT_GOV_SCHED
+fs_initcall(cpufreq_sched_init);
+#else
+module_init(cpufreq_sched_init);
+#endif
+
+MODULE_DESCRIPTION("'cpufreq_sched' - A cpufreq governor driven by "
+	"scheduler utilization updates");
+MODULE_LICENSE("GPL");
@@ -89,16 +89,26 @@ static struct ion_buffer *ion_buffer_create(struct ion_heap *heap,
 	return buffer;
 }
 
-static void ion_buffer_destroy(struct kref *kref)
+void ion_buffer_destroy(struct ion_buffer *buffer)
+{
+	buffer->heap->ops->free(buffer);
+	kfree(buffer);
+}
+
+static void _ion_buffer_destroy(struct kref *kref)
 {
 	struct ion_buffer *buffer = container_of(kref, struct ion_buffer, ref);
+	struct ion_heap *heap = buffer->heap;
 	struct ion_device *dev = buffer->dev;
 
-	buffer->heap->ops->free(buffer);
 	mutex_lock(&dev->lock);
 	rb_erase(&buffer->node, &dev->buffers);
 	mutex_unlock(&dev->lock);
-	kfree(buffer);
+
+	if (heap->flags & ION_HEAP_FLAG_DEFER_FREE)
+		ion_heap_freelist_add(heap, buffer);
+	else
+		ion_buffer_destroy(buffer);
 }
 
 static void ion_buffer_get(struct ion_buffer *buffer)
@@ -108,7 +118,7 @@ static void ion_buffer_get(struct ion_buffer *buffer)
 
 static int ion_buffer_put(struct ion_buffer *buffer)
 {
-	return kref_put(&buffer->ref, ion_buffer_destroy);
+	return kref_put(&buffer->ref, _ion_buffer_destroy);
 }
 
 static struct ion_handle *ion_handle_create(struct ion_client *client,
@@ -1157,6 +1167,27 @@ static int ion_debug_heap_show(struct seq_file *s, void *unused)
 		seq_printf(s, "%16.s %16u %16u\n", client->name, client->pid,
 			   size);
 	}
+	if (heap->flags & ION_HEAP_FLAG_DEFER_FREE) {
+		unsigned long drained;
+		u64 drain_ns, max_drain_ns;
+		size_t queued;
+
+		spin_lock(&heap->free_lock);
+		queued = heap->free_list_size;
+		drained = heap->drained;
+		drain_ns = heap->drain_ns;
+		max_drain_ns = heap->max_drain_ns;
+		spin_unlock(&heap->free_lock);
+
+		if (drained)
+			do_div(drain_ns, drained);
+		seq_printf(s, "\ndeferred free: queued %zu bytes, drained %lu "
+			   "buffers, latency avg %llu us max %llu us\n",
+			   queued, drained, div_u64(drain_ns, NSEC_PER_USEC),
+			   div_u64(max_drain_ns, NSEC_PER_USEC));
+	}
+	if (heap->debug_show)
+		heap->debug_show(heap, s, unused);
 	return 0;
 }
 
@@ -1179,6 +1210,9 @@ void ion_device_add_heap(struct ion_device *dev, struct ion_heap *heap)
 	struct ion_heap *entry;
 
 	heap->dev = dev;
+	if (heap->flags & ION_HEAP_FLAG_DEFER_FREE)
+		ion_heap_init_deferred_free(heap);
+
 	mutex_lock(&dev->lock);
 	while (*p) {
 		parent = *p;
@@ -15,7 +15,11 @@
  */
 
 #include <linux/err.h>
+#include <linux/freezer.h>
 #include <linux/ion.h>
+#include <linux/kthread.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
 #include "ion_priv.h"
 
 struct ion_heap *ion_heap_create(struct ion_platform_heap *heap_data)
@@ -55,6 +59,12 @@ void ion_heap_destroy(struct ion_heap *heap)
 	if (!heap)
 		return;
 
+	if (heap->task) {
+		kthread_stop(heap->task);
+		unregister_shrinker(&heap->shrinker);
+		ion_heap_freelist_drain(heap, 0);
+	}
+
 	switch (heap->type) {
 	case ION_HEAP_TYPE_SYSTEM_CONTIG:
 		ion_system_contig_heap_destroy(heap);
@@ -70,3 +80,127 @@ void ion_heap_destroy(struct ion_heap *heap)
 		       heap->type);
 	}
 }
+
+void ion_heap_freelist_add(struct ion_heap *heap, struct ion_buffer *buffer)
+{
+	buffer->queued = ktime_get();
+
+	spin_lock(&heap->free_lock);
+	list_add_tail(&buffer->list, &heap->free_list);
+	heap->free_list_size += buffer->size;
+	spin_unlock(&heap->free_lock);
+	wake_up(&heap->waitqueue);
+}
+
+size_t ion_heap_freelist_size(struct ion_heap *heap)
+{
+	size_t size;
+
+	spin_lock(&heap->free_lock);
+	size = heap->free_list_size;
+	spin_unlock(&heap->free_lock);
+
+	return size;
+}
+
+/* Takes the oldest buffer off the free list and frees it */
+static size_t ion_heap_freelist_free_one(struct ion_heap *heap)
+{
+	struct ion_buffer *buffer;
+	size_t size;
+	u64 ns;
+
+	spin_lock(&heap->free_lock);
+	if (list_empty(&heap->free_list)) {
+		spin_unlock(&heap->free_lock);
+		return 0;
+	}
+	buffer = list_first_entry(&heap->free_list, struct ion_buffer, list);
+	list_del(&buffer->list);
+	heap->free_list_size -= buffer->size;
+	spin_unlock(&heap->free_lock);
+
+	size = buffer->size;
+	ns = ktime_to_ns(ktime_sub(ktime_get(), buffer->queued));
+	ion_buffer_destroy(buffer);
+
+	spin_lock(&heap->free_lock);
+	heap->drained++;
+	heap->drain_ns += ns;
+	if (ns > heap->max_drain_ns)
+		heap->max_drain_ns = ns;
+	spin_unlock(&heap->free_lock);
+
+	return size;
+}
+
+size_t ion_heap_freelist_drain(struct ion_heap *heap, size_t size)
+{
+	size_t drained = 0;
+	size_t freed;
+
+	while (!size || drained < size) {
+		freed = ion_heap_freelist_free_one(heap);
+		if (!freed)
+			break;
+		drained += freed;
+	}
+
+	return drained;
+}
+
+static int ion_heap_deferred_free(void *data)
+{
+	struct ion_heap *heap = data;
+
+	set_freezable();
+	while (!kthread_should_stop()) {
+		wait_event_freezable(heap->waitqueue,
+				     ion_heap_freelist_size(heap) > 0 ||
+				     kthread_should_stop());
+		ion_heap_freelist_free_one(heap);
+	}
+
+	return 0;
+}
+
+/*
+ * The deferred free thread only runs when nothing else wants the CPU, so
+ * under memory pressure the queued buffers are freed by reclaim instead.
+ */
+static int ion_heap_shrink(struct shrinker *shrinker, struct shrink_control *sc)
+{
+	struct ion_heap *heap = container_of(shrinker, struct ion_heap,
+					     shrinker);
+
+	if (sc->nr_to_scan)
+		ion_heap_freelist_drain(heap, sc->nr_to_scan * PAGE_SIZE);
+
+	return ion_heap_freelist_size(heap) / PAGE_SIZE;
+}
+
+int ion_heap_init_deferred_free(struct ion_heap *heap)
+{
+	struct sched_param param = { .sched_priority = 0 };
+
+	INIT_LIST_HEAD(&heap->free_list);
+	heap->free_list_size = 0;
+	spin_lock_init(&heap->free_lock);
+	init_waitqueue_head(&heap->waitqueue);
+
+	heap->task = kthread_run(ion_heap_deferred_free, heap, "ion_%s",
+				 heap->name);
+	if (IS_ERR(heap->task)) {
+		pr_err("%s: creating thread for deferred free failed\n",
+		       __func__);
+		heap->task = NULL;
+		heap->flags &= ~ION_HEAP_FLAG_DEFER_FREE;
+		return -ENOMEM;
+	}
+	sched_setscheduler(heap->task, SCHED_IDLE, &param);
+
+	heap->shrinker.shrink = ion_heap_shrink;
+	heap->shrinker.seeks = DEFAULT_SEEKS;
+	register_shrinker(&heap->shrinker);
+	return 0;
+}
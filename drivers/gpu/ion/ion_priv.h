@@ -18,13 +18,18 @@
 #define _ION_PRIV_H
 
 #include <linux/kref.h>
+#include <linux/ktime.h>
 #include <linux/mm_types.h>
 #include <linux/mutex.h>
 #include <linux/rbtree.h>
 #include <linux/ion.h>
 #include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
 
 struct ion_mapping;
+struct seq_file;
 
 struct ion_dma_mapping {
 	struct kref ref;
@@ -126,6 +131,8 @@ struct ion_buffer *ion_handle_buffer(struct ion_handle *handle);
  * @vaddr:		the kenrel mapping if kmap_cnt is not zero
  * @dmap_cnt:		number of times the buffer is mapped for dma
  * @sglist:		the scatterlist for the buffer is dmap_cnt is not zero
+ * @list:		element in the heap's deferred free list
+ * @queued:		when the buffer was put on the deferred free list
 */
 struct ion_buffer {
 	struct kref ref;
@@ -144,8 +151,12 @@ struct ion_buffer {
 	int dmap_cnt;
 	struct scatterlist *sglist;
 	bool cached;
+	struct list_head list;
+	ktime_t queued;
 };
 
+void ion_buffer_destroy(struct ion_buffer *buffer);
+
 /**
  * struct ion_heap_ops - ops to operate on a given heap
  * @allocate:		allocate memory
@@ -190,6 +201,18 @@ struct ion_heap_ops {
  *			allocating.  These are specified by platform data and
  *			MUST be unique
  * @name:		used for debugging
+ * @flags:		ION_HEAP_FLAG_* flags of the heap
+ * @debug_show:		called when the heap's debugfs file is read, to add
+ *			any heap specific information to the output
+ * @free_list:		buffers waiting to be freed, if ION_HEAP_FLAG_DEFER_FREE
+ * @free_list_size:	total size of the buffers on free_list
+ * @free_lock:		protects free_list, free_list_size and the drain stats
+ * @waitqueue:		wakes up the deferred free thread
+ * @task:		the deferred free thread
+ * @shrinker:		drains free_list under memory pressure
+ * @drained:		number of buffers freed from free_list
+ * @drain_ns:		total time buffers spent on free_list
+ * @max_drain_ns:	longest time a buffer spent on free_list
  *
  * Represents a pool of memory from which buffers can be made.  In some
  * systems the only heap is regular system memory allocated via vmalloc.
@@ -203,8 +226,59 @@ struct ion_heap {
 	struct ion_heap_ops *ops;
 	int id;
 	const char *name;
+	unsigned long flags;
+	int (*debug_show)(struct ion_heap *heap, struct seq_file *s,
+			  void *unused);
+	struct list_head free_list;
+	size_t free_list_size;
+	spinlock_t free_lock;
+	wait_queue_head_t waitqueue;
+	struct task_struct *task;
+	struct shrinker shrinker;
+	unsigned long drained;
+	u64 drain_ns;
+	u64 max_drain_ns;
 };
 
+/*
+ * Buffers of the heap are freed asynchronously by a low priority thread
+ * once their last reference is dropped, so that the caller does not pay
+ * for the heap's free (cache maintenance, zeroing, unmapping).
+ */
+#define ION_HEAP_FLAG_DEFER_FREE	(1 << 0)
+
+/**
+ * ion_heap_init_deferred_free -- starts the deferred free thread of a heap
+ * @heap:		the heap
+ *
+ * Called when a heap with ION_HEAP_FLAG_DEFER_FREE is added to the device.
+ * If the thread can't be started, buffers of the heap are freed
+ * synchronously.
+ */
+int ion_heap_init_deferred_free(struct ion_heap *heap);
+
+/**
+ * ion_heap_freelist_add - queue a buffer for deferred freeing
+ * @heap:		the heap
+ * @buffer:		the buffer
+ */
+void ion_heap_freelist_add(struct ion_heap *heap, struct ion_buffer *buffer);
+
+/**
+ * ion_heap_freelist_drain - synchronously free buffers queued on a heap
+ * @heap:		the heap
+ * @size:		amount of memory to drain in bytes, 0 for all of it
+ *
+ * Returns the number of bytes drained.
+ */
+size_t ion_heap_freelist_drain(struct ion_heap *heap, size_t size);
+
+/**
+ * ion_heap_freelist_size - returns the number of bytes queued on a heap
+ * @heap:		the heap
+ */
+size_t ion_heap_freelist_size(struct ion_heap *heap);
+
 /**
  * ion_device_create - allocates and returns an ion device
  * @custom_ioctl:	arch specific ioctl function if applicable
@@ -254,6 +328,43 @@ ion_phys_addr_t ion_carveout_allocate(struct ion_heap *heap, unsigned long size,
 				      unsigned long align);
 void ion_carveout_free(struct ion_heap *heap, ion_phys_addr_t addr,
 		       unsigned long size);
+/**
+ * struct ion_page_pool - pool of zeroed chunks of a single page order
+ * @high_count:		number of highmem chunks in the pool
+ * @low_count:		number of lowmem chunks in the pool
+ * @high_items:		list of highmem chunks
+ * @low_items:		list of lowmem chunks
+ * @hits:		allocations served from the pool
+ * @misses:		allocations that went to the page allocator
+ * @mutex:		lock protecting this struct
+ * @gfp_mask:		gfp_mask to use for allocations from the system
+ * @order:		order of the chunks in the pool
+ *
+ * Allocating, zeroing and freeing large buffers page by page is slow.
+ * A pool keeps chunks freed by a heap, zeroed, so that the next
+ * allocation of the same order can reuse them directly. The owner of the
+ * pool is expected to register a shrinker that calls
+ * ion_page_pool_shrink() to give the memory back under pressure.
+ */
+struct ion_page_pool {
+	int high_count;
+	int low_count;
+	struct list_head high_items;
+	struct list_head low_items;
+	unsigned long hits;
+	unsigned long misses;
+	struct mutex mutex;
+	gfp_t gfp_mask;
+	unsigned int order;
+};
+
+struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order);
+void ion_page_pool_destroy(struct ion_page_pool *);
+struct page *ion_page_pool_alloc(struct ion_page_pool *);
+void ion_page_pool_free(struct ion_page_pool *, struct page *);
+int ion_page_pool_shrink(struct ion_page_pool *pool, gfp_t gfp_mask,
+			 int nr_to_scan);
+
 /**
  * The carveout heap returns physical addresses, since 0 may be a valid
  * physical address, this is used to indicate allocation failed
@@ -0,0 +1,363 @@
+/*
+ * tcm-rowmap.c
+ *
+ * Row bitmap TILER container manager: 2D and 1D reservation using an
+ * occupancy bitmap per container row.
+ *
+ * This package is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ */
+#include <linux/bitmap.h>
+#include <linux/bitops.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+
+#include "tcm-rowmap.h"
+
+#define TCM_ALG_NAME "tcm_rowmap"
+#include "tcm-utils.h"
+
+/*
+ * SiTA keeps a pointer per slot and tests every slot of every candidate,
+ * which gets slow once the container is fragmented. Here each row has a
+ * bitmap of busy slots and the length of its longest free run:
+ *
+ *  - candidate windows of 'h' rows containing a row whose longest run is
+ *    shorter than the requested width are skipped without looking at the
+ *    bitmaps
+ *  - for the remaining windows the rows are OR-ed a word at a time and
+ *    the first (or last) fitting aligned run is found with the bitmap
+ *    helpers
+ *
+ * 1D areas are found by walking the free runs backwards in raster order,
+ * so the cost is proportional to the number of busy runs, not slots.
+ */
+struct rowmap_pvt {
+	struct mutex mtx;
+	struct tcm_pt div_pt;	/* divider point splitting container */
+	unsigned long *rows;	/* busy bitmap of each row */
+	unsigned long *tmp;	/* scratch row for combining rows */
+	u16 *max_run;		/* longest free run in each row */
+	u16 stride;		/* longs per row bitmap */
+};
+
+static inline unsigned long *row(struct rowmap_pvt *pvt, u16 y)
+{
+	return pvt->rows + y * pvt->stride;
+}
+
+/* longest run of clear bits in the first 'width' bits of 'map' */
+static u16 longest_run(const unsigned long *map, u16 width)
+{
+	unsigned long pos = 0, z, b;
+	u16 max = 0;
+
+	while (pos < width) {
+		z = find_next_zero_bit(map, width, pos);
+		if (z >= width)
+			break;
+		b = find_next_bit(map, width, z);
+		if (b - z > max)
+			max = b - z;
+		pos = b;
+	}
+	return max;
+}
+
+/* returns the last bit below 'pos' that is 'set', or -1 if none */
+static s32 prev_bit(const unsigned long *map, s32 pos, bool set)
+{
+	while (pos > 0) {
+		s32 idx = (pos - 1) / BITS_PER_LONG;
+		unsigned long word = set ? map[idx] : ~map[idx];
+		unsigned int bits = pos - idx * BITS_PER_LONG;
+
+		if (bits < BITS_PER_LONG)
+			word &= (1UL << bits) - 1;
+		if (word)
+			return idx * BITS_PER_LONG + __fls(word);
+		pos = idx * BITS_PER_LONG;
+	}
+	return -1;
+}
+
+/* marks an area busy or free and updates the free runs of its rows */
+static void fill_area(struct tcm *tcm, struct tcm_area *area, bool busy)
+{
+	struct rowmap_pvt *pvt = (struct rowmap_pvt *)tcm->pvt;
+	struct tcm_area a, a_;
+	u16 y;
+
+	/* set area's tcm; otherwise, enumerator considers it invalid */
+	area->tcm = tcm;
+
+	tcm_for_each_slice(a, *area, a_) {
+		PA(2, "fill 2d area", &a);
+		for (y = a.p0.y; y <= a.p1.y; y++) {
+			if (busy)
+				bitmap_set(row(pvt, y), a.p0.x,
+					   a.p1.x - a.p0.x + 1);
+			else
+				bitmap_clear(row(pvt, y), a.p0.x,
+					     a.p1.x - a.p0.x + 1);
+			pvt->max_run[y] = longest_run(row(pvt, y), tcm->width);
+		}
+	}
+}
+
+/*
+ * Find the topmost place for a w x h area within columns x0..x1 and rows
+ * y0..y1, leftmost aligned fit if 'l2r', rightmost fit otherwise.
+ */
+static s32 find_2d(struct tcm *tcm, u16 w, u16 h, u16 align, bool l2r,
+		   u16 x0, u16 y0, u16 x1, u16 y1, struct tcm_area *area)
+{
+	struct rowmap_pvt *pvt = (struct rowmap_pvt *)tcm->pvt;
+	unsigned long pos, z, b;
+	s32 x, y, i;
+
+	if (w > x1 - x0 + 1 || h > y1 - y0 + 1)
+		return -ENOSPC;
+
+	for (y = y0; y + h - 1 <= y1; y++) {
+		/* skip past the lowest row that cannot hold the width */
+		for (i = h - 1; i >= 0; i--)
+			if (pvt->max_run[y + i] < w)
+				break;
+		if (i >= 0) {
+			y += i;
+			continue;
+		}
+
+		bitmap_copy(pvt->tmp, row(pvt, y), tcm->width);
+		for (i = 1; i < h; i++)
+			bitmap_or(pvt->tmp, pvt->tmp, row(pvt, y + i),
+				  tcm->width);
+
+		if (l2r) {
+			x = bitmap_find_next_zero_area(pvt->tmp, x1 + 1, x0, w,
+						       align - 1);
+			if (x + w - 1 > x1)
+				continue;
+		} else {
+			x = -1;
+			for (pos = x0; pos <= x1; pos = b) {
+				z = find_next_zero_bit(pvt->tmp, x1 + 1, pos);
+				if (z > x1)
+					break;
+				b = find_next_bit(pvt->tmp, x1 + 1, z);
+				if (b - z >= w)
+					x = b - w;
+			}
+			if (x < 0)
+				continue;
+		}
+
+		assign(area, x, y, x + w - 1, y + h - 1);
+		return 0;
+	}
+
+	return -ENOSPC;
+}
+
+/* same scan fields and fallbacks as SiTA's scan_areas_and_find_fit() */
+static s32 rowmap_reserve_2d(struct tcm *tcm, u16 h, u16 w, u8 align,
+			     struct tcm_area *area)
+{
+	struct rowmap_pvt *pvt = (struct rowmap_pvt *)tcm->pvt;
+	u16 boundary_x, boundary_y;
+	s32 ret;
+
+	/* not supporting more than 64 as alignment */
+	if (align > 64)
+		return -EINVAL;
+
+	/* we prefer 1, 32 and 64 as alignment */
+	align = align <= 1 ? 1 : align <= 32 ? 32 : 64;
+
+	mutex_lock(&(pvt->mtx));
+	if (align > 1) {
+		/* prefer top-left corner */
+		boundary_x = pvt->div_pt.x - 1;
+		boundary_y = pvt->div_pt.y - 1;
+
+		/* expand width and height if needed */
+		if (w > pvt->div_pt.x)
+			boundary_x = tcm->width - 1;
+		if (h > pvt->div_pt.y)
+			boundary_y = tcm->height - 1;
+
+		ret = find_2d(tcm, w, h, align, true, 0, 0, boundary_x,
+			      boundary_y, area);
+
+		/* scan whole container if failed, but do not scan 2x */
+		if (ret && (boundary_x != tcm->width - 1 ||
+			    boundary_y != tcm->height - 1))
+			ret = find_2d(tcm, w, h, align, true, 0, 0,
+				      tcm->width - 1, tcm->height - 1, area);
+	} else {
+		/* prefer top-right corner */
+		boundary_x = pvt->div_pt.x;
+		boundary_y = pvt->div_pt.y - 1;
+
+		/* expand width and height if needed */
+		if (w > (tcm->width - pvt->div_pt.x))
+			boundary_x = 0;
+		if (h > pvt->div_pt.y)
+			boundary_y = tcm->height - 1;
+
+		ret = find_2d(tcm, w, h, align, false, boundary_x, 0,
+			      tcm->width - 1, boundary_y, area);
+
+		/* scan whole container if failed, but do not scan 2x */
+		if (ret && (boundary_x != 0 ||
+			    boundary_y != tcm->height - 1))
+			ret = find_2d(tcm, w, h, align, false, 0, 0,
+				      tcm->width - 1, tcm->height - 1, area);
+	}
+
+	if (!ret)
+		fill_area(tcm, area, true);
+
+	mutex_unlock(&(pvt->mtx));
+	return ret;
+}
+
+/* finds the last run of num_slots free slots in raster order */
+static s32 rowmap_reserve_1d(struct tcm *tcm, u32 num_slots,
+			     struct tcm_area *area)
+{
+	struct rowmap_pvt *pvt = (struct rowmap_pvt *)tcm->pvt;
+	u32 run = 0;
+	s32 y, pos, busy;
+	s32 ret = -ENOSPC;
+
+	mutex_lock(&(pvt->mtx));
+	for (y = tcm->height - 1; y >= 0; y--) {
+		pos = tcm->width;
+		while (pos > 0) {
+			busy = prev_bit(row(pvt, y), pos, true);
+			if (pos - 1 > busy) {
+				/* remember bottom-right corner */
+				if (!run) {
+					area->p1.x = pos - 1;
+					area->p1.y = y;
+				}
+				if (run + (pos - 1 - busy) >= num_slots) {
+					area->p0.x = pos - (num_slots - run);
+					area->p0.y = y;
+					ret = 0;
+					goto found;
+				}
+				run += pos - 1 - busy;
+			}
+
+			/* free up to the start of the row: continue above */
+			if (busy < 0)
+				break;
+
+			/* start over below the busy run */
+			run = 0;
+			pos = prev_bit(row(pvt, y), busy, false) + 1;
+		}
+	}
+found:
+	if (!ret)
+		fill_area(tcm, area, true);
+
+	mutex_unlock(&(pvt->mtx));
+	return ret;
+}
+
+static s32 rowmap_free(struct tcm *tcm, struct tcm_area *area)
+{
+	struct rowmap_pvt *pvt = (struct rowmap_pvt *)tcm->pvt;
+
+	mutex_lock(&(pvt->mtx));
+
+	/* check that this is in fact a reserved area */
+	WARN_ON(!test_bit(area->p0.x, row(pvt, area->p0.y)) ||
+		!test_bit(area->p1.x, row(pvt, area->p1.y)));
+
+	fill_area(tcm, area, false);
+
+	mutex_unlock(&(pvt->mtx));
+
+	return 0;
+}
+
+static void rowmap_deinit(struct tcm *tcm)
+{
+	struct rowmap_pvt *pvt = (struct rowmap_pvt *)tcm->pvt;
+
+	mutex_destroy(&(pvt->mtx));
+	kfree(pvt->rows);
+	kfree(pvt->tmp);
+	kfree(pvt->max_run);
+	kfree(pvt);
+	kfree(tcm);
+}
+
+struct tcm *rowmap_init(u16 width, u16 height, struct tcm_pt *attr)
+{
+	struct tcm *tcm;
+	struct rowmap_pvt *pvt;
+	s32 y;
+
+	if (width == 0 || height == 0)
+		return NULL;
+
+	tcm = kzalloc(sizeof(*tcm), GFP_KERNEL);
+	pvt = kzalloc(sizeof(*pvt), GFP_KERNEL);
+	if (!tcm || !pvt)
+		goto error;
+
+	tcm->height = height;
+	tcm->width = width;
+	tcm->reserve_2d = rowmap_reserve_2d;
+	tcm->reserve_1d = rowmap_reserve_1d;
+	tcm->free = rowmap_free;
+	tcm->deinit = rowmap_deinit;
+	tcm->pvt = (void *)pvt;
+
+	mutex_init(&(pvt->mtx));
+
+	pvt->stride = BITS_TO_LONGS(width);
+	pvt->rows = kzalloc(sizeof(*pvt->rows) * pvt->stride * height,
+			    GFP_KERNEL);
+	pvt->tmp = kzalloc(sizeof(*pvt->tmp) * pvt->stride, GFP_KERNEL);
+	pvt->max_run = kmalloc(sizeof(*pvt->max_run) * height, GFP_KERNEL);
+	if (!pvt->rows || !pvt->tmp || !pvt->max_run)
+		goto error;
+
+	for (y = 0; y < height; y++)
+		pvt->max_run[y] = width;
+
+	if (attr && attr->x <= tcm->width && attr->y <= tcm->height) {
+		pvt->div_pt.x = attr->x;
+		pvt->div_pt.y = attr->y;
+	} else {
+		/* Defaulting to 3:1 ratio on width for 2D area split */
+		/* Defaulting to 3:1 ratio on height for 2D and 1D split */
+		pvt->div_pt.x = (tcm->width * 3) / 4;
+		pvt->div_pt.y = (tcm->height * 3) / 4;
+	}
+
+	return tcm;
+
+error:
+	if (pvt) {
+		kfree(pvt->rows);
+		kfree(pvt->tmp);
+		kfree(pvt->max_run);
+	}
+	kfree(tcm);
+	kfree(pvt);
+	return NULL;
+}
@@ -0,0 +1,40 @@
+/*
+ * tcm-rowmap.h
+ *
+ * Row bitmap TILER container manager interface.
+ *
+ * This package is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef TCM_ROWMAP_H
+#define TCM_ROWMAP_H
+
+#include "../tcm.h"
+
+/**
+ * Create a row bitmap container manager.
+ *
+ * Uses the same placement policy as SiTA (aligned 2D areas towards the
+ * top-left, unaligned ones towards the top-right, 1D areas from the
+ * bottom-right) but finds the first fit using per-row occupancy bitmaps
+ * and the longest free run of every row instead of scanning and scoring
+ * candidates slot by slot.
+ *
+ * @param width		Container width
+ * @param height	Container height
+ * @param attr		preferred division point between the 2D areas,
+ *			same as for sita_init()
+ *
+ * @return TCM instance
+ */
+struct tcm *rowmap_init(u16 width, u16 height, struct tcm_pt *attr);
+
+TCM_INIT(rowmap_init, struct tcm_pt);
+
+#endif /* TCM_ROWMAP_H */
@@ -177,10 +177,11 @@ static void sita_deinit(struct tcm *tcm)
 
 	mutex_destroy(&(pvt->mtx));
 
-	for (i = 0; i < tcm->height; i++)
+	for (i = 0; i < tcm->width; i++)
 		kfree(pvt->map[i]);
 	kfree(pvt->map);
 	kfree(pvt);
+	kfree(tcm);
 }
 
 /**
@@ -38,10 +38,12 @@
 #include "tmm.h"
 #include "_tiler.h"
 #include "tcm/tcm-sita.h"		/* TCM algorithm */
+#include "tcm/tcm-rowmap.h"
 
 static bool ssptr_id = CONFIG_TILER_SSPTR_ID;
 static uint granularity = CONFIG_TILER_GRANULARITY;
 static uint tiler_alloc_debug;
+static char *tcm_alg = "sita";
 
 /*
  * We can only change ssptr_id if there are no blocks allocated, so that
@@ -54,6 +56,8 @@ module_param_named(grain, granularity, uint, 0644);
 MODULE_PARM_DESC(grain, "Granularity (bytes)");
 module_param_named(alloc_debug, tiler_alloc_debug, uint, 0644);
 MODULE_PARM_DESC(alloc_debug, "Allocation debug flag");
+module_param_named(tcm, tcm_alg, charp, 0444);
+MODULE_PARM_DESC(tcm, "Container manager algorithm (sita or rowmap)");
 
 static struct dentry *dbgfs;
 static struct dentry *dbg_map;
@@ -1578,7 +1582,7 @@ static s32 __init tiler_init(void)
 	s32 r = -1;
 	struct device *device = NULL;
 	struct tcm_pt div_pt;
-	struct tcm *sita = NULL;
+	struct tcm *tcm_mgr = NULL;
 	struct tmm *tmm_pat = NULL;
 	struct pat_area area = {0};
 
@@ -1627,12 +1631,16 @@ static s32 __init tiler_init(void)
 	/* Allocate tiler container manager (we share 1 on OMAP4) */
 	div_pt.x = tiler.width;   /* hardcoded default */
 	div_pt.y = (3 * tiler.height) / 4;
-	sita = sita_init(tiler.width, tiler.height, (void *)&div_pt);
+	if (!strcmp(tcm_alg, "rowmap"))
+		tcm_mgr = rowmap_init(tiler.width, tiler.height,
+				      (void *)&div_pt);
+	else
+		tcm_mgr = sita_init(tiler.width, tiler.height, (void *)&div_pt);
 
-	tcm[TILFMT_8BIT]  = sita;
-	tcm[TILFMT_16BIT] = sita;
-	tcm[TILFMT_32BIT] = sita;
-	tcm[TILFMT_PAGE]  = sita;
+	tcm[TILFMT_8BIT]  = tcm_mgr;
+	tcm[TILFMT_16BIT] = tcm_mgr;
+	tcm[TILFMT_32BIT] = tcm_mgr;
+	tcm[TILFMT_PAGE]  = tcm_mgr;
 
 	/* Allocate tiler memory manager (must have 1 unique TMM per TCM ) */
 	tmm_pat = tmm_pat_init(0, dmac_va, dmac_pa);
@@ -1650,7 +1658,7 @@ static s32 __init tiler_init(void)
 	tiler.nv12_packed = tcm[TILFMT_8BIT] == tcm[TILFMT_16BIT];
 #endif
 
-	if (!sita || !tmm_pat) {
+	if (!tcm_mgr || !tmm_pat) {
 		r = -ENOMEM;
 		goto error;
 	}
@@ -1716,7 +1724,7 @@ error:
 #ifdef CONFIG_TILER_ENABLE_USERSPACE
 		kfree(tiler_device);
 #endif
-		tcm_deinit(sita);
+		tcm_deinit(tcm_mgr);
 		tmm_deinit(tmm_pat);
 		dma_free_coherent(NULL, tiler.width * tiler.height *
 					sizeof(*dmac_va), dmac_va, dmac_pa);
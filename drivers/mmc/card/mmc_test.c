@@ -1954,6 +1954,143 @@ static int mmc_test_large_seq_write_perf(struct mmc_test_card *test)
 	return mmc_test_large_seq_perf(test, 1);
 }
 
+#define PACKED_TEST_CHUNK	4096
+#define PACKED_TEST_ROUNDS	64
+
+/*
+ * Write 'cnt' chunks of 'sz' bytes, each followed by a gap of the same
+ * size so that they cannot be merged, starting at 'dev_addr'.  Either one
+ * write command per chunk or all of them in a single packed write, with
+ * 'hdr' as the packed command header.
+ */
+static int mmc_test_packed_io(struct mmc_test_card *test, unsigned long sz,
+			      unsigned int cnt, unsigned int dev_addr,
+			      u32 *hdr)
+{
+	struct mmc_test_area *t = &test->area;
+	struct mmc_card *card = test->card;
+	struct mmc_request mrq = {0};
+	struct mmc_command sbc = {0};
+	struct mmc_command cmd = {0};
+	struct mmc_command stop = {0};
+	struct mmc_data data = {0};
+	unsigned int ssz = sz >> 9, sg_len, i;
+	int ret;
+
+	if (!hdr) {
+		for (i = 0; i < cnt; i++) {
+			ret = mmc_test_area_io(test, sz, dev_addr + i * 2 * ssz,
+					       1, 0, 0);
+			if (ret)
+				return ret;
+		}
+		return 0;
+	}
+
+	memset(hdr, 0, 512);
+	hdr[0] = cpu_to_le32((cnt << 16) | (MMC_PACKED_HDR_WRITE << 8) |
+			     MMC_PACKED_HDR_VERSION);
+	for (i = 0; i < cnt; i++) {
+		unsigned int addr = dev_addr + i * 2 * ssz;
+
+		hdr[(i + 1) * 2] = cpu_to_le32(ssz);
+		hdr[(i + 1) * 2 + 1] = cpu_to_le32(mmc_card_blockaddr(card) ?
+						   addr : addr << 9);
+	}
+
+	/* the header block takes the first segment, the data the others */
+	sg_init_table(t->sg, t->max_segs);
+	ret = mmc_test_map_sg(t->mem, sz * cnt, t->sg + 1, 1, t->max_segs - 1,
+			      t->max_seg_sz, &sg_len);
+	if (ret)
+		return ret;
+	sg_set_buf(t->sg, hdr, 512);
+
+	mrq.sbc = &sbc;
+	mrq.cmd = &cmd;
+	mrq.data = &data;
+	mrq.stop = &stop;
+
+	mmc_test_prepare_mrq(test, &mrq, t->sg, sg_len + 1, dev_addr,
+			     cnt * ssz + 1, 512, 1);
+
+	sbc.opcode = MMC_SET_BLOCK_COUNT;
+	sbc.arg = MMC_CMD23_ARG_PACKED | (cnt * ssz + 1);
+	sbc.flags = MMC_RSP_R1 | MMC_CMD_AC;
+
+	mmc_wait_for_req(card->host, &mrq);
+
+	mmc_test_wait_busy(test);
+
+	if (sbc.error)
+		return sbc.error;
+	return mmc_test_check_result(test, &mrq);
+}
+
+/*
+ * Small scattered write performance, one write command per chunk versus
+ * eMMC 4.5 packed writes of the same chunks, for growing numbers of
+ * chunks per packed command.  The IOPS figures count chunks.
+ */
+static int mmc_test_packed_write_perf(struct mmc_test_card *test)
+{
+	struct mmc_test_area *t = &test->area;
+	struct mmc_card *card = test->card;
+	unsigned long sz = PACKED_TEST_CHUNK;
+	unsigned int max_cnt, cnt, i, dev_addr;
+	struct timespec ts1, ts2;
+	u32 *hdr;
+	int ret = 0, packed;
+
+	if (!mmc_host_cmd23(card->host) || !mmc_host_packed_wr(card->host))
+		return RESULT_UNSUP_HOST;
+	if (!card->ext_csd.max_packed_writes)
+		return RESULT_UNSUP_CARD;
+	/* the header needs a segment of its own */
+	if (t->max_segs < 2)
+		return RESULT_UNSUP_HOST;
+
+	/* one header word pair per entry after the first pair */
+	max_cnt = min_t(unsigned int, card->ext_csd.max_packed_writes, 63);
+	while (max_cnt > 1 && (max_cnt * sz + 512 > t->max_tfr ||
+			       max_cnt * 2 * sz > t->max_sz))
+		max_cnt--;
+	if (max_cnt < 2)
+		return RESULT_UNSUP_HOST;
+
+	hdr = kmalloc(512, GFP_KERNEL);
+	if (!hdr)
+		return -ENOMEM;
+
+	dev_addr = t->dev_addr;
+	for (cnt = 2; ; cnt = min(cnt * 2, max_cnt)) {
+		for (packed = 0; packed < 2; packed++) {
+			getnstimeofday(&ts1);
+			for (i = 0; i < PACKED_TEST_ROUNDS; i++) {
+				ret = mmc_test_packed_io(test, sz, cnt,
+							 dev_addr,
+							 packed ? hdr : NULL);
+				if (ret)
+					goto out;
+			}
+			getnstimeofday(&ts2);
+
+			printk(KERN_INFO "%s: %u chunks %s\n",
+			       mmc_hostname(card->host), cnt,
+			       packed ? "in one packed write" :
+			       "as separate writes");
+			mmc_test_print_avg_rate(test, sz,
+						cnt * PACKED_TEST_ROUNDS,
+						&ts1, &ts2);
+		}
+		if (cnt == max_cnt)
+			break;
+	}
+out:
+	kfree(hdr);
+	return ret;
+}
+
 static const struct mmc_test_case mmc_test_cases[] = {
 	{
 		.name = "Basic write (no data verification)",
@@ -2221,6 +2358,13 @@ static const struct mmc_test_case mmc_test_cases[] = {
 		.cleanup = mmc_test_area_cleanup,
 	},
 
+	{
+		.name = "Packed write performance of small scattered writes",
+		.prepare = mmc_test_area_prepare,
+		.run = mmc_test_packed_write_perf,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
 };
 
 static DEFINE_MUTEX(mmc_test_lock);
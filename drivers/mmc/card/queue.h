@@ -1,22 +1,89 @@
 #ifndef MMC_QUEUE_H
 #define MMC_QUEUE_H
 
+#include <linux/ktime.h>
+
 struct request;
 struct task_struct;
 
+struct mmc_blk_request {
+	struct mmc_request	mrq;
+	struct mmc_command	sbc;
+	struct mmc_command	cmd;
+	struct mmc_command	stop;
+	struct mmc_data		data;
+};
+
+enum mmc_packed_type {
+	MMC_PACKED_NONE = 0,
+	MMC_PACKED_WRITE,
+};
+
+/*
+ * An eMMC 4.5 packed write: one CMD23/CMD25 pair carrying a header block
+ * followed by the data of several write requests.  The header holds the
+ * CMD23 argument and start address of every packed request.
+ */
+#define MMC_PACKED_HDR_WORDS	128	/* one 512 byte block */
+#define MMC_PACKED_MAX_ENTRIES	(MMC_PACKED_HDR_WORDS / 2 - 1)
+#define MMC_PACKED_NR_IDX	-1
+
+struct mmc_packed {
+	struct list_head	list;		/* requests, in header order */
+	u32			cmd_hdr[MMC_PACKED_HDR_WORDS];
+	unsigned int		blocks;		/* data blocks, without header */
+	u8			nr_entries;
+	u8			retries;
+	s16			idx_failure;	/* first failed entry, or NR_IDX */
+};
+
+struct mmc_queue_req {
+	struct request		*req;
+	struct mmc_blk_request	brq;
+	struct scatterlist	*sg;
+	char			*bounce_buf;
+	struct scatterlist	*bounce_sg;
+	unsigned int		bounce_sg_len;
+	struct mmc_async_req	mmc_active;
+	ktime_t			fetched;	/* taken off the block queue */
+	ktime_t			done;		/* seen complete by err_check */
+	enum mmc_packed_type	cmd_type;
+	struct mmc_packed	*packed;	/* NULL if packing is unsupported */
+};
+
+/*
+ * Bus idle accounting: time between the end of one transfer and the start
+ * of the next one while the next request was already queued.  With the
+ * request pipeline the next transfer is issued right from the completion
+ * of the previous one, so this should stay close to the command overhead.
+ * The packed counters tell how many writes were merged into packed
+ * commands and how many still went out alone.
+ */
+struct mmc_queue_stats {
+	spinlock_t		lock;
+	ktime_t			last_done;	/* end of the last transfer */
+	unsigned long		transfers;
+	unsigned long		pipelined;	/* prepared during a transfer */
+	u64			idle_ns;	/* total gap between transfers */
+	u64			max_idle_ns;
+	unsigned long		packed_cmds;	/* packed writes issued */
+	unsigned long		packed_reqs;	/* requests sent in them */
+	unsigned long		unpacked_wr;	/* writes sent on their own */
+};
+
 struct mmc_queue {
 	struct mmc_card		*card;
 	struct task_struct	*thread;
 	struct semaphore	thread_sem;
 	unsigned int		flags;
-	struct request		*req;
 	int			(*issue_fn)(struct mmc_queue *, struct request *);
 	void			*data;
 	struct request_queue	*queue;
-	struct scatterlist	*sg;
-	char			*bounce_buf;
-	struct scatterlist	*bounce_sg;
-	unsigned int		bounce_sg_len;
+	struct mmc_queue_req	mqrq[2];
+	struct mmc_queue_req	*mqrq_cur;
+	struct mmc_queue_req	*mqrq_prev;
+	struct mmc_queue_stats	stats;
+	unsigned int		max_packed;	/* writes per packed command */
 };
 
 extern int mmc_init_queue(struct mmc_queue *, struct mmc_card *, spinlock_t *,
@@ -25,8 +92,13 @@ extern void mmc_cleanup_queue(struct mmc_queue *);
 extern void mmc_queue_suspend(struct mmc_queue *);
 extern void mmc_queue_resume(struct mmc_queue *);
 
-extern unsigned int mmc_queue_map_sg(struct mmc_queue *);
-extern void mmc_queue_bounce_pre(struct mmc_queue *);
-extern void mmc_queue_bounce_post(struct mmc_queue *);
+extern unsigned int mmc_queue_map_sg(struct mmc_queue *,
+				     struct mmc_queue_req *);
+extern void mmc_queue_bounce_pre(struct mmc_queue_req *);
+extern void mmc_queue_bounce_post(struct mmc_queue_req *);
+
+extern void mmc_queue_xfer_start(struct mmc_queue *, struct mmc_queue_req *,
+				 bool);
+extern void mmc_queue_xfer_done(struct mmc_queue *, ktime_t);
 
 #endif
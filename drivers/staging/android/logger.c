@@ -22,9 +22,11 @@
 #include <linux/fs.h>
 #include <linux/miscdevice.h>
 #include <linux/uaccess.h>
+#include <linux/percpu.h>
 #include <linux/poll.h>
 #include <linux/slab.h>
 #include <linux/time.h>
+#include <linux/mutex.h>
 #include "logger.h"
 
 #include <asm/ioctls.h>
@@ -34,14 +36,15 @@
  *
  * This structure lives from module insertion until module removal, so it does
  * not need additional reference counting. The structure is protected by the
- * mutex 'mutex'.
+ * spinlock 'lock', which is never held across a user copy: writers stage their
+ * payload beforehand and readers copy the entry out to their own buffer.
  */
 struct logger_log {
 	unsigned char 		*buffer;/* the ring buffer itself */
 	struct miscdevice	misc;	/* misc device representing the log */
 	wait_queue_head_t	wq;	/* wait queue for readers */
 	struct list_head	readers; /* this log's readers */
-	struct mutex		mutex;	/* mutex protecting buffer */
+	spinlock_t		lock;	/* lock protecting buffer */
 	size_t			w_off;	/* current write head offset */
 	size_t			head;	/* new readers start here */
 	size_t			size;	/* size of the log */
@@ -51,7 +54,9 @@ struct logger_log {
  * struct logger_reader - a logging device open for reading
  *
  * This object lives from open to release, so we don't need additional
- * reference counting. The structure is protected by log->mutex.
+ * reference counting. The structure is protected by log->lock, except for
+ * 'msg', which is only used by read() with 'mutex' held. 'mutex' also
+ * serializes changes to 'r_ver' against a read in progress.
  */
 struct logger_reader {
 	struct logger_log	*log;	/* associated log */
@@ -59,8 +64,20 @@ struct logger_reader {
 	size_t			r_off;	/* current read head offset */
 	bool			r_all;	/* reader can read all entries */
 	int			r_ver;	/* reader ABI version */
+	struct mutex		mutex;	/* serializes read() and r_ver */
+	unsigned char		*msg;	/* payload being copied to userspace */
 };
 
+/*
+ * Per-CPU staging buffer for the payload of a write. It is filled with page
+ * faults disabled while preemption is off, so a writer only takes log->lock
+ * to memcpy() an entry that is already in kernel memory.
+ */
+struct logger_stage {
+	unsigned char		msg[LOGGER_ENTRY_MAX_PAYLOAD];
+};
+static DEFINE_PER_CPU(struct logger_stage, logger_stage);
+
 /* logger_offset - returns index 'n' into the log via (optimized) modulus */
 #define logger_offset(n)	((n) & (log->size - 1))
 
@@ -112,7 +129,7 @@ static struct logger_entry *get_entry_header(struct logger_log *log,
  * get_entry_msg_len - Grabs the length of the message of the entry
  * starting from from 'off'.
  *
- * Caller needs to hold log->mutex.
+ * Caller needs to hold log->lock.
  */
 static __u32 get_entry_msg_len(struct logger_log *log, size_t off)
 {
@@ -156,31 +173,23 @@ static ssize_t copy_header_to_user(int ver, struct logger_entry *entry,
 }
 
 /*
- * do_read_log_to_user - reads exactly 'count' bytes from 'log' into the
- * user-space buffer 'buf'. Returns 'count' on success.
+ * do_read_log - copies the header of the entry at the read head of 'reader'
+ * to 'hdr' and its payload of 'count' bytes to reader->msg, and moves the
+ * read head past it.
  *
- * Caller must hold log->mutex.
+ * Caller must hold log->lock and reader->mutex.
  */
-static ssize_t do_read_log_to_user(struct logger_log *log,
-				   struct logger_reader *reader,
-				   char __user *buf,
-				   size_t count)
+static void do_read_log(struct logger_log *log, struct logger_reader *reader,
+			struct logger_entry *hdr, size_t count)
 {
-	struct logger_entry scratch;
 	struct logger_entry *entry;
 	size_t len;
 	size_t msg_start;
 
-	/*
-	 * First, copy the header to userspace, using the version of
-	 * the header requested
-	 */
-	entry = get_entry_header(log, reader->r_off, &scratch);
-	if (copy_header_to_user(reader->r_ver, entry, buf))
-		return -EFAULT;
+	entry = get_entry_header(log, reader->r_off, hdr);
+	if (entry != hdr)
+		*hdr = *entry;
 
-	count -= get_user_hdr_len(reader->r_ver);
-	buf += get_user_hdr_len(reader->r_ver);
 	msg_start = logger_offset(reader->r_off + sizeof(struct logger_entry));
 
 	/*
@@ -189,21 +198,39 @@ static ssize_t do_read_log_to_user(struct logger_log *log,
 	 * the log, whichever comes first.
 	 */
 	len = min(count, log->size - msg_start);
-	if (copy_to_user(buf, log->buffer + msg_start, len))
-		return -EFAULT;
+	memcpy(reader->msg, log->buffer + msg_start, len);
 
 	/*
 	 * Second, we read any remaining bytes, starting back at the head of
 	 * the log.
 	 */
 	if (count != len)
-		if (copy_to_user(buf + len, log->buffer, count - len))
-			return -EFAULT;
+		memcpy(reader->msg + len, log->buffer, count - len);
 
 	reader->r_off = logger_offset(reader->r_off +
 		sizeof(struct logger_entry) + count);
+}
+
+/*
+ * copy_entry_to_user - copies the entry staged by do_read_log() with a
+ * payload of 'count' bytes to the user-space buffer 'buf', using the version
+ * of the header requested. Returns the number of bytes copied.
+ *
+ * Caller must hold reader->mutex.
+ */
+static ssize_t copy_entry_to_user(struct logger_reader *reader,
+				  struct logger_entry *hdr,
+				  char __user *buf, size_t count)
+{
+	size_t hdr_len = get_user_hdr_len(reader->r_ver);
 
-	return count + get_user_hdr_len(reader->r_ver);
+	if (copy_header_to_user(reader->r_ver, hdr, buf))
+		return -EFAULT;
+
+	if (copy_to_user(buf + hdr_len, reader->msg, count))
+		return -EFAULT;
+
+	return hdr_len + count;
 }
 
 /*
@@ -247,16 +274,18 @@ static ssize_t logger_read(struct file *file, char __user *buf,
 {
 	struct logger_reader *reader = file->private_data;
 	struct logger_log *log = reader->log;
+	struct logger_entry hdr;
 	ssize_t ret;
+	size_t len;
 	DEFINE_WAIT(wait);
 
 start:
 	while (1) {
 		prepare_to_wait(&log->wq, &wait, TASK_INTERRUPTIBLE);
 
-		mutex_lock(&log->mutex);
+		spin_lock(&log->lock);
 		ret = (log->w_off == reader->r_off);
-		mutex_unlock(&log->mutex);
+		spin_unlock(&log->lock);
 		if (!ret)
 			break;
 
@@ -277,7 +306,8 @@ start:
 	if (ret)
 		return ret;
 
-	mutex_lock(&log->mutex);
+	mutex_lock(&reader->mutex);
+	spin_lock(&log->lock);
 
 	if (!reader->r_all)
 		reader->r_off = get_next_entry_by_uid(log,
@@ -285,23 +315,30 @@ start:
 
 	/* is there still something to read or did we race? */
 	if (unlikely(log->w_off == reader->r_off)) {
-		mutex_unlock(&log->mutex);
+		spin_unlock(&log->lock);
+		mutex_unlock(&reader->mutex);
 		goto start;
 	}
 
 	/* get the size of the next entry */
-	ret = get_user_hdr_len(reader->r_ver) +
-		get_entry_msg_len(log, reader->r_off);
-	if (count < ret) {
-		ret = -EINVAL;
-		goto out;
+	len = get_entry_msg_len(log, reader->r_off);
+	if (count < get_user_hdr_len(reader->r_ver) + len) {
+		spin_unlock(&log->lock);
+		mutex_unlock(&reader->mutex);
+		return -EINVAL;
 	}
 
-	/* get exactly one entry from the log */
-	ret = do_read_log_to_user(log, reader, buf, ret);
+	/*
+	 * Take exactly one entry from the log. It is consumed even if the
+	 * copy to userspace below faults, as it may be overwritten as soon
+	 * as the lock is dropped.
+	 */
+	do_read_log(log, reader, &hdr, len);
 
-out:
-	mutex_unlock(&log->mutex);
+	spin_unlock(&log->lock);
+
+	ret = copy_entry_to_user(reader, &hdr, buf, len);
+	mutex_unlock(&reader->mutex);
 
 	return ret;
 }
@@ -310,7 +347,7 @@ out:
  * get_next_entry - return the offset of the first valid entry at least 'len'
  * bytes after 'off'.
  *
- * Caller must hold log->mutex.
+ * Caller must hold log->lock.
  */
 static size_t get_next_entry(struct logger_log *log, size_t off, size_t len)
 {
@@ -349,7 +386,7 @@ static inline int clock_interval(size_t a, size_t b, size_t c)
  * We do this by "pulling forward" the readers and start head to the first
  * entry after the new write head.
  *
- * The caller needs to hold log->mutex.
+ * The caller needs to hold log->lock.
  */
 static void fix_up_readers(struct logger_log *log, size_t len)
 {
@@ -368,7 +405,7 @@ static void fix_up_readers(struct logger_log *log, size_t len)
 /*
  * do_write_log - writes 'len' bytes from 'buf' to 'log'
  *
- * The caller needs to hold log->mutex.
+ * The caller needs to hold log->lock.
  */
 static void do_write_log(struct logger_log *log, const void *buf, size_t count)
 {
@@ -385,44 +422,57 @@ static void do_write_log(struct logger_log *log, const void *buf, size_t count)
 }
 
 /*
- * do_write_log_user - writes 'len' bytes from the user-space buffer 'buf' to
- * the log 'log'
- *
- * The caller needs to hold log->mutex.
+ * copy_payload_from_user - gathers 'count' bytes from the user-space vectors
+ * 'iov' into 'msg'. With 'atomic' set this must be called with page faults
+ * disabled and fails rather than faulting the user pages in.
  *
  * Returns 'count' on success, negative error code on failure.
  */
-static ssize_t do_write_log_from_user(struct logger_log *log,
-				      const void __user *buf, size_t count)
+static ssize_t copy_payload_from_user(unsigned char *msg,
+				      const struct iovec *iov,
+				      unsigned long nr_segs, size_t count,
+				      bool atomic)
 {
-	size_t len;
+	size_t done = 0;
 
-	len = min(count, log->size - log->w_off);
-	if (len && copy_from_user(log->buffer + log->w_off, buf, len))
-		return -EFAULT;
+	while (nr_segs-- > 0 && done < count) {
+		size_t len = min_t(size_t, iov->iov_len, count - done);
+		unsigned long left;
 
-	if (count != len)
-		if (copy_from_user(log->buffer, buf + len, count - len))
+		if (atomic)
+			left = access_ok(VERIFY_READ, iov->iov_base, len) ?
+				__copy_from_user_inatomic(msg + done,
+					iov->iov_base, len) : len;
+		else
+			left = copy_from_user(msg + done, iov->iov_base, len);
+		if (unlikely(left))
 			return -EFAULT;
 
-	log->w_off = logger_offset(log->w_off + count);
+		iov++;
+		done += len;
+	}
 
-	return count;
+	return done;
 }
 
 /*
  * logger_aio_write - our write method, implementing support for write(),
  * writev(), and aio_write(). Writes are our fast path, and we try to optimize
  * them above all else.
+ *
+ * The payload is first staged in this CPU's buffer, so log->lock is only
+ * held to fix up the readers and copy the finished entry into the ring, and
+ * concurrent writers never sleep on each other. Only if the user pages are
+ * not resident do we fall back to faulting them into a temporary buffer.
  */
 ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 			 unsigned long nr_segs, loff_t ppos)
 {
 	struct logger_log *log = file_get_log(iocb->ki_filp);
-	size_t orig = log->w_off;
 	struct logger_entry header;
 	struct timespec now;
-	ssize_t ret = 0;
+	unsigned char *msg, *slow = NULL;
+	ssize_t ret;
 
 	now = current_kernel_time();
 
@@ -438,41 +488,51 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 	if (unlikely(!header.len))
 		return 0;
 
-	mutex_lock(&log->mutex);
+	preempt_disable();
+	msg = __get_cpu_var(logger_stage).msg;
+	pagefault_disable();
+	ret = copy_payload_from_user(msg, iov, nr_segs, header.len, true);
+	pagefault_enable();
+	if (unlikely(ret < 0)) {
+		preempt_enable();
+		msg = slow = kmalloc(header.len, GFP_KERNEL);
+		if (!slow)
+			return -ENOMEM;
+		ret = copy_payload_from_user(msg, iov, nr_segs, header.len,
+					     false);
+		if (unlikely(ret < 0)) {
+			kfree(slow);
+			return ret;
+		}
+	}
+
+	spin_lock(&log->lock);
 
 	/*
 	 * Fix up any readers, pulling them forward to the first readable
-	 * entry after (what will be) the new write offset. We do this now
-	 * because if we partially fail, we can end up with clobbered log
-	 * entries that encroach on readable buffer.
+	 * entry after (what will be) the new write offset.
 	 */
 	fix_up_readers(log, sizeof(struct logger_entry) + header.len);
 
 	do_write_log(log, &header, sizeof(struct logger_entry));
+	do_write_log(log, msg, header.len);
 
-	while (nr_segs-- > 0) {
-		size_t len;
-		ssize_t nr;
-
-		/* figure out how much of this vector we can keep */
-		len = min_t(size_t, iov->iov_len, header.len - ret);
+	spin_unlock(&log->lock);
 
-		/* write out this segment's payload */
-		nr = do_write_log_from_user(log, iov->iov_base, len);
-		if (unlikely(nr < 0)) {
-			log->w_off = orig;
-			mutex_unlock(&log->mutex);
-			return nr;
-		}
-
-		iov++;
-		ret += nr;
-	}
-
-	mutex_unlock(&log->mutex);
+	if (slow)
+		kfree(slow);
+	else
+		preempt_enable();
 
-	/* wake up any blocked readers */
-	wake_up_interruptible(&log->wq);
+	/*
+	 * Wake up any blocked readers. Readers queue themselves before they
+	 * check w_off under log->lock, so after the barrier an empty wait
+	 * queue means nobody can have missed this entry and we can skip the
+	 * wait queue lock, which all writers would otherwise contend on.
+	 */
+	smp_mb();
+	if (waitqueue_active(&log->wq))
+		wake_up_interruptible(&log->wq);
 
 	return ret;
 }
@@ -504,17 +564,24 @@ static int logger_open(struct inode *inode, struct file *file)
 		if (!reader)
 			return -ENOMEM;
 
+		reader->msg = kmalloc(LOGGER_ENTRY_MAX_PAYLOAD, GFP_KERNEL);
+		if (!reader->msg) {
+			kfree(reader);
+			return -ENOMEM;
+		}
+
 		reader->log = log;
 		reader->r_ver = 1;
+		mutex_init(&reader->mutex);
 		reader->r_all = in_egroup_p(inode->i_gid) ||
 			capable(CAP_SYSLOG);
 
 		INIT_LIST_HEAD(&reader->list);
 
-		mutex_lock(&log->mutex);
+		spin_lock(&log->lock);
 		reader->r_off = log->head;
 		list_add_tail(&reader->list, &log->readers);
-		mutex_unlock(&log->mutex);
+		spin_unlock(&log->lock);
 
 		file->private_data = reader;
 	} else
@@ -534,10 +601,11 @@ static int logger_release(struct inode *ignored, struct file *file)
 		struct logger_reader *reader = file->private_data;
 		struct logger_log *log = reader->log;
 
-		mutex_lock(&log->mutex);
+		spin_lock(&log->lock);
 		list_del(&reader->list);
-		mutex_unlock(&log->mutex);
+		spin_unlock(&log->lock);
 
+		kfree(reader->msg);
 		kfree(reader);
 	}
 
@@ -567,14 +635,14 @@ static unsigned int logger_poll(struct file *file, poll_table *wait)
 
 	poll_wait(file, &log->wq, wait);
 
-	mutex_lock(&log->mutex);
+	spin_lock(&log->lock);
 	if (!reader->r_all)
 		reader->r_off = get_next_entry_by_uid(log,
 			reader->r_off, current_euid());
 
 	if (log->w_off != reader->r_off)
 		ret |= POLLIN | POLLRDNORM;
-	mutex_unlock(&log->mutex);
+	spin_unlock(&log->lock);
 
 	return ret;
 }
@@ -588,7 +656,9 @@ static long logger_set_version(struct logger_reader *reader, void __user *arg)
 	if ((version < 1) || (version > 2))
 		return -EINVAL;
 
+	mutex_lock(&reader->mutex);
 	reader->r_ver = version;
+	mutex_unlock(&reader->mutex);
 	return 0;
 }
 
@@ -599,7 +669,14 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	long ret = -EINVAL;
 	void __user *argp = (void __user *) arg;
 
-	mutex_lock(&log->mutex);
+	/* only touches the reader, and may fault */
+	if (cmd == LOGGER_SET_VERSION) {
+		if (!(file->f_mode & FMODE_READ))
+			return -EBADF;
+		return logger_set_version(file->private_data, argp);
+	}
+
+	spin_lock(&log->lock);
 
 	switch (cmd) {
 	case LOGGER_GET_LOG_BUF_SIZE:
@@ -651,17 +728,9 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		reader = file->private_data;
 		ret = reader->r_ver;
 		break;
-	case LOGGER_SET_VERSION:
-		if (!(file->f_mode & FMODE_READ)) {
-			ret = -EBADF;
-			break;
-		}
-		reader = file->private_data;
-		ret = logger_set_version(reader, argp);
-		break;
 	}
 
-	mutex_unlock(&log->mutex);
+	spin_unlock(&log->lock);
 
 	return ret;
 }
@@ -694,7 +763,7 @@ static struct logger_log VAR = { \
 	}, \
 	.wq = __WAIT_QUEUE_HEAD_INITIALIZER(VAR .wq), \
 	.readers = LIST_HEAD_INIT(VAR .readers), \
-	.mutex = __MUTEX_INITIALIZER(VAR .mutex), \
+	.lock = __SPIN_LOCK_UNLOCKED(VAR .lock), \
 	.w_off = 0, \
 	.head = 0, \
 	.size = SIZE, \
@@ -17,6 +17,11 @@
  * percentage of the cached memory is locked this can be very inaccurate
  * and processes may not get killed until the normal oom killer is triggered.
  *
+ * With CONFIG_ANDROID_LMK_VMPRESSURE, /dev/lowmemorykiller additionally
+ * reports memory pressure levels computed from reclaim efficiency. Write
+ * "low", "medium" or "critical" to select the lowest level of interest,
+ * then poll() for POLLIN; read() returns the name of the latest level.
+ *
  * Copyright (C) 2007-2008 Google, Inc.
  *
  * This software is licensed under the terms of the GNU General Public
@@ -41,6 +46,17 @@
 #include <linux/compaction.h>
 #include <linux/mutex.h>
 #include <linux/delay.h>
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
+#include <linux/miscdevice.h>
+#include <linux/fs.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/vmpressure.h>
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/lowmemorykiller.h>
 
 static uint32_t lowmem_debug_level = 1;
 static int lowmem_adj[6] = {
@@ -70,20 +86,195 @@ extern int compact_nodes(bool);
 
 static DEFINE_MUTEX(scan_mutex);
 
-static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
+struct lowmem_victim {
+	struct task_struct *task;
+	int tasksize;
+	int oom_score_adj;
+};
+
+/*
+ * Check whether @tsk makes a better victim than the one selected so far.
+ * Returns -EBUSY if a previously killed task has not exited yet, in which
+ * case the scan is abandoned to give it time to free its memory.
+ */
+static int lowmem_consider(struct task_struct *tsk, int min_score_adj,
+			   struct lowmem_victim *victim)
+{
+	struct task_struct *p;
+	int oom_score_adj;
+	int tasksize;
+
+	if (tsk->flags & PF_KTHREAD)
+		return 0;
+
+	p = find_lock_task_mm(tsk);
+	if (!p)
+		return 0;
+
+	if (test_tsk_thread_flag(p, TIF_MEMDIE) &&
+	    time_before_eq(jiffies, lowmem_deathpending_timeout)) {
+		task_unlock(p);
+		return -EBUSY;
+	}
+	oom_score_adj = p->signal->oom_score_adj;
+	if (oom_score_adj < min_score_adj) {
+		task_unlock(p);
+		return 0;
+	}
+	tasksize = get_mm_rss(p->mm);
+	task_unlock(p);
+	if (tasksize <= 0)
+		return 0;
+	if (victim->task) {
+		if (oom_score_adj < victim->oom_score_adj)
+			return 0;
+		if (oom_score_adj == victim->oom_score_adj &&
+		    tasksize <= victim->tasksize)
+			return 0;
+	}
+	victim->task = p;
+	victim->tasksize = tasksize;
+	victim->oom_score_adj = oom_score_adj;
+	lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
+		     p->pid, p->comm, oom_score_adj, tasksize);
+	return 0;
+}
+
+#ifdef CONFIG_ANDROID_LMK_ADJ_INDEX
+#define LOWMEM_NR_BUCKETS	(OOM_SCORE_ADJ_MAX - OOM_SCORE_ADJ_MIN + 1)
+
+/*
+ * Thread group leaders hashed by oom_score_adj. The index is kept up to
+ * date on fork, exec, release and on every oom_score_adj change, so the
+ * shrinker only has to look at the tasks in the highest populated bucket
+ * instead of walking the whole task list. lowmem_bucket_map has a bit set
+ * for each non-empty bucket.
+ *
+ * The hooks are called with no other locks held; the scan takes task_lock
+ * under lowmem_index_lock so this lock must never nest inside it.
+ */
+static struct hlist_head lowmem_buckets[LOWMEM_NR_BUCKETS];
+static DECLARE_BITMAP(lowmem_bucket_map, LOWMEM_NR_BUCKETS);
+static DEFINE_SPINLOCK(lowmem_index_lock);
+
+static void __lowmem_index_insert(struct task_struct *tsk)
+{
+	int bucket = tsk->signal->oom_score_adj - OOM_SCORE_ADJ_MIN;
+
+	tsk->lmk_adj = tsk->signal->oom_score_adj;
+	hlist_add_head(&tsk->lmk_node, &lowmem_buckets[bucket]);
+	__set_bit(bucket, lowmem_bucket_map);
+}
+
+static void __lowmem_index_remove(struct task_struct *tsk)
+{
+	int bucket = tsk->lmk_adj - OOM_SCORE_ADJ_MIN;
+
+	hlist_del_init(&tsk->lmk_node);
+	if (hlist_empty(&lowmem_buckets[bucket]))
+		__clear_bit(bucket, lowmem_bucket_map);
+}
+
+void lowmem_index_add(struct task_struct *tsk)
+{
+	spin_lock(&lowmem_index_lock);
+	if (hlist_unhashed(&tsk->lmk_node))
+		__lowmem_index_insert(tsk);
+	spin_unlock(&lowmem_index_lock);
+}
+
+/*
+ * Move the thread group of @tsk to the bucket matching its current
+ * oom_score_adj. The group leader is looked up under the index lock so
+ * that a racing exec either sees the new value or is seen by us.
+ */
+void lowmem_index_update(struct task_struct *tsk)
+{
+	struct task_struct *leader;
+
+	rcu_read_lock();
+	spin_lock(&lowmem_index_lock);
+	leader = tsk->group_leader;
+	if (!hlist_unhashed(&leader->lmk_node) &&
+	    leader->lmk_adj != leader->signal->oom_score_adj) {
+		__lowmem_index_remove(leader);
+		__lowmem_index_insert(leader);
+	}
+	spin_unlock(&lowmem_index_lock);
+	rcu_read_unlock();
+}
+
+void lowmem_index_del(struct task_struct *tsk)
+{
+	spin_lock(&lowmem_index_lock);
+	if (!hlist_unhashed(&tsk->lmk_node))
+		__lowmem_index_remove(tsk);
+	spin_unlock(&lowmem_index_lock);
+}
+
+/*
+ * Walk the buckets from OOM_SCORE_ADJ_MAX down to @min_score_adj and stop
+ * at the first one containing a killable task; within a bucket the task
+ * with the largest RSS wins, as with the full task list walk.
+ */
+static int lowmem_select(int min_score_adj, struct lowmem_victim *victim,
+			 unsigned int *nr_scanned)
+{
+	unsigned long min_bucket = min_score_adj - OOM_SCORE_ADJ_MIN;
+	unsigned long limit = LOWMEM_NR_BUCKETS;
+	unsigned long bucket;
+	struct task_struct *tsk;
+	struct hlist_node *node;
+	int ret = 0;
+
+	spin_lock(&lowmem_index_lock);
+	while ((bucket = find_last_bit(lowmem_bucket_map, limit)) < limit &&
+	       bucket >= min_bucket) {
+		hlist_for_each_entry(tsk, node, &lowmem_buckets[bucket],
+				     lmk_node) {
+			(*nr_scanned)++;
+			ret = lowmem_consider(tsk, min_score_adj, victim);
+			if (ret)
+				goto out;
+		}
+		if (victim->task)
+			break;
+		limit = bucket;
+	}
+out:
+	spin_unlock(&lowmem_index_lock);
+	return ret;
+}
+#else
+static int lowmem_select(int min_score_adj, struct lowmem_victim *victim,
+			 unsigned int *nr_scanned)
 {
 	struct task_struct *tsk;
-	struct task_struct *selected = NULL;
+	int ret;
+
+	for_each_process(tsk) {
+		(*nr_scanned)++;
+		ret = lowmem_consider(tsk, min_score_adj, victim);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+#endif
+
+static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
+{
+	struct lowmem_victim victim = { .task = NULL };
 	int rem = 0;
-	int tasksize;
 	int i;
 	int min_score_adj = OOM_SCORE_ADJ_MAX + 1;
-	int selected_tasksize = 0;
-	int selected_oom_score_adj;
 	int array_size = ARRAY_SIZE(lowmem_adj);
 	int other_free;
 	int other_file;
 	unsigned long nr_to_scan = sc->nr_to_scan;
+	unsigned int nr_scanned = 0;
+	ktime_t start;
+	int ret;
 
 	if (nr_to_scan > 0) {
 		if (mutex_lock_interruptible(&scan_mutex) < 0)
@@ -123,70 +314,42 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 		return rem;
 	}
 
-	selected_oom_score_adj = min_score_adj;
-	
+	start = ktime_get();
 	rcu_read_lock();
-	for_each_process(tsk) {
-		struct task_struct *p;
-		int oom_score_adj;
-
-		if (tsk->flags & PF_KTHREAD)
-			continue;
-
-		p = find_lock_task_mm(tsk);
-		if (!p)
-			continue;
-
-		if (test_tsk_thread_flag(p, TIF_MEMDIE) &&
-		    time_before_eq(jiffies, lowmem_deathpending_timeout)) {
-			task_unlock(p);
-			rcu_read_unlock();
-			/* give the system time to free up the memory */
-			msleep_interruptible(20);
-			mutex_unlock(&scan_mutex);
-			return 0;
-		}
-		oom_score_adj = p->signal->oom_score_adj;
-		if (oom_score_adj < min_score_adj) {
-			task_unlock(p);
-			continue;
-		}
-		tasksize = get_mm_rss(p->mm);
-		task_unlock(p);
-		if (tasksize <= 0)
-			continue;
-		if (selected) {
-			if (oom_score_adj < selected_oom_score_adj)
-				continue;
-			if (oom_score_adj == selected_oom_score_adj &&
-			    tasksize <= selected_tasksize)
-				continue;
-		}
-		selected = p;
-		selected_tasksize = tasksize;
-		selected_oom_score_adj = oom_score_adj;
-		lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
-			     p->pid, p->comm, oom_score_adj, tasksize);
+	ret = lowmem_select(min_score_adj, &victim, &nr_scanned);
+	trace_lowmem_scan(min_score_adj, nr_scanned,
+			  ktime_to_ns(ktime_sub(ktime_get(), start)),
+			  victim.task && !ret ? victim.task->pid : 0,
+			  victim.oom_score_adj, victim.tasksize);
+	if (ret) {
+		rcu_read_unlock();
+		/* give the system time to free up the memory */
+		msleep_interruptible(20);
+		mutex_unlock(&scan_mutex);
+		return 0;
 	}
-	if (selected) {
+	if (victim.task) {
 		lowmem_print(1, "send sigkill to %d (%s), adj %d, size %d\n",
-			     selected->pid, selected->comm,
-			     selected_oom_score_adj, selected_tasksize);
+			     victim.task->pid, victim.task->comm,
+			     victim.oom_score_adj, victim.tasksize);
 		lowmem_deathpending_timeout = jiffies + HZ;
-		send_sig(SIGKILL, selected, 0);
-		set_tsk_thread_flag(selected, TIF_MEMDIE);
-		rem -= selected_tasksize;
-		/* give the system time to free up the memory */
-		msleep_interruptible(20);
+		send_sig(SIGKILL, victim.task, 0);
+		set_tsk_thread_flag(victim.task, TIF_MEMDIE);
+		rem -= victim.tasksize;
 	}
+	rcu_read_unlock();
+
 	lowmem_print(4, "lowmem_shrink %lu, %x, return %d\n",
 		     nr_to_scan, sc->gfp_mask, rem);
 
-	rcu_read_unlock();
+	if (victim.task) {
+		/* give the system time to free up the memory */
+		msleep_interruptible(20);
+	}
 	mutex_unlock(&scan_mutex);
 
-	if (selected)
-        	compact_nodes(false);
+	if (victim.task)
+		compact_nodes(false);
 
 	return rem;
 }
@@ -196,14 +359,212 @@ static struct shrinker lowmem_shrinker = {
 	.seeks = DEFAULT_SEEKS * 16
 };
 
+#ifdef CONFIG_ANDROID_LMK_VMPRESSURE
+struct lowmem_listener {
+	enum vmpressure_levels min_level;
+	unsigned long seen;
+};
+
+static DEFINE_SPINLOCK(lowmem_pressure_lock);
+static DECLARE_WAIT_QUEUE_HEAD(lowmem_pressure_wait);
+/* events at or above each level, and the most recent such level */
+static unsigned long lowmem_pressure_events[VMPRESSURE_NUM_LEVELS];
+static enum vmpressure_levels lowmem_pressure_last[VMPRESSURE_NUM_LEVELS];
+
+static int lowmem_pressure_notify(struct notifier_block *nb,
+				  unsigned long level, void *data)
+{
+	int i;
+
+	lowmem_print(4, "lowmem pressure %s\n",
+		     vmpressure_level_name(level));
+
+	spin_lock(&lowmem_pressure_lock);
+	for (i = 0; i <= level; i++) {
+		lowmem_pressure_events[i]++;
+		lowmem_pressure_last[i] = level;
+	}
+	spin_unlock(&lowmem_pressure_lock);
+
+	wake_up_interruptible(&lowmem_pressure_wait);
+	return NOTIFY_OK;
+}
+
+static struct notifier_block lowmem_pressure_nb = {
+	.notifier_call = lowmem_pressure_notify,
+};
+
+static bool lowmem_pressure_pending(struct lowmem_listener *l)
+{
+	bool pending;
+
+	spin_lock(&lowmem_pressure_lock);
+	pending = lowmem_pressure_events[l->min_level] != l->seen;
+	spin_unlock(&lowmem_pressure_lock);
+
+	return pending;
+}
+
+static int lowmem_pressure_open(struct inode *inode, struct file *file)
+{
+	struct lowmem_listener *l;
+
+	l = kzalloc(sizeof(*l), GFP_KERNEL);
+	if (!l)
+		return -ENOMEM;
+
+	l->min_level = VMPRESSURE_LOW;
+	spin_lock(&lowmem_pressure_lock);
+	l->seen = lowmem_pressure_events[l->min_level];
+	spin_unlock(&lowmem_pressure_lock);
+
+	file->private_data = l;
+	return nonseekable_open(inode, file);
+}
+
+static int lowmem_pressure_release(struct inode *inode, struct file *file)
+{
+	kfree(file->private_data);
+	return 0;
+}
+
+static ssize_t lowmem_pressure_read(struct file *file, char __user *buf,
+				    size_t count, loff_t *ppos)
+{
+	struct lowmem_listener *l = file->private_data;
+	enum vmpressure_levels level;
+	char kbuf[16];
+	int len;
+	int ret;
+
+	if (count < sizeof(kbuf))
+		return -EINVAL;
+
+	for (;;) {
+		spin_lock(&lowmem_pressure_lock);
+		if (lowmem_pressure_events[l->min_level] != l->seen) {
+			l->seen = lowmem_pressure_events[l->min_level];
+			level = lowmem_pressure_last[l->min_level];
+			spin_unlock(&lowmem_pressure_lock);
+			break;
+		}
+		spin_unlock(&lowmem_pressure_lock);
+
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+
+		ret = wait_event_interruptible(lowmem_pressure_wait,
+					       lowmem_pressure_pending(l));
+		if (ret)
+			return ret;
+	}
+
+	len = scnprintf(kbuf, sizeof(kbuf), "%s\n",
+			vmpressure_level_name(level));
+	if (copy_to_user(buf, kbuf, len))
+		return -EFAULT;
+
+	return len;
+}
+
+static ssize_t lowmem_pressure_write(struct file *file,
+				     const char __user *buf,
+				     size_t count, loff_t *ppos)
+{
+	struct lowmem_listener *l = file->private_data;
+	char kbuf[16];
+	int i;
+
+	if (count >= sizeof(kbuf))
+		return -EINVAL;
+	if (copy_from_user(kbuf, buf, count))
+		return -EFAULT;
+	kbuf[count] = '\0';
+
+	for (i = 0; i < VMPRESSURE_NUM_LEVELS; i++) {
+		if (sysfs_streq(kbuf, vmpressure_level_name(i)))
+			break;
+	}
+	if (i == VMPRESSURE_NUM_LEVELS)
+		return -EINVAL;
+
+	spin_lock(&lowmem_pressure_lock);
+	l->min_level = i;
+	l->seen = lowmem_pressure_events[i];
+	spin_unlock(&lowmem_pressure_lock);
+
+	return count;
+}
+
+static unsigned int lowmem_pressure_poll(struct file *file, poll_table *wait)
+{
+	struct lowmem_listener *l = file->private_data;
+
+	poll_wait(file, &lowmem_pressure_wait, wait);
+	if (lowmem_pressure_pending(l))
+		return POLLIN | POLLRDNORM;
+
+	return 0;
+}
+
+static const struct file_operations lowmem_pressure_fops = {
+	.owner = THIS_MODULE,
+	.open = lowmem_pressure_open,
+	.release = lowmem_pressure_release,
+	.read = lowmem_pressure_read,
+	.write = lowmem_pressure_write,
+	.poll = lowmem_pressure_poll,
+	.llseek = no_llseek,
+};
+
+static struct miscdevice lowmem_pressure_dev = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = "lowmemorykiller",
+	.fops = &lowmem_pressure_fops,
+};
+
+static int __init lowmem_pressure_init(void)
+{
+	int ret;
+
+	ret = misc_register(&lowmem_pressure_dev);
+	if (ret)
+		return ret;
+
+	ret = vmpressure_register_notifier(&lowmem_pressure_nb);
+	if (ret)
+		misc_deregister(&lowmem_pressure_dev);
+
+	return ret;
+}
+
+static void __exit lowmem_pressure_exit(void)
+{
+	vmpressure_unregister_notifier(&lowmem_pressure_nb);
+	misc_deregister(&lowmem_pressure_dev);
+}
+#else
+static inline int lowmem_pressure_init(void)
+{
+	return 0;
+}
+
+static inline void lowmem_pressure_exit(void)
+{
+}
+#endif
+
 static int __init lowmem_init(void)
 {
 	register_shrinker(&lowmem_shrinker);
+	if (lowmem_pressure_init())
+		pr_err("lowmemorykiller: failed to register pressure device\n");
 	return 0;
 }
 
 static void __exit lowmem_exit(void)
 {
+	lowmem_pressure_exit();
 	unregister_shrinker(&lowmem_shrinker);
 }
 
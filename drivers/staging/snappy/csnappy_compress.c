@@ -167,6 +167,24 @@ FindMatchLength(const char *s1, const char *s2, const char *s2_limit)
 	int matched = 0;
 	DCHECK_GE(s2_limit, s2);
 
+#ifdef CONFIG_SNAPPY_ARM_FASTPATH
+	/*
+	 * Two words per iteration: with hardware unaligned loads the loop
+	 * overhead, not the loads, dominates for long matches.
+	 */
+	while (likely(s2 <= s2_limit - 8)) {
+		uint32_t x = UNALIGNED_LOAD32(s1 + matched) ^
+				UNALIGNED_LOAD32(s2);
+		if (x)
+			return matched + (FindLSBSetNonZero(x) >> 3);
+		x = UNALIGNED_LOAD32(s1 + matched + 4) ^
+			UNALIGNED_LOAD32(s2 + 4);
+		if (x)
+			return matched + 4 + (FindLSBSetNonZero(x) >> 3);
+		s2 += 8;
+		matched += 8;
+	}
+#endif
 	while (s2 <= s2_limit - 4 &&
 		UNALIGNED_LOAD32(s2) == UNALIGNED_LOAD32(s1 + matched)) {
 		s2 += 4;
@@ -214,8 +232,7 @@ EmitLiteral(char *op, const char *literal, int len, int allow_fast_path)
 		snappy_max_compressed_length).
 		*/
 		if (allow_fast_path && len <= 16) {
-			UnalignedCopy64(literal, op);
-			UnalignedCopy64(literal + 8, op + 8);
+			UnalignedCopy128(literal, op);
 			return op + len;
 		}
 	} else {
@@ -241,6 +241,17 @@ static inline void IncrementalCopyFastPath(const char *src, char *op, int len)
 		len -= op - src;
 		op += op - src;
 	}
+#ifdef CONFIG_SNAPPY_ARM_FASTPATH
+	/* long non-overlapping matches, 16 bytes at a time */
+	if (op - src >= 16) {
+		while (len >= 16) {
+			UnalignedCopy128(src, op);
+			src += 16;
+			op += 16;
+			len -= 16;
+		}
+	}
+#endif
 	while (len > 0) {
 		UnalignedCopy64(src, op);
 		src += 8;
@@ -264,8 +275,7 @@ SAW__AppendFastPath(struct SnappyArrayWriter *this,
 	char *op = this->op;
 	const int space_left = this->op_limit - op;
 	if (likely(space_left >= 16)) {
-		UnalignedCopy64(ip, op);
-		UnalignedCopy64(ip + 8, op + 8);
+		UnalignedCopy128(ip, op);
 	} else {
 		if (unlikely(space_left < len))
 			return CSNAPPY_E_OUTPUT_OVERRUN;
@@ -298,7 +308,10 @@ SAW__AppendFromSelf(struct SnappyArrayWriter *this,
 	if (op - this->base <= offset - 1u)
 		return CSNAPPY_E_DATA_MALFORMED;
 	/* Fast path, used for the majority (70-80%) of dynamic invocations. */
-	if (len <= 16 && offset >= 8 && space_left >= 16) {
+	if (len <= 16 && offset >= 16 && space_left >= 16) {
+		UnalignedCopy128(op - offset, op);
+	} else if (len <= 16 && offset >= 8 && space_left >= 16) {
+		/* second half may read what the first one wrote */
 		UnalignedCopy64(op - offset, op);
 		UnalignedCopy64(op - offset + 8, op + 8);
 	} else if (space_left >= len + kMaxIncrementCopyOverflow) {
@@ -65,12 +65,46 @@ Zeev Tarantov <zeev.tarantov@gmail.com>
 #define DCHECK(cond)
 #endif
 
+#ifdef CONFIG_SNAPPY_ARM_FASTPATH
+/*
+ * get_unaligned() on ARM always goes byte by byte.  ARMv7 does unaligned
+ * ldr/str in hardware once the alignment trap is off (ALLOW_CPU_ALIGNMENT),
+ * so use them directly.  The memory operands keep the compiler from
+ * reordering them against the overlapping stores of IncrementalCopy.
+ */
+static inline uint32_t csnappy_arm_load32(const void *p)
+{
+	uint32_t v;
+
+	asm("ldr	%0, %1" : "=r" (v) : "Q" (*(const uint32_t *)p));
+	return v;
+}
+
+static inline void csnappy_arm_store32(void *p, uint32_t v)
+{
+	asm("str	%1, %0" : "=Q" (*(uint32_t *)p) : "r" (v));
+}
+
+#define UNALIGNED_LOAD16(_p)		get_unaligned((const uint16_t *)(_p))
+#define UNALIGNED_LOAD32(_p)		csnappy_arm_load32(_p)
+#define UNALIGNED_LOAD64(_p)		\
+	(csnappy_arm_load32(_p) |	\
+	 (uint64_t)csnappy_arm_load32((const char *)(_p) + 4) << 32)
+#define UNALIGNED_STORE16(_p, _val)	put_unaligned((_val), (uint16_t *)(_p))
+#define UNALIGNED_STORE32(_p, _val)	csnappy_arm_store32((_p), (_val))
+#define UNALIGNED_STORE64(_p, _val)	do {				\
+	uint64_t __v = (_val);						\
+	csnappy_arm_store32((_p), (uint32_t)__v);			\
+	csnappy_arm_store32((char *)(_p) + 4, (uint32_t)(__v >> 32));	\
+} while (0)
+#else
 #define UNALIGNED_LOAD16(_p)		get_unaligned((const uint16_t *)(_p))
 #define UNALIGNED_LOAD32(_p)		get_unaligned((const uint32_t *)(_p))
 #define UNALIGNED_LOAD64(_p)		get_unaligned((const uint64_t *)(_p))
 #define UNALIGNED_STORE16(_p, _val)	put_unaligned((_val), (uint16_t *)(_p))
 #define UNALIGNED_STORE32(_p, _val)	put_unaligned((_val), (uint32_t *)(_p))
 #define UNALIGNED_STORE64(_p, _val)	put_unaligned((_val), (uint64_t *)(_p))
+#endif
 
 #define FindLSBSetNonZero(n)		__builtin_ctz(n)
 #define FindLSBSetNonZero64(n)		__builtin_ctzll(n)
@@ -108,12 +142,41 @@ static inline void UnalignedCopy64(const void *src, void *dst) {
 #endif
 }
 
+/*
+ * Copy 16 bytes, loading all of them before storing any: the regions must
+ * not overlap (for self copies, offset >= 16).  With the ARM fast path this
+ * is four unaligned ldr and four str, which the core can pipeline.
+ */
+static inline void UnalignedCopy128(const void *src, void *dst) {
+#ifdef CONFIG_SNAPPY_ARM_FASTPATH
+  const uint8_t *src_bytep = (const uint8_t *)src;
+  uint8_t *dst_bytep = (uint8_t *)dst;
+  uint32_t a, b, c, d;
+
+  a = UNALIGNED_LOAD32(src_bytep);
+  b = UNALIGNED_LOAD32(src_bytep + 4);
+  c = UNALIGNED_LOAD32(src_bytep + 8);
+  d = UNALIGNED_LOAD32(src_bytep + 12);
+  UNALIGNED_STORE32(dst_bytep, a);
+  UNALIGNED_STORE32(dst_bytep + 4, b);
+  UNALIGNED_STORE32(dst_bytep + 8, c);
+  UNALIGNED_STORE32(dst_bytep + 12, d);
+#else
+  UnalignedCopy64(src, dst);
+  UnalignedCopy64((const uint8_t *)src + 8, (uint8_t *)dst + 8);
+#endif
+}
+
 #if defined(__arm__)
   #if ARCH_ARM_HAVE_UNALIGNED
      static inline uint32_t get_unaligned_le(const void *p, uint32_t n)
      {
        uint32_t wordmask = (1U << (8 * n)) - 1;
+#ifdef CONFIG_SNAPPY_ARM_FASTPATH
+       return UNALIGNED_LOAD32(p) & wordmask;
+#else
        return get_unaligned_le32(p) & wordmask;
+#endif
      }
   #else
      extern uint32_t get_unaligned_le_armv5(const void *p, uint32_t n);
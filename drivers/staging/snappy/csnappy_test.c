@@ -0,0 +1,337 @@
+/*
+ * Snappy self-test and benchmark
+ *
+ * Round-trips generated buffers through csnappy_compress() and
+ * csnappy_decompress() at unaligned source and destination offsets,
+ * feeds the decompressor corrupt and truncated streams and checks that it
+ * never writes past the end of the output buffer, then reports the
+ * compression ratio and the throughput of both directions for 4KiB pages
+ * (what zram hands to the compressor) and 32KiB blocks.
+ *
+ *	modprobe csnappy_test [bench_ms=N] [seed=N]
+ *
+ * The module fails to load if any check failed, results are in the log.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/types.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/string.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/sched.h>
+#include "csnappy.h"
+
+#define TEST_MAX_LEN	(64 * 1024 + 7)
+#define TEST_GUARD	64
+#define TEST_GUARD_BYTE	0xa5
+#define TEST_CORRUPT	512
+
+static unsigned int bench_ms = 200;
+module_param(bench_ms, uint, 0444);
+MODULE_PARM_DESC(bench_ms, "time spent on each benchmark, 0 to skip them");
+
+static unsigned int seed = 1;
+module_param(seed, uint, 0444);
+MODULE_PARM_DESC(seed, "seed of the test data generator");
+
+struct test_bufs {
+	char *src;
+	char *comp;
+	char *out;
+	void *workmem;
+};
+
+static u32 test_state;
+
+static u32 test_rand(void)
+{
+	/* xorshift32, reproducible from the seed parameter */
+	test_state ^= test_state << 13;
+	test_state ^= test_state >> 17;
+	test_state ^= test_state << 5;
+	return test_state;
+}
+
+static void fill_zero(char *p, int len)
+{
+	memset(p, 0, len);
+}
+
+static void fill_text(char *p, int len)
+{
+	static const char * const words[] = {
+		"the", "of", "and", "a", "to", "in", "is", "you", "that",
+		"it", "he", "was", "for", "on", "are", "as", "with", "his",
+		"they", "at", "be", "this", "have", "from", "or", "one",
+		"android", "kernel", "memory", "swap", "compression",
+	};
+	int i = 0;
+
+	while (i < len) {
+		const char *w = words[test_rand() % ARRAY_SIZE(words)];
+
+		while (*w && i < len)
+			p[i++] = *w++;
+		if (i < len)
+			p[i++] = test_rand() % 16 ? ' ' : '\n';
+	}
+}
+
+static void fill_random(char *p, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		p[i] = test_rand();
+}
+
+/* Array of small integers and pointers, as found in anonymous memory. */
+static void fill_words(char *p, int len)
+{
+	u32 base = 0xc0000000 | (test_rand() & 0x00fff000);
+	int i;
+
+	for (i = 0; i + 4 <= len; i += 4) {
+		u32 v = test_rand() % 4 ? base + (test_rand() & 0xfc) :
+			test_rand() % 64;
+
+		memcpy(p + i, &v, 4);
+	}
+	memset(p + i, 0, len - i);
+}
+
+/* Compressible and incompressible runs of 256 bytes. */
+static void fill_mixed(char *p, int len)
+{
+	int i, n;
+
+	for (i = 0; i < len; i += 256) {
+		n = min(256, len - i);
+		if (test_rand() % 2)
+			fill_text(p + i, n);
+		else
+			fill_random(p + i, n);
+	}
+}
+
+static const struct {
+	const char *name;
+	void (*fill)(char *, int);
+} patterns[] = {
+	{ "zero", fill_zero },
+	{ "text", fill_text },
+	{ "random", fill_random },
+	{ "words", fill_words },
+	{ "mixed", fill_mixed },
+};
+
+static int check_guard(const char *p, const char *what, const char *name,
+		       int len)
+{
+	int i;
+
+	for (i = 0; i < TEST_GUARD; i++) {
+		if ((u8)p[i] != TEST_GUARD_BYTE) {
+			pr_err("snappy_test: %s %s len %d: wrote %d bytes "
+			       "past the end\n", what, name, len, i + 1);
+			return -EFAULT;
+		}
+	}
+	return 0;
+}
+
+static int round_trip(struct test_bufs *b, const char *name, int len,
+		      int src_off, int out_off)
+{
+	uint32_t max_len = csnappy_max_compressed_length(len);
+	uint32_t comp_len;
+	char *src = b->src + src_off, *out = b->out + out_off;
+	int ret;
+
+	memset(b->comp + max_len, TEST_GUARD_BYTE, TEST_GUARD);
+	csnappy_compress(src, len, b->comp, &comp_len, b->workmem,
+			 CSNAPPY_WORKMEM_BYTES_POWER_OF_TWO);
+	if (comp_len > max_len) {
+		pr_err("snappy_test: compress %s len %d: %u bytes, max %u\n",
+		       name, len, comp_len, max_len);
+		return -EFAULT;
+	}
+	if (check_guard(b->comp + max_len, "compress", name, len))
+		return -EFAULT;
+
+	memset(out + len, TEST_GUARD_BYTE, TEST_GUARD);
+	ret = csnappy_decompress(b->comp, comp_len, out, len);
+	if (ret != CSNAPPY_E_OK) {
+		pr_err("snappy_test: decompress %s len %d offsets %d/%d: "
+		       "error %d\n", name, len, src_off, out_off, ret);
+		return -EINVAL;
+	}
+	if (memcmp(src, out, len)) {
+		pr_err("snappy_test: %s len %d offsets %d/%d: data mismatch\n",
+		       name, len, src_off, out_off);
+		return -EINVAL;
+	}
+	return check_guard(out + len, "decompress", name, len);
+}
+
+static int test_round_trips(struct test_bufs *b)
+{
+	static const int lens[] = {
+		1, 2, 3, 4, 7, 8, 15, 16, 17, 31, 32, 33, 61, 64, 100, 257,
+		1000, 4096, 4099, 32768, 32769, TEST_MAX_LEN - 8,
+	};
+	static const int offs[] = { 0, 1, 3 };
+	int p, l, so, oo, cases = 0, failed = 0;
+
+	for (p = 0; p < ARRAY_SIZE(patterns); p++) {
+		patterns[p].fill(b->src, TEST_MAX_LEN);
+		for (l = 0; l < ARRAY_SIZE(lens); l++)
+			for (so = 0; so < ARRAY_SIZE(offs); so++)
+				for (oo = 0; oo < ARRAY_SIZE(offs); oo++) {
+					cases++;
+					if (round_trip(b, patterns[p].name,
+						       lens[l], offs[so],
+						       offs[oo]))
+						failed++;
+				}
+		cond_resched();
+	}
+	pr_info("snappy_test: round trip: %d cases, %d failed\n",
+		cases, failed);
+	return failed ? -EINVAL : 0;
+}
+
+/*
+ * The decompressor may reject a damaged stream or decode it into garbage,
+ * but it must never write past the length it was given.
+ */
+static int test_corrupt(struct test_bufs *b)
+{
+	const int len = 4096;
+	uint32_t comp_len;
+	int i, n, failed = 0, rejected = 0;
+
+	fill_mixed(b->src, len);
+	csnappy_compress(b->src, len, b->comp, &comp_len, b->workmem,
+			 CSNAPPY_WORKMEM_BYTES_POWER_OF_TWO);
+
+	for (i = 0; i < TEST_CORRUPT; i++) {
+		char *c = b->comp + comp_len + TEST_GUARD;
+		uint32_t clen = comp_len;
+		int ret;
+
+		memcpy(c, b->comp, comp_len);
+		if (i % 4 == 0) {
+			clen = test_rand() % comp_len;
+		} else {
+			for (n = 1 + test_rand() % 4; n; n--)
+				c[test_rand() % comp_len] ^= 1 << test_rand() % 8;
+		}
+
+		memset(b->out + len, TEST_GUARD_BYTE, TEST_GUARD);
+		ret = csnappy_decompress(c, clen, b->out, len);
+		if (ret != CSNAPPY_E_OK)
+			rejected++;
+		if (check_guard(b->out + len, "corrupt", "mixed", len))
+			failed++;
+	}
+	pr_info("snappy_test: corrupt input: %d cases, %d rejected, "
+		"%d overruns\n", TEST_CORRUPT, rejected, failed);
+	return failed ? -EFAULT : 0;
+}
+
+static unsigned long mb_per_s(u64 bytes, s64 ns)
+{
+	return ns > 0 ? (unsigned long)div64_u64(bytes * 1000, ns) : 0;
+}
+
+static void bench(struct test_bufs *b, const char *name, int len)
+{
+	u64 comp_bytes = 0, decomp_bytes = 0;
+	s64 comp_ns, decomp_ns, limit = (s64)bench_ms * NSEC_PER_MSEC;
+	uint32_t comp_len = 0;
+	ktime_t start;
+
+	start = ktime_get();
+	do {
+		csnappy_compress(b->src, len, b->comp, &comp_len, b->workmem,
+				 CSNAPPY_WORKMEM_BYTES_POWER_OF_TWO);
+		comp_bytes += len;
+		comp_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+		cond_resched();
+	} while (comp_ns < limit);
+
+	start = ktime_get();
+	do {
+		csnappy_decompress(b->comp, comp_len, b->out, len);
+		decomp_bytes += len;
+		decomp_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+		cond_resched();
+	} while (decomp_ns < limit);
+
+	pr_info("snappy_test: %-6s %5d: ratio %3u%% compress %4lu MB/s "
+		"decompress %4lu MB/s\n", name, len, comp_len * 100 / len,
+		mb_per_s(comp_bytes, comp_ns),
+		mb_per_s(decomp_bytes, decomp_ns));
+}
+
+static void test_bench(struct test_bufs *b)
+{
+	static const int lens[] = { 4096, 32768 };
+	int p, l;
+
+	for (p = 0; p < ARRAY_SIZE(patterns); p++) {
+		patterns[p].fill(b->src, TEST_MAX_LEN);
+		for (l = 0; l < ARRAY_SIZE(lens); l++)
+			bench(b, patterns[p].name, lens[l]);
+	}
+}
+
+static int __init csnappy_test_init(void)
+{
+	struct test_bufs b;
+	int comp_size, ret = -ENOMEM;
+
+	/* the corrupt test keeps a copy of the stream after the original */
+	comp_size = 2 * (csnappy_max_compressed_length(TEST_MAX_LEN) +
+			 TEST_GUARD);
+	b.src = vmalloc(TEST_MAX_LEN);
+	b.comp = vmalloc(comp_size);
+	b.out = vmalloc(TEST_MAX_LEN + TEST_GUARD);
+	b.workmem = kmalloc(CSNAPPY_WORKMEM_BYTES, GFP_KERNEL);
+	if (!b.src || !b.comp || !b.out || !b.workmem)
+		goto out;
+
+	test_state = seed ? seed : 1;
+
+	ret = test_round_trips(&b);
+	if (!ret)
+		ret = test_corrupt(&b);
+	if (!ret && bench_ms)
+		test_bench(&b);
+
+out:
+	kfree(b.workmem);
+	vfree(b.out);
+	vfree(b.comp);
+	vfree(b.src);
+	return ret;
+}
+
+static void __exit csnappy_test_exit(void)
+{
+}
+
+module_init(csnappy_test_init);
+module_exit(csnappy_test_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Snappy self-test and benchmark");
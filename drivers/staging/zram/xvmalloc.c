@@ -20,6 +20,8 @@
 #include <linux/errno.h>
 #include <linux/highmem.h>
 #include <linux/init.h>
+#include <linux/list.h>
+#include <linux/mm.h>
 #include <linux/string.h>
 #include <linux/slab.h>
 
@@ -281,9 +283,11 @@ static int grow_pool(struct xv_pool *pool, gfp_t flags)
 	if (unlikely(!page))
 		return -ENOMEM;
 
+	spin_lock(&pool->lock);
 	stat_inc(&pool->total_pages);
+	set_page_private(page, 0);
+	list_add_tail(&page->lru, &pool->pages);
 
-	spin_lock(&pool->lock);
 	block = get_ptr_atomic(page, 0, KM_USER0);
 
 	block->size = PAGE_SIZE - XV_ALIGN;
@@ -314,6 +318,7 @@ struct xv_pool *xv_create_pool(void)
 		return NULL;
 
 	spin_lock_init(&pool->lock);
+	INIT_LIST_HEAD(&pool->pages);
 
 	return pool;
 }
@@ -360,7 +365,7 @@ int xv_malloc(struct xv_pool *pool, u32 size, struct page **page,
 
 	if (!*page) {
 		spin_unlock(&pool->lock);
-		if (flags & GFP_NOWAIT)
+		if (!(flags & __GFP_WAIT))
 			return -ENOMEM;
 		error = grow_pool(pool, flags);
 		if (unlikely(error))
@@ -405,6 +410,9 @@ int xv_malloc(struct xv_pool *pool, u32 size, struct page **page,
 	block->size = origsize;
 	clear_flag(block, BLOCK_FREE);
 
+	set_page_private(*page, page_private(*page) + size + XV_ALIGN);
+	pool->used_bytes += size + XV_ALIGN;
+
 	put_ptr_atomic(block, KM_USER0);
 	spin_unlock(&pool->lock);
 
@@ -419,6 +427,7 @@ EXPORT_SYMBOL_GPL(xv_malloc);
  */
 void xv_free(struct xv_pool *pool, struct page *page, u32 offset)
 {
+	int isolated;
 	void *page_start;
 	struct block_header *block, *tmpblock;
 
@@ -426,6 +435,9 @@ void xv_free(struct xv_pool *pool, struct page *page, u32 offset)
 
 	spin_lock(&pool->lock);
 
+	/* Free blocks of a page under compaction stay off the freelists */
+	isolated = (page == pool->compact_page);
+
 	page_start = get_ptr_atomic(page, 0, KM_USER0);
 	block = (struct block_header *)((char *)page_start + offset);
 
@@ -434,6 +446,9 @@ void xv_free(struct xv_pool *pool, struct page *page, u32 offset)
 
 	block->size = ALIGN(block->size, XV_ALIGN);
 
+	set_page_private(page, page_private(page) - block->size - XV_ALIGN);
+	pool->used_bytes -= block->size + XV_ALIGN;
+
 	tmpblock = BLOCK_NEXT(block);
 	if (offset + block->size + XV_ALIGN == PAGE_SIZE)
 		tmpblock = NULL;
@@ -444,7 +459,7 @@ void xv_free(struct xv_pool *pool, struct page *page, u32 offset)
 		 * Blocks smaller than XV_MIN_ALLOC_SIZE
 		 * are not inserted in any free list.
 		 */
-		if (tmpblock->size >= XV_MIN_ALLOC_SIZE) {
+		if (tmpblock->size >= XV_MIN_ALLOC_SIZE && !isolated) {
 			remove_block(pool, page,
 				    offset + block->size + XV_ALIGN, tmpblock,
 				    get_index_for_insert(tmpblock->size));
@@ -458,7 +473,7 @@ void xv_free(struct xv_pool *pool, struct page *page, u32 offset)
 						get_blockprev(block));
 		offset = offset - tmpblock->size - XV_ALIGN;
 
-		if (tmpblock->size >= XV_MIN_ALLOC_SIZE)
+		if (tmpblock->size >= XV_MIN_ALLOC_SIZE && !isolated)
 			remove_block(pool, page, offset, tmpblock,
 				    get_index_for_insert(tmpblock->size));
 
@@ -467,17 +482,18 @@ void xv_free(struct xv_pool *pool, struct page *page, u32 offset)
 	}
 
 	/* No used objects in this page. Free it. */
-	if (block->size == PAGE_SIZE - XV_ALIGN) {
+	if (block->size == PAGE_SIZE - XV_ALIGN && !isolated) {
+		list_del(&page->lru);
+		stat_dec(&pool->total_pages);
 		put_ptr_atomic(page_start, KM_USER0);
 		spin_unlock(&pool->lock);
 
 		__free_page(page);
-		stat_dec(&pool->total_pages);
 		return;
 	}
 
 	set_flag(block, BLOCK_FREE);
-	if (block->size >= XV_MIN_ALLOC_SIZE)
+	if (block->size >= XV_MIN_ALLOC_SIZE && !isolated)
 		insert_block(pool, page, offset, block);
 
 	if (offset + block->size + XV_ALIGN != PAGE_SIZE) {
@@ -491,6 +507,173 @@ void xv_free(struct xv_pool *pool, struct page *page, u32 offset)
 }
 EXPORT_SYMBOL_GPL(xv_free);
 
+/*
+ * Take all free blocks of the given page off the freelists so that
+ * objects migrated out of it cannot be allocated in it again.
+ * Called with pool->lock held.
+ */
+static void isolate_page(struct xv_pool *pool, struct page *page)
+{
+	u32 offset = 0;
+	char *page_start;
+	struct block_header *block;
+
+	page_start = get_ptr_atomic(page, 0, KM_USER0);
+	while (offset < PAGE_SIZE) {
+		block = (struct block_header *)(page_start + offset);
+		if (test_flag(block, BLOCK_FREE) &&
+				block->size >= XV_MIN_ALLOC_SIZE)
+			remove_block(pool, page, offset, block,
+				    get_index_for_insert(block->size));
+		offset += ALIGN(block->size, XV_ALIGN) + XV_ALIGN;
+	}
+	put_ptr_atomic(page_start, KM_USER0);
+
+	pool->compact_page = page;
+}
+
+/*
+ * End compaction of the isolated page: put its free blocks back on the
+ * freelists, or remove it from the pool if it no longer holds any
+ * object. Returns 1 if the caller should free the page.
+ * Called with pool->lock held.
+ */
+static int putback_page(struct xv_pool *pool, struct page *page)
+{
+	u32 offset = 0;
+	char *page_start;
+	struct block_header *block;
+
+	pool->compact_page = NULL;
+
+	page_start = get_ptr_atomic(page, 0, KM_USER0);
+	block = (struct block_header *)page_start;
+	if (test_flag(block, BLOCK_FREE) &&
+			block->size == PAGE_SIZE - XV_ALIGN) {
+		put_ptr_atomic(page_start, KM_USER0);
+		list_del(&page->lru);
+		stat_dec(&pool->total_pages);
+		return 1;
+	}
+
+	while (offset < PAGE_SIZE) {
+		block = (struct block_header *)(page_start + offset);
+		if (test_flag(block, BLOCK_FREE) &&
+				block->size >= XV_MIN_ALLOC_SIZE)
+			insert_block(pool, page, offset, block);
+		offset += ALIGN(block->size, XV_ALIGN) + XV_ALIGN;
+	}
+	put_ptr_atomic(page_start, KM_USER0);
+
+	return 0;
+}
+
+/*
+ * Find the first allocated block at or after @offset in the page.
+ * Returns its offset, or PAGE_SIZE if there is none.
+ * Called with pool->lock held.
+ */
+static u32 next_object(struct page *page, u32 offset)
+{
+	u32 pos = 0;
+	char *page_start;
+	struct block_header *block;
+
+	page_start = get_ptr_atomic(page, 0, KM_USER0);
+	while (pos < PAGE_SIZE) {
+		block = (struct block_header *)(page_start + pos);
+		if (pos >= offset && !test_flag(block, BLOCK_FREE))
+			break;
+		pos += ALIGN(block->size, XV_ALIGN) + XV_ALIGN;
+	}
+	put_ptr_atomic(page_start, KM_USER0);
+
+	return pos;
+}
+
+/**
+ * xv_compact - move objects out of sparsely used pages
+ * @pool: pool to compact
+ * @max_pages: maximum number of pool pages to look at
+ * @migrate: callback moving the object at <page, offset> elsewhere
+ * @priv: passed to @migrate
+ *
+ * Pages using at most half of their space are isolated one at a time
+ * and @migrate is called for each object in them. It must allocate a
+ * new object (with a gfp mask that does not allow the pool to grow),
+ * copy the data, update its references and xv_free() the old object,
+ * returning 0; or return an error to leave the object in place. Pages
+ * that end up empty are freed.
+ *
+ * Returns the number of pages freed.
+ */
+u32 xv_compact(struct xv_pool *pool, u32 max_pages,
+		xv_migrate_fn migrate, void *priv)
+{
+	u32 scanned, freed = 0;
+
+	spin_lock(&pool->lock);
+	if (max_pages > pool->total_pages)
+		max_pages = pool->total_pages;
+	spin_unlock(&pool->lock);
+
+	for (scanned = 0; scanned < max_pages; scanned++) {
+		u32 offset, obj;
+		struct page *page;
+		struct block_header *block;
+
+		spin_lock(&pool->lock);
+		if (list_empty(&pool->pages)) {
+			spin_unlock(&pool->lock);
+			break;
+		}
+
+		page = list_first_entry(&pool->pages, struct page, lru);
+		list_move_tail(&page->lru, &pool->pages);
+		if (page_private(page) > PAGE_SIZE / 2) {
+			spin_unlock(&pool->lock);
+			continue;
+		}
+		isolate_page(pool, page);
+		spin_unlock(&pool->lock);
+
+		offset = 0;
+		for (;;) {
+			u32 size = 0;
+
+			spin_lock(&pool->lock);
+			obj = next_object(page, offset);
+			if (obj < PAGE_SIZE) {
+				block = get_ptr_atomic(page, obj, KM_USER0);
+				size = ALIGN(block->size, XV_ALIGN);
+				put_ptr_atomic(block, KM_USER0);
+			}
+			spin_unlock(&pool->lock);
+
+			if (obj >= PAGE_SIZE)
+				break;
+
+			/* No point going on if the page cannot be emptied */
+			if (migrate(priv, page, obj + XV_ALIGN))
+				break;
+
+			offset = obj + size + XV_ALIGN;
+		}
+
+		spin_lock(&pool->lock);
+		if (putback_page(pool, page)) {
+			spin_unlock(&pool->lock);
+			__free_page(page);
+			freed++;
+		} else {
+			spin_unlock(&pool->lock);
+		}
+	}
+
+	return freed;
+}
+EXPORT_SYMBOL_GPL(xv_compact);
+
 u32 xv_get_object_size(void *obj)
 {
 	struct block_header *blk;
@@ -508,3 +691,12 @@ u64 xv_get_total_size_bytes(struct xv_pool *pool)
 	return pool->total_pages << PAGE_SHIFT;
 }
 EXPORT_SYMBOL_GPL(xv_get_total_size_bytes);
+
+/*
+ * Returns memory taken by allocated objects, including block headers
+ */
+u64 xv_get_used_size_bytes(struct xv_pool *pool)
+{
+	return pool->used_bytes;
+}
+EXPORT_SYMBOL_GPL(xv_get_used_size_bytes);
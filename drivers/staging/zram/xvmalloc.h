@@ -17,6 +17,9 @@
 
 struct xv_pool;
 
+/* Relocates the object at <page, offset>, see xv_compact() */
+typedef int (*xv_migrate_fn)(void *priv, struct page *page, u32 offset);
+
 struct xv_pool *xv_create_pool(void);
 void xv_destroy_pool(struct xv_pool *pool);
 
@@ -26,5 +29,9 @@ void xv_free(struct xv_pool *pool, struct page *page, u32 offset);
 
 u32 xv_get_object_size(void *obj);
 u64 xv_get_total_size_bytes(struct xv_pool *pool);
+u64 xv_get_used_size_bytes(struct xv_pool *pool);
+
+u32 xv_compact(struct xv_pool *pool, u32 max_pages,
+		xv_migrate_fn migrate, void *priv);
 
 #endif
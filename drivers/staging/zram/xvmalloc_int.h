@@ -14,6 +14,7 @@
 #define _XV_MALLOC_INT_H_
 
 #include <linux/kernel.h>
+#include <linux/list.h>
 #include <linux/types.h>
 
 /* User configurable params */
@@ -88,7 +89,15 @@ struct xv_pool {
 	ulong flbitmap;
 	ulong slbitmap[MAX_FLI];
 	u64 total_pages;	/* stats */
+	u64 used_bytes;		/* stats: allocated blocks incl. headers */
 	struct freelist_entry freelist[NUM_FREE_LISTS];
+	/*
+	 * All pages of the pool, linked through page->lru. page->private
+	 * holds the number of bytes allocated from each page.
+	 */
+	struct list_head pages;
+	/* Page being compacted; its free blocks are off the freelists */
+	struct page *compact_page;
 	spinlock_t lock;
 };
 
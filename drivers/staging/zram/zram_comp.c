@@ -0,0 +1,208 @@
+/*
+ * Compressed RAM block device
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Project home: http://compcache.googlecode.com
+ */
+
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include "zram_comp.h"
+
+#ifdef CONFIG_ZRAM_LZO
+#include <linux/lzo.h>
+
+static void *lzo_create(void)
+{
+	return kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
+}
+
+static void lzo_destroy(void *private)
+{
+	kfree(private);
+}
+
+static int lzo_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *private)
+{
+	return lzo1x_1_compress(src, src_len, dst, dst_len, private);
+}
+
+static int lzo_decompress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *private)
+{
+	return lzo1x_decompress_safe(src, src_len, dst, dst_len);
+}
+
+static const struct zram_backend zram_lzo = {
+	.name		= "lzo",
+	.id		= ZRAM_BACKEND_LZO,
+	.create		= lzo_create,
+	.destroy	= lzo_destroy,
+	.compress	= lzo_compress,
+	.decompress	= lzo_decompress,
+};
+#endif
+
+#ifdef CONFIG_ZRAM_SNAPPY
+#include "../snappy/csnappy.h" /* if built in drivers/staging */
+#define WMSIZE_ORDER	((PAGE_SHIFT > 14) ? (15) : (PAGE_SHIFT+1))
+#define WMSIZE		(1 << WMSIZE_ORDER)
+
+static void *snappy_create(void)
+{
+	return kzalloc(WMSIZE, GFP_KERNEL);
+}
+
+static void snappy_destroy(void *private)
+{
+	kfree(private);
+}
+
+static int snappy_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *private)
+{
+	const char *end = csnappy_compress_fragment(
+		(const char *)src, (uint32_t)src_len, (char *)dst,
+		private, WMSIZE_ORDER);
+	*dst_len = end - (char *)dst;
+	return 0;
+}
+
+static int snappy_decompress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *private)
+{
+	uint32_t dst_len_ = (uint32_t)*dst_len;
+	int ret = csnappy_decompress_noheader((const char *)src, src_len,
+					(char *)dst, &dst_len_);
+	*dst_len = (size_t)dst_len_;
+	return ret;
+}
+
+static const struct zram_backend zram_snappy = {
+	.name		= "snappy",
+	.id		= ZRAM_BACKEND_SNAPPY,
+	.create		= snappy_create,
+	.destroy	= snappy_destroy,
+	.compress	= snappy_compress,
+	.decompress	= snappy_decompress,
+};
+#endif
+
+#ifdef CONFIG_ZRAM_DEFLATE
+#include <linux/crypto.h>
+#include <linux/err.h>
+
+/*
+ * The crypto deflate transform carries zlib stream state for both
+ * directions, so the caller must own it exclusively while (de)compressing.
+ */
+static void *deflate_create(void)
+{
+	struct crypto_comp *tfm;
+
+	tfm = crypto_alloc_comp("deflate", 0, 0);
+	if (IS_ERR(tfm))
+		return NULL;
+
+	return tfm;
+}
+
+static void deflate_destroy(void *private)
+{
+	crypto_free_comp(private);
+}
+
+static int deflate_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *private)
+{
+	int ret;
+	unsigned int dlen = 2 * PAGE_SIZE;	/* size of stream buffer */
+
+	ret = crypto_comp_compress(private, src, src_len, dst, &dlen);
+	*dst_len = dlen;
+	return ret;
+}
+
+static int deflate_decompress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *private)
+{
+	int ret;
+	unsigned int dlen = *dst_len;
+
+	ret = crypto_comp_decompress(private, src, src_len, dst, &dlen);
+	*dst_len = dlen;
+	return ret;
+}
+
+static const struct zram_backend zram_deflate = {
+	.name		= "deflate",
+	.id		= ZRAM_BACKEND_DEFLATE,
+	.decompress_needs_private = 1,
+	.create		= deflate_create,
+	.destroy	= deflate_destroy,
+	.compress	= deflate_compress,
+	.decompress	= deflate_decompress,
+};
+#endif
+
+#if !defined(CONFIG_ZRAM_LZO) && !defined(CONFIG_ZRAM_SNAPPY) && \
+	!defined(CONFIG_ZRAM_DEFLATE)
+#error at least one of CONFIG_ZRAM_{LZO,SNAPPY,DEFLATE} must be defined
+#endif
+
+const struct zram_backend *zram_backends[__NR_ZRAM_BACKENDS] = {
+#ifdef CONFIG_ZRAM_LZO
+	[ZRAM_BACKEND_LZO]	= &zram_lzo,
+#endif
+#ifdef CONFIG_ZRAM_SNAPPY
+	[ZRAM_BACKEND_SNAPPY]	= &zram_snappy,
+#endif
+#ifdef CONFIG_ZRAM_DEFLATE
+	[ZRAM_BACKEND_DEFLATE]	= &zram_deflate,
+#endif
+};
+
+/*
+ * Look up a built-in backend by name. Trailing newline is ignored
+ * so that the result of a sysfs write can be passed directly.
+ */
+const struct zram_backend *zram_backend_find(const char *name)
+{
+	int i;
+
+	for (i = 0; i < __NR_ZRAM_BACKENDS; i++) {
+		if (zram_backends[i] &&
+				sysfs_streq(name, zram_backends[i]->name))
+			return zram_backends[i];
+	}
+
+	return NULL;
+}
+
+const struct zram_backend *zram_backend_default(void)
+{
+	const struct zram_backend *backend;
+	int i;
+
+	backend = zram_backend_find(CONFIG_ZRAM_DEFAULT_COMPRESSOR);
+	if (backend)
+		return backend;
+
+	for (i = 0; i < __NR_ZRAM_BACKENDS; i++) {
+		if (zram_backends[i])
+			return zram_backends[i];
+	}
+
+	return NULL;
+}
@@ -0,0 +1,63 @@
+/*
+ * Compressed RAM block device
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Project home: http://compcache.googlecode.com
+ */
+
+#ifndef _ZRAM_COMP_H_
+#define _ZRAM_COMP_H_
+
+#include <linux/types.h>
+
+/* Compressor backends known to zram (not all may be built in) */
+enum zram_backend_id {
+	ZRAM_BACKEND_LZO,
+	ZRAM_BACKEND_SNAPPY,
+	ZRAM_BACKEND_DEFLATE,
+
+	__NR_ZRAM_BACKENDS,
+};
+
+/*
+ * Compressor operations. create() returns the backend private data
+ * (working memory, transform etc.) which is handed back to compress()
+ * and decompress(). Both are called with pages kmap_atomic'ed so they
+ * must not sleep. Decompression is passed a NULL private unless
+ * decompress_needs_private is set.
+ */
+struct zram_backend {
+	const char *name;
+	enum zram_backend_id id;
+	int decompress_needs_private;
+	void *(*create)(void);
+	void (*destroy)(void *private);
+	int (*compress)(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len, void *private);
+	int (*decompress)(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len, void *private);
+};
+
+/* Per-backend counters; kept across device reset for A/B comparisons */
+struct zram_comp_stats {
+	u64 num_compress;
+	u64 compress_ns;	/* total time spent compressing */
+	u64 compress_in;	/* bytes given to the compressor */
+	u64 compress_out;	/* bytes produced by the compressor */
+	u64 num_decompress;
+	u64 decompress_ns;	/* total time spent decompressing */
+};
+
+extern const struct zram_backend *zram_backends[__NR_ZRAM_BACKENDS];
+
+extern const struct zram_backend *zram_backend_find(const char *name);
+extern const struct zram_backend *zram_backend_default(void);
+
+#endif
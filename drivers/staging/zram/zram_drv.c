@@ -25,60 +25,23 @@
 #include <linux/bitops.h>
 #include <linux/blkdev.h>
 #include <linux/buffer_head.h>
+#include <linux/completion.h>
+#include <linux/cpumask.h>
 #include <linux/device.h>
+#include <linux/err.h>
+#include <linux/fs.h>
 #include <linux/genhd.h>
 #include <linux/highmem.h>
+#include <linux/jhash.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
 #include <linux/slab.h>
 #include <linux/string.h>
 #include <linux/vmalloc.h>
 
 #include "zram_drv.h"
 
-#if defined(CONFIG_ZRAM_LZO)
-#include <linux/lzo.h>
-#define WMSIZE		LZO1X_MEM_COMPRESS
-#define COMPRESS(s, sl, d, dl, wm)	\
-	lzo1x_1_compress(s, sl, d, dl, wm)
-#define DECOMPRESS(s, sl, d, dl)	\
-	lzo1x_decompress_safe(s, sl, d, dl)
-#elif defined(CONFIG_ZRAM_SNAPPY)
-#include "../snappy/csnappy.h" /* if built in drivers/staging */
-#define WMSIZE_ORDER	((PAGE_SHIFT > 14) ? (15) : (PAGE_SHIFT+1))
-#define WMSIZE		(1 << WMSIZE_ORDER)
-static int
-snappy_compress_(
-	const unsigned char *src,
-	size_t src_len,
-	unsigned char *dst,
-	size_t *dst_len,
-	void *workmem)
-{
-	const unsigned char *end = csnappy_compress_fragment(
-		src, (uint32_t)src_len, dst, workmem, WMSIZE_ORDER);
-	*dst_len = end - dst;
-	return 0;
-}
-static int
-snappy_decompress_(
-	const unsigned char *src,
-	size_t src_len,
-	unsigned char *dst,
-	size_t *dst_len)
-{
-	uint32_t dst_len_ = (uint32_t)*dst_len;
-	int ret = csnappy_decompress_noheader(src, src_len, dst, &dst_len_);
-	*dst_len = (size_t)dst_len_;
-	return ret;
-}
-#define COMPRESS(s, sl, d, dl, wm)	\
-	snappy_compress_(s, sl, d, dl, wm)
-#define DECOMPRESS(s, sl, d, dl)	\
-	snappy_decompress_(s, sl, d, dl)
-#else
-#error either CONFIG_ZRAM_LZO or CONFIG_ZRAM_SNAPPY must be defined
-#endif
-
-
 /* Globals */
 static int zram_major;
 struct zram *devices;
@@ -115,6 +78,139 @@ static void zram_stat64_inc(struct zram *zram, u64 *v)
 	zram_stat64_add(zram, v, 1);
 }
 
+/*
+ * Take an idle compression stream, sleeping until one is released if
+ * all of them are in use by other writers.
+ */
+static struct zram_stream *zram_stream_get(struct zram *zram)
+{
+	struct zram_stream *stream;
+
+	spin_lock(&zram->stream_lock);
+	while (list_empty(&zram->idle_streams)) {
+		spin_unlock(&zram->stream_lock);
+		wait_event(zram->stream_wait,
+			!list_empty(&zram->idle_streams));
+		spin_lock(&zram->stream_lock);
+	}
+	stream = list_first_entry(&zram->idle_streams,
+				struct zram_stream, list);
+	list_del(&stream->list);
+	spin_unlock(&zram->stream_lock);
+
+	return stream;
+}
+
+static void zram_stream_put(struct zram *zram, struct zram_stream *stream)
+{
+	spin_lock(&zram->stream_lock);
+	list_add(&stream->list, &zram->idle_streams);
+	spin_unlock(&zram->stream_lock);
+
+	wake_up(&zram->stream_wait);
+}
+
+static void zram_destroy_streams(struct zram *zram)
+{
+	unsigned int i;
+
+	for (i = 0; i < zram->num_streams; i++) {
+		struct zram_stream *stream = &zram->streams[i];
+
+		if (stream->private)
+			zram->backend->destroy(stream->private);
+		free_pages((unsigned long)stream->buffer, 1);
+	}
+
+	kfree(zram->streams);
+	zram->streams = NULL;
+	zram->num_streams = 0;
+	INIT_LIST_HEAD(&zram->idle_streams);
+}
+
+static int zram_create_streams(struct zram *zram)
+{
+	unsigned int i, num;
+
+	num = zram->max_comp_streams;
+	if (!num)
+		num = num_online_cpus();
+
+	zram->streams = kcalloc(num, sizeof(*zram->streams), GFP_KERNEL);
+	if (!zram->streams)
+		return -ENOMEM;
+	zram->num_streams = num;
+
+	for (i = 0; i < num; i++) {
+		struct zram_stream *stream = &zram->streams[i];
+
+		stream->private = zram->backend->create();
+		if (!stream->private) {
+			pr_err("Error allocating %s compressor working "
+				"memory!\n", zram->backend->name);
+			return -ENOMEM;
+		}
+
+		stream->buffer = (void *)__get_free_pages(GFP_KERNEL |
+							__GFP_ZERO, 1);
+		if (!stream->buffer) {
+			pr_err("Error allocating compressor buffer space\n");
+			return -ENOMEM;
+		}
+
+		list_add_tail(&stream->list, &zram->idle_streams);
+	}
+
+	return 0;
+}
+
+static int zram_compress(struct zram *zram, struct zram_stream *stream,
+			const unsigned char *src, size_t *dst_len)
+{
+	int ret;
+	ktime_t start;
+	struct zram_comp_stats *cstats;
+
+	cstats = &zram->comp_stats[zram->backend->id];
+
+	start = ktime_get();
+	ret = zram->backend->compress(src, PAGE_SIZE, stream->buffer, dst_len,
+					stream->private);
+
+	spin_lock(&zram->stat64_lock);
+	cstats->num_compress++;
+	cstats->compress_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+	if (!ret) {
+		cstats->compress_in += PAGE_SIZE;
+		cstats->compress_out += *dst_len;
+	}
+	spin_unlock(&zram->stat64_lock);
+
+	return ret;
+}
+
+static int zram_decompress(struct zram *zram, struct zram_stream *stream,
+			const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len)
+{
+	int ret;
+	ktime_t start;
+	struct zram_comp_stats *cstats;
+
+	cstats = &zram->comp_stats[zram->backend->id];
+
+	start = ktime_get();
+	ret = zram->backend->decompress(src, src_len, dst, dst_len,
+					stream ? stream->private : NULL);
+
+	spin_lock(&zram->stat64_lock);
+	cstats->num_decompress++;
+	cstats->decompress_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+	spin_unlock(&zram->stat64_lock);
+
+	return ret;
+}
+
 static int zram_test_flag(struct zram *zram, u32 index,
 			enum zram_pageflags flag)
 {
@@ -133,6 +229,15 @@ static void zram_clear_flag(struct zram *zram, u32 index,
 	zram->table[index].flags &= ~BIT(flag);
 }
 
+/* Size of the zobj_header in front of each compressed object */
+static size_t zram_hdr_size(struct zram *zram)
+{
+	if (zram->dedup)
+		return sizeof(struct zobj_header);
+
+	return offsetof(struct zobj_header, checksum);
+}
+
 static int page_zero_filled(void *ptr)
 {
 	unsigned int pos;
@@ -177,14 +282,248 @@ static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 	zram->disksize &= PAGE_MASK;
 }
 
+static u32 zram_page_checksum(struct page *page)
+{
+	u32 checksum;
+	void *user_mem;
+
+	user_mem = kmap_atomic(page, KM_USER0);
+	checksum = jhash2(user_mem, PAGE_SIZE / sizeof(u32), 0);
+	kunmap_atomic(user_mem, KM_USER0);
+
+	return checksum;
+}
+
+static struct hlist_head *zram_dedup_bucket(struct zram *zram, u32 checksum)
+{
+	return &zram->dedup_hash[checksum & zram->dedup_hash_mask];
+}
+
+/*
+ * Find a stored object with the same content as @page and take a
+ * reference on it. Candidates are decompressed into the stream buffer
+ * and compared in full, so checksum collisions never alias pages.
+ */
+static struct zram_dedup_entry *zram_dedup_get(struct zram *zram,
+		struct zram_stream *stream, struct page *page, u32 checksum,
+		size_t *clen)
+{
+	struct hlist_node *pos;
+	struct zram_dedup_entry *entry, *found = NULL;
+
+	spin_lock(&zram->dedup_lock);
+	hlist_for_each_entry(entry, pos, zram_dedup_bucket(zram, checksum),
+				node) {
+		int ret;
+		size_t len, objlen;
+		unsigned char *user_mem, *cmem;
+
+		if (entry->checksum != checksum)
+			continue;
+
+		cmem = kmap_atomic(entry->page, KM_USER1) + entry->offset;
+		objlen = xv_get_object_size(cmem) - zram_hdr_size(zram);
+		len = PAGE_SIZE;
+		ret = zram_decompress(zram, stream,
+			cmem + zram_hdr_size(zram), objlen,
+			stream->buffer, &len);
+		kunmap_atomic(cmem, KM_USER1);
+
+		if (ret || len != PAGE_SIZE)
+			continue;
+
+		user_mem = kmap_atomic(page, KM_USER0);
+		ret = memcmp(user_mem, stream->buffer, PAGE_SIZE);
+		kunmap_atomic(user_mem, KM_USER0);
+
+		if (!ret) {
+			entry->refcount++;
+			*clen = objlen;
+			found = entry;
+			break;
+		}
+	}
+	spin_unlock(&zram->dedup_lock);
+
+	return found;
+}
+
+static int zram_dedup_add(struct zram *zram, u32 checksum,
+			struct page *page, u16 offset)
+{
+	struct zram_dedup_entry *entry;
+
+	entry = kmalloc(sizeof(*entry), GFP_NOIO);
+	if (!entry)
+		return -ENOMEM;
+
+	entry->checksum = checksum;
+	entry->refcount = 1;
+	entry->page = page;
+	entry->offset = offset;
+
+	spin_lock(&zram->dedup_lock);
+	hlist_add_head(&entry->node, zram_dedup_bucket(zram, checksum));
+	spin_unlock(&zram->dedup_lock);
+
+	return 0;
+}
+
+/* Find the dedup entry for <page, offset>. Caller holds dedup_lock. */
+static struct zram_dedup_entry *zram_dedup_find(struct zram *zram,
+		u32 checksum, struct page *page, u16 offset)
+{
+	struct hlist_node *pos;
+	struct zram_dedup_entry *entry;
+
+	hlist_for_each_entry(entry, pos, zram_dedup_bucket(zram, checksum),
+				node) {
+		if (entry->page == page && entry->offset == offset)
+			return entry;
+	}
+
+	return NULL;
+}
+
+/*
+ * Drop a reference on the dedup entry for <page, offset>. Returns the
+ * number of references left; the caller frees the object at zero.
+ */
+static u32 zram_dedup_put(struct zram *zram, u32 checksum,
+			struct page *page, u16 offset)
+{
+	u32 refcount = 0;
+	struct zram_dedup_entry *entry;
+
+	spin_lock(&zram->dedup_lock);
+	entry = zram_dedup_find(zram, checksum, page, offset);
+	if (entry) {
+		refcount = --entry->refcount;
+		if (!refcount) {
+			hlist_del(&entry->node);
+			kfree(entry);
+		}
+	}
+	spin_unlock(&zram->dedup_lock);
+
+	return refcount;
+}
+
+static unsigned long zram_bd_alloc_block(struct zram *zram)
+{
+	unsigned long blk;
+
+	spin_lock(&zram->bd_lock);
+	blk = find_next_zero_bit(zram->bd_map, zram->bd_nr_blocks, 1);
+	if (blk < zram->bd_nr_blocks)
+		set_bit(blk, zram->bd_map);
+	else
+		blk = 0;
+	spin_unlock(&zram->bd_lock);
+
+	return blk;
+}
+
+static void zram_bd_free_block(struct zram *zram, unsigned long blk)
+{
+	spin_lock(&zram->bd_lock);
+	clear_bit(blk, zram->bd_map);
+	spin_unlock(&zram->bd_lock);
+}
+
+static void zram_bd_end_io(struct bio *bio, int err)
+{
+	complete(bio->bi_private);
+}
+
+static int zram_bd_rw(struct zram *zram, int rw, unsigned long blk,
+			struct page *page)
+{
+	int ret;
+	struct bio *bio;
+	DECLARE_COMPLETION_ONSTACK(done);
+
+	bio = bio_alloc(GFP_NOIO, 1);
+	if (!bio)
+		return -ENOMEM;
+
+	bio->bi_bdev = zram->bdev;
+	bio->bi_sector = blk << SECTORS_PER_PAGE_SHIFT;
+	bio->bi_end_io = zram_bd_end_io;
+	bio->bi_private = &done;
+	if (bio_add_page(bio, page, PAGE_SIZE, 0) != PAGE_SIZE) {
+		bio_put(bio);
+		return -EIO;
+	}
+
+	submit_bio(rw | REQ_SYNC, bio);
+	wait_for_completion(&done);
+
+	ret = test_bit(BIO_UPTODATE, &bio->bi_flags) ? 0 : -EIO;
+	bio_put(bio);
+
+	return ret;
+}
+
+struct zram_bd_read_work {
+	struct work_struct work;
+	struct zram *zram;
+	unsigned long blk;
+	struct page *page;
+	int ret;
+};
+
+static void zram_bd_read_fn(struct work_struct *work)
+{
+	struct zram_bd_read_work *rw;
+
+	rw = container_of(work, struct zram_bd_read_work, work);
+	rw->ret = zram_bd_rw(rw->zram, READ, rw->blk, rw->page);
+}
+
+/*
+ * Reads come in through zram_make_request(), where a bio submitted to
+ * another device is only dispatched once we return. Issue the read
+ * from a worker and wait for it instead.
+ */
+static int zram_bd_read(struct zram *zram, unsigned long blk,
+			struct page *page)
+{
+	struct zram_bd_read_work rw;
+
+	rw.zram = zram;
+	rw.blk = blk;
+	rw.page = page;
+	rw.ret = 0;
+
+	INIT_WORK_ONSTACK(&rw.work, zram_bd_read_fn);
+	queue_work(system_unbound_wq, &rw.work);
+	flush_work(&rw.work);
+	destroy_work_on_stack(&rw.work);
+
+	return rw.ret;
+}
+
 static void zram_free_page(struct zram *zram, size_t index)
 {
 	u32 clen;
+	u32 checksum;
 	void *obj;
 
 	struct page *page = zram->table[index].page;
 	u32 offset = zram->table[index].offset;
 
+	zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+
+	if (unlikely(zram_test_flag(zram, index, ZRAM_WB))) {
+		zram_clear_flag(zram, index, ZRAM_WB);
+		zram_bd_free_block(zram, zram->table[index].wb_block);
+		zram_stat_dec(&zram->stats.bd_pages);
+		zram_stat_dec(&zram->stats.pages_stored);
+		zram->table[index].wb_block = 0;
+		return;
+	}
+
 	if (unlikely(!page)) {
 		/*
 		 * No memory is allocated for zero filled pages.
@@ -206,9 +545,22 @@ static void zram_free_page(struct zram *zram, size_t index)
 	}
 
 	obj = kmap_atomic(page, KM_USER0) + offset;
-	clen = xv_get_object_size(obj) - sizeof(struct zobj_header);
+	clen = xv_get_object_size(obj) - zram_hdr_size(zram);
+	checksum = zram->dedup ? ((struct zobj_header *)obj)->checksum : 0;
 	kunmap_atomic(obj, KM_USER0);
 
+	if (zram_test_flag(zram, index, ZRAM_DEDUP)) {
+		zram_clear_flag(zram, index, ZRAM_DEDUP);
+		if (zram_dedup_put(zram, checksum, page, offset)) {
+			/* Object is still used by other pages */
+			zram_stat_dec(&zram->stats.dedup_pages);
+			zram_stat64_sub(zram, &zram->stats.dedup_saved_bytes,
+					clen);
+			zram_stat_dec(&zram->stats.pages_stored);
+			goto clear;
+		}
+	}
+
 	xv_free(zram->mem_pool, page, offset);
 	if (clen <= PAGE_SIZE / 2)
 		zram_stat_dec(&zram->stats.good_compress);
@@ -217,6 +569,7 @@ out:
 	zram_stat64_sub(zram, &zram->stats.compr_size, clen);
 	zram_stat_dec(&zram->stats.pages_stored);
 
+clear:
 	zram->table[index].page = NULL;
 	zram->table[index].offset = 0;
 }
@@ -261,32 +614,72 @@ static void zram_read(struct zram *zram, struct bio *bio)
 	bio_for_each_segment(bvec, bio, i) {
 		int ret;
 		size_t clen;
+		unsigned long blk;
 		struct page *page;
-		struct zobj_header *zheader;
+		struct zram_stream *stream = NULL;
 		unsigned char *user_mem, *cmem;
 
 		page = bvec->bv_page;
 
+		if (zram->idle_map)
+			clear_bit(index, zram->idle_map);
+
+		/* Taken up front: getting a stream may sleep */
+		if (zram->backend->decompress_needs_private)
+			stream = zram_stream_get(zram);
+
+		/*
+		 * Compaction, writeback and slot free notifications move or
+		 * free objects under table_lock, so hold it from the lookup
+		 * until the object has been copied out.
+		 */
+		spin_lock(&zram->table_lock);
+
 		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
+			spin_unlock(&zram->table_lock);
 			handle_zero_page(page);
-			index++;
-			continue;
+			goto next;
+		}
+
+		/* Page was moved out to the backing device */
+		if (unlikely(zram_test_flag(zram, index, ZRAM_WB))) {
+			blk = zram->table[index].wb_block;
+			spin_unlock(&zram->table_lock);
+
+			/* Not needed, don't hold it across the I/O */
+			if (stream) {
+				zram_stream_put(zram, stream);
+				stream = NULL;
+			}
+
+			ret = zram_bd_read(zram, blk, page);
+			if (unlikely(ret)) {
+				pr_err("Backing device read failed! err=%d, "
+					"page=%u\n", ret, index);
+				zram_stat64_inc(zram,
+					&zram->stats.failed_reads);
+				goto out;
+			}
+			zram_stat64_add(zram, &zram->stats.bd_read_bytes,
+					PAGE_SIZE);
+			flush_dcache_page(page);
+			goto next;
 		}
 
 		/* Requested page is not present in compressed area */
 		if (unlikely(!zram->table[index].page)) {
+			spin_unlock(&zram->table_lock);
 			pr_debug("Read before write: sector=%lu, size=%u",
 				(ulong)(bio->bi_sector), bio->bi_size);
 			handle_zero_page(page);
-			index++;
-			continue;
+			goto next;
 		}
 
 		/* Page is stored uncompressed since it's incompressible */
 		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
 			handle_uncompressed_page(zram, page, index);
-			index++;
-			continue;
+			spin_unlock(&zram->table_lock);
+			goto next;
 		}
 
 		user_mem = kmap_atomic(page, KM_USER0);
@@ -295,16 +688,19 @@ static void zram_read(struct zram *zram, struct bio *bio)
 		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
 				zram->table[index].offset;
 
-		ret = DECOMPRESS(
-			cmem + sizeof(*zheader),
-			xv_get_object_size(cmem) - sizeof(*zheader),
+		ret = zram_decompress(zram, stream,
+			cmem + zram_hdr_size(zram),
+			xv_get_object_size(cmem) - zram_hdr_size(zram),
 			user_mem, &clen);
 
 		kunmap_atomic(user_mem, KM_USER0);
 		kunmap_atomic(cmem, KM_USER1);
+		spin_unlock(&zram->table_lock);
 
 		/* Should NEVER happen. Return bio error if it does. */
 		if (unlikely(ret)) {
+			if (stream)
+				zram_stream_put(zram, stream);
 			pr_err("Decompression failed! err=%d, page=%u\n",
 				ret, index);
 			zram_stat64_inc(zram, &zram->stats.failed_reads);
@@ -312,6 +708,9 @@ static void zram_read(struct zram *zram, struct bio *bio)
 		}
 
 		flush_dcache_page(page);
+next:
+		if (stream)
+			zram_stream_put(zram, stream);
 		index++;
 	}
 
@@ -335,46 +734,86 @@ static void zram_write(struct zram *zram, struct bio *bio)
 	bio_for_each_segment(bvec, bio, i) {
 		int ret;
 		u32 offset;
+		u32 checksum = 0;
 		size_t clen;
 		struct zobj_header *zheader;
+		struct zram_stream *stream;
+		struct zram_dedup_entry *entry;
 		struct page *page, *page_store;
 		unsigned char *user_mem, *cmem, *src;
 
 		page = bvec->bv_page;
-		src = zram->compress_buffer;
-
-		/*
-		 * System overwrites unused sectors. Free memory associated
-		 * with this sector now.
-		 */
-		if (zram->table[index].page ||
-				zram_test_flag(zram, index, ZRAM_ZERO))
-			zram_free_page(zram, index);
 
-		mutex_lock(&zram->lock);
+		if (zram->idle_map)
+			clear_bit(index, zram->idle_map);
 
 		user_mem = kmap_atomic(page, KM_USER0);
 		if (page_zero_filled(user_mem)) {
 			kunmap_atomic(user_mem, KM_USER0);
-			mutex_unlock(&zram->lock);
+			mutex_lock(&zram->lock);
+			/*
+			 * System overwrites unused sectors. Free memory
+			 * associated with this sector now.
+			 */
+			if (zram->table[index].page ||
+					zram_test_flag(zram, index, ZRAM_ZERO))
+				zram_free_page(zram, index);
 			zram_stat_inc(&zram->stats.pages_zero);
 			zram_set_flag(zram, index, ZRAM_ZERO);
+			mutex_unlock(&zram->lock);
 			index++;
 			continue;
 		}
+		kunmap_atomic(user_mem, KM_USER0);
 
-		ret = COMPRESS(user_mem, PAGE_SIZE, src, &clen,
-					zram->compress_workmem);
+		/*
+		 * Compression runs outside zram->lock on a stream owned by
+		 * this writer; only allocation and table update below are
+		 * serialized.
+		 */
+		stream = zram_stream_get(zram);
+		src = stream->buffer;
+
+		if (zram->dedup) {
+			checksum = zram_page_checksum(page);
+			entry = zram_dedup_get(zram, stream, page, checksum,
+						&clen);
+			if (entry) {
+				mutex_lock(&zram->lock);
+				if (zram->table[index].page ||
+					zram_test_flag(zram, index, ZRAM_ZERO))
+					zram_free_page(zram, index);
+				zram->table[index].page = entry->page;
+				zram->table[index].offset = entry->offset;
+				zram_set_flag(zram, index, ZRAM_DEDUP);
+				zram_stat_inc(&zram->stats.pages_stored);
+				zram_stat_inc(&zram->stats.dedup_pages);
+				zram_stat64_add(zram,
+					&zram->stats.dedup_saved_bytes, clen);
+				mutex_unlock(&zram->lock);
+				zram_stream_put(zram, stream);
+				index++;
+				continue;
+			}
+		}
 
+		user_mem = kmap_atomic(page, KM_USER0);
+		ret = zram_compress(zram, stream, user_mem, &clen);
 		kunmap_atomic(user_mem, KM_USER0);
 
 		if (unlikely(ret)) {
-			mutex_unlock(&zram->lock);
+			zram_stream_put(zram, stream);
 			pr_err("Compression failed! err=%d\n", ret);
 			zram_stat64_inc(zram, &zram->stats.failed_writes);
 			goto out;
 		}
 
+		mutex_lock(&zram->lock);
+
+		if (zram->table[index].page ||
+				zram_test_flag(zram, index, ZRAM_ZERO))
+			zram_free_page(zram, index);
+
 		/*
 		 * Page is incompressible. Store it as-is (uncompressed)
 		 * since we do not want to return too many disk write
@@ -385,6 +824,7 @@ static void zram_write(struct zram *zram, struct bio *bio)
 			page_store = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
 			if (unlikely(!page_store)) {
 				mutex_unlock(&zram->lock);
+				zram_stream_put(zram, stream);
 				pr_info("Error allocating memory for "
 					"incompressible page: %u\n", index);
 				zram_stat64_inc(zram,
@@ -400,10 +840,11 @@ static void zram_write(struct zram *zram, struct bio *bio)
 			goto memstore;
 		}
 
-		if (xv_malloc(zram->mem_pool, clen + sizeof(*zheader),
+		if (xv_malloc(zram->mem_pool, clen + zram_hdr_size(zram),
 				&zram->table[index].page, &offset,
 				GFP_NOIO | __GFP_HIGHMEM)) {
 			mutex_unlock(&zram->lock);
+			zram_stream_put(zram, stream);
 			pr_info("Error allocating memory for compressed "
 				"page: %u, size=%zu\n", index, clen);
 			zram_stat64_inc(zram, &zram->stats.failed_writes);
@@ -416,14 +857,14 @@ memstore:
 		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
 				zram->table[index].offset;
 
-#if 0
-		/* Back-reference needed for memory defragmentation */
 		if (!zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
 			zheader = (struct zobj_header *)cmem;
+			if (zram->dedup)
+				zheader->checksum = checksum;
+			/* Back-reference needed for memory defragmentation */
 			zheader->table_idx = index;
-			cmem += sizeof(*zheader);
+			cmem += zram_hdr_size(zram);
 		}
-#endif
 
 		memcpy(cmem, src, clen);
 
@@ -437,7 +878,15 @@ memstore:
 		if (clen <= PAGE_SIZE / 2)
 			zram_stat_inc(&zram->stats.good_compress);
 
+		/* Make this object available to later identical pages */
+		if (zram->dedup &&
+			!zram_test_flag(zram, index, ZRAM_UNCOMPRESSED) &&
+			!zram_dedup_add(zram, checksum,
+				zram->table[index].page, offset))
+			zram_set_flag(zram, index, ZRAM_DEDUP);
+
 		mutex_unlock(&zram->lock);
+		zram_stream_put(zram, stream);
 		index++;
 	}
 
@@ -449,6 +898,274 @@ out:
 	bio_io_error(bio);
 }
 
+static int zram_writeback_candidate(struct zram *zram, u32 index)
+{
+	if (!zram->table[index].page ||
+			zram_test_flag(zram, index, ZRAM_ZERO) ||
+			zram_test_flag(zram, index, ZRAM_WB) ||
+			zram_test_flag(zram, index, ZRAM_DEDUP))
+		return 0;
+
+	return zram_test_flag(zram, index, ZRAM_UNCOMPRESSED) ||
+		test_bit(index, zram->idle_map);
+}
+
+/*
+ * Move one slot to the backing device. The page is copied out under
+ * table_lock and written without it. The slot is only switched over if
+ * it still holds the object that was copied: a slot freed or rewritten
+ * meanwhile has ZRAM_UNDER_WB cleared or points elsewhere, and the copy
+ * is dropped.
+ */
+static int zram_writeback_slot(struct zram *zram, u32 index)
+{
+	int ret = 0;
+	u16 offset;
+	size_t clen;
+	unsigned long blk;
+	struct page *page;
+	struct zram_stream *stream;
+	unsigned char *cmem, *dst;
+
+	blk = zram_bd_alloc_block(zram);
+	if (!blk)
+		return -ENOSPC;
+
+	stream = zram_stream_get(zram);
+	mutex_lock(&zram->lock);
+	spin_lock(&zram->table_lock);
+
+	if (!zram_writeback_candidate(zram, index)) {
+		spin_unlock(&zram->table_lock);
+		mutex_unlock(&zram->lock);
+		zram_stream_put(zram, stream);
+		zram_bd_free_block(zram, blk);
+		return 0;
+	}
+
+	page = zram->table[index].page;
+	offset = zram->table[index].offset;
+
+	dst = kmap_atomic(zram->wb_page, KM_USER0);
+	cmem = kmap_atomic(page, KM_USER1) + offset;
+
+	if (zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
+		memcpy(dst, cmem, PAGE_SIZE);
+	} else {
+		clen = PAGE_SIZE;
+		ret = zram_decompress(zram, stream,
+			cmem + zram_hdr_size(zram),
+			xv_get_object_size(cmem) - zram_hdr_size(zram),
+			dst, &clen);
+	}
+
+	kunmap_atomic(dst, KM_USER0);
+	kunmap_atomic(cmem, KM_USER1);
+
+	if (!ret)
+		zram_set_flag(zram, index, ZRAM_UNDER_WB);
+
+	spin_unlock(&zram->table_lock);
+	mutex_unlock(&zram->lock);
+	zram_stream_put(zram, stream);
+
+	if (!ret)
+		ret = zram_bd_rw(zram, WRITE, blk, zram->wb_page);
+
+	/*
+	 * Free the object and publish the backing block in one table_lock
+	 * section, so that readers never see the slot empty.
+	 */
+	mutex_lock(&zram->lock);
+	spin_lock(&zram->table_lock);
+	if (!ret && zram_test_flag(zram, index, ZRAM_UNDER_WB) &&
+			!zram_test_flag(zram, index, ZRAM_WB) &&
+			zram->table[index].page == page &&
+			zram->table[index].offset == offset) {
+		zram_free_page(zram, index);
+		zram->table[index].wb_block = blk;
+		zram_set_flag(zram, index, ZRAM_WB);
+		zram_stat_inc(&zram->stats.pages_stored);
+		zram_stat_inc(&zram->stats.bd_pages);
+		blk = 0;
+	} else {
+		zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+	}
+	spin_unlock(&zram->table_lock);
+	mutex_unlock(&zram->lock);
+
+	if (blk)
+		zram_bd_free_block(zram, blk);
+	else
+		zram_stat64_add(zram, &zram->stats.bd_write_bytes, PAGE_SIZE);
+
+	return ret;
+}
+
+/*
+ * Periodic writeback pass. Incompressible pages are written out right
+ * away; other pages once they have gone a full pass (writeback_idle_secs)
+ * without being read or rewritten.
+ */
+static void zram_writeback_work(struct work_struct *work)
+{
+	u32 index, num_pages;
+	struct zram *zram;
+
+	zram = container_of(to_delayed_work(work), struct zram, wb_work);
+	num_pages = zram->disksize >> PAGE_SHIFT;
+
+	for (index = 0; index < num_pages; index++) {
+		if (zram_writeback_candidate(zram, index)) {
+			if (zram_writeback_slot(zram, index) == -ENOSPC)
+				break;
+		} else if (zram->table[index].page &&
+				!zram_test_flag(zram, index, ZRAM_WB)) {
+			set_bit(index, zram->idle_map);
+		}
+		cond_resched();
+	}
+
+	if (zram->writeback_idle_secs)
+		queue_delayed_work(system_long_wq, &zram->wb_work,
+				zram->writeback_idle_secs * HZ);
+}
+
+/*
+ * xv_compact() callback: move one compressed object to another pool
+ * page, using its back-reference to find and update the table entry.
+ *
+ * With dedup every object is registered in the dedup table. One that
+ * is referenced by a single slot is moved along with its dedup entry,
+ * provided that slot is still the one that first stored it: only that
+ * slot is known from the header. An object shared by several slots is
+ * left in place, and so is one whose first owner was freed or
+ * overwritten while another slot kept it: the back-reference is not
+ * moved to the remaining slot, so such an object stays pinned until it
+ * is freed.
+ */
+static int zram_migrate_object(void *priv, struct page *page, u32 offset)
+{
+	u32 index, size, new_offset, checksum;
+	struct page *new_page;
+	struct zram *zram = priv;
+	struct zram_dedup_entry *entry = NULL;
+	unsigned char *src, *dst;
+
+	src = kmap_atomic(page, KM_USER0) + offset;
+	index = ((struct zobj_header *)src)->table_idx;
+	checksum = zram->dedup ? ((struct zobj_header *)src)->checksum : 0;
+	size = xv_get_object_size(src);
+	kunmap_atomic(src, KM_USER0);
+
+	if (index >= zram->disksize >> PAGE_SHIFT)
+		return -EINVAL;
+
+	/* Only reuse free space already in the pool */
+	if (xv_malloc(zram->mem_pool, size, &new_page, &new_offset,
+			GFP_NOWAIT | __GFP_HIGHMEM))
+		return -ENOMEM;
+
+	spin_lock(&zram->table_lock);
+	if (zram->table[index].page != page ||
+			zram->table[index].offset != offset ||
+			zram_test_flag(zram, index, ZRAM_UNCOMPRESSED) ||
+			zram_test_flag(zram, index, ZRAM_WB))
+		goto busy;
+
+	if (zram_test_flag(zram, index, ZRAM_DEDUP)) {
+		spin_lock(&zram->dedup_lock);
+		entry = zram_dedup_find(zram, checksum, page, offset);
+		if (!entry || entry->refcount != 1) {
+			/* Object shared through dedup */
+			spin_unlock(&zram->dedup_lock);
+			goto busy;
+		}
+	}
+
+	src = kmap_atomic(page, KM_USER0) + offset;
+	dst = kmap_atomic(new_page, KM_USER1) + new_offset;
+	memcpy(dst, src, size);
+	kunmap_atomic(dst, KM_USER1);
+	kunmap_atomic(src, KM_USER0);
+
+	zram->table[index].page = new_page;
+	zram->table[index].offset = new_offset;
+	if (entry) {
+		entry->page = new_page;
+		entry->offset = new_offset;
+		spin_unlock(&zram->dedup_lock);
+	}
+	spin_unlock(&zram->table_lock);
+
+	xv_free(zram->mem_pool, page, offset);
+
+	return 0;
+
+busy:
+	/* Stale or orphaned back-reference, or object still shared */
+	spin_unlock(&zram->table_lock);
+	xv_free(zram->mem_pool, new_page, new_offset);
+	return -EBUSY;
+}
+
+/* Percentage of pool memory not holding objects */
+static u32 zram_pool_frag(struct zram *zram)
+{
+	u64 total = xv_get_total_size_bytes(zram->mem_pool);
+	u64 used = xv_get_used_size_bytes(zram->mem_pool);
+
+	if (!total)
+		return 0;
+
+	return 100 - (u32)div64_u64(used * 100, total);
+}
+
+/*
+ * Migrate objects out of sparsely used pool pages so that those pages
+ * can be freed. Caller must hold zram->lock. Returns pages freed.
+ */
+u32 zram_compact(struct zram *zram, u32 max_pages)
+{
+	u32 freed, frag_before;
+
+	frag_before = zram_pool_frag(zram);
+	freed = xv_compact(zram->mem_pool, max_pages,
+			zram_migrate_object, zram);
+
+	spin_lock(&zram->stat64_lock);
+	zram->stats.compact_runs++;
+	zram->stats.compact_pages_freed += freed;
+	zram->stats.frag_before = frag_before;
+	zram->stats.frag_after = zram_pool_frag(zram);
+	spin_unlock(&zram->stat64_lock);
+
+	pr_debug("Compaction freed %u pages, fragmentation %u%% -> %u%%\n",
+		freed, frag_before, zram->stats.frag_after);
+
+	return freed;
+}
+
+static int zram_shrink(struct shrinker *shrinker, struct shrink_control *sc)
+{
+	u64 total, used;
+	struct zram *zram = container_of(shrinker, struct zram, shrinker);
+
+	if (sc->nr_to_scan) {
+		/* We may be called from our own allocations in zram_write() */
+		if (!mutex_trylock(&zram->lock))
+			return -1;
+		zram_compact(zram, sc->nr_to_scan);
+		mutex_unlock(&zram->lock);
+	}
+
+	/* Pages that compaction could give back at best */
+	total = xv_get_total_size_bytes(zram->mem_pool) >> PAGE_SHIFT;
+	used = DIV_ROUND_UP(xv_get_used_size_bytes(zram->mem_pool), PAGE_SIZE);
+
+	return total > used ? (int)min_t(u64, total - used, INT_MAX) : 0;
+}
+
 /*
  * Check if request is within bounds and page aligned.
  */
@@ -502,14 +1219,14 @@ void zram_reset_device(struct zram *zram)
 	size_t index;
 
 	mutex_lock(&zram->init_lock);
+	if (zram->init_done)
+		unregister_shrinker(&zram->shrinker);
 	zram->init_done = 0;
 
-	/* Free various per-device buffers */
-	kfree(zram->compress_workmem);
-	free_pages((unsigned long)zram->compress_buffer, 1);
+	cancel_delayed_work_sync(&zram->wb_work);
 
-	zram->compress_workmem = NULL;
-	zram->compress_buffer = NULL;
+	/* Free various per-device buffers */
+	zram_destroy_streams(zram);
 
 	/* Free all pages that are still in this zram device */
 	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
@@ -522,15 +1239,53 @@ void zram_reset_device(struct zram *zram)
 		if (!page)
 			continue;
 
+		/*
+		 * Shared objects are freed through the dedup table below;
+		 * written back pages only hold a block on the backing device.
+		 */
+		if (zram_test_flag(zram, index, ZRAM_DEDUP) ||
+				zram_test_flag(zram, index, ZRAM_WB))
+			continue;
+
 		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
 			__free_page(page);
 		else
 			xv_free(zram->mem_pool, page, offset);
 	}
 
+	if (zram->dedup_hash) {
+		for (index = 0; index <= zram->dedup_hash_mask; index++) {
+			struct hlist_node *pos, *n;
+			struct zram_dedup_entry *entry;
+
+			hlist_for_each_entry_safe(entry, pos, n,
+					&zram->dedup_hash[index], node) {
+				xv_free(zram->mem_pool, entry->page,
+					entry->offset);
+				kfree(entry);
+			}
+		}
+		vfree(zram->dedup_hash);
+		zram->dedup_hash = NULL;
+	}
+
 	vfree(zram->table);
 	zram->table = NULL;
 
+	if (zram->bdev) {
+		blkdev_put(zram->bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+		zram->bdev = NULL;
+	}
+	vfree(zram->bd_map);
+	zram->bd_map = NULL;
+	zram->bd_nr_blocks = 0;
+	vfree(zram->idle_map);
+	zram->idle_map = NULL;
+	if (zram->wb_page) {
+		__free_page(zram->wb_page);
+		zram->wb_page = NULL;
+	}
+
 	xv_destroy_pool(zram->mem_pool);
 	zram->mem_pool = NULL;
 
@@ -541,6 +1296,43 @@ void zram_reset_device(struct zram *zram)
 	mutex_unlock(&zram->init_lock);
 }
 
+static int zram_init_backing_dev(struct zram *zram, size_t num_pages)
+{
+	struct block_device *bdev;
+
+	bdev = blkdev_get_by_path(zram->backing_dev_name,
+			FMODE_READ | FMODE_WRITE | FMODE_EXCL, zram);
+	if (IS_ERR(bdev)) {
+		pr_err("Error opening backing device %s\n",
+			zram->backing_dev_name);
+		return PTR_ERR(bdev);
+	}
+	zram->bdev = bdev;
+
+	zram->bd_nr_blocks = i_size_read(bdev->bd_inode) >> PAGE_SHIFT;
+	if (zram->bd_nr_blocks < 2) {
+		pr_err("Backing device %s is too small\n",
+			zram->backing_dev_name);
+		return -EINVAL;
+	}
+
+	zram->bd_map = vzalloc(BITS_TO_LONGS(zram->bd_nr_blocks) *
+				sizeof(long));
+	zram->idle_map = vzalloc(BITS_TO_LONGS(num_pages) * sizeof(long));
+	zram->wb_page = alloc_page(GFP_KERNEL);
+	if (!zram->bd_map || !zram->idle_map || !zram->wb_page) {
+		pr_err("Error allocating backing device structures\n");
+		return -ENOMEM;
+	}
+
+	/* Block 0 is reserved, see struct zram */
+	set_bit(0, zram->bd_map);
+
+	pr_info("Using %s as backing device (%lu pages)\n",
+		zram->backing_dev_name, zram->bd_nr_blocks);
+	return 0;
+}
+
 int zram_init_device(struct zram *zram)
 {
 	int ret;
@@ -555,17 +1347,9 @@ int zram_init_device(struct zram *zram)
 
 	zram_set_disksize(zram, totalram_pages << PAGE_SHIFT);
 
-	zram->compress_workmem = kzalloc(WMSIZE, GFP_KERNEL);
-	if (!zram->compress_workmem) {
-		pr_err("Error allocating compressor working memory!\n");
-		ret = -ENOMEM;
-		goto fail;
-	}
-
-	zram->compress_buffer = (void *)__get_free_pages(__GFP_ZERO, 1);
-	if (!zram->compress_buffer) {
-		pr_err("Error allocating compressor buffer space\n");
-		ret = -ENOMEM;
+	ret = zram_create_streams(zram);
+	if (ret) {
+		pr_err("Error allocating compression streams\n");
 		goto fail;
 	}
 
@@ -579,6 +1363,25 @@ int zram_init_device(struct zram *zram)
 		goto fail;
 	}
 
+	if (zram->dedup) {
+		unsigned long buckets;
+
+		buckets = roundup_pow_of_two(max_t(size_t, num_pages >> 4, 64));
+		zram->dedup_hash = vzalloc(buckets * sizeof(*zram->dedup_hash));
+		if (!zram->dedup_hash) {
+			pr_err("Error allocating dedup hash table\n");
+			ret = -ENOMEM;
+			goto fail;
+		}
+		zram->dedup_hash_mask = buckets - 1;
+	}
+
+	if (zram->backing_dev_name) {
+		ret = zram_init_backing_dev(zram, num_pages);
+		if (ret)
+			goto fail;
+	}
+
 	set_capacity(zram->disk, zram->disksize >> SECTOR_SHIFT);
 
 	/* zram devices sort of resembles non-rotational disks */
@@ -591,10 +1394,15 @@ int zram_init_device(struct zram *zram)
 		goto fail;
 	}
 
+	register_shrinker(&zram->shrinker);
 	zram->init_done = 1;
+	if (zram->bdev && zram->writeback_idle_secs)
+		queue_delayed_work(system_long_wq, &zram->wb_work,
+				zram->writeback_idle_secs * HZ);
 	mutex_unlock(&zram->init_lock);
 
-	pr_debug("Initialization done!\n");
+	pr_debug("Initialization done! (%s, %u streams)\n",
+		zram->backend->name, zram->num_streams);
 	return 0;
 
 fail:
@@ -610,7 +1418,9 @@ void zram_slot_free_notify(struct block_device *bdev, unsigned long index)
 	struct zram *zram;
 
 	zram = bdev->bd_disk->private_data;
+	spin_lock(&zram->table_lock);
 	zram_free_page(zram, index);
+	spin_unlock(&zram->table_lock);
 	zram_stat64_inc(zram, &zram->stats.notify_free);
 }
 
@@ -626,6 +1436,17 @@ static int create_device(struct zram *zram, int device_id)
 	mutex_init(&zram->lock);
 	mutex_init(&zram->init_lock);
 	spin_lock_init(&zram->stat64_lock);
+	spin_lock_init(&zram->stream_lock);
+	spin_lock_init(&zram->dedup_lock);
+	spin_lock_init(&zram->bd_lock);
+	spin_lock_init(&zram->table_lock);
+	zram->shrinker.shrink = zram_shrink;
+	zram->shrinker.seeks = DEFAULT_SEEKS;
+	INIT_DELAYED_WORK(&zram->wb_work, zram_writeback_work);
+	init_waitqueue_head(&zram->stream_wait);
+	INIT_LIST_HEAD(&zram->idle_streams);
+
+	zram->backend = zram_backend_default();
 
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
 	if (!zram->queue) {
@@ -695,6 +1516,8 @@ static void destroy_device(struct zram *zram)
 
 	if (zram->queue)
 		blk_cleanup_queue(zram->queue);
+
+	kfree(zram->backing_dev_name);
 }
 
 static int __init zram_init(void)
@@ -15,10 +15,15 @@
 #ifndef _ZRAM_DRV_H_
 #define _ZRAM_DRV_H_
 
+#include <linux/list.h>
+#include <linux/mm.h>
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
 
 #include "xvmalloc.h"
+#include "zram_comp.h"
 
 /*
  * Some arbitrary value. This is just to catch
@@ -31,11 +36,12 @@ static const unsigned max_num_devices = 32;
  *
  * It stores back-reference to table entry which points to this
  * object. This is required to support memory defragmentation.
+ * The checksum is only stored on devices with dedup enabled, see
+ * zram_hdr_size().
  */
 struct zobj_header {
-#if 0
 	u32 table_idx;
-#endif
+	u32 checksum;	/* content hash of the uncompressed page */
 };
 
 /*-- Configurable parameters */
@@ -71,6 +77,15 @@ enum zram_pageflags {
 	/* Page consists entirely of zeros */
 	ZRAM_ZERO,
 
+	/* Object is registered in the dedup table and may be shared */
+	ZRAM_DEDUP,
+
+	/* Page lives on the backing device at table[].wb_block */
+	ZRAM_WB,
+
+	/* Page is being copied to the backing device */
+	ZRAM_UNDER_WB,
+
 	__NR_ZRAM_PAGEFLAGS,
 };
 
@@ -78,7 +93,10 @@ enum zram_pageflags {
 
 /* Allocated for each disk page */
 struct table {
-	struct page *page;
+	union {
+		struct page *page;
+		unsigned long wb_block;	/* ZRAM_WB: backing device block */
+	};
 	u16 offset;
 	u8 count;	/* object ref count (not yet used) */
 	u8 flags;
@@ -96,16 +114,79 @@ struct zram_stats {
 	u32 pages_stored;	/* no. of pages currently stored */
 	u32 good_compress;	/* % of pages with compression ratio<=50% */
 	u32 pages_expand;	/* % of incompressible pages */
+	u32 dedup_pages;	/* no. of pages sharing another's object */
+	u64 dedup_saved_bytes;	/* compressed bytes not stored due to dedup */
+	u32 bd_pages;		/* no. of pages on the backing device */
+	u64 bd_write_bytes;	/* written to the backing device */
+	u64 bd_read_bytes;	/* read back from the backing device */
+	u32 compact_runs;	/* no. of compaction passes */
+	u64 compact_pages_freed;
+	u32 frag_before;	/* % of pool unused before last compaction */
+	u32 frag_after;		/* --do-- after last compaction */
+};
+
+/*
+ * One per deduplicated compressed object. All table entries pointing
+ * at <page, offset> hold a reference.
+ */
+struct zram_dedup_entry {
+	struct hlist_node node;
+	u32 checksum;
+	u32 refcount;
+	struct page *page;
+	u16 offset;
+};
+
+/*
+ * Compression workspace. A device has a small pool of these so that
+ * several writers can compress in parallel.
+ */
+struct zram_stream {
+	struct list_head list;	/* entry in zram->idle_streams */
+	void *private;		/* backend private data */
+	void *buffer;		/* compressed output (2 pages) */
 };
 
 struct zram {
 	struct xv_pool *mem_pool;
-	void *compress_workmem;
-	void *compress_buffer;
+	const struct zram_backend *backend;
+	struct zram_stream *streams;
+	unsigned int num_streams;
+	/* Streams to create on init; 0 means one per online CPU */
+	unsigned int max_comp_streams;
+	struct list_head idle_streams;
+	spinlock_t stream_lock;	/* protect idle_streams */
+	wait_queue_head_t stream_wait;
 	struct table *table;
+	int dedup;		/* deduplicate identical pages */
+	struct hlist_head *dedup_hash;
+	unsigned int dedup_hash_mask;
+	spinlock_t dedup_lock;	/* protect dedup_hash and refcounts */
+	/*
+	 * Optional backing device for incompressible and idle pages.
+	 * Block 0 is never used so that a written back slot is
+	 * distinguishable from an empty one.
+	 */
+	char *backing_dev_name;
+	struct block_device *bdev;
+	unsigned long *bd_map;	/* allocated blocks on bdev */
+	unsigned long bd_nr_blocks;
+	spinlock_t bd_lock;	/* protect bd_map */
+	unsigned long *idle_map;	/* slots not accessed since last pass */
+	unsigned int writeback_idle_secs;
+	struct page *wb_page;	/* bounce page for writeback */
+	struct delayed_work wb_work;
+	/*
+	 * Protect table entries that are being relocated (compaction,
+	 * writeback) against readers and swap slot free notifications,
+	 * which run in atomic context and cannot take zram->lock. Readers
+	 * hold it until they have copied the object out.
+	 */
+	spinlock_t table_lock;
+	struct shrinker shrinker;	/* compacts the pool under pressure */
 	spinlock_t stat64_lock;	/* protect 64-bit stats */
-	struct mutex lock;	/* protect compression buffers against
-				 * concurrent writes */
+	struct mutex lock;	/* protect object allocation and table
+				 * updates against concurrent writes */
 	struct request_queue *queue;
 	struct gendisk *disk;
 	int init_done;
@@ -118,6 +199,7 @@ struct zram {
 	u64 disksize;	/* bytes */
 
 	struct zram_stats stats;
+	struct zram_comp_stats comp_stats[__NR_ZRAM_BACKENDS];
 };
 
 extern struct zram *devices;
@@ -128,5 +210,6 @@ extern struct attribute_group zram_disk_attr_group;
 
 extern int zram_init_device(struct zram *zram);
 extern void zram_reset_device(struct zram *zram);
+extern u32 zram_compact(struct zram *zram, u32 max_pages);
 
 #endif
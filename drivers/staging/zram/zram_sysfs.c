@@ -12,9 +12,14 @@
  * Project home: http://compcache.googlecode.com/
  */
 
+#include <linux/cpumask.h>
 #include <linux/device.h>
 #include <linux/genhd.h>
+#include <linux/math64.h>
 #include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/workqueue.h>
 
 #include "zram_drv.h"
 
@@ -191,6 +196,337 @@ static ssize_t mem_used_total_show(struct device *dev,
 	return sprintf(buf, "%llu\n", val);
 }
 
+static ssize_t dedup_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%d\n", zram->dedup);
+}
+
+static ssize_t dedup_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int ret;
+	unsigned long val;
+	struct zram *zram = dev_to_zram(dev);
+
+	ret = strict_strtoul(buf, 10, &val);
+	if (ret)
+		return ret;
+
+	mutex_lock(&zram->init_lock);
+	if (zram->init_done) {
+		mutex_unlock(&zram->init_lock);
+		pr_info("Cannot change dedup for initialized device\n");
+		return -EBUSY;
+	}
+	zram->dedup = !!val;
+	mutex_unlock(&zram->init_lock);
+
+	return len;
+}
+
+static ssize_t dedup_pages_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%u\n", zram->stats.dedup_pages);
+}
+
+static ssize_t dedup_saved_bytes_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%llu\n",
+		zram_stat64_read(zram, &zram->stats.dedup_saved_bytes));
+}
+
+static ssize_t backing_dev_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	ssize_t len;
+	struct zram *zram = dev_to_zram(dev);
+
+	mutex_lock(&zram->init_lock);
+	len = sprintf(buf, "%s\n", zram->backing_dev_name ?
+			zram->backing_dev_name : "none");
+	mutex_unlock(&zram->init_lock);
+
+	return len;
+}
+
+static ssize_t backing_dev_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	char *name;
+	struct zram *zram = dev_to_zram(dev);
+
+	name = kstrndup(buf, len, GFP_KERNEL);
+	if (!name)
+		return -ENOMEM;
+	strim(name);
+
+	mutex_lock(&zram->init_lock);
+	if (zram->init_done) {
+		mutex_unlock(&zram->init_lock);
+		kfree(name);
+		pr_info("Cannot change backing_dev for initialized device\n");
+		return -EBUSY;
+	}
+
+	kfree(zram->backing_dev_name);
+	zram->backing_dev_name = NULL;
+	if (*name && strcmp(name, "none"))
+		zram->backing_dev_name = name;
+	else
+		kfree(name);
+	mutex_unlock(&zram->init_lock);
+
+	return len;
+}
+
+static ssize_t writeback_idle_secs_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%u\n", zram->writeback_idle_secs);
+}
+
+static ssize_t writeback_idle_secs_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int ret;
+	unsigned long secs;
+	struct zram *zram = dev_to_zram(dev);
+
+	ret = strict_strtoul(buf, 10, &secs);
+	if (ret)
+		return ret;
+
+	mutex_lock(&zram->init_lock);
+	zram->writeback_idle_secs = secs;
+	if (zram->init_done && zram->bdev) {
+		cancel_delayed_work_sync(&zram->wb_work);
+		if (secs)
+			queue_delayed_work(system_long_wq, &zram->wb_work,
+					secs * HZ);
+	}
+	mutex_unlock(&zram->init_lock);
+
+	return len;
+}
+
+/* Run a writeback pass now */
+static ssize_t writeback_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	mutex_lock(&zram->init_lock);
+	if (!zram->init_done || !zram->bdev) {
+		mutex_unlock(&zram->init_lock);
+		return -EINVAL;
+	}
+	cancel_delayed_work_sync(&zram->wb_work);
+	queue_delayed_work(system_long_wq, &zram->wb_work, 0);
+	mutex_unlock(&zram->init_lock);
+
+	return len;
+}
+
+static ssize_t bd_pages_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%u\n", zram->stats.bd_pages);
+}
+
+static ssize_t bd_write_bytes_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%llu\n",
+		zram_stat64_read(zram, &zram->stats.bd_write_bytes));
+}
+
+static ssize_t bd_read_bytes_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%llu\n",
+		zram_stat64_read(zram, &zram->stats.bd_read_bytes));
+}
+
+static ssize_t compact_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	mutex_lock(&zram->init_lock);
+	if (!zram->init_done) {
+		mutex_unlock(&zram->init_lock);
+		return -EINVAL;
+	}
+
+	mutex_lock(&zram->lock);
+	zram_compact(zram, UINT_MAX);
+	mutex_unlock(&zram->lock);
+	mutex_unlock(&zram->init_lock);
+
+	return len;
+}
+
+/* runs pages_freed frag_before(%) frag_after(%) */
+static ssize_t compact_stats_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	ssize_t len;
+	struct zram *zram = dev_to_zram(dev);
+
+	spin_lock(&zram->stat64_lock);
+	len = sprintf(buf, "%u %llu %u %u\n",
+		zram->stats.compact_runs, zram->stats.compact_pages_freed,
+		zram->stats.frag_before, zram->stats.frag_after);
+	spin_unlock(&zram->stat64_lock);
+
+	return len;
+}
+
+static ssize_t compressor_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	int i;
+	ssize_t len = 0;
+	struct zram *zram = dev_to_zram(dev);
+
+	for (i = 0; i < __NR_ZRAM_BACKENDS; i++) {
+		const struct zram_backend *backend = zram_backends[i];
+
+		if (!backend)
+			continue;
+
+		if (backend == zram->backend)
+			len += sprintf(buf + len, "[%s] ", backend->name);
+		else
+			len += sprintf(buf + len, "%s ", backend->name);
+	}
+	len += sprintf(buf + len, "\n");
+
+	return len;
+}
+
+static ssize_t compressor_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	const struct zram_backend *backend;
+	struct zram *zram = dev_to_zram(dev);
+
+	backend = zram_backend_find(buf);
+	if (!backend)
+		return -EINVAL;
+
+	mutex_lock(&zram->init_lock);
+	if (zram->init_done) {
+		mutex_unlock(&zram->init_lock);
+		pr_info("Cannot change compressor for initialized device\n");
+		return -EBUSY;
+	}
+	zram->backend = backend;
+	mutex_unlock(&zram->init_lock);
+
+	return len;
+}
+
+static ssize_t max_comp_streams_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	unsigned int val;
+	struct zram *zram = dev_to_zram(dev);
+
+	mutex_lock(&zram->init_lock);
+	if (zram->init_done)
+		val = zram->num_streams;
+	else
+		val = zram->max_comp_streams ? : num_online_cpus();
+	mutex_unlock(&zram->init_lock);
+
+	return sprintf(buf, "%u\n", val);
+}
+
+static ssize_t max_comp_streams_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int ret;
+	unsigned long num;
+	struct zram *zram = dev_to_zram(dev);
+
+	ret = strict_strtoul(buf, 10, &num);
+	if (ret)
+		return ret;
+
+	if (num > NR_CPUS * 2)
+		return -EINVAL;
+
+	mutex_lock(&zram->init_lock);
+	if (zram->init_done) {
+		mutex_unlock(&zram->init_lock);
+		pr_info("Cannot change max_comp_streams for initialized "
+			"device\n");
+		return -EBUSY;
+	}
+	zram->max_comp_streams = num;
+	mutex_unlock(&zram->init_lock);
+
+	return len;
+}
+
+/*
+ * One line per built-in backend:
+ * name compressions avg_compress_ns decompressions avg_decompress_ns
+ * bytes_in bytes_out
+ */
+static ssize_t compressor_stats_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	int i;
+	ssize_t len = 0;
+	struct zram *zram = dev_to_zram(dev);
+
+	for (i = 0; i < __NR_ZRAM_BACKENDS; i++) {
+		struct zram_comp_stats cs;
+		u64 comp_avg = 0, decomp_avg = 0;
+
+		if (!zram_backends[i])
+			continue;
+
+		spin_lock(&zram->stat64_lock);
+		cs = zram->comp_stats[i];
+		spin_unlock(&zram->stat64_lock);
+
+		if (cs.num_compress)
+			comp_avg = div64_u64(cs.compress_ns, cs.num_compress);
+		if (cs.num_decompress)
+			decomp_avg = div64_u64(cs.decompress_ns,
+						cs.num_decompress);
+
+		len += sprintf(buf + len,
+			"%-8s %10llu %8llu %10llu %8llu %14llu %14llu\n",
+			zram_backends[i]->name,
+			cs.num_compress, comp_avg,
+			cs.num_decompress, decomp_avg,
+			cs.compress_in, cs.compress_out);
+	}
+
+	return len;
+}
+
 static DEVICE_ATTR(disksize, S_IRUGO | S_IWUSR,
 		disksize_show, disksize_store);
 static DEVICE_ATTR(initstate, S_IRUGO, initstate_show, NULL);
@@ -203,6 +539,24 @@ static DEVICE_ATTR(zero_pages, S_IRUGO, zero_pages_show, NULL);
 static DEVICE_ATTR(orig_data_size, S_IRUGO, orig_data_size_show, NULL);
 static DEVICE_ATTR(compr_data_size, S_IRUGO, compr_data_size_show, NULL);
 static DEVICE_ATTR(mem_used_total, S_IRUGO, mem_used_total_show, NULL);
+static DEVICE_ATTR(dedup, S_IRUGO | S_IWUSR, dedup_show, dedup_store);
+static DEVICE_ATTR(dedup_pages, S_IRUGO, dedup_pages_show, NULL);
+static DEVICE_ATTR(dedup_saved_bytes, S_IRUGO, dedup_saved_bytes_show, NULL);
+static DEVICE_ATTR(backing_dev, S_IRUGO | S_IWUSR,
+		backing_dev_show, backing_dev_store);
+static DEVICE_ATTR(writeback_idle_secs, S_IRUGO | S_IWUSR,
+		writeback_idle_secs_show, writeback_idle_secs_store);
+static DEVICE_ATTR(writeback, S_IWUSR, NULL, writeback_store);
+static DEVICE_ATTR(bd_pages, S_IRUGO, bd_pages_show, NULL);
+static DEVICE_ATTR(bd_write_bytes, S_IRUGO, bd_write_bytes_show, NULL);
+static DEVICE_ATTR(bd_read_bytes, S_IRUGO, bd_read_bytes_show, NULL);
+static DEVICE_ATTR(compact, S_IWUSR, NULL, compact_store);
+static DEVICE_ATTR(compact_stats, S_IRUGO, compact_stats_show, NULL);
+static DEVICE_ATTR(compressor, S_IRUGO | S_IWUSR,
+		compressor_show, compressor_store);
+static DEVICE_ATTR(compressor_stats, S_IRUGO, compressor_stats_show, NULL);
+static DEVICE_ATTR(max_comp_streams, S_IRUGO | S_IWUSR,
+		max_comp_streams_show, max_comp_streams_store);
 
 static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_disksize.attr,
@@ -216,6 +570,20 @@ static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_orig_data_size.attr,
 	&dev_attr_compr_data_size.attr,
 	&dev_attr_mem_used_total.attr,
+	&dev_attr_dedup.attr,
+	&dev_attr_dedup_pages.attr,
+	&dev_attr_dedup_saved_bytes.attr,
+	&dev_attr_backing_dev.attr,
+	&dev_attr_writeback_idle_secs.attr,
+	&dev_attr_writeback.attr,
+	&dev_attr_bd_pages.attr,
+	&dev_attr_bd_write_bytes.attr,
+	&dev_attr_bd_read_bytes.attr,
+	&dev_attr_compact.attr,
+	&dev_attr_compact_stats.attr,
+	&dev_attr_compressor.attr,
+	&dev_attr_compressor_stats.attr,
+	&dev_attr_max_comp_streams.attr,
 	NULL,
 };
 
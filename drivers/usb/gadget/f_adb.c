@@ -26,12 +26,40 @@
 #include <linux/types.h>
 #include <linux/device.h>
 #include <linux/miscdevice.h>
+#include <linux/moduleparam.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/ktime.h>
 
 #define ADB_BULK_BUFFER_SIZE           4096
 
 /* number of tx requests to allocate */
 #define TX_REQ_MAX 4
 
+/* bounds of the bulk-out request ring */
+#define ADB_RX_REQ_MAX 32
+#define ADB_RX_REQ_MIN 2
+#define ADB_RX_BUFFER_MAX 65536
+
+/*
+ * Bulk-out requests are kept queued while adbd is reading, so the host
+ * can send the next message before adbd asks for it.  adbd expects every
+ * read to return exactly what it asked for and the host does not end
+ * transfers that fill their last packet with a zero length packet, so a
+ * request larger than one packet could sit half full after such a
+ * transfer while the host waits for our reply.  With the default of 0
+ * each request is one packet at the negotiated speed; only set
+ * adb_rx_req_len when the host terminates every transfer.
+ */
+static unsigned int adb_rx_reqs = 16;
+module_param(adb_rx_reqs, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(adb_rx_reqs, "number of ADB bulk-out requests (2-32)");
+
+static unsigned int adb_rx_req_len;
+module_param(adb_rx_req_len, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(adb_rx_req_len,
+		 "size of each ADB bulk-out request, 0 for one packet");
+
 static const char adb_shortname[] = "android_adb";
 
 struct adb_dev {
@@ -53,8 +81,24 @@ struct adb_dev {
 
 	wait_queue_head_t read_wq;
 	wait_queue_head_t write_wq;
-	struct usb_request *rx_req;
-	int rx_done;
+
+	/* bulk-out ring, see adb_rx_start() */
+	struct usb_request *rx_req[ADB_RX_REQ_MAX];
+	unsigned rx_reqs;
+	unsigned rx_buf_len;		/* allocated size of each buffer */
+	int rx_running;
+	int rx_armed;			/* requests queued on ep_out */
+	struct list_head rx_done;	/* filled, in completion order */
+	unsigned rx_offset;		/* already read from the first one */
+
+	/* time the ring was full of unread data and the host got NAKed */
+	int rx_stalled;
+	ktime_t rx_stall_start;
+	unsigned long rx_stalls;
+	u64 rx_stall_us;
+	u64 rx_bytes;
+
+	struct dentry *debugfs;
 };
 
 static struct usb_interface_descriptor adb_interface_desc = {
@@ -205,14 +249,106 @@ static void adb_complete_in(struct usb_ep *ep, struct usb_request *req)
 static void adb_complete_out(struct usb_ep *ep, struct usb_request *req)
 {
 	struct adb_dev *dev = _adb_dev;
+	unsigned long flags;
 
-	dev->rx_done = 1;
-	if (req->status != 0)
+	spin_lock_irqsave(&dev->lock, flags);
+	dev->rx_armed--;
+	if (req->status == 0) {
+		if (dev->rx_running) {
+			list_add_tail(&req->list, &dev->rx_done);
+			dev->rx_bytes += req->actual;
+			if (!dev->rx_armed) {
+				dev->rx_stalled = 1;
+				dev->rx_stall_start = ktime_get();
+				dev->rx_stalls++;
+			}
+		}
+	} else if (req->status != -ECONNRESET) {
+		/* anything but our own usb_ep_dequeue() */
 		dev->error = 1;
+	}
+	spin_unlock_irqrestore(&dev->lock, flags);
 
 	wake_up(&dev->read_wq);
 }
 
+/* length of each bulk-out request, at least one high-speed packet */
+static unsigned adb_rx_length(struct adb_dev *dev)
+{
+	if (!adb_rx_req_len)
+		return dev->ep_out->maxpacket;
+	return clamp(adb_rx_req_len & ~511, 512U, dev->rx_buf_len);
+}
+
+static int adb_rx_queue(struct adb_dev *dev, struct usb_request *req)
+{
+	unsigned long flags;
+	int ret;
+
+	req->length = adb_rx_length(dev);
+
+	spin_lock_irqsave(&dev->lock, flags);
+	dev->rx_armed++;
+	if (dev->rx_stalled) {
+		dev->rx_stalled = 0;
+		dev->rx_stall_us += ktime_us_delta(ktime_get(),
+						   dev->rx_stall_start);
+	}
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	ret = usb_ep_queue(dev->ep_out, req, GFP_ATOMIC);
+	if (ret < 0) {
+		spin_lock_irqsave(&dev->lock, flags);
+		dev->rx_armed--;
+		spin_unlock_irqrestore(&dev->lock, flags);
+	}
+	return ret;
+}
+
+/* arm the whole ring, called from adb_read() */
+static int adb_rx_start(struct adb_dev *dev)
+{
+	int i, ret;
+
+	spin_lock_irq(&dev->lock);
+	INIT_LIST_HEAD(&dev->rx_done);
+	dev->rx_offset = 0;
+	dev->rx_running = 1;
+	spin_unlock_irq(&dev->lock);
+
+	for (i = 0; i < dev->rx_reqs; i++) {
+		ret = adb_rx_queue(dev, dev->rx_req[i]);
+		if (ret < 0)
+			return ret;
+	}
+	return 0;
+}
+
+/*
+ * Forget what was received but not read.  The requests themselves are
+ * given back by usb_ep_disable() or by dequeueing them.
+ */
+static void adb_rx_reset(struct adb_dev *dev)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&dev->lock, flags);
+	dev->rx_running = 0;
+	dev->rx_stalled = 0;
+	INIT_LIST_HEAD(&dev->rx_done);
+	dev->rx_offset = 0;
+	spin_unlock_irqrestore(&dev->lock, flags);
+}
+
+static void adb_rx_stop(struct adb_dev *dev)
+{
+	int i;
+
+	adb_rx_reset(dev);
+	for (i = 0; i < dev->rx_reqs; i++)
+		usb_ep_dequeue(dev->ep_out, dev->rx_req[i]);
+}
+
 static int adb_create_bulk_endpoints(struct adb_dev *dev,
 				struct usb_endpoint_descriptor *in_desc,
 				struct usb_endpoint_descriptor *out_desc)
@@ -243,11 +379,17 @@ static int adb_create_bulk_endpoints(struct adb_dev *dev,
 	dev->ep_out = ep;
 
 	/* now allocate requests for our endpoints */
-	req = adb_request_new(dev->ep_out, ADB_BULK_BUFFER_SIZE);
-	if (!req)
-		goto fail;
-	req->complete = adb_complete_out;
-	dev->rx_req = req;
+	dev->rx_reqs = clamp(adb_rx_reqs, (unsigned)ADB_RX_REQ_MIN,
+			     (unsigned)ADB_RX_REQ_MAX);
+	dev->rx_buf_len = clamp(adb_rx_req_len & ~511, 512U,
+				(unsigned)ADB_RX_BUFFER_MAX);
+	for (i = 0; i < dev->rx_reqs; i++) {
+		req = adb_request_new(dev->ep_out, dev->rx_buf_len);
+		if (!req)
+			goto fail;
+		req->complete = adb_complete_out;
+		dev->rx_req[i] = req;
+	}
 
 	for (i = 0; i < TX_REQ_MAX; i++) {
 		req = adb_request_new(dev->ep_in, ADB_BULK_BUFFER_SIZE);
@@ -264,21 +406,24 @@ fail:
 	return -1;
 }
 
+/*
+ * Copy out of the filled requests in order, putting each one back on the
+ * endpoint as soon as it is empty.  Like a read of one exactly sized
+ * transfer, this returns once count bytes were copied or a short packet
+ * ended the host's transfer.
+ */
 static ssize_t adb_read(struct file *fp, char __user *buf,
 				size_t count, loff_t *pos)
 {
 	struct adb_dev *dev = fp->private_data;
 	struct usb_request *req;
-	int r = count, xfer;
+	int r = 0, xfer, boundary = 0;
 	int ret;
 
 	pr_debug("adb_read(%d)\n", count);
 	if (!_adb_dev)
 		return -ENODEV;
 
-	if (count > ADB_BULK_BUFFER_SIZE)
-		return -EINVAL;
-
 	if (adb_lock(&dev->read_excl))
 		return -EBUSY;
 
@@ -297,41 +442,67 @@ static ssize_t adb_read(struct file *fp, char __user *buf,
 		goto done;
 	}
 
-requeue_req:
-	/* queue a request */
-	req = dev->rx_req;
-	req->length = count;
-	dev->rx_done = 0;
-	ret = usb_ep_queue(dev->ep_out, req, GFP_ATOMIC);
-	if (ret < 0) {
-		pr_debug("adb_read: failed to queue req %p (%d)\n", req, ret);
-		r = -EIO;
-		dev->error = 1;
-		goto done;
-	} else {
-		pr_debug("rx %p queue\n", req);
+	if (!dev->rx_running) {
+		ret = adb_rx_start(dev);
+		if (ret < 0) {
+			pr_debug("adb_read: failed to queue rx (%d)\n", ret);
+			r = -EIO;
+			dev->error = 1;
+			goto done;
+		}
 	}
 
-	/* wait for a request to complete */
-	ret = wait_event_interruptible(dev->read_wq, dev->rx_done);
-	if (ret < 0) {
-		dev->error = 1;
-		r = ret;
-		usb_ep_dequeue(dev->ep_out, req);
-		goto done;
-	}
-	if (!dev->error) {
-		/* If we got a 0-len packet, throw it back and try again. */
-		if (req->actual == 0)
-			goto requeue_req;
+	while (r < count && !boundary) {
+		/* wait for a request to complete */
+		ret = wait_event_interruptible(dev->read_wq,
+			!list_empty(&dev->rx_done) || dev->error);
+		if (ret < 0) {
+			if (!r)
+				r = ret;
+			break;
+		}
+		if (dev->error) {
+			/* hand over what was copied before the error */
+			if (!r)
+				r = -EIO;
+			break;
+		}
+
+		/* only we take requests off the list */
+		spin_lock_irq(&dev->lock);
+		req = list_first_entry(&dev->rx_done, struct usb_request, list);
+		spin_unlock_irq(&dev->lock);
 
 		pr_debug("rx %p %d\n", req, req->actual);
-		xfer = (req->actual < count) ? req->actual : count;
-		if (copy_to_user(buf, req->buf, xfer))
+		xfer = min_t(int, req->actual - dev->rx_offset, count - r);
+		if (xfer && copy_to_user(buf + r, req->buf + dev->rx_offset,
+					 xfer)) {
 			r = -EFAULT;
+			break;
+		}
+		r += xfer;
+		dev->rx_offset += xfer;
+		if (dev->rx_offset < req->actual)
+			break;
 
-	} else
-		r = -EIO;
+		/* request drained: a short one ends the transfer */
+		if (r && req->actual < req->length)
+			boundary = 1;
+		spin_lock_irq(&dev->lock);
+		list_del(&req->list);
+		dev->rx_offset = 0;
+		spin_unlock_irq(&dev->lock);
+
+		ret = adb_rx_queue(dev, req);
+		if (ret < 0) {
+			pr_debug("adb_read: failed to queue req %p (%d)\n",
+				 req, ret);
+			if (!r)
+				r = -EIO;
+			dev->error = 1;
+			break;
+		}
+	}
 
 done:
 	adb_unlock(&dev->read_excl);
@@ -429,6 +600,10 @@ static int adb_release(struct inode *ip, struct file *fp)
 {
 	pr_info("adb_release\n");
 
+	/* whoever opens us next must not see what this reader left behind */
+	if (_adb_dev->online)
+		adb_rx_stop(_adb_dev);
+
 	adb_closed_callback();
 
 	adb_unlock(&_adb_dev->open_excl);
@@ -492,14 +667,18 @@ adb_function_unbind(struct usb_configuration *c, struct usb_function *f)
 {
 	struct adb_dev	*dev = func_to_adb(f);
 	struct usb_request *req;
-
+	int i;
 
 	dev->online = 0;
 	dev->error = 1;
 
 	wake_up(&dev->read_wq);
 
-	adb_request_free(dev->rx_req, dev->ep_out);
+	adb_rx_reset(dev);
+	for (i = 0; i < ADB_RX_REQ_MAX; i++) {
+		adb_request_free(dev->rx_req[i], dev->ep_out);
+		dev->rx_req[i] = NULL;
+	}
 	while ((req = adb_req_get(dev, &dev->tx_idle)))
 		adb_request_free(req, dev->ep_in);
 }
@@ -543,6 +722,7 @@ static void adb_function_disable(struct usb_function *f)
 	dev->error = 1;
 	usb_ep_disable(dev->ep_in);
 	usb_ep_disable(dev->ep_out);
+	adb_rx_reset(dev);
 
 	/* readers may be blocked waiting for us to go online */
 	wake_up(&dev->read_wq);
@@ -568,6 +748,63 @@ static int adb_bind_config(struct usb_configuration *c)
 	return usb_add_function(c, &dev->function);
 }
 
+static int adb_debugfs_show(struct seq_file *s, void *unused)
+{
+	struct adb_dev *dev = s->private;
+	unsigned long stalls;
+	u64 stall_us, bytes;
+	int armed, queued = 0;
+	struct usb_request *req;
+
+	spin_lock_irq(&dev->lock);
+	stalls = dev->rx_stalls;
+	stall_us = dev->rx_stall_us;
+	if (dev->rx_stalled)
+		stall_us += ktime_us_delta(ktime_get(), dev->rx_stall_start);
+	bytes = dev->rx_bytes;
+	armed = dev->rx_armed;
+	if (dev->rx_running)
+		list_for_each_entry(req, &dev->rx_done, list)
+			queued++;
+	spin_unlock_irq(&dev->lock);
+
+	seq_printf(s, "rx requests: %u, length %u\n", dev->rx_reqs,
+		   dev->ep_out ? adb_rx_length(dev) : 0);
+	seq_printf(s, "rx armed: %d, unread: %d\n", armed, queued);
+	seq_printf(s, "rx bytes: %llu\n", bytes);
+	seq_printf(s, "rx stalls: %lu, stalled %llu us\n", stalls, stall_us);
+	return 0;
+}
+
+static int adb_debugfs_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, adb_debugfs_show, inode->i_private);
+}
+
+/* writing anything to the file clears the counters */
+static ssize_t adb_debugfs_write(struct file *file, const char __user *buf,
+		size_t count, loff_t *ppos)
+{
+	struct adb_dev *dev = ((struct seq_file *)file->private_data)->private;
+
+	spin_lock_irq(&dev->lock);
+	dev->rx_stalls = 0;
+	dev->rx_stall_us = 0;
+	dev->rx_bytes = 0;
+	if (dev->rx_stalled)
+		dev->rx_stall_start = ktime_get();
+	spin_unlock_irq(&dev->lock);
+	return count;
+}
+
+static const struct file_operations adb_debugfs_fops = {
+	.open = adb_debugfs_open,
+	.read = seq_read,
+	.write = adb_debugfs_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 static int adb_setup(void)
 {
 	struct adb_dev *dev;
@@ -587,6 +824,7 @@ static int adb_setup(void)
 	atomic_set(&dev->write_excl, 0);
 
 	INIT_LIST_HEAD(&dev->tx_idle);
+	INIT_LIST_HEAD(&dev->rx_done);
 
 	_adb_dev = dev;
 
@@ -594,6 +832,10 @@ static int adb_setup(void)
 	if (ret)
 		goto err;
 
+	/* ring counters, not fatal if debugfs is missing */
+	dev->debugfs = debugfs_create_file(adb_shortname, S_IRUGO | S_IWUSR,
+					   NULL, dev, &adb_debugfs_fops);
+
 	return 0;
 
 err:
@@ -604,6 +846,7 @@ err:
 
 static void adb_cleanup(void)
 {
+	debugfs_remove(_adb_dev->debugfs);
 	misc_deregister(&adb_device);
 
 	kfree(_adb_dev);
@@ -832,6 +832,7 @@ static int cdrom_do_read(struct cdrom_fsg_common *common)
 	unsigned int		amount;
 	unsigned int		partial_page;
 	ssize_t			nread;
+	ktime_t			start = ktime_get();
 
 	/* Get the starting Logical Block Address and check that it's
 	 * not too big */
@@ -859,6 +860,9 @@ static int cdrom_do_read(struct cdrom_fsg_common *common)
 	if (unlikely(amount_left == 0))
 		return -EIO;		/* No default reply */
 
+	if (file_offset == curlun->next_read)
+		fsg_lun_readahead(curlun, file_offset, amount_left);
+
 	for (;;) {
 
 		/* Figure out how much we need to read:
@@ -944,6 +948,9 @@ static int cdrom_do_read(struct cdrom_fsg_common *common)
 		common->next_buffhd_to_fill = bh->next;
 	}
 
+	curlun->next_read = file_offset;
+	fsg_lun_account(curlun, READ, common->data_size_from_cmnd - amount_left,
+			start);
 	return -EIO;		/* No default reply */
 }
 
@@ -962,6 +969,7 @@ static int cdrom_do_write(struct cdrom_fsg_common *common)
 	unsigned int		partial_page;
 	ssize_t			nwritten;
 	int			rc;
+	ktime_t			start = ktime_get();
 
 #ifdef CONFIG_USB_CSW_HACK
 	int			csw_hack_sent = 0;
@@ -1125,6 +1133,9 @@ static int cdrom_do_write(struct cdrom_fsg_common *common)
 				nwritten -= (nwritten & 511);
 				/* Round down to a block */
 			}
+			if (nwritten && !(curlun->filp->f_flags & O_SYNC))
+				fsg_lun_writebehind(curlun, file_offset,
+						    nwritten);
 			file_offset += nwritten;
 			amount_left_to_write -= nwritten;
 			common->residue -= nwritten;
@@ -1178,6 +1189,9 @@ write_error:
 			return rc;
 	}
 
+	fsg_lun_account(curlun, WRITE,
+			common->data_size_from_cmnd - amount_left_to_write,
+			start);
 	return -EIO;		/* No default reply */
 }
 
@@ -1192,6 +1206,7 @@ static int cdrom_do_synchronize_cache(struct cdrom_fsg_common *common)
 	/* We ignore the requested LBA and write out all file's
 	 * dirty data buffers. */
 	rc = fsg_lun_fsync_sub(curlun);
+	curlun->wb_start = curlun->wb_end;
 	if (rc)
 		curlun->sense_data = SS_WRITE_ERROR;
 	return 0;
@@ -3068,6 +3083,7 @@ static DEVICE_ATTR(cdrom_ro, 0644, fsg_show_ro, fsg_store_ro);
 static DEVICE_ATTR(cdrom_file, 0644, fsg_show_file, fsg_store_file);
 static DEVICE_ATTR(cdrom_nofua, 0644, fsg_show_nofua, fsg_store_nofua);
 static DEVICE_ATTR(cdrom_usbmode, 0664, fsg_show_usbmode, fsg_store_usbmode);
+static DEVICE_ATTR(cdrom_stats, 0644, fsg_show_stats, fsg_store_stats);
 
 
 /****************************** FSG COMMON ******************************/
@@ -3185,6 +3201,9 @@ static struct cdrom_fsg_common *cdrom_fsg_common_init(struct cdrom_fsg_common *c
 		if (rc)
 			goto error_luns;
 		rc = device_create_file(&curlun->dev, &dev_attr_cdrom_usbmode);
+		if (rc)
+			goto error_luns;
+		rc = device_create_file(&curlun->dev, &dev_attr_cdrom_stats);
 		if (rc)
 			goto error_luns;
 		if (lcfg->filename) {
@@ -3353,6 +3372,7 @@ static void cdrom_fsg_common_release(struct kref *ref)
 			device_remove_file(&lun->dev, &dev_attr_cdrom_file);
 			device_remove_file(&lun->dev, &dev_attr_cdrom_nofua);
 			device_remove_file(&lun->dev, &dev_attr_cdrom_usbmode);
+			device_remove_file(&lun->dev, &dev_attr_cdrom_stats);
 			fsg_lun_close(lun);
 			device_unregister(&lun->dev);
 		}
@@ -283,13 +283,17 @@
 #include <linux/fs.h>
 #include <linux/kref.h>
 #include <linux/kthread.h>
+#include <linux/ktime.h>
 #include <linux/limits.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
 #include <linux/rwsem.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/string.h>
 #include <linux/freezer.h>
 #include <linux/utsname.h>
+#include <linux/writeback.h>
 
 #include <linux/usb/ch9.h>
 #include <linux/usb/gadget.h>
@@ -335,6 +339,33 @@ static const char fsg_string_interface[] = "Mass Storage";
 
 #include "storage_common.c"
 
+/*
+ * Asynchronous I/O.  The worker thread still does every vfs_read() and
+ * vfs_write() itself, but for sequential streams it gets the disk going
+ * ahead of it: a READ that starts where the previous one ended kicks off
+ * read-ahead of the whole command plus fsg_readahead_kb, and WRITE data
+ * is left in the page cache until fsg_writebehind_kb of contiguous data
+ * has been gathered, which is then handed to writeback without waiting.
+ * FUA and SYNCHRONIZE CACHE are still honoured synchronously.
+ */
+static unsigned int fsg_num_buffers = FSG_NUM_BUFFERS;
+module_param(fsg_num_buffers, uint, S_IRUGO);
+MODULE_PARM_DESC(fsg_num_buffers, "Number of pipeline buffers (2-8)");
+
+static unsigned int fsg_readahead_kb = 256;
+module_param(fsg_readahead_kb, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(fsg_readahead_kb,
+		 "Read-ahead past sequential READs in KB, 0 to disable");
+
+static unsigned int fsg_writebehind_kb = 1024;
+module_param(fsg_writebehind_kb, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(fsg_writebehind_kb,
+		 "Sequential WRITE data gathered before writeback in KB, "
+		 "0 to disable");
+
+/* Protects the stats of all LUNs */
+static DEFINE_SPINLOCK(fsg_stats_lock);
+
 
 /*-------------------------------------------------------------------------*/
 
@@ -386,7 +417,8 @@ struct fsg_common {
 
 	struct fsg_buffhd	*next_buffhd_to_fill;
 	struct fsg_buffhd	*next_buffhd_to_drain;
-	struct fsg_buffhd	buffhds[FSG_NUM_BUFFERS];
+	struct fsg_buffhd	buffhds[FSG_MAX_NUM_BUFFERS];
+	unsigned int		num_buffers;
 
 	int			cmnd_size;
 	u8			cmnd[MAX_COMMAND_SIZE];
@@ -780,6 +812,84 @@ static int sleep_thread(struct fsg_common *common)
 }
 
 
+/*-------------------------------------------------------------------------*/
+
+static void fsg_lun_account(struct fsg_lun *curlun, int dir, u64 bytes,
+			    ktime_t start)
+{
+	struct fsg_lun_stats	*stats = &curlun->stats;
+	u32			us;
+
+	us = ktime_to_us(ktime_sub(ktime_get(), start));
+	spin_lock(&fsg_stats_lock);
+	stats->cmds[dir]++;
+	stats->bytes[dir] += bytes;
+	stats->busy_us[dir] += us;
+	if (us > stats->max_us[dir])
+		stats->max_us[dir] = us;
+	spin_unlock(&fsg_stats_lock);
+}
+
+/*
+ * Start reading a sequential READ of len bytes at offset, and the
+ * fsg_readahead_kb after it, so that the vfs_read() calls of this and the
+ * next command find the pages in the cache, or at least already under I/O.
+ */
+static void fsg_lun_readahead(struct fsg_lun *curlun, loff_t offset, u32 len)
+{
+	struct file	*filp = curlun->filp;
+	unsigned long	window = fsg_readahead_kb >> (PAGE_CACHE_SHIFT - 10);
+	pgoff_t		index = offset >> PAGE_CACHE_SHIFT;
+	unsigned long	nr;
+
+	if (!window)
+		return;
+	nr = ((offset + len + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT) - index;
+	nr = min(nr, window) + window;
+
+	spin_lock(&filp->f_lock);
+	if (filp->f_ra.ra_pages < nr)
+		filp->f_ra.ra_pages = nr;
+	filp->f_mode &= ~FMODE_RANDOM;
+	spin_unlock(&filp->f_lock);
+
+	page_cache_sync_readahead(filp->f_mapping, &filp->f_ra, filp,
+				  index, nr);
+	spin_lock(&fsg_stats_lock);
+	curlun->stats.readaheads++;
+	spin_unlock(&fsg_stats_lock);
+}
+
+/*
+ * Write-behind: track the contiguous range written since the last flush
+ * and start writeback of it once fsg_writebehind_kb has been gathered.
+ * Scattered writes (FAT and directory updates) just restart the range and
+ * are left to the flusher threads, so they still get merged in the cache.
+ * WB_SYNC_NONE only submits the I/O: pages already under writeback are
+ * skipped rather than waited upon, and completion is not waited for.
+ */
+static void fsg_lun_writebehind(struct fsg_lun *curlun, loff_t offset,
+				u32 len)
+{
+	loff_t	limit = (loff_t)fsg_writebehind_kb << 10;
+
+	if (!limit)
+		return;
+	if (offset != curlun->wb_end)
+		curlun->wb_start = offset;
+	curlun->wb_end = offset + len;
+	if (curlun->wb_end - curlun->wb_start < limit)
+		return;
+
+	__filemap_fdatawrite_range(curlun->filp->f_mapping, curlun->wb_start,
+				   curlun->wb_end - 1, WB_SYNC_NONE);
+	curlun->wb_start = curlun->wb_end;
+	spin_lock(&fsg_stats_lock);
+	curlun->stats.writebehinds++;
+	spin_unlock(&fsg_stats_lock);
+}
+
+
 /*-------------------------------------------------------------------------*/
 
 static int do_read(struct fsg_common *common)
@@ -793,6 +903,7 @@ static int do_read(struct fsg_common *common)
 	unsigned int		amount;
 	unsigned int		partial_page;
 	ssize_t			nread;
+	ktime_t			start = ktime_get();
 
 	/*
 	 * Get the starting Logical Block Address and check that it's
@@ -824,6 +935,9 @@ static int do_read(struct fsg_common *common)
 	if (unlikely(amount_left == 0))
 		return -EIO;		/* No default reply */
 
+	if (file_offset == curlun->next_read)
+		fsg_lun_readahead(curlun, file_offset, amount_left);
+
 	for (;;) {
 		/*
 		 * Figure out how much we need to read:
@@ -908,6 +1022,9 @@ static int do_read(struct fsg_common *common)
 		common->next_buffhd_to_fill = bh->next;
 	}
 
+	curlun->next_read = file_offset;
+	fsg_lun_account(curlun, READ, common->data_size_from_cmnd - amount_left,
+			start);
 	return -EIO;		/* No default reply */
 }
 
@@ -926,6 +1043,7 @@ static int do_write(struct fsg_common *common)
 	unsigned int		partial_page;
 	ssize_t			nwritten;
 	int			rc;
+	ktime_t			start = ktime_get();
 
 	if (curlun->ro) {
 		curlun->sense_data = SS_WRITE_PROTECTED;
@@ -1082,6 +1200,9 @@ static int do_write(struct fsg_common *common)
 				nwritten -= (nwritten & 511);
 				/* Round down to a block */
 			}
+			if (nwritten && !(curlun->filp->f_flags & O_SYNC))
+				fsg_lun_writebehind(curlun, file_offset,
+						    nwritten);
 			file_offset += nwritten;
 			amount_left_to_write -= nwritten;
 			common->residue -= nwritten;
@@ -1108,6 +1229,9 @@ static int do_write(struct fsg_common *common)
 			return rc;
 	}
 
+	fsg_lun_account(curlun, WRITE,
+			common->data_size_from_cmnd - amount_left_to_write,
+			start);
 	return -EIO;		/* No default reply */
 }
 
@@ -1122,6 +1246,7 @@ static int do_synchronize_cache(struct fsg_common *common)
 	/* We ignore the requested LBA and write out all file's
 	 * dirty data buffers. */
 	rc = fsg_lun_fsync_sub(curlun);
+	curlun->wb_start = curlun->wb_end;
 	if (rc)
 		curlun->sense_data = SS_WRITE_ERROR;
 	return 0;
@@ -2413,7 +2538,7 @@ reset:
 	if (common->fsg) {
 		fsg = common->fsg;
 
-		for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+		for (i = 0; i < common->num_buffers; ++i) {
 			struct fsg_buffhd *bh = &common->buffhds[i];
 
 			if (bh->inreq) {
@@ -2465,7 +2590,7 @@ reset:
 	clear_bit(IGNORE_BULK_OUT, &fsg->atomic_bitflags);
 
 	/* Allocate the requests */
-	for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+	for (i = 0; i < common->num_buffers; ++i) {
 		struct fsg_buffhd	*bh = &common->buffhds[i];
 
 		rc = alloc_request(common, fsg->bulk_in, &bh->inreq);
@@ -2534,7 +2659,7 @@ static void handle_exception(struct fsg_common *common)
 
 	/* Cancel all the pending transfers */
 	if (likely(common->fsg)) {
-		for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+		for (i = 0; i < common->num_buffers; ++i) {
 			bh = &common->buffhds[i];
 			if (bh->inreq_busy)
 				usb_ep_dequeue(common->fsg->bulk_in, bh->inreq);
@@ -2546,7 +2671,7 @@ static void handle_exception(struct fsg_common *common)
 		/* Wait until everything is idle */
 		for (;;) {
 			int num_active = 0;
-			for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+			for (i = 0; i < common->num_buffers; ++i) {
 				bh = &common->buffhds[i];
 				num_active += bh->inreq_busy + bh->outreq_busy;
 			}
@@ -2569,7 +2694,7 @@ static void handle_exception(struct fsg_common *common)
 	 */
 	spin_lock_irq(&common->lock);
 
-	for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+	for (i = 0; i < common->num_buffers; ++i) {
 		bh = &common->buffhds[i];
 		bh->state = BUF_STATE_EMPTY;
 	}
@@ -2742,10 +2867,54 @@ static int fsg_main_thread(void *common_)
 
 /*************************** DEVICE ATTRIBUTES ***************************/
 
+/*
+ * One line per direction: commands, bytes, throughput over the time spent
+ * on the commands in KB/s, average and worst command time in usecs, and
+ * the read-ahead or write-behind kicks.  Writing anything resets them.
+ */
+static ssize_t fsg_show_stats(struct device *dev, struct device_attribute *attr,
+			      char *buf)
+{
+	struct fsg_lun		*curlun = fsg_lun_from_dev(dev);
+	struct fsg_lun_stats	s;
+	ssize_t			len = 0;
+	int			dir;
+
+	spin_lock(&fsg_stats_lock);
+	s = curlun->stats;
+	spin_unlock(&fsg_stats_lock);
+
+	for (dir = READ; dir <= WRITE; dir++)
+		len += sprintf(buf + len,
+			       "%s %lu %llu %llu %llu %u %lu\n",
+			       dir == READ ? "read" : "write", s.cmds[dir],
+			       s.bytes[dir],
+			       s.busy_us[dir] ? div64_u64((s.bytes[dir] >> 10) *
+						USEC_PER_SEC, s.busy_us[dir]) : 0,
+			       s.cmds[dir] ? div64_u64(s.busy_us[dir],
+						       s.cmds[dir]) : 0,
+			       s.max_us[dir],
+			       dir == READ ? s.readaheads : s.writebehinds);
+	return len;
+}
+
+static ssize_t fsg_store_stats(struct device *dev,
+			       struct device_attribute *attr,
+			       const char *buf, size_t count)
+{
+	struct fsg_lun	*curlun = fsg_lun_from_dev(dev);
+
+	spin_lock(&fsg_stats_lock);
+	memset(&curlun->stats, 0, sizeof(curlun->stats));
+	spin_unlock(&fsg_stats_lock);
+	return count;
+}
+
 /* Write permission is checked per LUN in store_*() functions. */
 static DEVICE_ATTR(ro, 0644, fsg_show_ro, fsg_store_ro);
 static DEVICE_ATTR(nofua, 0644, fsg_show_nofua, fsg_store_nofua);
 static DEVICE_ATTR(file, 0644, fsg_show_file, fsg_store_file);
+static DEVICE_ATTR(stats, 0644, fsg_show_stats, fsg_store_stats);
 /* LGE_SJIT_S 1/19/2012 [mohamed.khadri@lge.com] LG Gadget driver  */
 static DEVICE_ATTR(cdrom, 0644, fsg_show_cdrom, fsg_store_cdrom);
 /* LGE_SJIT_E 1/19/2012 [mohamed.khadri@lge.com] LG Gadget driver  */
@@ -2811,6 +2980,8 @@ static struct fsg_common *fsg_common_init(struct fsg_common *common,
 
 	common->ops = cfg->ops;
 	common->private_data = cfg->private_data;
+	common->num_buffers = clamp_t(unsigned int, fsg_num_buffers,
+				      2, FSG_MAX_NUM_BUFFERS);
 
 	common->gadget = gadget;
 	common->ep0 = gadget->ep0;
@@ -2869,6 +3040,9 @@ static struct fsg_common *fsg_common_init(struct fsg_common *common,
 		if (rc)
 			goto error_luns;
 		rc = device_create_file(&curlun->dev, &dev_attr_nofua);
+		if (rc)
+			goto error_luns;
+		rc = device_create_file(&curlun->dev, &dev_attr_stats);
 		if (rc)
 			goto error_luns;
 		/* LGE_SJIT_S 1/19/2012 [mohamed.khadri@lge.com] LG Gadget driver  */
@@ -2890,7 +3064,7 @@ static struct fsg_common *fsg_common_init(struct fsg_common *common,
 
 	/* Data buffers cyclic list */
 	bh = common->buffhds;
-	i = FSG_NUM_BUFFERS;
+	i = common->num_buffers;
 	goto buffhds_first_it;
 	do {
 		bh->next = bh + 1;
@@ -3015,6 +3189,7 @@ static void fsg_common_release(struct kref *ref)
 
 		/* In error recovery common->nluns may be zero. */
 		for (; i; --i, ++lun) {
+			device_remove_file(&lun->dev, &dev_attr_stats);
 			device_remove_file(&lun->dev, &dev_attr_nofua);
 			device_remove_file(&lun->dev, &dev_attr_ro);
 			device_remove_file(&lun->dev, &dev_attr_file);
@@ -3030,7 +3205,7 @@ static void fsg_common_release(struct kref *ref)
 
 	{
 		struct fsg_buffhd *bh = common->buffhds;
-		unsigned i = FSG_NUM_BUFFERS;
+		unsigned i = common->num_buffers;
 		do {
 			kfree(bh->buf);
 		} while (++bh, --i);
@@ -30,6 +30,12 @@
 #include <linux/file.h>
 #include <linux/device.h>
 #include <linux/miscdevice.h>
+#include <linux/moduleparam.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/backing-dev.h>
 
 #include <linux/usb.h>
 #include <linux/usb_usual.h>
@@ -37,6 +43,8 @@
 #include <linux/usb/f_mtp.h>
 
 #define MTP_BULK_BUFFER_SIZE       16384
+#define MTP_TX_BUFFER_INIT_SIZE    65536
+#define MTP_RX_BUFFER_INIT_SIZE    65536
 #define INTR_BUFFER_SIZE           28
 
 /* String IDs */
@@ -50,10 +58,33 @@
 #define STATE_ERROR                 4   /* error from completion routine */
 
 /* number of tx and rx requests to allocate */
-#define TX_REQ_MAX 4
-#define RX_REQ_MAX 2
+#define MTP_TX_REQ_MAX 16
+#define MTP_RX_REQ_MAX 4
+#define MTP_TX_REQ_MIN 4
 #define INTR_REQ_MAX 5
 
+/*
+ * Bulk request buffer sizes and counts, read when the function is bound.
+ * If the buffers cannot be allocated we fall back to MTP_TX_REQ_MIN
+ * requests of MTP_BULK_BUFFER_SIZE.  The rx size is rounded down to a
+ * multiple of the high speed packet size.
+ */
+static unsigned int mtp_tx_req_len = MTP_TX_BUFFER_INIT_SIZE;
+module_param(mtp_tx_req_len, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(mtp_tx_req_len, "size of each MTP bulk-in request buffer");
+
+static unsigned int mtp_tx_reqs = 8;
+module_param(mtp_tx_reqs, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(mtp_tx_reqs, "number of MTP bulk-in requests (max 16)");
+
+static unsigned int mtp_rx_req_len = MTP_RX_BUFFER_INIT_SIZE;
+module_param(mtp_rx_req_len, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(mtp_rx_req_len, "size of each MTP bulk-out request buffer");
+
+static unsigned int mtp_rx_reqs = MTP_RX_REQ_MAX;
+module_param(mtp_rx_reqs, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(mtp_rx_reqs, "number of MTP bulk-out requests (max 4)");
+
 /* ID for Microsoft MTP OS String */
 #define MTP_OS_STRING_ID   0xEE
 
@@ -69,6 +100,19 @@
 
 static const char mtp_shortname[] = "mtp_usb";
 
+/* file transfers in one direction, see mtp_debugfs_show() */
+struct mtp_xfer_stats {
+	unsigned long	transfers;
+	u64		last_bytes;
+	s64		last_us;
+	u64		total_bytes;
+	s64		total_us;
+	/* times the endpoint had nothing queued while file I/O ran */
+	unsigned long	usb_idle;
+};
+
+enum { MTP_STATS_SEND, MTP_STATS_RECEIVE };
+
 struct mtp_dev {
 	struct usb_function function;
 	struct usb_composite_dev *cdev;
@@ -91,8 +135,17 @@ struct mtp_dev {
 	wait_queue_head_t read_wq;
 	wait_queue_head_t write_wq;
 	wait_queue_head_t intr_wq;
-	struct usb_request *rx_req[RX_REQ_MAX];
+	struct usb_request *rx_req[MTP_RX_REQ_MAX];
+	/* completed rx requests, they complete in the order they were queued */
 	int rx_done;
+	/* tx requests queued on ep_in */
+	atomic_t tx_busy;
+
+	/* request sizes and counts actually allocated at bind time */
+	unsigned tx_req_len;
+	unsigned tx_reqs;
+	unsigned rx_req_len;
+	unsigned rx_reqs;
 
 	/* for processing MTP_SEND_FILE, MTP_RECEIVE_FILE and
 	 * MTP_SEND_FILE_WITH_HEADER ioctls on a work queue
@@ -107,6 +160,9 @@ struct mtp_dev {
 	uint16_t xfer_command;
 	uint32_t xfer_transaction_id;
 	int xfer_result;
+
+	struct mtp_xfer_stats stats[2];
+	struct dentry *debugfs;
 };
 
 static struct usb_interface_descriptor mtp_interface_desc = {
@@ -352,6 +408,7 @@ static void mtp_complete_in(struct usb_ep *ep, struct usb_request *req)
 	if (req->status != 0)
 		dev->state = STATE_ERROR;
 
+	atomic_dec(&dev->tx_busy);
 	mtp_req_put(dev, &dev->tx_idle, req);
 
 	wake_up(&dev->write_wq);
@@ -361,7 +418,7 @@ static void mtp_complete_out(struct usb_ep *ep, struct usb_request *req)
 {
 	struct mtp_dev *dev = _mtp_dev;
 
-	dev->rx_done = 1;
+	dev->rx_done++;
 	if (req->status != 0)
 		dev->state = STATE_ERROR;
 
@@ -428,21 +485,47 @@ static int mtp_create_bulk_endpoints(struct mtp_dev *dev,
 	ep->driver_data = dev;		/* claim the endpoint */
 	dev->ep_intr = ep;
 
+	dev->tx_req_len = max(mtp_tx_req_len, (unsigned)MTP_BULK_BUFFER_SIZE);
+	dev->tx_reqs = clamp(mtp_tx_reqs, (unsigned)MTP_TX_REQ_MIN,
+			     (unsigned)MTP_TX_REQ_MAX);
+	dev->rx_req_len = max(mtp_rx_req_len, (unsigned)MTP_BULK_BUFFER_SIZE)
+				& ~511;
+	dev->rx_reqs = clamp(mtp_rx_reqs, 2U, (unsigned)MTP_RX_REQ_MAX);
+
 	/* now allocate requests for our endpoints */
-	for (i = 0; i < TX_REQ_MAX; i++) {
-		req = mtp_request_new(dev->ep_in, MTP_BULK_BUFFER_SIZE);
-		if (!req)
-			goto fail;
+retry_tx_alloc:
+	for (i = 0; i < dev->tx_reqs; i++) {
+		req = mtp_request_new(dev->ep_in, dev->tx_req_len);
+		if (!req) {
+			if (dev->tx_req_len == MTP_BULK_BUFFER_SIZE)
+				goto fail;
+			while ((req = mtp_req_get(dev, &dev->tx_idle)))
+				mtp_request_free(req, dev->ep_in);
+			dev->tx_req_len = MTP_BULK_BUFFER_SIZE;
+			dev->tx_reqs = MTP_TX_REQ_MIN;
+			goto retry_tx_alloc;
+		}
 		req->complete = mtp_complete_in;
 		mtp_req_put(dev, &dev->tx_idle, req);
 	}
-	for (i = 0; i < RX_REQ_MAX; i++) {
-		req = mtp_request_new(dev->ep_out, MTP_BULK_BUFFER_SIZE);
-		if (!req)
-			goto fail;
+retry_rx_alloc:
+	for (i = 0; i < dev->rx_reqs; i++) {
+		req = mtp_request_new(dev->ep_out, dev->rx_req_len);
+		if (!req) {
+			if (dev->rx_req_len == MTP_BULK_BUFFER_SIZE)
+				goto fail;
+			while (--i >= 0) {
+				mtp_request_free(dev->rx_req[i], dev->ep_out);
+				dev->rx_req[i] = NULL;
+			}
+			dev->rx_req_len = MTP_BULK_BUFFER_SIZE;
+			goto retry_rx_alloc;
+		}
 		req->complete = mtp_complete_out;
 		dev->rx_req[i] = req;
 	}
+	DBG(cdev, "tx %u x %u bytes, rx %u x %u bytes\n", dev->tx_reqs,
+		dev->tx_req_len, dev->rx_reqs, dev->rx_req_len);
 	for (i = 0; i < INTR_REQ_MAX; i++) {
 		req = mtp_request_new(dev->ep_intr, INTR_BUFFER_SIZE);
 		if (!req)
@@ -469,7 +552,7 @@ static ssize_t mtp_read(struct file *fp, char __user *buf,
 
 	DBG(cdev, "mtp_read(%d)\n", count);
 
-	if (count > MTP_BULK_BUFFER_SIZE)
+	if (count > dev->rx_req_len)
 		return -EINVAL;
 
 	/* we will block until we're online */
@@ -589,8 +672,8 @@ static ssize_t mtp_write(struct file *fp, const char __user *buf,
 			break;
 		}
 
-		if (count > MTP_BULK_BUFFER_SIZE)
-			xfer = MTP_BULK_BUFFER_SIZE;
+		if (count > dev->tx_req_len)
+			xfer = dev->tx_req_len;
 		else
 			xfer = count;
 		if (xfer && copy_from_user(req->buf, buf, xfer)) {
@@ -599,8 +682,10 @@ static ssize_t mtp_write(struct file *fp, const char __user *buf,
 		}
 
 		req->length = xfer;
+		atomic_inc(&dev->tx_busy);
 		ret = usb_ep_queue(dev->ep_in, req, GFP_KERNEL);
 		if (ret < 0) {
+			atomic_dec(&dev->tx_busy);
 			DBG(cdev, "mtp_write: xfer error %d\n", ret);
 			r = -EIO;
 			break;
@@ -627,6 +712,43 @@ static ssize_t mtp_write(struct file *fp, const char __user *buf,
 	return r;
 }
 
+static void mtp_stats_add(struct mtp_dev *dev, int dir, u64 bytes,
+		ktime_t start)
+{
+	struct mtp_xfer_stats *st = &dev->stats[dir];
+	s64 us = ktime_us_delta(ktime_get(), start);
+	unsigned long flags;
+
+	spin_lock_irqsave(&dev->lock, flags);
+	st->transfers++;
+	st->last_bytes = bytes;
+	st->last_us = us;
+	st->total_bytes += bytes;
+	st->total_us += us;
+	spin_unlock_irqrestore(&dev->lock, flags);
+}
+
+/*
+ * The whole range is read front to back while the host is waiting for
+ * it, so open up the readahead window the way POSIX_FADV_SEQUENTIAL does
+ * and let the page cache stay ahead of the bulk-in queue.
+ */
+static void mtp_file_sequential(struct file *filp)
+{
+	struct address_space *mapping = filp->f_mapping;
+	struct backing_dev_info *bdi;
+
+	if (!mapping || !mapping->backing_dev_info)
+		return;
+	bdi = mapping->backing_dev_info;
+
+	spin_lock(&filp->f_lock);
+	if (filp->f_ra.ra_pages < bdi->ra_pages * 2)
+		filp->f_ra.ra_pages = bdi->ra_pages * 2;
+	filp->f_mode &= ~FMODE_RANDOM;
+	spin_unlock(&filp->f_lock);
+}
+
 /* read from a local file and write to USB */
 static void send_file_work(struct work_struct *data) {
 	struct mtp_dev	*dev = container_of(data, struct mtp_dev, send_file_work);
@@ -639,6 +761,9 @@ static void send_file_work(struct work_struct *data) {
 	int xfer, ret, hdr_size;
 	int r = 0;
 	int sendZLP = 0;
+	int first = 1;
+	u64 sent = 0;
+	ktime_t start = ktime_get();
 
 	/* read our parameters */
 	smp_rmb();
@@ -648,6 +773,8 @@ static void send_file_work(struct work_struct *data) {
 
 	DBG(cdev, "send_file_work(%lld %lld)\n", offset, count);
 
+	mtp_file_sequential(filp);
+
 	if (dev->xfer_send_header) {
 		hdr_size = sizeof(struct mtp_data_header);
 		count += hdr_size;
@@ -681,8 +808,8 @@ static void send_file_work(struct work_struct *data) {
 			break;
 		}
 
-		if (count > MTP_BULK_BUFFER_SIZE)
-			xfer = MTP_BULK_BUFFER_SIZE;
+		if (count > dev->tx_req_len)
+			xfer = dev->tx_req_len;
 		else
 			xfer = count;
 
@@ -703,9 +830,16 @@ static void send_file_work(struct work_struct *data) {
 		xfer = ret + hdr_size;
 		hdr_size = 0;
 
+		/* the file read did not keep up with the host */
+		if (!first && atomic_read(&dev->tx_busy) == 0)
+			dev->stats[MTP_STATS_SEND].usb_idle++;
+		first = 0;
+
 		req->length = xfer;
+		atomic_inc(&dev->tx_busy);
 		ret = usb_ep_queue(dev->ep_in, req, GFP_KERNEL);
 		if (ret < 0) {
+			atomic_dec(&dev->tx_busy);
 			DBG(cdev, "send_file_work: xfer error %d\n", ret);
 			dev->state = STATE_ERROR;
 			r = -EIO;
@@ -713,6 +847,7 @@ static void send_file_work(struct work_struct *data) {
 		}
 
 		count -= xfer;
+		sent += xfer;
 
 		/* zero this so we don't try to free it on error exit */
 		req = 0;
@@ -721,23 +856,44 @@ static void send_file_work(struct work_struct *data) {
 	if (req)
 		mtp_req_put(dev, &dev->tx_idle, req);
 
+	if (!r)
+		mtp_stats_add(dev, MTP_STATS_SEND, sent, start);
+
 	DBG(cdev, "send_file_work returning %d\n", r);
 	/* write the result */
 	dev->xfer_result = r;
 	smp_wmb();
 }
 
-/* read from USB and write to a local file */
+/* take back rx requests that are still queued, mtp_read() reuses them */
+static void mtp_rx_dequeue(struct mtp_dev *dev, unsigned done, unsigned queued)
+{
+	while (done != queued)
+		usb_ep_dequeue(dev->ep_out, dev->rx_req[done++ % dev->rx_reqs]);
+}
+
+/*
+ * read from USB and write to a local file
+ *
+ * Up to rx_reqs requests are kept queued on ep_out so that the host can
+ * keep sending while we are in vfs_write().  We never ask for more than
+ * the length of the transfer, since anything queued past its end would
+ * swallow the next MTP command; when the length is unknown (0xFFFFFFFF,
+ * terminated by a short packet) only one request is queued at a time.
+ */
 static void receive_file_work(struct work_struct *data)
 {
 	struct mtp_dev	*dev = container_of(data, struct mtp_dev, receive_file_work);
 	struct usb_composite_dev *cdev = dev->cdev;
-	struct usb_request *read_req = NULL, *write_req = NULL;
+	struct usb_request *req;
 	struct file *filp;
 	loff_t offset;
 	int64_t count;
-	int ret, cur_buf = 0;
+	unsigned queued = 0, done = 0, depth;
+	int ret;
 	int r = 0;
+	u64 received = 0;
+	ktime_t start = ktime_get();
 
 	/* read our parameters */
 	smp_rmb();
@@ -747,61 +903,68 @@ static void receive_file_work(struct work_struct *data)
 
 	DBG(cdev, "receive_file_work(%lld)\n", count);
 
-	while (count > 0 || write_req) {
-		if (count > 0) {
-			/* queue a request */
-			read_req = dev->rx_req[cur_buf];
-			cur_buf = (cur_buf + 1) % RX_REQ_MAX;
+	depth = count == 0xFFFFFFFF ? 1 : dev->rx_reqs;
+	dev->rx_done = 0;
 
-			read_req->length = (count > MTP_BULK_BUFFER_SIZE
-					? MTP_BULK_BUFFER_SIZE : count);
-			dev->rx_done = 0;
-			ret = usb_ep_queue(dev->ep_out, read_req, GFP_KERNEL);
-			if (ret < 0) {
-				r = -EIO;
-				dev->state = STATE_ERROR;
-				break;
-			}
+	while (count > 0 || done != queued) {
+		if (dev->state != STATE_BUSY) {
+			r = dev->state == STATE_CANCELED ? -ECANCELED : -EIO;
+			break;
 		}
 
-		if (write_req) {
-			DBG(cdev, "rx %p %d\n", write_req, write_req->actual);
-			ret = vfs_write(filp, write_req->buf, write_req->actual,
-				&offset);
-			DBG(cdev, "vfs_write %d\n", ret);
-			if (ret != write_req->actual) {
+		/* the host had nothing to send to while we were writing */
+		if (count > 0 && done && done == queued)
+			dev->stats[MTP_STATS_RECEIVE].usb_idle++;
+
+		while (count > 0 && queued - done < depth) {
+			req = dev->rx_req[queued % dev->rx_reqs];
+			req->length = (count > dev->rx_req_len
+					? dev->rx_req_len : count);
+			ret = usb_ep_queue(dev->ep_out, req, GFP_KERNEL);
+			if (ret < 0) {
 				r = -EIO;
 				dev->state = STATE_ERROR;
-				break;
-			}
-			write_req = NULL;
-		}
-
-		if (read_req) {
-			/* wait for our last read to complete */
-			ret = wait_event_interruptible(dev->read_wq,
-				dev->rx_done || dev->state != STATE_BUSY);
-			if (dev->state == STATE_CANCELED) {
-				r = -ECANCELED;
-				if (!dev->rx_done)
-					usb_ep_dequeue(dev->ep_out, read_req);
-				break;
+				goto out;
 			}
+			queued++;
 			/* if xfer_file_length is 0xFFFFFFFF, then we read until
 			 * we get a zero length packet
 			 */
 			if (count != 0xFFFFFFFF)
-				count -= read_req->actual;
-			if (read_req->actual < read_req->length) {
-				/* short packet is used to signal EOF for sizes > 4 gig */
-				DBG(cdev, "got short packet\n");
-				count = 0;
-			}
+				count -= req->length;
+		}
+
+		/* wait for the oldest request to complete */
+		req = dev->rx_req[done % dev->rx_reqs];
+		wait_event_interruptible(dev->read_wq,
+			dev->rx_done > done || dev->state != STATE_BUSY);
+		if (dev->rx_done <= done)
+			continue;
+		done++;
+
+		DBG(cdev, "rx %p %d\n", req, req->actual);
+		if (req->actual < req->length) {
+			/* short packet is used to signal EOF for sizes > 4 gig */
+			DBG(cdev, "got short packet\n");
+			count = 0;
+			mtp_rx_dequeue(dev, done, queued);
+			queued = done;
+		}
 
-			write_req = read_req;
-			read_req = NULL;
+		ret = vfs_write(filp, req->buf, req->actual, &offset);
+		DBG(cdev, "vfs_write %d\n", ret);
+		if (ret != req->actual) {
+			r = -EIO;
+			dev->state = STATE_ERROR;
+			break;
 		}
+		received += req->actual;
 	}
+out:
+	mtp_rx_dequeue(dev, done, queued);
+
+	if (!r)
+		mtp_stats_add(dev, MTP_STATS_RECEIVE, received, start);
 
 	DBG(cdev, "receive_file_work returning %d\n", r);
 	/* write the result */
@@ -1117,8 +1280,10 @@ mtp_function_unbind(struct usb_configuration *c, struct usb_function *f)
 
 	while ((req = mtp_req_get(dev, &dev->tx_idle)))
 		mtp_request_free(req, dev->ep_in);
-	for (i = 0; i < RX_REQ_MAX; i++)
+	for (i = 0; i < MTP_RX_REQ_MAX; i++) {
 		mtp_request_free(dev->rx_req[i], dev->ep_out);
+		dev->rx_req[i] = NULL;
+	}
 	while ((req = mtp_req_get(dev, &dev->intr_idle)))
 		mtp_request_free(req, dev->ep_intr);
 	dev->state = STATE_OFFLINE;
@@ -1210,6 +1375,61 @@ static int mtp_bind_config(struct usb_configuration *c, bool ptp_config)
 	return usb_add_function(c, &dev->function);
 }
 
+static int mtp_debugfs_show(struct seq_file *s, void *unused)
+{
+	static const char * const names[] = { "send", "receive" };
+	struct mtp_dev *dev = s->private;
+	struct mtp_xfer_stats st;
+	int i;
+
+	seq_printf(s, "tx requests: %u x %u bytes\n",
+		   dev->tx_reqs, dev->tx_req_len);
+	seq_printf(s, "rx requests: %u x %u bytes\n",
+		   dev->rx_reqs, dev->rx_req_len);
+
+	for (i = 0; i < ARRAY_SIZE(names); i++) {
+		spin_lock_irq(&dev->lock);
+		st = dev->stats[i];
+		spin_unlock_irq(&dev->lock);
+
+		seq_printf(s, "%s: %lu transfers, %llu bytes, %llu KB/s, "
+			   "usb idle %lu\n", names[i], st.transfers,
+			   st.total_bytes, st.total_us > 0 ?
+			   div64_u64(st.total_bytes * 1000, st.total_us) : 0,
+			   st.usb_idle);
+		seq_printf(s, "%s: last %llu bytes in %lld us, %llu KB/s\n",
+			   names[i], st.last_bytes, st.last_us,
+			   st.last_us > 0 ?
+			   div64_u64(st.last_bytes * 1000, st.last_us) : 0);
+	}
+	return 0;
+}
+
+static int mtp_debugfs_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mtp_debugfs_show, inode->i_private);
+}
+
+/* writing anything to the file clears the counters */
+static ssize_t mtp_debugfs_write(struct file *file, const char __user *buf,
+		size_t count, loff_t *ppos)
+{
+	struct mtp_dev *dev = ((struct seq_file *)file->private_data)->private;
+
+	spin_lock_irq(&dev->lock);
+	memset(dev->stats, 0, sizeof(dev->stats));
+	spin_unlock_irq(&dev->lock);
+	return count;
+}
+
+static const struct file_operations mtp_debugfs_fops = {
+	.open = mtp_debugfs_open,
+	.read = seq_read,
+	.write = mtp_debugfs_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 static int mtp_setup(void)
 {
 	struct mtp_dev *dev;
@@ -1225,8 +1445,11 @@ static int mtp_setup(void)
 	init_waitqueue_head(&dev->intr_wq);
 	atomic_set(&dev->open_excl, 0);
 	atomic_set(&dev->ioctl_excl, 0);
+	atomic_set(&dev->tx_busy, 0);
 	INIT_LIST_HEAD(&dev->tx_idle);
 	INIT_LIST_HEAD(&dev->intr_idle);
+	dev->tx_req_len = MTP_BULK_BUFFER_SIZE;
+	dev->rx_req_len = MTP_BULK_BUFFER_SIZE;
 
 	dev->wq = create_singlethread_workqueue("f_mtp");
 	if (!dev->wq) {
@@ -1242,6 +1465,10 @@ static int mtp_setup(void)
 	if (ret)
 		goto err2;
 
+	/* throughput counters, not fatal if debugfs is missing */
+	dev->debugfs = debugfs_create_file(mtp_shortname, S_IRUGO | S_IWUSR,
+					   NULL, dev, &mtp_debugfs_fops);
+
 	return 0;
 
 err2:
@@ -1260,6 +1487,7 @@ static void mtp_cleanup(void)
 	if (!dev)
 		return;
 
+	debugfs_remove(dev->debugfs);
 	misc_deregister(&mtp_device);
 	destroy_workqueue(dev->wq);
 	_mtp_dev = NULL;
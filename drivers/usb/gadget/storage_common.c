@@ -229,6 +229,20 @@ struct interrupt_data {
 /*-------------------------------------------------------------------------*/
 
 
+/*
+ * Per-LUN I/O counters, indexed by direction (0 for READ, 1 for WRITE).
+ * busy_us is the time the worker thread spent on the commands, so
+ * bytes / busy_us is the throughput the backing file delivered.
+ */
+struct fsg_lun_stats {
+	unsigned long	cmds[2];
+	u64		bytes[2];
+	u64		busy_us[2];
+	u32		max_us[2];
+	unsigned long	readaheads;	/* Read-ahead windows started */
+	unsigned long	writebehinds;	/* Write-behind flushes started */
+};
+
 struct fsg_lun {
 	struct file	*filp;
 	loff_t		file_length;
@@ -247,6 +261,11 @@ struct fsg_lun {
 	u32		sense_data_info;
 	u32		unit_attention_data;
 
+	loff_t		next_read;	/* End of the last READ */
+	loff_t		wb_start;	/* Written range not yet handed */
+	loff_t		wb_end;		/*  to writeback */
+	struct fsg_lun_stats stats;
+
 	struct device	dev;
 };
 
@@ -265,6 +284,9 @@ static struct fsg_lun *fsg_lun_from_dev(struct device *dev)
 /* Number of buffers we will use.  2 is enough for double-buffering */
 #define FSG_NUM_BUFFERS	2
 
+/* Deepest pipeline the composite function can be configured with */
+#define FSG_MAX_NUM_BUFFERS	8
+
 /* Default size of buffer length. */
 #define FSG_BUFLEN	((u32)16384)
 
@@ -603,6 +625,8 @@ static int fsg_lun_open(struct fsg_lun *curlun, const char *filename)
 	curlun->filp = filp;
 	curlun->file_length = size;
 	curlun->num_sectors = num_sectors;
+	curlun->next_read = 0;
+	curlun->wb_start = curlun->wb_end = 0;
 	LDBG(curlun, "open backing file: %s\n", filename);
 	rc = 0;
 
@@ -0,0 +1,92 @@
+/*
+ * include/linux/cpufreq_sched.h
+ *
+ * Interface between the CFS scheduler and the 'sched' cpufreq governor.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ */
+
+#ifndef _LINUX_CPUFREQ_SCHED_H
+#define _LINUX_CPUFREQ_SCHED_H
+
+#include <linux/types.h>
+
+/*
+ * Runnable utilization of a CPU, in 1/SCHED_UTIL_SCALE: a decaying
+ * average of the fraction of time the CPU had runnable tasks.  It is
+ * updated whenever the number of runnable tasks changes and on every
+ * CFS tick with the time since the previous update, moving towards SCHED_UTIL_SCALE (busy) or 0 (idle) by
+ * delta / (delta + tau) of the remaining distance, which is a first order
+ * low-pass filter with a time constant of SCHED_UTIL_TAU.
+ *
+ * Times are in units of 1024ns, close enough to microseconds and free to
+ * compute from nanoseconds.
+ */
+#define SCHED_UTIL_SHIFT	10
+#define SCHED_UTIL_SCALE	(1UL << SCHED_UTIL_SHIFT)
+#define SCHED_UTIL_TAU		16000		/* about 16ms */
+
+static inline unsigned long sched_util_update(unsigned long util, int busy,
+					      u64 delta_ns)
+{
+	unsigned long target = busy ? SCHED_UTIL_SCALE : 0;
+	u32 delta, w;
+
+	/* a gap of 8 time constants or more forgets the old value */
+	if (delta_ns >= (u64)SCHED_UTIL_TAU << (SCHED_UTIL_SHIFT + 3))
+		return target;
+	delta = (u32)(delta_ns >> SCHED_UTIL_SHIFT);
+	w = (delta << SCHED_UTIL_SHIFT) / (delta + SCHED_UTIL_TAU);
+
+	return (util * (SCHED_UTIL_SCALE - w) + target * w) >>
+		SCHED_UTIL_SHIFT;
+}
+
+/*
+ * Frequency that would bring a CPU running at cur with the given
+ * utilization down to target_load percent busy, raised to hispeed_freq
+ * once the utilization reaches go_hispeed_load percent so that a burst
+ * from a low speed does not have to climb one step per update.  The
+ * caller clamps the result to the policy limits.
+ */
+struct cpufreq_sched_tunables {
+	unsigned int	target_load;
+	unsigned int	go_hispeed_load;
+	unsigned int	hispeed_freq;
+};
+
+static inline unsigned int
+cpufreq_sched_next_freq(const struct cpufreq_sched_tunables *t,
+			unsigned int cur, unsigned long util)
+{
+	unsigned int load = (util * 100) >> SCHED_UTIL_SHIFT;
+	unsigned int freq = cur * load / t->target_load;
+
+	if (load >= t->go_hispeed_load && freq < t->hispeed_freq)
+		freq = t->hispeed_freq;
+	return freq;
+}
+
+#ifdef __KERNEL__
+/*
+ * Called by the scheduler with the runqueue lock held and interrupts
+ * off, on the CPU that changed the runqueue, which need not be the CPU
+ * the runqueue belongs to.  time is the runqueue clock in ns.
+ */
+struct sched_util_hook {
+	void (*func)(struct sched_util_hook *hook, u64 time,
+		     unsigned long util, unsigned long nr_running);
+};
+
+#ifdef CONFIG_CPU_FREQ_GOV_SCHED
+extern void sched_set_util_hook(int cpu, struct sched_util_hook *hook);
+#else
+static inline void sched_set_util_hook(int cpu, struct sched_util_hook *hook)
+{
+}
+#endif
+#endif /* __KERNEL__ */
+
+#endif /* _LINUX_CPUFREQ_SCHED_H */
@@ -50,6 +50,9 @@ struct mmc_ext_csd {
 	u8			rel_sectors;
 	u8			rel_param;
 	u8			part_config;
+	u8			max_packed_writes;	/* 0 if unsupported */
+	u8			max_packed_reads;
+	bool			packed_event_en;	/* packed failures raise an exception event */
 	unsigned int		part_time;		/* Units: ms */
 	unsigned int		sa_timeout;		/* Units: 100ns */
 	unsigned int		hs_max_dtr;
@@ -42,6 +42,33 @@ enum oom_constraint {
 
 extern int test_set_oom_score_adj(int new_val);
 
+#ifdef CONFIG_ANDROID_LMK_ADJ_INDEX
+extern void lowmem_index_add(struct task_struct *tsk);
+extern void lowmem_index_update(struct task_struct *tsk);
+extern void lowmem_index_del(struct task_struct *tsk);
+
+static inline void lowmem_index_init(struct task_struct *tsk)
+{
+	INIT_HLIST_NODE(&tsk->lmk_node);
+}
+#else
+static inline void lowmem_index_add(struct task_struct *tsk)
+{
+}
+
+static inline void lowmem_index_update(struct task_struct *tsk)
+{
+}
+
+static inline void lowmem_index_del(struct task_struct *tsk)
+{
+}
+
+static inline void lowmem_index_init(struct task_struct *tsk)
+{
+}
+#endif
+
 extern unsigned int oom_badness(struct task_struct *p, struct mem_cgroup *mem,
 			const nodemask_t *nodemask, unsigned long totalpages);
 extern int try_set_zonelist_oom(struct zonelist *zonelist, gfp_t gfp_flags);
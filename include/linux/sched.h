@@ -1288,6 +1288,10 @@ struct task_struct {
 #ifdef CONFIG_SMP
 	struct plist_node pushable_tasks;
 #endif
+#ifdef CONFIG_ANDROID_LMK_ADJ_INDEX
+	struct hlist_node lmk_node;	/* lowmemorykiller oom_score_adj index */
+	int lmk_adj;
+#endif
 
 	struct mm_struct *mm, *active_mm;
 #ifdef CONFIG_COMPAT_BRK
@@ -0,0 +1,52 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM lowmemorykiller
+
+#if !defined(_TRACE_LOWMEMORYKILLER_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_LOWMEMORYKILLER_H
+
+#include <linux/types.h>
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(lowmem_scan,
+
+	TP_PROTO(int min_score_adj,
+		unsigned int nr_scanned,
+		u64 scan_ns,
+		pid_t pid,
+		int oom_score_adj,
+		int tasksize),
+
+	TP_ARGS(min_score_adj, nr_scanned, scan_ns, pid, oom_score_adj,
+		tasksize),
+
+	TP_STRUCT__entry(
+		__field(int, min_score_adj)
+		__field(unsigned int, nr_scanned)
+		__field(u64, scan_ns)
+		__field(pid_t, pid)
+		__field(int, oom_score_adj)
+		__field(int, tasksize)
+	),
+
+	TP_fast_assign(
+		__entry->min_score_adj = min_score_adj;
+		__entry->nr_scanned = nr_scanned;
+		__entry->scan_ns = scan_ns;
+		__entry->pid = pid;
+		__entry->oom_score_adj = oom_score_adj;
+		__entry->tasksize = tasksize;
+	),
+
+	TP_printk("min_adj=%d nr_scanned=%u scan_ns=%llu pid=%d adj=%d size=%d",
+		__entry->min_score_adj,
+		__entry->nr_scanned,
+		(unsigned long long)__entry->scan_ns,
+		__entry->pid,
+		__entry->oom_score_adj,
+		__entry->tasksize)
+);
+
+#endif /* _TRACE_LOWMEMORYKILLER_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
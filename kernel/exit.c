@@ -211,6 +211,7 @@ repeat:
 	}
 
 	write_unlock_irq(&tasklist_lock);
+	lowmem_index_del(p);
 	release_thread(p);
 	call_rcu(&p->rcu, delayed_put_task_struct);
 
@@ -114,6 +114,15 @@ bool irq_work_queue(struct irq_work *entry)
 }
 EXPORT_SYMBOL_GPL(irq_work_queue);
 
+/*
+ * Architectures without a self-interrupt run the entries from the tick,
+ * so NOHZ must not stop it while any are queued on this cpu.
+ */
+bool irq_work_needs_cpu(void)
+{
+	return this_cpu_read(irq_work_list) != NULL;
+}
+
 /*
  * Run the irq_work entries on this cpu. Requires to be ran from hardirq
  * context with local IRQs disabled.
@@ -72,6 +72,7 @@
 #include <linux/ftrace.h>
 #include <linux/slab.h>
 #include <linux/cpuacct.h>
+#include <linux/cpufreq_sched.h>
 
 #include <asm/tlb.h>
 #include <asm/irq_regs.h>
@@ -502,6 +503,12 @@ struct rq {
 
 	atomic_t nr_iowait;
 
+#ifdef CONFIG_CPU_FREQ_GOV_SCHED
+	/* runnable utilization, see include/linux/cpufreq_sched.h */
+	unsigned long util_avg;
+	u64 util_stamp;
+#endif
+
 #ifdef CONFIG_SMP
 	struct root_domain *rd;
 	struct sched_domain *sd;
@@ -1777,14 +1784,69 @@ static const struct sched_class rt_sched_class;
 
 #include "sched_stats.h"
 
+#ifdef CONFIG_CPU_FREQ_GOV_SCHED
+static DEFINE_PER_CPU(struct sched_util_hook *, sched_util_hooks);
+
+/*
+ * Install (or with NULL, remove) the callback that receives the runnable
+ * utilization of a CPU.  After removing it the caller must wait for
+ * synchronize_sched() before freeing it.
+ */
+void sched_set_util_hook(int cpu, struct sched_util_hook *hook)
+{
+	rcu_assign_pointer(per_cpu(sched_util_hooks, cpu), hook);
+}
+EXPORT_SYMBOL_GPL(sched_set_util_hook);
+
+/*
+ * Fold the time since the last update into the utilization of the
+ * runqueue.  Called before nr_running changes, so it still tells
+ * whether the CPU was busy during that time.
+ */
+static void update_rq_util(struct rq *rq)
+{
+	u64 now = rq->clock;
+
+	rq->util_avg = sched_util_update(rq->util_avg, rq->nr_running != 0,
+					 now - rq->util_stamp);
+	rq->util_stamp = now;
+}
+
+static void sched_util_notify(struct rq *rq)
+{
+	struct sched_util_hook *hook;
+
+	hook = rcu_dereference_sched(per_cpu(sched_util_hooks, cpu_of(rq)));
+	if (hook)
+		hook->func(hook, rq->util_stamp, rq->util_avg, rq->nr_running);
+}
+#else
+static inline void update_rq_util(struct rq *rq)
+{
+}
+
+static inline void sched_util_notify(struct rq *rq)
+{
+}
+#endif
+
+/*
+ * Only activate_task() and deactivate_task() change nr_running; a class
+ * requeueing a task (renice, PI boost, group move) goes through
+ * enqueue_task()/dequeue_task() alone and is not reported.
+ */
 static void inc_nr_running(struct rq *rq)
 {
+	update_rq_util(rq);
 	rq->nr_running++;
+	sched_util_notify(rq);
 }
 
 static void dec_nr_running(struct rq *rq)
 {
+	update_rq_util(rq);
 	rq->nr_running--;
+	sched_util_notify(rq);
 }
 
 static void set_load_weight(struct task_struct *p)
@@ -4128,6 +4128,9 @@ static void task_tick_fair(struct rq *rq, struct task_struct *curr, int queued)
 		cfs_rq = cfs_rq_of(se);
 		entity_tick(cfs_rq, se, queued);
 	}
+
+	update_rq_util(rq);
+	sched_util_notify(rq);
 }
 
 /*
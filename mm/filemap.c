@@ -221,6 +221,7 @@ int __filemap_fdatawrite_range(struct address_space *mapping, loff_t start,
 	ret = do_writepages(mapping, &wbc);
 	return ret;
 }
+EXPORT_SYMBOL(__filemap_fdatawrite_range);
 
 static inline int __filemap_fdatawrite(struct address_space *mapping,
 	int sync_mode)
@@ -61,6 +61,8 @@ int test_set_oom_score_adj(int new_val)
 		current->signal->oom_score_adj = new_val;
 	}
 	spin_unlock_irq(&sighand->siglock);
+	if (new_val != old_val)
+		lowmem_index_update(current);
 
 	return old_val;
 }
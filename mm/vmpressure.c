@@ -0,0 +1,183 @@
+/*
+ * linux/mm/vmpressure.c
+ *
+ * Memory pressure levels derived from page reclaim efficiency.
+ *
+ * Every reclaim pass reports how many pages it scanned and how many of
+ * them it managed to reclaim. Once a window worth of pages has been
+ * scanned the ratio is turned into a pressure level and handed to the
+ * registered notifiers from process context. A low ratio of reclaimed to
+ * scanned pages means the LRU lists are full of pages in active use and
+ * the system is about to start thrashing, so the level can be used to
+ * trim caches or kill processes before direct reclaim latency is felt.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/log2.h>
+#include <linux/notifier.h>
+#include <linux/spinlock.h>
+#include <linux/swap.h>
+#include <linux/workqueue.h>
+#include <linux/vmpressure.h>
+
+/*
+ * Number of scanned pages after which the pressure level is evaluated.
+ * Smaller windows react faster but are noisier; 512 pages is 2MB with
+ * 4K pages and matches the amount a few reclaim batches go through.
+ */
+static const unsigned long vmpressure_win = SWAP_CLUSTER_MAX * 16;
+
+/* Percentage of scanned pages that were not reclaimed, per level */
+static const unsigned int vmpressure_level_med = 60;
+static const unsigned int vmpressure_level_critical = 95;
+
+/*
+ * Reclaim priority at which we consider the system critical regardless
+ * of efficiency: each pass scans 1/2^prio of the LRU lists, so by this
+ * point reclaim has gone through more than 10% of them per pass without
+ * meeting its target.
+ */
+static const int vmpressure_level_critical_prio = ilog2(100 / 10);
+
+static struct {
+	spinlock_t lock;
+	unsigned long scanned;
+	unsigned long reclaimed;
+} vmpr = {
+	.lock = __SPIN_LOCK_UNLOCKED(vmpr.lock),
+};
+
+static BLOCKING_NOTIFIER_HEAD(vmpressure_notifier);
+
+static const char * const vmpressure_str_levels[] = {
+	[VMPRESSURE_LOW] = "low",
+	[VMPRESSURE_MEDIUM] = "medium",
+	[VMPRESSURE_CRITICAL] = "critical",
+};
+
+const char *vmpressure_level_name(enum vmpressure_levels level)
+{
+	return vmpressure_str_levels[level];
+}
+EXPORT_SYMBOL_GPL(vmpressure_level_name);
+
+static enum vmpressure_levels vmpressure_level(unsigned long pressure)
+{
+	if (pressure >= vmpressure_level_critical)
+		return VMPRESSURE_CRITICAL;
+	else if (pressure >= vmpressure_level_med)
+		return VMPRESSURE_MEDIUM;
+	return VMPRESSURE_LOW;
+}
+
+static enum vmpressure_levels vmpressure_calc_level(unsigned long scanned,
+						    unsigned long reclaimed)
+{
+	unsigned long pressure;
+
+	/* Slab and lumpy reclaim can free more pages than were scanned */
+	if (reclaimed >= scanned)
+		return VMPRESSURE_LOW;
+
+	pressure = (scanned - reclaimed) * 100 / scanned;
+
+	pr_debug("%s: %3lu  (s: %lu  r: %lu)\n", __func__, pressure,
+		 scanned, reclaimed);
+
+	return vmpressure_level(pressure);
+}
+
+static void vmpressure_work_fn(struct work_struct *work)
+{
+	unsigned long scanned;
+	unsigned long reclaimed;
+
+	spin_lock(&vmpr.lock);
+	scanned = vmpr.scanned;
+	reclaimed = vmpr.reclaimed;
+	vmpr.scanned = 0;
+	vmpr.reclaimed = 0;
+	spin_unlock(&vmpr.lock);
+
+	/* Already handled by a previous run of the work */
+	if (!scanned)
+		return;
+
+	blocking_notifier_call_chain(&vmpressure_notifier,
+				     vmpressure_calc_level(scanned, reclaimed),
+				     NULL);
+}
+
+static DECLARE_WORK(vmpressure_work, vmpressure_work_fn);
+
+/**
+ * vmpressure() - Account memory pressure through scanned/reclaimed ratio
+ * @gfp:	reclaimer's gfp mask
+ * @scanned:	number of pages scanned
+ * @reclaimed:	number of pages reclaimed
+ *
+ * Called from the reclaim paths after each pass over a zone. The actual
+ * level calculation and notification is deferred to a work item once
+ * enough pages have been scanned, so this is cheap and never sleeps.
+ */
+void vmpressure(gfp_t gfp, unsigned long scanned, unsigned long reclaimed)
+{
+	/*
+	 * Only count reclaim done on behalf of ordinary allocations;
+	 * atomic and NOFS/NOIO ones cannot reclaim everything and would
+	 * report misleadingly high pressure.
+	 */
+	if (!(gfp & (__GFP_HIGHMEM | __GFP_MOVABLE | __GFP_IO | __GFP_FS)))
+		return;
+
+	/*
+	 * Nothing was scanned, e.g. all LRU pages are isolated or the
+	 * scan count was rounded down; don't count it either way.
+	 */
+	if (!scanned)
+		return;
+
+	spin_lock(&vmpr.lock);
+	vmpr.scanned += scanned;
+	vmpr.reclaimed += reclaimed;
+	scanned = vmpr.scanned;
+	spin_unlock(&vmpr.lock);
+
+	if (scanned < vmpressure_win)
+		return;
+	schedule_work(&vmpressure_work);
+}
+
+/**
+ * vmpressure_prio() - Account memory pressure through reclaimer priority
+ * @gfp:	reclaimer's gfp mask
+ * @prio:	reclaimer's priority
+ *
+ * Once reclaim has had to raise its priority far enough the system is
+ * in trouble no matter how many pages the last pass happened to free.
+ */
+void vmpressure_prio(gfp_t gfp, int prio)
+{
+	if (prio > vmpressure_level_critical_prio)
+		return;
+
+	/* A full window with nothing reclaimed is critical by definition */
+	vmpressure(gfp, vmpressure_win, 0);
+}
+
+int vmpressure_register_notifier(struct notifier_block *nb)
+{
+	return blocking_notifier_chain_register(&vmpressure_notifier, nb);
+}
+EXPORT_SYMBOL_GPL(vmpressure_register_notifier);
+
+int vmpressure_unregister_notifier(struct notifier_block *nb)
+{
+	return blocking_notifier_chain_unregister(&vmpressure_notifier, nb);
+}
+EXPORT_SYMBOL_GPL(vmpressure_unregister_notifier);
@@ -0,0 +1,714 @@
+/* $(CROSS_COMPILE)cc -Wall -Wextra -g -O2 -o binder-bench binder-bench.c */
+
+/*
+ * binder transaction throughput benchmark
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ */
+
+/*
+ * Runs 1..N independent client/server process pairs, each client doing
+ * synchronous transactions to its own server as fast as it can, and
+ * reports the aggregate transactions/s for each pair count. With a
+ * single global driver lock the total stays flat as pairs are added;
+ * it should scale with the number of CPUs when the pairs do not share
+ * any state in the driver.
+ *
+ *	binder-bench [-p max_pairs] [-t seconds] [-s payload_bytes]
+ *
+ * Servers are published through the context manager using the
+ * servicemanager protocol. If no servicemanager is running (e.g. on a
+ * bare test system) the benchmark registers a minimal one itself.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../drivers/staging/android/binder.h"
+
+#define BINDER_DEV		"/dev/binder"
+#define BINDER_VM_SIZE		(128 * 1024)
+#define MAX_PAYLOAD		4096
+#define MAX_SERVICES		256
+
+/* IServiceManager transaction codes */
+#define SVC_MGR_CHECK_SERVICE	2
+#define SVC_MGR_ADD_SERVICE	3
+
+static const char svcmgr_id[] = "android.os.IServiceManager";
+
+struct parcel {
+	uint8_t data[MAX_PAYLOAD + 256];
+	size_t len;
+	size_t offs[4];
+	size_t noffs;
+	size_t pos;	/* read position */
+};
+
+struct binder_conn {
+	int fd;
+	void *map;
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static int binder_conn_open(struct binder_conn *bc)
+{
+	struct binder_version vers;
+
+	bc->fd = open(BINDER_DEV, O_RDWR);
+	if (bc->fd < 0)
+		return -1;
+	if (ioctl(bc->fd, BINDER_VERSION, &vers) < 0 ||
+	    vers.protocol_version != BINDER_CURRENT_PROTOCOL_VERSION) {
+		fprintf(stderr, "binder: protocol version mismatch\n");
+		errno = EPROTO;
+		return -1;
+	}
+	bc->map = mmap(NULL, BINDER_VM_SIZE, PROT_READ, MAP_PRIVATE,
+		       bc->fd, 0);
+	if (bc->map == MAP_FAILED)
+		return -1;
+	return 0;
+}
+
+static int binder_write_read(struct binder_conn *bc, void *wbuf, size_t wlen,
+			     void *rbuf, size_t rlen, size_t *rconsumed)
+{
+	struct binder_write_read bwr;
+	int ret;
+
+	memset(&bwr, 0, sizeof(bwr));
+	bwr.write_buffer = (unsigned long)wbuf;
+	bwr.write_size = wlen;
+	bwr.read_buffer = (unsigned long)rbuf;
+	bwr.read_size = rlen;
+	do {
+		ret = ioctl(bc->fd, BINDER_WRITE_READ, &bwr);
+	} while (ret < 0 && errno == EINTR && bwr.write_consumed == 0);
+	if (rconsumed)
+		*rconsumed = bwr.read_consumed;
+	return ret;
+}
+
+static int binder_cmd(struct binder_conn *bc, uint32_t cmd, const void *arg,
+		      size_t len)
+{
+	uint8_t buf[sizeof(uint32_t) + sizeof(struct binder_transaction_data)];
+
+	memcpy(buf, &cmd, sizeof(cmd));
+	memcpy(buf + sizeof(cmd), arg, len);
+	return binder_write_read(bc, buf, sizeof(cmd) + len, NULL, 0, NULL);
+}
+
+static void parcel_init(struct parcel *p)
+{
+	p->len = 0;
+	p->noffs = 0;
+	p->pos = 0;
+}
+
+static void parcel_put(struct parcel *p, const void *data, size_t len)
+{
+	memcpy(p->data + p->len, data, len);
+	p->len += (len + 3) & ~3;
+}
+
+static void parcel_put_u32(struct parcel *p, uint32_t v)
+{
+	parcel_put(p, &v, sizeof(v));
+}
+
+/* String16: length in chars, then UTF-16 chars with a terminating NUL */
+static void parcel_put_str16(struct parcel *p, const char *s)
+{
+	uint16_t *out;
+	size_t i, n = strlen(s);
+
+	parcel_put_u32(p, n);
+	out = (uint16_t *)(p->data + p->len);
+	for (i = 0; i <= n; i++)
+		out[i] = (unsigned char)s[i];
+	p->len += ((n + 1) * sizeof(uint16_t) + 3) & ~3;
+}
+
+static void parcel_put_obj(struct parcel *p, unsigned long type, void *binder,
+			   signed long handle)
+{
+	struct flat_binder_object obj;
+
+	memset(&obj, 0, sizeof(obj));
+	obj.type = type;
+	obj.flags = 0x7f | FLAT_BINDER_FLAG_ACCEPTS_FDS;
+	if (type == BINDER_TYPE_BINDER) {
+		obj.binder = binder;
+		obj.cookie = binder;
+	} else
+		obj.handle = handle;
+	p->offs[p->noffs++] = p->len;
+	parcel_put(p, &obj, sizeof(obj));
+}
+
+static void parcel_from_txn(struct parcel *p,
+			    const struct binder_transaction_data *txn)
+{
+	size_t i;
+
+	parcel_init(p);
+	p->len = txn->data_size < sizeof(p->data) ?
+		txn->data_size : sizeof(p->data);
+	memcpy(p->data, txn->data.ptr.buffer, p->len);
+	for (i = 0; i < txn->offsets_size / sizeof(size_t) && i < 4; i++)
+		p->offs[p->noffs++] = ((const size_t *)txn->data.ptr.offsets)[i];
+}
+
+static uint32_t parcel_get_u32(struct parcel *p)
+{
+	uint32_t v = 0;
+
+	if (p->pos + sizeof(v) <= p->len)
+		memcpy(&v, p->data + p->pos, sizeof(v));
+	p->pos += sizeof(v);
+	return v;
+}
+
+/* Reads a String16 into an ASCII buffer */
+static void parcel_get_str16(struct parcel *p, char *s, size_t size)
+{
+	uint32_t i, n = parcel_get_u32(p);
+	const uint16_t *in = (const uint16_t *)(p->data + p->pos);
+
+	if (p->pos + (n + 1) * sizeof(uint16_t) > p->len)
+		n = 0;
+	for (i = 0; i < n && i < size - 1; i++)
+		s[i] = in[i];
+	s[i] = '\0';
+	p->pos += ((n + 1) * sizeof(uint16_t) + 3) & ~3;
+}
+
+static struct flat_binder_object *parcel_get_obj(struct parcel *p)
+{
+	struct flat_binder_object *obj;
+	size_t i;
+
+	for (i = 0; i < p->noffs; i++) {
+		if (p->offs[i] != p->pos)
+			continue;
+		obj = (void *)(p->data + p->pos);
+		p->pos += sizeof(*obj);
+		return obj;
+	}
+	return NULL;
+}
+
+/*
+ * Send a transaction and wait for the reply, answering refcount requests
+ * for our own objects on the way. On return the reply buffer is still
+ * owned by us and must be released with BC_FREE_BUFFER.
+ */
+static int binder_call(struct binder_conn *bc, uint32_t handle, uint32_t code,
+		       struct parcel *data, struct binder_transaction_data *reply)
+{
+	struct {
+		uint32_t cmd;
+		struct binder_transaction_data txn;
+	} __attribute__((packed)) w;
+	uint32_t rbuf[64];
+	int wrote = 0;
+
+	memset(&w, 0, sizeof(w));
+	w.cmd = BC_TRANSACTION;
+	w.txn.target.handle = handle;
+	w.txn.code = code;
+	w.txn.data_size = data->len;
+	w.txn.offsets_size = data->noffs * sizeof(size_t);
+	w.txn.data.ptr.buffer = data->data;
+	w.txn.data.ptr.offsets = data->offs;
+
+	for (;;) {
+		size_t consumed, pos = 0;
+
+		if (binder_write_read(bc, wrote ? NULL : &w,
+				      wrote ? 0 : sizeof(w),
+				      rbuf, sizeof(rbuf), &consumed) < 0)
+			return -1;
+		wrote = 1;
+
+		while (pos < consumed) {
+			uint32_t cmd = *(uint32_t *)((char *)rbuf + pos);
+
+			pos += sizeof(cmd);
+			switch (cmd) {
+			case BR_NOOP:
+			case BR_TRANSACTION_COMPLETE:
+				break;
+			case BR_INCREFS:
+			case BR_ACQUIRE:
+			case BR_RELEASE:
+			case BR_DECREFS: {
+				struct binder_ptr_cookie *pc =
+					(void *)((char *)rbuf + pos);
+
+				pos += sizeof(*pc);
+				if (cmd == BR_INCREFS)
+					binder_cmd(bc, BC_INCREFS_DONE, pc,
+						   sizeof(*pc));
+				else if (cmd == BR_ACQUIRE)
+					binder_cmd(bc, BC_ACQUIRE_DONE, pc,
+						   sizeof(*pc));
+			} break;
+			case BR_REPLY:
+				memcpy(reply, (char *)rbuf + pos,
+				       sizeof(*reply));
+				return 0;
+			case BR_DEAD_REPLY:
+			case BR_FAILED_REPLY:
+				errno = EPIPE;
+				return -1;
+			default:
+				fprintf(stderr, "binder: unexpected return %#x\n",
+					cmd);
+				errno = EPROTO;
+				return -1;
+			}
+		}
+	}
+}
+
+static void binder_free(struct binder_conn *bc, const void *buffer)
+{
+	binder_cmd(bc, BC_FREE_BUFFER, &buffer, sizeof(buffer));
+}
+
+static void svcmgr_header(struct parcel *p, const char *name)
+{
+	parcel_init(p);
+	parcel_put_u32(p, 0);			/* strict mode policy */
+	parcel_put_str16(p, svcmgr_id);
+	parcel_put_str16(p, name);
+}
+
+static int svcmgr_add(struct binder_conn *bc, const char *name, void *binder)
+{
+	struct binder_transaction_data reply;
+	struct parcel p;
+
+	svcmgr_header(&p, name);
+	parcel_put_obj(&p, BINDER_TYPE_BINDER, binder, 0);
+	parcel_put_u32(&p, 0);			/* allow isolated */
+	if (binder_call(bc, 0, SVC_MGR_ADD_SERVICE, &p, &reply) < 0)
+		return -1;
+	binder_free(bc, reply.data.ptr.buffer);
+	return 0;
+}
+
+static int svcmgr_check(struct binder_conn *bc, const char *name)
+{
+	struct binder_transaction_data reply;
+	struct flat_binder_object *obj;
+	struct parcel p;
+	int handle = 0;
+
+	svcmgr_header(&p, name);
+	if (binder_call(bc, 0, SVC_MGR_CHECK_SERVICE, &p, &reply) < 0)
+		return -1;
+	parcel_from_txn(&p, &reply);
+	obj = parcel_get_obj(&p);
+	if (obj && obj->type == BINDER_TYPE_HANDLE) {
+		handle = obj->handle;
+		/* keep the ref past the reply buffer */
+		binder_cmd(bc, BC_ACQUIRE, &handle, sizeof(uint32_t));
+	}
+	binder_free(bc, reply.data.ptr.buffer);
+	return handle;
+}
+
+/*
+ * Minimal context manager speaking the servicemanager protocol, only
+ * used when nobody else holds the context.
+ */
+static void svcmgr_loop(struct binder_conn *bc)
+{
+	static struct {
+		char name[64];
+		uint32_t handle;
+	} svc[MAX_SERVICES];
+	int nsvc = 0;
+	uint32_t rbuf[64];
+	uint32_t cmd = BC_ENTER_LOOPER;
+
+	binder_write_read(bc, &cmd, sizeof(cmd), NULL, 0, NULL);
+
+	for (;;) {
+		size_t consumed, pos = 0;
+
+		if (binder_write_read(bc, NULL, 0, rbuf, sizeof(rbuf),
+				      &consumed) < 0)
+			die("svcmgr read");
+
+		while (pos < consumed) {
+			struct binder_transaction_data *txn;
+			struct parcel req, rep;
+			struct flat_binder_object *obj;
+			char name[64];
+			struct {
+				uint32_t free_cmd;
+				const void *free_buf;
+				uint32_t cmd;
+				struct binder_transaction_data txn;
+			} __attribute__((packed)) w;
+			int i;
+
+			cmd = *(uint32_t *)((char *)rbuf + pos);
+			pos += sizeof(cmd);
+			if (cmd == BR_NOOP || cmd == BR_TRANSACTION_COMPLETE ||
+			    cmd == BR_SPAWN_LOOPER)
+				continue;
+			if (cmd == BR_INCREFS || cmd == BR_ACQUIRE ||
+			    cmd == BR_RELEASE || cmd == BR_DECREFS) {
+				pos += sizeof(struct binder_ptr_cookie);
+				continue;
+			}
+			if (cmd != BR_TRANSACTION) {
+				fprintf(stderr, "svcmgr: unexpected return "
+					"%#x\n", cmd);
+				exit(1);
+			}
+			txn = (void *)((char *)rbuf + pos);
+			pos += sizeof(*txn);
+
+			parcel_from_txn(&req, txn);
+			parcel_get_u32(&req);
+			parcel_get_str16(&req, name, sizeof(name));
+			parcel_get_str16(&req, name, sizeof(name));
+			parcel_init(&rep);
+
+			if (txn->code == SVC_MGR_ADD_SERVICE) {
+				obj = parcel_get_obj(&req);
+				if (obj && obj->type == BINDER_TYPE_HANDLE &&
+				    nsvc < MAX_SERVICES) {
+					uint32_t h = obj->handle;
+
+					binder_cmd(bc, BC_ACQUIRE, &h,
+						   sizeof(h));
+					strcpy(svc[nsvc].name, name);
+					svc[nsvc++].handle = h;
+				}
+				parcel_put_u32(&rep, 0);
+			} else {
+				for (i = nsvc - 1; i >= 0; i--)
+					if (!strcmp(svc[i].name, name))
+						break;
+				if (i >= 0)
+					parcel_put_obj(&rep, BINDER_TYPE_HANDLE,
+						       NULL, svc[i].handle);
+				else
+					parcel_put_u32(&rep, 0);
+			}
+
+			memset(&w, 0, sizeof(w));
+			w.free_cmd = BC_FREE_BUFFER;
+			w.free_buf = txn->data.ptr.buffer;
+			w.cmd = BC_REPLY;
+			w.txn.data_size = rep.len;
+			w.txn.offsets_size = rep.noffs * sizeof(size_t);
+			w.txn.data.ptr.buffer = rep.data;
+			w.txn.data.ptr.offsets = rep.offs;
+			if (binder_write_read(bc, &w, sizeof(w), NULL, 0,
+					      NULL) < 0)
+				die("svcmgr reply");
+		}
+	}
+}
+
+/* Echo every transaction back with a reply of the same size */
+static void server_loop(struct binder_conn *bc, const char *name)
+{
+	static uint8_t payload[MAX_PAYLOAD];
+	static int object;
+	uint32_t rbuf[128];
+	uint32_t cmd;
+
+	if (svcmgr_add(bc, name, &object) < 0)
+		die("add service");
+
+	cmd = BC_ENTER_LOOPER;
+	binder_write_read(bc, &cmd, sizeof(cmd), NULL, 0, NULL);
+
+	for (;;) {
+		size_t consumed, pos = 0;
+
+		if (binder_write_read(bc, NULL, 0, rbuf, sizeof(rbuf),
+				      &consumed) < 0)
+			die("server read");
+
+		while (pos < consumed) {
+			struct binder_transaction_data *txn;
+			struct {
+				uint32_t free_cmd;
+				const void *free_buf;
+				uint32_t cmd;
+				struct binder_transaction_data txn;
+			} __attribute__((packed)) w;
+
+			cmd = *(uint32_t *)((char *)rbuf + pos);
+			pos += sizeof(cmd);
+			switch (cmd) {
+			case BR_INCREFS:
+			case BR_ACQUIRE:
+			case BR_RELEASE:
+			case BR_DECREFS: {
+				struct binder_ptr_cookie *pc =
+					(void *)((char *)rbuf + pos);
+
+				pos += sizeof(*pc);
+				if (cmd == BR_INCREFS)
+					binder_cmd(bc, BC_INCREFS_DONE, pc,
+						   sizeof(*pc));
+				else if (cmd == BR_ACQUIRE)
+					binder_cmd(bc, BC_ACQUIRE_DONE, pc,
+						   sizeof(*pc));
+				continue;
+			}
+			case BR_TRANSACTION:
+				break;
+			default:
+				continue;
+			}
+			txn = (void *)((char *)rbuf + pos);
+			pos += sizeof(*txn);
+
+			memset(&w, 0, sizeof(w));
+			w.free_cmd = BC_FREE_BUFFER;
+			w.free_buf = txn->data.ptr.buffer;
+			w.cmd = BC_REPLY;
+			w.txn.data_size = txn->data_size;
+			w.txn.data.ptr.buffer = payload;
+			if (binder_write_read(bc, &w, sizeof(w), NULL, 0,
+					      NULL) < 0)
+				die("server reply");
+		}
+	}
+}
+
+static void client_run(struct binder_conn *bc, const char *name, int start_fd,
+		       int result_fd, double seconds, size_t payload_size)
+{
+	static struct parcel p;
+	struct binder_transaction_data reply;
+	unsigned long count = 0;
+	double t0, t;
+	int handle;
+	char c;
+
+	while ((handle = svcmgr_check(bc, name)) == 0)
+		usleep(1000);
+	if (handle < 0)
+		die("check service");
+
+	parcel_init(&p);
+	p.len = payload_size;
+
+	/* wait until all clients are connected */
+	if (read(start_fd, &c, 1) < 0)
+		die("start");
+
+	t0 = now();
+	do {
+		if (binder_call(bc, handle, 1, &p, &reply) < 0)
+			die("transaction");
+		binder_free(bc, reply.data.ptr.buffer);
+		count++;
+		t = now();
+	} while (t - t0 < seconds);
+
+	t -= t0;
+	if (write(result_fd, &count, sizeof(count)) != sizeof(count) ||
+	    write(result_fd, &t, sizeof(t)) != sizeof(t))
+		die("result");
+}
+
+static pid_t spawn(void (*fn)(struct binder_conn *, void *), void *arg)
+{
+	struct binder_conn bc;
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0)
+		die("fork");
+	if (pid)
+		return pid;
+
+	if (binder_conn_open(&bc) < 0)
+		die(BINDER_DEV);
+	fn(&bc, arg);
+	exit(0);
+}
+
+struct pair_arg {
+	char name[64];
+	int start_fd;
+	int result_fd;
+	double seconds;
+	size_t payload_size;
+};
+
+static void server_fn(struct binder_conn *bc, void *arg)
+{
+	struct pair_arg *pa = arg;
+
+	server_loop(bc, pa->name);
+}
+
+static void client_fn(struct binder_conn *bc, void *arg)
+{
+	struct pair_arg *pa = arg;
+
+	client_run(bc, pa->name, pa->start_fd, pa->result_fd, pa->seconds,
+		   pa->payload_size);
+}
+
+static void svcmgr_fn(struct binder_conn *bc, void *arg)
+{
+	int ready_fd = *(int *)arg;
+	char ok;
+
+	/* a real servicemanager already owns the context: use that one */
+	ok = ioctl(bc->fd, BINDER_SET_CONTEXT_MGR, 0) == 0;
+	if (write(ready_fd, &ok, 1) != 1 || !ok)
+		exit(0);
+	close(ready_fd);
+	svcmgr_loop(bc);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-p max_pairs] [-t seconds] "
+		"[-s payload_bytes]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int max_pairs = 4;
+	double seconds = 2;
+	size_t payload_size = 128;
+	pid_t svcmgr = 0, *pids;
+	int opt, pairs, i, ready[2];
+	char ok;
+
+	while ((opt = getopt(argc, argv, "p:t:s:")) != -1) {
+		switch (opt) {
+		case 'p':
+			max_pairs = atoi(optarg);
+			break;
+		case 't':
+			seconds = atof(optarg);
+			break;
+		case 's':
+			payload_size = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (max_pairs < 1 || seconds <= 0 || payload_size > MAX_PAYLOAD ||
+	    payload_size & 3)
+		usage(argv[0]);
+
+	if (pipe(ready) < 0)
+		die("pipe");
+	svcmgr = spawn(svcmgr_fn, &ready[1]);
+	close(ready[1]);
+	if (read(ready[0], &ok, 1) != 1)
+		die("servicemanager");
+	close(ready[0]);
+	if (!ok)
+		svcmgr = 0;
+	printf("using %s context manager, %zu byte payload, %.1fs per run\n",
+	       svcmgr ? "built-in" : "existing", payload_size, seconds);
+
+	pids = calloc(2 * max_pairs, sizeof(*pids));
+	if (!pids)
+		die("calloc");
+
+	for (pairs = 1; pairs <= max_pairs; pairs++) {
+		struct pair_arg pa;
+		int start[2], result[2];
+		double total = 0;
+
+		if (pipe(start) < 0 || pipe(result) < 0)
+			die("pipe");
+
+		pa.start_fd = start[0];
+		pa.result_fd = result[1];
+		pa.seconds = seconds;
+		pa.payload_size = payload_size;
+		for (i = 0; i < pairs; i++) {
+			snprintf(pa.name, sizeof(pa.name),
+				 "binder_bench.%d.%d.%d", getpid(), pairs, i);
+			pids[2 * i] = spawn(server_fn, &pa);
+			pids[2 * i + 1] = spawn(client_fn, &pa);
+		}
+		close(start[0]);
+		close(result[1]);
+
+		/* closing the start pipe releases all clients at once */
+		close(start[1]);
+		for (i = 0; i < pairs; i++) {
+			unsigned long count;
+			double t;
+
+			if (read(result[0], &count, sizeof(count)) !=
+			    sizeof(count) ||
+			    read(result[0], &t, sizeof(t)) != sizeof(t)) {
+				fprintf(stderr, "client failed\n");
+				exit(1);
+			}
+			total += count / t;
+		}
+		close(result[0]);
+
+		for (i = 0; i < pairs; i++) {
+			kill(pids[2 * i], SIGKILL);
+			waitpid(pids[2 * i], NULL, 0);
+			waitpid(pids[2 * i + 1], NULL, 0);
+		}
+
+		printf("%2d pairs: %10.0f transactions/s (%8.0f per pair)\n",
+		       pairs, total, total / pairs);
+	}
+
+	if (svcmgr) {
+		kill(svcmgr, SIGKILL);
+		waitpid(svcmgr, NULL, 0);
+	}
+	return 0;
+}
@@ -0,0 +1,13 @@
+/*
+ * Userspace stand-in for <linux/types.h>, enough for the inline helpers
+ * of include/linux/cpufreq_sched.h.
+ */
+#ifndef _TOOLS_LINUX_TYPES_H
+#define _TOOLS_LINUX_TYPES_H
+
+#include <stdint.h>
+
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+#endif
@@ -0,0 +1,725 @@
+/*
+ * cpufreq governor trace replay
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+/*
+ * Replays the CPU bursts of a recorded scheduler trace on a simulated
+ * policy of CPUs sharing one clock, once for each governor model, and
+ * reports the energy spent relative to running at the top speed and how
+ * much later than at the top speed each burst completed.
+ *
+ * The 'sched' model uses the utilization average and the frequency choice
+ * of include/linux/cpufreq_sched.h as they are built into the kernel, plus
+ * the rules of drivers/cpufreq/cpufreq_sched.c: requests raised from the
+ * scheduler hooks take effect on the next tick, speed only drops after
+ * down_delay.  The 'interactive' model follows cpufreq_interactive_timer()
+ * without the load history tuning.
+ *
+ * Two trace formats are accepted.  The text output of ftrace with the
+ * sched_switch and power_frequency (or cpu_frequency) events enabled:
+ *
+ *	echo 1 > /sys/kernel/debug/tracing/events/sched/sched_switch/enable
+ *	echo 1 > /sys/kernel/debug/tracing/events/power/power_frequency/enable
+ *	cat /sys/kernel/debug/tracing/trace > trace.txt
+ *
+ * where every stretch between leaving and returning to the idle task is
+ * a burst, whose amount of work is its duration times the recorded speed.
+ * Or one burst per line, '#' starts a comment:
+ *
+ *	<cpu> <start usecs> <run usecs> [<kHz the run time was measured at>]
+ *
+ * Bursts on one CPU run in order; a burst that arrives while the previous
+ * one is still running waits for it.  Without a trace file a random one
+ * is generated: display frames, touch bursts and background wakeups.
+ *
+ *	sched-replay [-c cpus] [-f kHz:mV,...] [-H hz] [-d secs] [-S seed]
+ *		     [-t target_load] [-g go_hispeed_load] [-D down_delay]
+ *		     [-r timer_rate] [-m min_sample_time] [-v] [trace]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <linux/cpufreq_sched.h>
+
+#define MAX_CPUS	8
+#define MAX_OPPS	16
+#define STEP_US		100
+
+struct opp {
+	unsigned int khz;
+	unsigned int mv;
+};
+
+/* OMAP4460 MPU operating points */
+static struct opp opps[MAX_OPPS] = {
+	{ 350000, 1025 }, { 700000, 1203 }, { 920000, 1317 }, { 1200000, 1380 },
+};
+static int nr_opps = 4;
+
+struct burst {
+	int cpu;
+	u64 start;		/* usecs */
+	u64 work;		/* kHz * usecs */
+	u64 done;		/* completion time in the current replay */
+};
+
+static struct burst *bursts;
+static int nr_bursts;
+static int nr_cpus = 2;
+
+/* Tunables of both models, kernel defaults. */
+static unsigned int hz = 128;
+static struct cpufreq_sched_tunables sched_tun = { 80, 90, 0 };
+static u64 down_delay = 20000;
+static unsigned int go_hispeed_load = 95;
+static u64 timer_rate = 20000;
+static u64 min_sample_time = 20000;
+
+enum { GOV_PERFORMANCE, GOV_INTERACTIVE, GOV_SCHED, NR_GOVS };
+static const char * const gov_names[] = {
+	"performance", "interactive", "sched",
+};
+
+struct sim_cpu {
+	struct burst **q;	/* this CPU's bursts in arrival order */
+	int n;
+	int head, tail;		/* queued: q[head] to q[tail - 1] */
+	u64 left;		/* work left in q[head] */
+
+	/* sched model */
+	unsigned long util;
+	u64 util_time;
+	int busy;		/* queue not empty, rq->nr_running != 0 */
+
+	/* interactive model */
+	u64 win_busy;		/* busy usecs since the timer last ran */
+	u64 change_busy;	/* busy usecs since target_set_time */
+	u64 target_set_time;
+	u64 floor_validate_time;
+	u64 hispeed_validate_time;
+	unsigned int target;
+	unsigned int floor;
+};
+
+struct sim {
+	int gov;
+	struct sim_cpu cpu[MAX_CPUS];
+	unsigned int cur;
+	unsigned int changes;
+
+	/* sched model, per policy */
+	int kick;
+	int down_pending;
+	u64 down_timer;
+	u64 freq_set_time;
+	unsigned int down_freq;
+
+	double energy;
+	u64 busy_at[MAX_OPPS];
+};
+
+static unsigned int max_khz(void)
+{
+	return opps[nr_opps - 1].khz;
+}
+
+static unsigned int min_khz(void)
+{
+	return opps[0].khz;
+}
+
+static int opp_index(unsigned int khz)
+{
+	int i;
+
+	for (i = 0; i < nr_opps - 1; i++)
+		if (opps[i].khz >= khz)
+			break;
+	return i;
+}
+
+/* CPUFREQ_RELATION_L: lowest speed at or above khz */
+static unsigned int relation_l(unsigned int khz)
+{
+	return opps[opp_index(khz)].khz;
+}
+
+/* CPUFREQ_RELATION_H: highest speed at or below khz */
+static unsigned int relation_h(unsigned int khz)
+{
+	int i;
+
+	for (i = nr_opps - 1; i > 0; i--)
+		if (opps[i].khz <= khz)
+			break;
+	return opps[i].khz;
+}
+
+static void add_burst(int cpu, u64 start, u64 work)
+{
+	static int max_bursts;
+
+	if (!work)
+		return;
+	if (nr_bursts == max_bursts) {
+		max_bursts = max_bursts ? max_bursts * 2 : 4096;
+		bursts = realloc(bursts, max_bursts * sizeof(*bursts));
+		if (!bursts) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+	bursts[nr_bursts].cpu = cpu;
+	bursts[nr_bursts].start = start;
+	bursts[nr_bursts].work = work;
+	nr_bursts++;
+	if (cpu >= nr_cpus)
+		nr_cpus = cpu + 1;
+}
+
+/* Timestamp of an ftrace line, the "secs.usecs:" before the event name. */
+static int ftrace_time(char *line, char *event, u64 *t)
+{
+	unsigned long s, us;
+	char *p = event;
+
+	while (p > line && p[-1] != ' ')
+		p--;
+	if (sscanf(p, "%lu.%lu:", &s, &us) != 2)
+		return -1;
+	*t = (u64)s * 1000000 + us;
+	return 0;
+}
+
+static int load_trace(const char *path)
+{
+	struct {
+		int busy;
+		u64 seg_start;
+		u64 burst_start;
+		u64 work;
+		unsigned int khz;
+	} rec[MAX_CPUS];
+	char line[512];
+	FILE *f;
+	int lineno = 0, i;
+	u64 t0 = 0;
+
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	memset(rec, 0, sizeof(rec));
+	for (i = 0; i < MAX_CPUS; i++)
+		rec[i].khz = max_khz();
+
+	while (fgets(line, sizeof(line), f)) {
+		char *ev, *br;
+		unsigned long long a, b;
+		unsigned int khz;
+		int cpu, prev_pid, next_pid;
+		u64 t;
+
+		lineno++;
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+
+		ev = strstr(line, ": sched_switch: ");
+		if (!ev)
+			ev = strstr(line, ": power_frequency: ");
+		if (!ev)
+			ev = strstr(line, ": cpu_frequency: ");
+		if (ev) {
+			br = strchr(line, '[');
+			if (!br || ftrace_time(line, ev, &t))
+				goto bad;
+			if (!t0)
+				t0 = t;
+			t -= t0;
+			cpu = atoi(br + 1);
+			if (strstr(ev, "sched_switch")) {
+				char *pp = strstr(ev, "prev_pid=");
+				char *np = strstr(ev, "next_pid=");
+
+				if (cpu >= MAX_CPUS || !pp || !np)
+					goto bad;
+				prev_pid = atoi(pp + 9);
+				next_pid = atoi(np + 9);
+				if (!prev_pid && next_pid && !rec[cpu].busy) {
+					rec[cpu].busy = 1;
+					rec[cpu].burst_start = t;
+					rec[cpu].seg_start = t;
+					rec[cpu].work = 0;
+				} else if (prev_pid && !next_pid &&
+					   rec[cpu].busy) {
+					rec[cpu].busy = 0;
+					rec[cpu].work += (t - rec[cpu].seg_start) *
+							 rec[cpu].khz;
+					add_burst(cpu, rec[cpu].burst_start,
+						  rec[cpu].work);
+				}
+			} else {
+				char *st = strstr(ev, "state=");
+				char *ci = strstr(ev, "cpu_id=");
+
+				/* power_frequency type 2 is POWER_PSTATE */
+				if (strstr(ev, "power_frequency") &&
+				    !strstr(ev, "type=2"))
+					continue;
+				if (!st || !ci)
+					goto bad;
+				khz = strtoul(st + 6, NULL, 10);
+				cpu = atoi(ci + 7);
+				if (cpu >= MAX_CPUS || !khz)
+					goto bad;
+				if (rec[cpu].busy) {
+					rec[cpu].work += (t - rec[cpu].seg_start) *
+							 rec[cpu].khz;
+					rec[cpu].seg_start = t;
+				}
+				rec[cpu].khz = khz;
+			}
+			continue;
+		}
+
+		/* other ftrace events */
+		if (strstr(line, "]") && strchr(line, ':') &&
+		    !strchr("0123456789", line[strspn(line, " \t")]))
+			continue;
+
+		khz = max_khz();
+		i = sscanf(line, "%d %llu %llu %u", &cpu, &a, &b, &khz);
+		if (i < 3 || cpu < 0 || cpu >= MAX_CPUS)
+			goto bad;
+		add_burst(cpu, a, b * khz);
+	}
+	fclose(f);
+	return 0;
+
+bad:
+	fprintf(stderr, "%s:%d: bad line\n", path, lineno);
+	fclose(f);
+	return -1;
+}
+
+/*
+ * Random trace: every CPU gets a 60fps frame loop that is busy for a
+ * varying part of the frame, touch bursts of a few hundred ms and short
+ * background wakeups.
+ */
+static void gen_trace(u64 duration)
+{
+	int cpu;
+
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		u64 t = 0, frame = 16667, next_touch = 500000 + rand() % 2000000;
+
+		while (t < duration) {
+			/* frame work measured at the top speed */
+			u64 run = cpu ? 1000 + rand() % 3000 :
+					2000 + rand() % 6000;
+
+			if (t >= next_touch) {
+				add_burst(cpu, t, (u64)(100000 + rand() % 300000) *
+					  max_khz());
+				t += 400000;
+				next_touch = t + 500000 + rand() % 3000000;
+				continue;
+			}
+			add_burst(cpu, t, run * max_khz());
+			if (rand() % 4 == 0)
+				add_burst(cpu, t + run + rand() % 5000,
+					  (u64)(100 + rand() % 500) * max_khz());
+			t += frame;
+		}
+	}
+}
+
+static int cmp_burst(const void *a, const void *b)
+{
+	const struct burst *x = a, *y = b;
+
+	if (x->start != y->start)
+		return x->start < y->start ? -1 : 1;
+	return x->cpu - y->cpu;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void set_speed(struct sim *s, unsigned int khz)
+{
+	if (khz != s->cur) {
+		s->cur = khz;
+		s->changes++;
+	}
+}
+
+/* ---- sched model: drivers/cpufreq/cpufreq_sched.c ---- */
+
+static void sched_update_down_freq(struct sim *s)
+{
+	int i = opp_index(s->cur);
+
+	s->down_freq = i ? opps[i - 1].khz : 0;
+}
+
+/* update_rq_util() and sched_util_notify(), then the governor hook */
+static void sched_hook(struct sim *s, struct sim_cpu *c, u64 now, int busy)
+{
+	unsigned int freq;
+
+	c->util = sched_util_update(c->util, c->busy,
+				    (now - c->util_time) * 1000);
+	c->util_time = now;
+	c->busy = busy;
+
+	freq = cpufreq_sched_next_freq(&sched_tun, s->cur, c->util);
+	if ((freq > s->cur && s->cur < max_khz()) ||
+	    (freq <= s->down_freq && s->down_freq && !s->down_pending))
+		s->kick = 1;
+}
+
+static void sched_set_speed(struct sim *s, u64 now)
+{
+	unsigned int freq, max_freq = 0;
+	int i;
+
+	for (i = 0; i < nr_cpus; i++) {
+		struct sim_cpu *c = &s->cpu[i];
+		unsigned long util = sched_util_update(c->util, c->busy,
+						(now - c->util_time) * 1000);
+
+		freq = cpufreq_sched_next_freq(&sched_tun, s->cur, util);
+		if (freq > max_freq)
+			max_freq = freq;
+	}
+	max_freq = relation_l(max_freq);
+	if (max_freq == s->cur)
+		return;
+	if (max_freq < s->cur && now - s->freq_set_time < down_delay) {
+		s->down_pending = 1;
+		s->down_timer = s->freq_set_time + down_delay;
+		return;
+	}
+	set_speed(s, max_freq);
+	s->freq_set_time = now;
+	sched_update_down_freq(s);
+}
+
+/* ---- interactive model: cpufreq_interactive_timer() ---- */
+
+static void interactive_timer(struct sim *s, struct sim_cpu *c, u64 now)
+{
+	unsigned int cpu_load, load_since_change, new_freq;
+	unsigned int hispeed = max_khz();
+	u64 since_change = now - c->target_set_time;
+	int i;
+
+	cpu_load = 100 * c->win_busy / timer_rate;
+	load_since_change = since_change ?
+			    100 * c->change_busy / since_change : 0;
+	if (load_since_change > cpu_load)
+		cpu_load = load_since_change;
+	c->win_busy = 0;
+
+	if (cpu_load >= go_hispeed_load) {
+		if (c->target <= min_khz()) {
+			new_freq = hispeed;
+		} else {
+			new_freq = (u64)max_khz() * cpu_load / 100;
+			if (new_freq < hispeed)
+				new_freq = hispeed;
+		}
+	} else {
+		new_freq = (u64)max_khz() * cpu_load / 100;
+	}
+	if (new_freq <= hispeed)
+		c->hispeed_validate_time = now;
+
+	new_freq = relation_h(new_freq);
+	if (new_freq < c->floor &&
+	    now - c->floor_validate_time < min_sample_time)
+		return;
+	c->floor = new_freq;
+	c->floor_validate_time = now;
+	if (c->target == new_freq)
+		return;
+	c->target_set_time = now;
+	c->change_busy = 0;
+	c->target = new_freq;
+
+	/* up_task and freq_down both apply the highest CPU target */
+	new_freq = 0;
+	for (i = 0; i < nr_cpus; i++)
+		if (s->cpu[i].target > new_freq)
+			new_freq = s->cpu[i].target;
+	set_speed(s, new_freq);
+}
+
+/* ---- replay ---- */
+
+static void replay(struct sim *s, u64 *delays)
+{
+	u64 end = 0, now, tick = 1000000 / hz, next_tick = tick;
+	u64 next_timer = timer_rate;
+	int i, nr_delays = 0;
+
+	for (i = 0; i < nr_bursts; i++) {
+		u64 e = bursts[i].start + bursts[i].work / min_khz();
+
+		if (e > end)
+			end = e;
+	}
+	end += 1000000;
+
+	s->cur = s->gov == GOV_PERFORMANCE ? max_khz() : min_khz();
+	for (i = 0; i < nr_cpus; i++) {
+		s->cpu[i].target = s->cur;
+		s->cpu[i].floor = s->cur;
+	}
+	sched_update_down_freq(s);
+
+	for (now = 0; now < end; now += STEP_US) {
+		for (i = 0; i < nr_cpus; i++) {
+			struct sim_cpu *c = &s->cpu[i];
+			u64 t = now, budget = STEP_US, ran = 0;
+
+			/* arrivals: enqueue_task_fair() */
+			while (c->tail < c->n && c->q[c->tail]->start <= now) {
+				if (c->head == c->tail)
+					c->left = c->q[c->tail]->work;
+				c->tail++;
+				if (s->gov == GOV_SCHED)
+					sched_hook(s, c, now, 1);
+			}
+
+			while (budget && c->head < c->tail) {
+				u64 need = (c->left + s->cur - 1) / s->cur;
+
+				if (need > budget) {
+					c->left -= budget * s->cur;
+					ran += budget;
+					break;
+				}
+				t += need;
+				ran += need;
+				budget -= need;
+				c->q[c->head]->done = t;
+				c->head++;
+				if (c->head < c->tail)
+					c->left = c->q[c->head]->work;
+				/* dequeue_task_fair() */
+				if (s->gov == GOV_SCHED)
+					sched_hook(s, c, t, c->head < c->tail);
+			}
+
+			c->win_busy += ran;
+			c->change_busy += ran;
+			s->busy_at[opp_index(s->cur)] += ran;
+			s->energy += (double)ran * s->cur / 1000 *
+				     opps[opp_index(s->cur)].mv *
+				     opps[opp_index(s->cur)].mv / 1e6;
+		}
+
+		if (s->gov == GOV_SCHED) {
+			if (s->down_pending && now >= s->down_timer) {
+				s->down_pending = 0;
+				sched_set_speed(s, now);
+			}
+			if (now >= next_tick) {
+				/* task_tick_fair() on busy CPUs */
+				for (i = 0; i < nr_cpus; i++)
+					if (s->cpu[i].busy)
+						sched_hook(s, &s->cpu[i], now, 1);
+				/* irq_work raised since the last tick */
+				if (s->kick) {
+					s->kick = 0;
+					sched_set_speed(s, now);
+				}
+				next_tick += tick;
+			}
+		} else if (s->gov == GOV_INTERACTIVE && now >= next_timer) {
+			for (i = 0; i < nr_cpus; i++)
+				interactive_timer(s, &s->cpu[i], now);
+			next_timer += timer_rate;
+		}
+	}
+
+	for (i = 0; i < nr_bursts; i++)
+		delays[nr_delays++] = bursts[i].done - bursts[i].start -
+				      bursts[i].work / max_khz();
+	qsort(delays, nr_delays, sizeof(*delays), cmp_u64);
+}
+
+static int parse_opps(char *arg)
+{
+	char *tok;
+
+	nr_opps = 0;
+	for (tok = strtok(arg, ","); tok; tok = strtok(NULL, ",")) {
+		if (nr_opps == MAX_OPPS ||
+		    sscanf(tok, "%u:%u", &opps[nr_opps].khz,
+			   &opps[nr_opps].mv) != 2 || !opps[nr_opps].khz)
+			return -1;
+		if (nr_opps && opps[nr_opps].khz <= opps[nr_opps - 1].khz)
+			return -1;
+		nr_opps++;
+	}
+	return nr_opps ? 0 : -1;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-c cpus] [-f kHz:mV,...] [-H hz] "
+		"[-d secs] [-S seed]\n\t[-t target_load] [-g go_hispeed_load] "
+		"[-D down_delay] [-r timer_rate]\n\t[-m min_sample_time] [-v] "
+		"[trace]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct sim_cpu cpus[MAX_CPUS];
+	unsigned int seed = 1, duration = 30;
+	double base_energy = 0;
+	int verbose = 0, opt, g, i, j;
+	u64 *delays;
+
+	while ((opt = getopt(argc, argv, "c:f:H:d:S:t:g:D:r:m:v")) != -1) {
+		switch (opt) {
+		case 'c':
+			nr_cpus = atoi(optarg);
+			break;
+		case 'f':
+			if (parse_opps(optarg))
+				usage(argv[0]);
+			break;
+		case 'H':
+			hz = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			duration = strtoul(optarg, NULL, 0);
+			break;
+		case 'S':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			sched_tun.target_load = strtoul(optarg, NULL, 0);
+			break;
+		case 'g':
+			sched_tun.go_hispeed_load = strtoul(optarg, NULL, 0);
+			break;
+		case 'D':
+			down_delay = strtoull(optarg, NULL, 0);
+			break;
+		case 'r':
+			timer_rate = strtoull(optarg, NULL, 0);
+			break;
+		case 'm':
+			min_sample_time = strtoull(optarg, NULL, 0);
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (nr_cpus < 1 || nr_cpus > MAX_CPUS || !hz || !duration ||
+	    !timer_rate || sched_tun.target_load < 1 ||
+	    sched_tun.target_load > 100)
+		usage(argv[0]);
+	sched_tun.hispeed_freq = max_khz();
+
+	if (optind < argc) {
+		nr_cpus = 1;
+		if (load_trace(argv[optind]))
+			return 1;
+	} else {
+		srand(seed);
+		gen_trace((u64)duration * 1000000);
+	}
+	if (!nr_bursts) {
+		fprintf(stderr, "no bursts in the trace\n");
+		return 1;
+	}
+	qsort(bursts, nr_bursts, sizeof(*bursts), cmp_burst);
+
+	/* per-CPU queues in arrival order */
+	memset(cpus, 0, sizeof(cpus));
+	for (i = 0; i < nr_cpus; i++) {
+		cpus[i].q = malloc(nr_bursts * sizeof(*cpus[i].q));
+		if (!cpus[i].q) {
+			perror("malloc");
+			return 1;
+		}
+	}
+	for (i = 0; i < nr_bursts; i++) {
+		struct sim_cpu *c = &cpus[bursts[i].cpu];
+
+		c->q[c->n++] = &bursts[i];
+	}
+	delays = malloc(nr_bursts * sizeof(*delays));
+	if (!delays) {
+		perror("malloc");
+		return 1;
+	}
+
+	printf("%d CPUs, %d bursts, %d speeds %u-%u kHz, HZ=%u\n", nr_cpus,
+	       nr_bursts, nr_opps, min_khz(), max_khz(), hz);
+	printf("%-12s %7s %8s %8s %8s %8s %8s\n", "governor", "energy",
+	       "avg ms", "p50 ms", "p95 ms", "p99 ms", "changes");
+
+	for (g = 0; g < NR_GOVS; g++) {
+		static struct sim s;
+		u64 busy = 0, sum = 0;
+
+		memset(&s, 0, sizeof(s));
+		s.gov = g;
+		for (i = 0; i < nr_cpus; i++) {
+			s.cpu[i].q = cpus[i].q;
+			s.cpu[i].n = cpus[i].n;
+		}
+		replay(&s, delays);
+
+		for (i = 0; i < nr_bursts; i++)
+			sum += delays[i];
+		if (g == GOV_PERFORMANCE)
+			base_energy = s.energy;
+		printf("%-12s %6.1f%% %8.2f %8.2f %8.2f %8.2f %8u\n",
+		       gov_names[g], 100 * s.energy / base_energy,
+		       (double)sum / nr_bursts / 1000,
+		       delays[nr_bursts / 2] / 1000.0,
+		       delays[(u64)nr_bursts * 95 / 100] / 1000.0,
+		       delays[(u64)nr_bursts * 99 / 100] / 1000.0,
+		       s.changes);
+
+		if (verbose) {
+			for (j = 0; j < nr_opps; j++)
+				busy += s.busy_at[j];
+			for (j = 0; j < nr_opps; j++)
+				printf("  %8u kHz %5.1f%% of busy time\n",
+				       opps[j].khz, busy ?
+				       100.0 * s.busy_at[j] / busy : 0);
+		}
+	}
+
+	for (i = 0; i < nr_cpus; i++)
+		free(cpus[i].q);
+	free(delays);
+	free(bursts);
+	return 0;
+}
@@ -0,0 +1,235 @@
+/* $(CROSS_COMPILE)cc -Wall -Wextra -g -O2 -o logger-bench logger-bench.c -lpthread */
+
+/*
+ * logger write throughput and latency benchmark
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ */
+
+/*
+ * Writes log entries in the liblog format (priority, tag, message) from
+ * 1..N threads for a fixed time and reports the aggregate entries/s and
+ * the median and 99th percentile latency of a single writev() for each
+ * writer count. With -r a reader drains the log concurrently, like
+ * logcat does on a device.
+ *
+ *	logger-bench [-w max_writers] [-t seconds] [-s msg_bytes] [-r]
+ *		[/dev/log/main]
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_MSG		4000
+#define HIST_US		10000	/* 1us buckets, the last one is overflow */
+
+struct writer {
+	pthread_t thread;
+	const char *path;
+	double seconds;
+	size_t msg_len;
+	unsigned long count;
+	unsigned long hist[HIST_US + 1];
+	int err;
+};
+
+static volatile int stop_reader;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *writer_fn(void *arg)
+{
+	struct writer *w = arg;
+	char prio = 4;			/* ANDROID_LOG_INFO */
+	char tag[] = "logger-bench";
+	char msg[MAX_MSG + 1];
+	struct iovec iov[3];
+	double t0, t, start;
+	int fd;
+
+	fd = open(w->path, O_WRONLY);
+	if (fd < 0) {
+		w->err = errno;
+		return NULL;
+	}
+
+	memset(msg, 'x', w->msg_len);
+	msg[w->msg_len] = '\0';
+	iov[0].iov_base = &prio;
+	iov[0].iov_len = 1;
+	iov[1].iov_base = tag;
+	iov[1].iov_len = sizeof(tag);
+	iov[2].iov_base = msg;
+	iov[2].iov_len = w->msg_len + 1;
+
+	start = now();
+	do {
+		unsigned long us;
+
+		t0 = now();
+		if (writev(fd, iov, 3) < 0) {
+			w->err = errno;
+			break;
+		}
+		t = now();
+
+		us = (t - t0) * 1e6;
+		w->hist[us < HIST_US ? us : HIST_US]++;
+		w->count++;
+	} while (t - start < w->seconds);
+
+	close(fd);
+	return NULL;
+}
+
+static void *reader_fn(void *arg)
+{
+	const char *path = arg;
+	char buf[5 * 1024];
+	int fd;
+
+	fd = open(path, O_RDONLY | O_NONBLOCK);
+	if (fd < 0) {
+		perror(path);
+		return NULL;
+	}
+	while (!stop_reader) {
+		if (read(fd, buf, sizeof(buf)) < 0 && errno == EAGAIN)
+			usleep(1000);
+	}
+	close(fd);
+	return NULL;
+}
+
+/* Returns the latency in us below which 'pct' percent of writes fall */
+static unsigned long percentile(const unsigned long *hist,
+				unsigned long total, unsigned int pct)
+{
+	unsigned long want = (total * pct + 99) / 100, seen = 0;
+	unsigned long i;
+
+	for (i = 0; i < HIST_US; i++) {
+		seen += hist[i];
+		if (seen >= want)
+			break;
+	}
+	return i;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-w max_writers] [-t seconds] "
+		"[-s msg_bytes] [-r] [/dev/log/main]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = "/dev/log/main";
+	int max_writers = 8, reader = 0;
+	double seconds = 2;
+	size_t msg_len = 64;
+	int opt, n, i;
+
+	while ((opt = getopt(argc, argv, "w:t:s:r")) != -1) {
+		switch (opt) {
+		case 'w':
+			max_writers = atoi(optarg);
+			break;
+		case 't':
+			seconds = atof(optarg);
+			break;
+		case 's':
+			msg_len = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			reader = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind < argc)
+		path = argv[optind];
+	if (max_writers < 1 || seconds <= 0 || msg_len > MAX_MSG)
+		usage(argv[0]);
+
+	printf("%s: %zu byte messages, %.1fs per run%s\n", path, msg_len,
+	       seconds, reader ? ", with reader" : "");
+
+	for (n = 1; n <= max_writers; n++) {
+		static unsigned long hist[HIST_US + 1];
+		struct writer *w;
+		pthread_t rthread;
+		unsigned long total = 0;
+
+		w = calloc(n, sizeof(*w));
+		if (!w) {
+			perror("calloc");
+			return 1;
+		}
+
+		stop_reader = 0;
+		if (reader && pthread_create(&rthread, NULL, reader_fn,
+					     (void *)path)) {
+			perror("pthread_create");
+			return 1;
+		}
+
+		for (i = 0; i < n; i++) {
+			w[i].path = path;
+			w[i].seconds = seconds;
+			w[i].msg_len = msg_len;
+			if (pthread_create(&w[i].thread, NULL, writer_fn,
+					   &w[i])) {
+				perror("pthread_create");
+				return 1;
+			}
+		}
+
+		memset(hist, 0, sizeof(hist));
+		for (i = 0; i < n; i++) {
+			unsigned long j;
+
+			pthread_join(w[i].thread, NULL);
+			if (w[i].err) {
+				fprintf(stderr, "%s: %s\n", path,
+					strerror(w[i].err));
+				return 1;
+			}
+			for (j = 0; j <= HIST_US; j++)
+				hist[j] += w[i].hist[j];
+			total += w[i].count;
+		}
+
+		if (reader) {
+			stop_reader = 1;
+			pthread_join(rthread, NULL);
+		}
+
+		printf("%2d writers: %9.0f entries/s  p50 %5luus  p99 %5luus%s\n",
+		       n, total / seconds, percentile(hist, total, 50),
+		       percentile(hist, total, 99),
+		       hist[HIST_US] ? " (some writes over 10ms)" : "");
+		free(w);
+	}
+
+	return 0;
+}
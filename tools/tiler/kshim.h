@@ -0,0 +1,153 @@
+/*
+ * Minimal kernel environment for building the TILER container managers
+ * in userspace.  Only what drivers/media/video/tiler/tcm/ uses.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#ifndef KSHIM_H
+#define KSHIM_H
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef int16_t s16;
+typedef int32_t s32;
+
+#define GFP_KERNEL	0
+#define kmalloc(size, gfp)	malloc(size)
+#define kzalloc(size, gfp)	calloc(1, size)
+#define kfree(p)		free(p)
+
+#define printk(fmt, ...)	printf(fmt, ##__VA_ARGS__)
+#define KERN_NOTICE	""
+#define KERN_INFO	""
+#define KERN_DEBUG	""
+
+#define WARN_ON(cond) ({						\
+	int __c = !!(cond);						\
+	if (__c)							\
+		fprintf(stderr, "WARN_ON(%s) at %s:%d\n", #cond,	\
+			__FILE__, __LINE__);				\
+	__c;								\
+})
+
+#define BUG_ON(cond) do {						\
+	if (cond) {							\
+		fprintf(stderr, "BUG_ON(%s) at %s:%d\n", #cond,		\
+			__FILE__, __LINE__);				\
+		abort();						\
+	}								\
+} while (0)
+
+#define ALIGN(x, a)	(((x) + (a) - 1) & ~((typeof(x))(a) - 1))
+
+struct mutex {
+	pthread_mutex_t m;
+};
+#define mutex_init(l)		pthread_mutex_init(&(l)->m, NULL)
+#define mutex_destroy(l)	pthread_mutex_destroy(&(l)->m)
+#define mutex_lock(l)		pthread_mutex_lock(&(l)->m)
+#define mutex_unlock(l)		pthread_mutex_unlock(&(l)->m)
+
+#define BITS_PER_LONG		(sizeof(long) * CHAR_BIT)
+#define BITS_TO_LONGS(n)	(((n) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+#define BIT_WORD(n)		((n) / BITS_PER_LONG)
+#define BIT_MASK(n)		(1UL << ((n) % BITS_PER_LONG))
+
+static inline unsigned long __fls(unsigned long word)
+{
+	return BITS_PER_LONG - 1 - __builtin_clzl(word);
+}
+
+static inline int test_bit(unsigned long nr, const unsigned long *map)
+{
+	return !!(map[BIT_WORD(nr)] & BIT_MASK(nr));
+}
+
+static inline unsigned long __find_next(const unsigned long *map,
+					unsigned long size,
+					unsigned long pos, bool set)
+{
+	while (pos < size) {
+		unsigned long word = set ? map[BIT_WORD(pos)] :
+					   ~map[BIT_WORD(pos)];
+
+		word &= ~0UL << (pos % BITS_PER_LONG);
+		if (word) {
+			pos = pos - pos % BITS_PER_LONG +
+			      __builtin_ctzl(word);
+			return pos < size ? pos : size;
+		}
+		pos = pos - pos % BITS_PER_LONG + BITS_PER_LONG;
+	}
+	return size;
+}
+
+#define find_next_bit(map, size, pos)	   __find_next(map, size, pos, true)
+#define find_next_zero_bit(map, size, pos) __find_next(map, size, pos, false)
+
+static inline void bitmap_set(unsigned long *map, int start, int nr)
+{
+	while (nr--) {
+		map[BIT_WORD(start)] |= BIT_MASK(start);
+		start++;
+	}
+}
+
+static inline void bitmap_clear(unsigned long *map, int start, int nr)
+{
+	while (nr--) {
+		map[BIT_WORD(start)] &= ~BIT_MASK(start);
+		start++;
+	}
+}
+
+static inline void bitmap_copy(unsigned long *dst, const unsigned long *src,
+			       int nbits)
+{
+	memcpy(dst, src, BITS_TO_LONGS(nbits) * sizeof(long));
+}
+
+static inline void bitmap_or(unsigned long *dst, const unsigned long *a,
+			     const unsigned long *b, int nbits)
+{
+	int i;
+
+	for (i = 0; i < (int)BITS_TO_LONGS(nbits); i++)
+		dst[i] = a[i] | b[i];
+}
+
+/* same contract as lib/bitmap.c: returns > size if there is no fit */
+static inline unsigned long
+bitmap_find_next_zero_area(unsigned long *map, unsigned long size,
+			   unsigned long start, unsigned int nr,
+			   unsigned long align_mask)
+{
+	unsigned long index, end, i;
+again:
+	index = find_next_zero_bit(map, size, start);
+	index = (index + align_mask) & ~align_mask;
+	end = index + nr;
+	if (end > size)
+		return end;
+	i = find_next_bit(map, end, index);
+	if (i < end) {
+		start = i + 1;
+		goto again;
+	}
+	return index;
+}
+
+#endif /* KSHIM_H */
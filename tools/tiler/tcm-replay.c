@@ -0,0 +1,406 @@
+/*
+ * TILER container manager trace replay
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+/*
+ * Builds the in-kernel container managers against kshim.h and replays the
+ * same allocation trace through each of them, reporting the time spent in
+ * reserve, the number of failed reservations (and how many of those failed
+ * although there were enough free slots) and the fragmentation of the
+ * container, sampled after every operation.
+ *
+ * A trace has one operation per line, '#' starts a comment:
+ *
+ *	a2d <id> <width> <height> <align>	reserve a 2D area
+ *	a1d <id> <slots>			reserve a 1D area
+ *	f <id>					free an area
+ *
+ * Without a trace file a random one is generated, biased towards the
+ * video buffer sizes seen on OMAP4 (-n ops, -S seed).
+ *
+ *	tcm-replay [-W width] [-H height] [-n ops] [-S seed] [-v] [trace]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "kshim.h"
+#include "tcm/tcm-sita.h"
+#include "tcm/tcm-rowmap.h"
+
+#define MAX_IDS		4096
+
+enum { OP_A2D, OP_A1D, OP_FREE };
+
+struct op {
+	int type;
+	int id;
+	u16 w, h;
+	u8 align;
+	u32 slots;
+};
+
+struct result {
+	unsigned long allocs, fails, frag_fails;
+	double alloc_ns, max_alloc_ns;
+	double frag_sum;
+	unsigned long frag_samples;
+	double peak_used;
+};
+
+static struct op *ops;
+static int nr_ops;
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void add_op(struct op *op)
+{
+	static int max_ops;
+
+	if (nr_ops == max_ops) {
+		max_ops = max_ops ? max_ops * 2 : 1024;
+		ops = realloc(ops, max_ops * sizeof(*ops));
+		if (!ops) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+	ops[nr_ops++] = *op;
+}
+
+static int load_trace(const char *path)
+{
+	char line[256];
+	FILE *f;
+	int lineno = 0;
+
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		struct op op = { 0 };
+		char cmd[8];
+		unsigned int a = 0, b = 0, c = 0;
+		int n;
+
+		lineno++;
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+		n = sscanf(line, "%7s %d %u %u %u", cmd, &op.id, &a, &b, &c);
+		if (n >= 2 && op.id >= 0 && op.id < MAX_IDS) {
+			if (!strcmp(cmd, "a2d") && n == 5) {
+				op.type = OP_A2D;
+				op.w = a;
+				op.h = b;
+				op.align = c;
+				add_op(&op);
+				continue;
+			} else if (!strcmp(cmd, "a1d") && n == 3) {
+				op.type = OP_A1D;
+				op.slots = a;
+				add_op(&op);
+				continue;
+			} else if (!strcmp(cmd, "f") && n == 2) {
+				op.type = OP_FREE;
+				add_op(&op);
+				continue;
+			}
+		}
+		fprintf(stderr, "%s:%d: bad line\n", path, lineno);
+		fclose(f);
+		return -1;
+	}
+	fclose(f);
+	return 0;
+}
+
+/*
+ * Random trace: NV12-like pairs of 8-bit and 16-bit 2D buffers, unaligned
+ * 2D buffers and 1D page buffers, freed in random order so that the
+ * container stays mostly full.
+ */
+static void gen_trace(int n, u16 width, u16 height)
+{
+	static const u16 sizes[][2] = {
+		{ 12, 23 }, { 30, 68 }, { 40, 60 }, { 60, 135 },
+		{ 8, 8 }, { 20, 15 }, { 64, 32 }, { 4, 4 },
+	};
+	int live[MAX_IDS], nr_live = 0, next_id = 0;
+	unsigned long used = 0, cap = (unsigned long)width * height;
+	static unsigned long size_of[MAX_IDS];
+	static bool in_use[MAX_IDS];
+	struct op op;
+
+	while (nr_ops < n) {
+		memset(&op, 0, sizeof(op));
+		if (nr_live && (used > cap * 3 / 4 || nr_live >= MAX_IDS / 2 ||
+				rand() % 3 == 0)) {
+			int i = rand() % nr_live;
+
+			op.type = OP_FREE;
+			op.id = live[i];
+			used -= size_of[op.id];
+			in_use[op.id] = false;
+			live[i] = live[--nr_live];
+			add_op(&op);
+			continue;
+		}
+
+		/* ids are reused once freed */
+		do
+			next_id = (next_id + 1) % MAX_IDS;
+		while (in_use[next_id]);
+		op.id = next_id;
+
+		switch (rand() % 4) {
+		case 0:
+			op.type = OP_A1D;
+			op.slots = 1 + rand() % (width * 2);
+			size_of[op.id] = op.slots;
+			break;
+		default: {
+			const u16 *s = sizes[rand() % 8];
+
+			op.type = OP_A2D;
+			op.w = s[0] + rand() % 4;
+			op.h = s[1] + rand() % 4;
+			if (op.w > width)
+				op.w = width;
+			if (op.h > height)
+				op.h = height;
+			op.align = rand() % 3 ? 64 : 1;
+			size_of[op.id] = op.w * op.h;
+			break;
+		}
+		}
+		used += size_of[op.id];
+		in_use[op.id] = true;
+		live[nr_live++] = op.id;
+		add_op(&op);
+	}
+}
+
+/*
+ * Fragmentation of a row is 1 - (longest free run / free slots); the
+ * container value is the average over rows that have free slots.
+ */
+static double fragmentation(const unsigned char *busy, u16 width, u16 height,
+			    unsigned long *free_slots)
+{
+	double sum = 0;
+	int rows = 0, x, y;
+
+	*free_slots = 0;
+	for (y = 0; y < height; y++) {
+		int free = 0, cur = 0, max = 0;
+
+		for (x = 0; x < width; x++) {
+			if (busy[y * width + x]) {
+				cur = 0;
+				continue;
+			}
+			free++;
+			if (++cur > max)
+				max = cur;
+		}
+		if (free) {
+			sum += 1.0 - (double)max / free;
+			rows++;
+		}
+		*free_slots += free;
+	}
+	return rows ? sum / rows : 0;
+}
+
+static void mark(unsigned char *busy, struct tcm_area *area, int val)
+{
+	struct tcm_area a, a_;
+	int x, y;
+
+	tcm_for_each_slice(a, *area, a_)
+		for (y = a.p0.y; y <= a.p1.y; y++)
+			for (x = a.p0.x; x <= a.p1.x; x++) {
+				if (!!busy[y * a.tcm->width + x] == val)
+					fprintf(stderr, "slot %d,%d already %s\n",
+						x, y, val ? "busy" : "free");
+				busy[y * a.tcm->width + x] = val;
+			}
+}
+
+static int replay(struct tcm *tcm, struct result *res, int verbose)
+{
+	static struct tcm_area areas[MAX_IDS];
+	unsigned char *busy;
+	unsigned long used = 0, free_slots;
+	int i;
+
+	busy = calloc(tcm->width, tcm->height);
+	if (!busy)
+		return -1;
+	memset(areas, 0, sizeof(areas));
+	memset(res, 0, sizeof(*res));
+
+	for (i = 0; i < nr_ops; i++) {
+		struct op *op = &ops[i];
+		struct tcm_area *area = &areas[op->id];
+		unsigned long want;
+		double t;
+		s32 r;
+
+		if (op->type == OP_FREE) {
+			if (area->tcm) {
+				used -= tcm_sizeof(*area);
+				mark(busy, area, 0);
+				tcm_free(area);
+			}
+		} else {
+			if (area->tcm) {
+				fprintf(stderr, "op %d: id %d is in use\n",
+					i, op->id);
+				free(busy);
+				return -1;
+			}
+			t = now_ns();
+			if (op->type == OP_A2D)
+				r = tcm_reserve_2d(tcm, op->w, op->h,
+						   op->align, area);
+			else
+				r = tcm_reserve_1d(tcm, op->slots, area);
+			t = now_ns() - t;
+
+			res->allocs++;
+			res->alloc_ns += t;
+			if (t > res->max_alloc_ns)
+				res->max_alloc_ns = t;
+
+			want = op->type == OP_A2D ? op->w * op->h : op->slots;
+			if (r) {
+				area->tcm = NULL;
+				res->fails++;
+				fragmentation(busy, tcm->width, tcm->height,
+					      &free_slots);
+				if (free_slots >= want)
+					res->frag_fails++;
+				if (verbose)
+					printf("  op %d: %s %lu slots failed\n",
+					       i, op->type == OP_A2D ?
+					       "2d" : "1d", want);
+			} else {
+				used += want;
+				mark(busy, area, 1);
+			}
+		}
+
+		res->frag_sum += fragmentation(busy, tcm->width, tcm->height,
+					       &free_slots);
+		res->frag_samples++;
+		if (used > res->peak_used)
+			res->peak_used = used;
+	}
+
+	/* release whatever the trace left allocated */
+	for (i = 0; i < MAX_IDS; i++)
+		tcm_free(&areas[i]);
+	free(busy);
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-W width] [-H height] [-n ops] "
+		"[-S seed] [-v] [trace]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	static const struct {
+		const char *name;
+		struct tcm *(*init)(u16, u16, struct tcm_pt *);
+	} algs[] = {
+		{ "sita", sita_init },
+		{ "rowmap", rowmap_init },
+	};
+	unsigned int width = 256, height = 128, seed = 1;
+	int n = 20000, verbose = 0, opt, i;
+
+	while ((opt = getopt(argc, argv, "W:H:n:S:v")) != -1) {
+		switch (opt) {
+		case 'W':
+			width = strtoul(optarg, NULL, 0);
+			break;
+		case 'H':
+			height = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			n = atoi(optarg);
+			break;
+		case 'S':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!width || width > 0xffff || !height || height > 0xffff || n < 1)
+		usage(argv[0]);
+
+	if (optind < argc) {
+		if (load_trace(argv[optind]))
+			return 1;
+	} else {
+		srand(seed);
+		gen_trace(n, width, height);
+	}
+
+	printf("%ux%u container, %d operations\n", width, height, nr_ops);
+	printf("%-8s %9s %9s %9s %7s %10s %6s %6s\n", "alg", "reserves",
+	       "avg ns", "max ns", "fails", "frag fails", "frag", "peak");
+
+	for (i = 0; i < (int)(sizeof(algs) / sizeof(algs[0])); i++) {
+		/* same division point as tiler_init() */
+		struct tcm_pt div_pt = { width, (3 * height) / 4 };
+		struct result res;
+		struct tcm *tcm;
+
+		tcm = algs[i].init(width, height, &div_pt);
+		if (!tcm) {
+			fprintf(stderr, "%s: init failed\n", algs[i].name);
+			return 1;
+		}
+		if (replay(tcm, &res, verbose)) {
+			tcm_deinit(tcm);
+			return 1;
+		}
+		tcm_deinit(tcm);
+
+		printf("%-8s %9lu %9.0f %9.0f %7lu %10lu %5.1f%% %5.1f%%\n",
+		       algs[i].name, res.allocs,
+		       res.allocs ? res.alloc_ns / res.allocs : 0,
+		       res.max_alloc_ns, res.fails, res.frag_fails,
+		       100 * res.frag_sum / res.frag_samples,
+		       100 * res.peak_used / (width * height));
+	}
+
+	free(ops);
+	return 0;
+}
@@ -0,0 +1,179 @@
+/* $(CROSS_COMPILE)cc -Wall -Wextra -g -O2 -o zram-bench zram-bench.c -lpthread */
+
+/*
+ * zram write throughput benchmark
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ */
+
+/*
+ * Writes moderately compressible pages to a zram device from 1..N
+ * threads with O_DIRECT, the same page-sized bio pattern swap-out
+ * produces, and reports the aggregate MB/s for each writer count.
+ * Each writer owns a disjoint slice of the device.
+ *
+ *	zram-bench [-t max_threads] [-s size_mb] /dev/zram0
+ *
+ * Compare the results with /sys/block/zram<id>/max_comp_streams set
+ * to 1 and to the number of CPUs (the device must be reset between).
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PAGE_SZ		4096
+#define BATCH_PAGES	8
+
+struct writer {
+	pthread_t thread;
+	int fd;
+	off_t start;
+	size_t pages;
+	int err;
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Half random, half text: compresses to a bit over 50% */
+static void fill_page(unsigned char *p, unsigned int seed)
+{
+	static const char text[] = "dalvik-heap zram benchmark payload ";
+	unsigned int i;
+
+	for (i = 0; i < PAGE_SZ / 2; i++) {
+		seed = seed * 1103515245 + 12345;
+		p[i] = seed >> 16;
+	}
+	for (; i < PAGE_SZ; i++)
+		p[i] = text[i % (sizeof(text) - 1)];
+}
+
+static void *writer_fn(void *arg)
+{
+	struct writer *w = arg;
+	unsigned char *buf;
+	size_t done, i;
+
+	if (posix_memalign((void **)&buf, PAGE_SZ, PAGE_SZ * BATCH_PAGES)) {
+		w->err = ENOMEM;
+		return NULL;
+	}
+
+	for (done = 0; done < w->pages; done += BATCH_PAGES) {
+		size_t n = w->pages - done;
+		ssize_t len;
+
+		if (n > BATCH_PAGES)
+			n = BATCH_PAGES;
+		for (i = 0; i < n; i++)
+			fill_page(buf + i * PAGE_SZ,
+				(unsigned int)(w->start / PAGE_SZ + done + i));
+
+		len = pwrite(w->fd, buf, n * PAGE_SZ,
+				w->start + done * PAGE_SZ);
+		if (len != (ssize_t)(n * PAGE_SZ)) {
+			w->err = len < 0 ? errno : EIO;
+			break;
+		}
+	}
+
+	free(buf);
+	return NULL;
+}
+
+static int run(const char *dev, int nthreads, size_t total_pages)
+{
+	struct writer *w;
+	double start, elapsed;
+	size_t per_thread = total_pages / nthreads;
+	int i, ret = 0;
+
+	w = calloc(nthreads, sizeof(*w));
+	if (!w)
+		return -1;
+
+	for (i = 0; i < nthreads; i++) {
+		w[i].fd = open(dev, O_WRONLY | O_DIRECT);
+		if (w[i].fd < 0) {
+			perror(dev);
+			ret = -1;
+			goto out;
+		}
+		w[i].start = (off_t)i * per_thread * PAGE_SZ;
+		w[i].pages = per_thread;
+	}
+
+	start = now();
+	for (i = 0; i < nthreads; i++)
+		pthread_create(&w[i].thread, NULL, writer_fn, &w[i]);
+	for (i = 0; i < nthreads; i++)
+		pthread_join(w[i].thread, NULL);
+	elapsed = now() - start;
+
+	for (i = 0; i < nthreads; i++) {
+		if (w[i].err) {
+			fprintf(stderr, "writer %d: %s\n", i,
+				strerror(w[i].err));
+			ret = -1;
+		}
+	}
+	if (!ret)
+		printf("%2d writer(s): %8.1f MB/s\n", nthreads,
+			(double)per_thread * nthreads * PAGE_SZ /
+			(1024 * 1024) / elapsed);
+out:
+	for (i = 0; i < nthreads; i++)
+		if (w[i].fd > 0)
+			close(w[i].fd);
+	free(w);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t size_mb = 64;
+	int opt, t;
+
+	while ((opt = getopt(argc, argv, "t:s:")) != -1) {
+		switch (opt) {
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		case 's':
+			size_mb = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || max_threads < 1 || !size_mb)
+		goto usage;
+
+	for (t = 1; t <= max_threads; t++)
+		if (run(argv[optind], t, size_mb * 1024 * 1024 / PAGE_SZ))
+			return 1;
+
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-t max_threads] [-s size_mb] device\n",
+		argv[0]);
+	return 1;
+}